@@ -0,0 +1,350 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Asset Watcher Class
+//
+// AssetWatcher.cpp: implementation of the AssetWatcher class.
+// This class watches the asset folders for changes and
+// reloads only the models and textures whose files were
+// written. It uses inotify on Linux and ReadDirectoryChangesW
+// on Windows, both without blocking, so Update() can be
+// called between frames and the game keeps running while
+// you edit the assets. A file is reloaded once it has been
+// quiet for a short while so a save that is written in
+// several pieces only triggers one reload.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "AssetWatcher.h"
+#include "TextureCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// The size of the buffer the change notifications are read into
+#define NOTIFY_BUFFER	16384
+
+struct AssetWatcher::Root
+{
+	std::string path;						// The folder as it was given to Watch()
+#ifdef _WIN32
+	HANDLE dir;								// The folder opened for overlapped reads
+	OVERLAPPED overlapped;					// The pending ReadDirectoryChangesW
+	DWORD buffer[NOTIFY_BUFFER / 4];		// FILE_NOTIFY_INFORMATION records (must be DWORD aligned)
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+AssetWatcher::AssetWatcher()
+{
+	// Wait for 150ms of quiet before reloading a file
+	settle = 150;
+
+	notify = -1;
+}
+
+AssetWatcher::~AssetWatcher()
+{
+	for (size_t i = 0; i < roots.size(); i++)
+	{
+#ifdef _WIN32
+		CancelIo(roots[i]->dir);
+		CloseHandle(roots[i]->dir);
+		CloseHandle(roots[i]->overlapped.hEvent);
+#endif
+		delete roots[i];
+	}
+
+#ifndef _WIN32
+	if (notify >= 0)
+		close(notify);
+#endif
+}
+
+bool AssetWatcher::Watch(const char *dir)
+{
+	Root *root = new Root;
+	root->path = dir;
+
+#ifdef _WIN32
+	// Open the folder for asynchronous change notifications
+	root->dir = CreateFileA(dir, FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+
+	if (root->dir == INVALID_HANDLE_VALUE)
+	{
+		delete root;
+		return false;
+	}
+
+	memset(&root->overlapped, 0, sizeof(root->overlapped));
+	root->overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+	// Start the first read, Poll() picks up the result and starts the next one
+	ReadDirectoryChangesW(root->dir, root->buffer, sizeof(root->buffer), TRUE,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME,
+		NULL, &root->overlapped, NULL);
+#else
+	// One inotify descriptor serves all of the folders
+	if (notify < 0)
+		notify = inotify_init1(IN_NONBLOCK);
+
+	if (notify < 0)
+	{
+		delete root;
+		return false;
+	}
+
+	// inotify isn't recursive so every subfolder gets its own watch
+	WatchTree(root->path);
+#endif
+
+	roots.push_back(root);
+	return true;
+}
+
+void AssetWatcher::WatchTree(const std::string &dir)
+{
+#ifndef _WIN32
+	int wd = inotify_add_watch(notify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+
+	if (wd < 0)
+		return;
+
+	dirs[wd] = dir;
+
+	// Look for subfolders
+	DIR *d = opendir(dir.c_str());
+
+	if (d == NULL)
+		return;
+
+	struct dirent *entry;
+
+	while ((entry = readdir(d)) != NULL)
+	{
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		std::string sub = dir + "/" + entry->d_name;
+		struct stat st;
+
+		if (stat(sub.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+			WatchTree(sub);
+	}
+
+	closedir(d);
+#endif
+}
+
+void AssetWatcher::Track(Model_3DS *model)
+{
+	models.push_back(model);
+}
+
+void AssetWatcher::Track(GLTexture *texture)
+{
+	textures.push_back(texture);
+}
+
+int AssetWatcher::Update()
+{
+	int reloaded = 0;
+
+	// Pick up whatever changed since the last frame
+	Poll();
+
+	unsigned long now = Now();
+
+	// Reload the files that have been quiet long enough
+	std::map<std::string, unsigned long>::iterator it = pending.begin();
+
+	while (it != pending.end())
+	{
+		if (now - it->second >= (unsigned long)settle)
+		{
+			reloaded += Reload(it->first);
+			it = pending.erase(it);
+		}
+		else
+			++it;
+	}
+
+	return reloaded;
+}
+
+void AssetWatcher::Poll()
+{
+#ifdef _WIN32
+	for (size_t i = 0; i < roots.size(); i++)
+	{
+		Root *root = roots[i];
+		DWORD bytes = 0;
+
+		// Still waiting for something to change
+		if (!HasOverlappedIoCompleted(&root->overlapped))
+			continue;
+
+		if (GetOverlappedResult(root->dir, &root->overlapped, &bytes, FALSE) && bytes > 0)
+		{
+			FILE_NOTIFY_INFORMATION *info = (FILE_NOTIFY_INFORMATION *)root->buffer;
+
+			for (;;)
+			{
+				// The name is relative to the folder and not null terminated
+				char name[MAX_PATH];
+				int length = WideCharToMultiByte(CP_ACP, 0, info->FileName,
+					info->FileNameLength / sizeof(WCHAR), name, MAX_PATH - 1, NULL, NULL);
+				name[length] = 0;
+
+				if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED ||
+					info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+					Changed(root->path + "/" + name);
+
+				if (info->NextEntryOffset == 0)
+					break;
+
+				info = (FILE_NOTIFY_INFORMATION *)((char *)info + info->NextEntryOffset);
+			}
+		}
+
+		// Queue up the next read
+		ResetEvent(root->overlapped.hEvent);
+		ReadDirectoryChangesW(root->dir, root->buffer, sizeof(root->buffer), TRUE,
+			FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME,
+			NULL, &root->overlapped, NULL);
+	}
+#else
+	if (notify < 0)
+		return;
+
+	// inotify_event has to be aligned like the struct
+	char buffer[NOTIFY_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	for (;;)
+	{
+		ssize_t length = read(notify, buffer, sizeof(buffer));
+
+		// EAGAIN means there is nothing left to read
+		if (length <= 0)
+			break;
+
+		for (char *ptr = buffer; ptr < buffer + length; )
+		{
+			struct inotify_event *event = (struct inotify_event *)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			std::map<int, std::string>::iterator dir = dirs.find(event->wd);
+
+			if (dir == dirs.end() || event->len == 0)
+				continue;
+
+			std::string file = dir->second + "/" + event->name;
+
+			// A new subfolder needs a watch of its own
+			if (event->mask & IN_ISDIR)
+			{
+				if (event->mask & (IN_CREATE | IN_MOVED_TO))
+					WatchTree(file);
+			}
+			else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+				Changed(file);
+		}
+	}
+#endif
+}
+
+void AssetWatcher::Changed(const std::string &file)
+{
+	// Restart the quiet period of the file
+	pending[TextureCache::Normalize(file.c_str())] = Now();
+}
+
+int AssetWatcher::Reload(const std::string &file)
+{
+	int reloaded = 0;
+
+	// Textures already reloaded for this file, by OpenGL id
+	std::map<unsigned int, GLTexture *> done;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		Model_3DS *model = models[i];
+
+		if (model->modelname == NULL)
+			continue;
+
+		// The model file itself changed so load all of it again
+		if (TextureCache::Normalize(model->modelname) == file)
+		{
+			if (model->Reload())
+				reloaded++;
+			continue;
+		}
+
+		// Otherwise only the materials that use the file
+		for (int j = 0; j < model->numMaterials; j++)
+		{
+			GLTexture &tex = model->Materials[j].tex;
+
+			if (tex.texturename != NULL && TextureCache::Normalize(tex.texturename) == file)
+				reloaded += Reload(&tex, done);
+		}
+	}
+
+	for (size_t k = 0; k < textures.size(); k++)
+	{
+		if (textures[k]->texturename != NULL && TextureCache::Normalize(textures[k]->texturename) == file)
+			reloaded += Reload(textures[k], done);
+	}
+
+	if (reloaded > 0)
+	{
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("Reloaded %s (%d asset(s)) in %.1f ms\n", file.c_str(), reloaded, ms);
+	}
+
+	return reloaded;
+}
+
+int AssetWatcher::Reload(GLTexture *tex, std::map<unsigned int, GLTexture *> &done)
+{
+	std::map<unsigned int, GLTexture *>::iterator shared = done.find(tex->texture[0]);
+
+	// The texture cache shares one texture between everybody who loaded the
+	// file, so it only has to be loaded once. The others just take its size.
+	if (shared != done.end())
+	{
+		tex->width = shared->second->width;
+		tex->height = shared->second->height;
+		tex->bytes = shared->second->bytes;
+		return 0;
+	}
+
+	tex->Reload();
+	done[tex->texture[0]] = tex;
+
+	return 1;
+}
+
+unsigned long AssetWatcher::Now()
+{
+	return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
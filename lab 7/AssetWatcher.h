@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Asset Watcher Class
+//
+// AssetWatcher.h: interface for the AssetWatcher class.
+// This class watches the asset folders for changes and
+// reloads only the models and textures whose files were
+// written. It uses inotify on Linux and ReadDirectoryChangesW
+// on Windows, both without blocking, so Update() can be
+// called between frames and the game keeps running while
+// you edit the assets. A file is reloaded once it has been
+// quiet for a short while so a save that is written in
+// several pieces only triggers one reload.
+//
+// Usage:
+// AssetWatcher watcher;
+//
+// watcher.Watch("models");		// Watch a folder and its subfolders
+// watcher.Track(&model);		// Reload the model (or one of its textures) when it changes
+// watcher.Track(&texture);		// Reload a texture when it changes
+//
+// // Between frames (from a timer for example)
+// if (watcher.Update() > 0)
+//		glutPostRedisplay();
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef ASSETWATCHER_H
+#define ASSETWATCHER_H
+
+#include "Model_3DS.h"
+#include "GLTexture.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+class AssetWatcher
+{
+public:
+	bool Watch(const char *dir);					// Start watching a folder and its subfolders
+	void Track(Model_3DS *model);					// Reload this model when its file or textures change
+	void Track(GLTexture *texture);					// Reload this texture when its file changes
+	int Update();									// Reloads the changed assets, returns how many were reloaded
+	int settle;										// How long (ms) a file has to be quiet before it is reloaded
+	AssetWatcher();									// Constructor
+	virtual ~AssetWatcher();						// Destructor
+
+private:
+	// One folder given to Watch()
+	struct Root;
+
+	std::vector<Root *> roots;						// The folders we are watching
+	std::vector<Model_3DS *> models;				// The models to reload
+	std::vector<GLTexture *> textures;				// The textures to reload
+	std::map<std::string, unsigned long> pending;	// Changed files and the time of their last change
+	std::map<int, std::string> dirs;				// inotify watch descriptors and their folders
+	int notify;										// The inotify descriptor
+
+	void Poll();									// Reads the change notifications without blocking
+	void Changed(const std::string &file);			// Marks a file as changed
+	int Reload(const std::string &file);			// Reloads everything that uses the file
+	void WatchTree(const std::string &dir);			// Adds inotify watches for a folder and its subfolders
+	int Reload(GLTexture *tex, std::map<unsigned int, GLTexture *> &done);	// Reloads a texture once even if it is shared
+	static unsigned long Now();						// Milliseconds from a steady clock
+};
+
+#endif ASSETWATCHER_H
@@ -0,0 +1,305 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Benchmark Class
+//
+// Benchmark.cpp: implementation of the Benchmark class.
+// The context is made on Mesa's surfaceless platform when EGL
+// has it, which needs no X server, and on the default display
+// otherwise. It is a compatibility context like GLUT's, so the
+// game draws into it unchanged; glewInit() after this finds the
+// functions as usual.
+//
+// EndFrame() waits for the card with glFinish() every frame. A
+// frame then can't overlap the next one the way it does in the
+// window, but each one's times are its own. Software renderers
+// draw inside glFinish(), where the timer query hardly sees
+// it: with llvmpipe the frame time is the one to go by.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Benchmark.h"
+#include "Image.h"
+#include "glew.h"
+
+#ifndef _WIN32
+#define BENCHMARK_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// What one frame took, in milliseconds
+struct FrameTimes
+{
+	double cpu;										// Until every call was made
+	double gpu;										// On the card, -1 without timer queries
+	double total;									// Until it was drawn
+};
+
+static std::vector<float> path;						// Eye and center, six floats a camera
+static std::vector<FrameTimes> times;
+static std::chrono::steady_clock::time_point start;
+static GLuint query = 0;
+
+#ifdef BENCHMARK_EGL
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLSurface surface = EGL_NO_SURFACE;
+static EGLContext context = EGL_NO_CONTEXT;
+#endif
+
+static double Elapsed()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The card can time the frame itself
+static bool HasTimer()
+{
+	return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+bool Benchmark::CreateContext(int width, int height)
+{
+#ifdef BENCHMARK_EGL
+	const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	if (getPlatformDisplay != NULL && extensions != NULL && strstr(extensions, "EGL_MESA_platform_surfaceless") != NULL)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+	{
+		printf("Benchmark: no EGL display\n");
+		display = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	static const EGLint configAttributes[] =
+	{
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+
+	const EGLint surfaceAttributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	EGLConfig config;
+	EGLint configs = 0;
+
+	if (eglChooseConfig(display, configAttributes, &config, 1, &configs) && configs > 0 && eglBindAPI(EGL_OPENGL_API))
+	{
+		surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	}
+
+	if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context))
+	{
+		printf("Benchmark: no OpenGL pbuffer of %dx%d\n", width, height);
+		DestroyContext();
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Benchmark::DestroyContext()
+{
+#ifdef BENCHMARK_EGL
+	if (display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+	if (context != EGL_NO_CONTEXT)
+		eglDestroyContext(display, context);
+	if (surface != EGL_NO_SURFACE)
+		eglDestroySurface(display, surface);
+
+	eglTerminate(display);
+
+	display = EGL_NO_DISPLAY;
+	surface = EGL_NO_SURFACE;
+	context = EGL_NO_CONTEXT;
+#endif
+}
+
+bool Benchmark::LoadPath(const char *name)
+{
+	FILE *file = fopen(name, "r");
+
+	if (file == NULL)
+	{
+		printf("Benchmark: can't open %s\n", name);
+		return false;
+	}
+
+	char line[256];
+	float c[6];
+
+	path.clear();
+
+	while (fgets(line, sizeof(line), file))
+	{
+		if (line[0] == '#')
+			continue;
+
+		if (sscanf(line, "%f %f %f %f %f %f", &c[0], &c[1], &c[2], &c[3], &c[4], &c[5]) == 6)
+			path.insert(path.end(), c, c + 6);
+	}
+
+	fclose(file);
+
+	if (path.empty())
+		printf("Benchmark: no cameras in %s\n", name);
+
+	return !path.empty();
+}
+
+void Benchmark::Camera(int frame, int frames, float *eye, float *center)
+{
+	int cameras = (int)path.size() / 6;
+
+	if (cameras == 0)
+		return;
+
+	// Where the frame falls between two cameras
+	double t = frames > 1 ? (double)frame * (cameras - 1) / (frames - 1) : 0.0;
+	int from = std::min((int)t, std::max(cameras - 2, 0));
+	int to = std::min(from + 1, cameras - 1);
+	float f = (float)(t - from);
+
+	for (int i = 0; i < 3; i++)
+	{
+		eye[i] = path[from * 6 + i] + (path[to * 6 + i] - path[from * 6 + i]) * f;
+		center[i] = path[from * 6 + 3 + i] + (path[to * 6 + 3 + i] - path[from * 6 + 3 + i]) * f;
+	}
+}
+
+void Benchmark::BeginFrame()
+{
+	if (HasTimer())
+	{
+		if (query == 0)
+			glGenQueries(1, &query);
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+	}
+
+	start = std::chrono::steady_clock::now();
+}
+
+void Benchmark::EndFrame()
+{
+	FrameTimes frame;
+
+	frame.cpu = Elapsed();
+	frame.gpu = -1.0;
+
+	if (query != 0)
+		glEndQuery(GL_TIME_ELAPSED);
+
+	glFinish();
+	frame.total = Elapsed();
+
+	// Drawn, so the result is there without waiting
+	if (query != 0)
+	{
+		GLuint64 nanoseconds = 0;
+
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+		frame.gpu = nanoseconds / 1000000.0;
+
+		// The card can't have taken longer than the whole frame, the driver's timer is off
+		if (frame.gpu > frame.total)
+			frame.gpu = -1.0;
+	}
+
+	times.push_back(frame);
+}
+
+bool Benchmark::SaveFrame(const char *name, int width, int height)
+{
+	Image image;
+
+	if (!image.Create(width, height, 3))
+		return false;
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, image.data);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	return image.SavePNG(name);
+}
+
+bool Benchmark::Write(const char *name)
+{
+	FILE *file = fopen(name, "w");
+
+	if (file == NULL)
+	{
+		printf("Benchmark: can't write %s\n", name);
+		return false;
+	}
+
+	int count = (int)times.size();
+	int timed = 0;
+	double cpu = 0.0, gpu = 0.0, total = 0.0;
+	std::vector<double> sorted;
+
+	fprintf(file, "frame,cpu_ms,gpu_ms,frame_ms\n");
+
+	for (int i = 0; i < count; i++)
+	{
+		const FrameTimes &frame = times[i];
+
+		if (frame.gpu >= 0.0)
+		{
+			fprintf(file, "%d,%.3f,%.3f,%.3f\n", i, frame.cpu, frame.gpu, frame.total);
+			gpu += frame.gpu;
+			timed++;
+		}
+		else
+			fprintf(file, "%d,%.3f,,%.3f\n", i, frame.cpu, frame.total);
+
+		cpu += frame.cpu;
+		total += frame.total;
+		sorted.push_back(frame.total);
+	}
+
+	fclose(file);
+
+	if (count == 0)
+		return true;
+
+	std::sort(sorted.begin(), sorted.end());
+
+	printf("Benchmark: %d frames, %.1f frames a second\n", count, 1000.0 * count / total);
+
+	if (timed > 0)
+		printf("  CPU %.3f ms, GPU %.3f ms, frame %.3f ms on average\n", cpu / count, gpu / timed, total / count);
+	else
+		printf("  CPU %.3f ms, frame %.3f ms on average (no GPU timer)\n", cpu / count, total / count);
+
+	printf("  frame %.3f ms median, %.3f ms 99th percentile, %.3f ms worst\n",
+		sorted[count / 2], sorted[std::min(count * 99 / 100, count - 1)], sorted[count - 1]);
+	printf("  every frame's times are in %s\n", name);
+
+	return true;
+}
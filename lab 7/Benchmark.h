@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Benchmark Class
+//
+// Benchmark.h: interface for the Benchmark class.
+// Timing the game by walking around in its window never gives
+// the same numbers twice. The benchmark flies the camera along
+// a path read from a file instead, the same frames every run,
+// and times each one: the CPU time to get the frame out, the
+// GPU time it took (with a GL_TIME_ELAPSED query where the card
+// has them) and the whole frame once glFinish() returns.
+//
+// Off Windows it draws without a window, into an EGL pbuffer,
+// so it runs on a machine with no screen or GPU at all, e.g.
+// with Mesa's llvmpipe. On Windows CreateContext() is false and
+// the game opens its usual window to draw in.
+//
+// The path file has a camera on each line, the eye and the
+// point it looks at, "# " lines are comments:
+//
+// # eyeX eyeY eyeZ   centerX centerY centerZ
+// 65 2500 105        0 0 0
+// 1500 400 1500      0 0 0
+//
+// The frames are spread evenly over the path, the camera moving
+// in a straight line from one to the next.
+//
+// Usage:
+// if (Benchmark::CreateContext(1280, 720) && Benchmark::LoadPath("benchmark.path"))
+// {
+//		for (int i = 0; i < frames; i++)
+//		{
+//			Benchmark::Camera(i, frames, eye, center);
+//			Benchmark::BeginFrame();
+//			// Draw
+//			Benchmark::EndFrame();
+//			Benchmark::SaveFrame("frame0000.png", 1280, 720);
+//		}
+//
+//		Benchmark::Write("benchmark.csv");
+// }
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+class Benchmark
+{
+public:
+	// Makes an offscreen context width by height pixels current, false if it can't
+	static bool CreateContext(int width, int height);
+	static void DestroyContext();					// Lets go of the offscreen context
+
+	static bool LoadPath(const char *name);			// Reads the cameras of the path, false if there are none
+	// The eye and center of frame out of frames along the path
+	static void Camera(int frame, int frames, float *eye, float *center);
+
+	static void BeginFrame();						// Starts the clocks
+	static void EndFrame();							// Waits for the frame to be drawn and keeps its times
+	static bool SaveFrame(const char *name, int width, int height);	// Writes the frame drawn to a PNG file
+
+	// Writes a line of times for each frame and prints the averages, false if the file can't be written
+	static bool Write(const char *name);
+};
+
+#endif BENCHMARK_H
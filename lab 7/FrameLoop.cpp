@@ -0,0 +1,252 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Frame Loop Class
+//
+// FrameLoop.cpp: implementation of the FrameLoop class.
+// The game time left over after the ticks carries on to the
+// next idle call, so the ticks average out to the rate asked
+// for. A frame is posted with glutPostRedisplay() and GLUT
+// draws it as soon as the idle function returns; the requests
+// made until then are already in it.
+//
+// Only the frames asked for within a refresh of the one before
+// are timed: a gap while nothing moved isn't a stutter.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "FrameLoop.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <glut.h>
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#define WINDOW				120						// Frames the stats are over
+#define MAX_STEPS			10						// Ticks run at most in one go, more and they are dropped
+
+static void (*tickFunction)() = NULL;
+static double tickLength = 1.0 / 60.0;				// In seconds
+static double period = 1.0 / 60.0;					// Of the screen's refresh
+static double frameLength = 1.0 / 60.0;				// The soonest the next frame can be started after the last one
+static std::chrono::steady_clock::time_point start;
+static double lag = 0.0;							// Game time not ticked yet
+static double last = 0.0;							// When the idle function last ran
+static double lastPost = 0.0;						// When the last frame was started
+static double lastFrame = 0.0;						// When it was presented
+static double askedAt = 0.0;						// When the first Redraw() for the next frame came
+static bool wanted = false;							// A frame has been asked for
+static bool posted = false;							// And GLUT is about to draw it
+static bool paced = false;							// It follows the last frame without a gap
+
+static double intervals[WINDOW];					// Milliseconds between the last frames
+static int count = 0;
+static int next = 0;
+
+static int requests = 0;
+static int drawn = 0;
+static int skipped = 0;
+static int refreshRate = 60;
+static bool vsync = false;
+
+#ifndef _WIN32
+// True if name is one of the space separated extensions in list
+static bool HasExtension(const char *list, const char *name)
+{
+	size_t length = strlen(name);
+
+	if (list == NULL)
+		return false;
+
+	// A match has to be the whole name, not the start of a longer one
+	for (const char *p = strstr(list, name); p != NULL; p = strstr(p + length, name))
+	{
+		if ((p == list || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+#endif
+
+static double Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Idle()
+{
+	double now = Now();
+	int steps = 0;
+
+	lag += now - last;
+	last = now;
+
+	while (lag >= tickLength && steps < MAX_STEPS)
+	{
+		tickFunction();
+		lag -= tickLength;
+		steps++;
+	}
+
+	// Too far behind (a breakpoint, a stall loading) to catch up without a burst of ticks
+	if (lag >= tickLength)
+	{
+		skipped += (int)(lag / tickLength);
+		lag = fmod(lag, tickLength);
+	}
+
+	if (wanted && !posted && now - lastPost >= frameLength)
+	{
+		paced = drawn > 0 && askedAt - lastFrame <= period;
+		lastPost = now;
+		posted = true;
+		glutPostRedisplay();
+		return;
+	}
+
+	// Nothing to do until the next tick, or until the frame asked for can be drawn
+	double wait = tickLength - lag;
+
+	if (wanted && !posted)
+		wait = std::min(wait, lastPost + frameLength - now);
+
+	// Short of the time, sleeps can run over by a little
+	if (wait > 0.002)
+		std::this_thread::sleep_for(std::chrono::duration<double>(wait - 0.001));
+}
+
+void FrameLoop::Start(int ticksPerSecond, void (*tick)())
+{
+	tickFunction = tick;
+	tickLength = 1.0 / ticksPerSecond;
+
+#ifdef _WIN32
+	DEVMODE mode;
+
+	ZeroMemory(&mode, sizeof(mode));
+	mode.dmSize = sizeof(mode);
+
+	if (EnumDisplaySettings(NULL, ENUM_CURRENT_SETTINGS, &mode) && mode.dmDisplayFrequency > 1)
+		refreshRate = mode.dmDisplayFrequency;
+
+	typedef BOOL (WINAPI *SwapIntervalProc)(int interval);
+	SwapIntervalProc swapInterval = (SwapIntervalProc)wglGetProcAddress("wglSwapIntervalEXT");
+
+	vsync = swapInterval != NULL && swapInterval(1);
+
+	// Sleep to the millisecond rather than to the 15.6 ms the scheduler ticks at
+	timeBeginPeriod(1);
+#else
+	// The same through GLX when the window is an X11 one
+	Display *display = glXGetCurrentDisplay();
+	GLXDrawable drawable = glXGetCurrentDrawable();
+
+	if (display != NULL && drawable != 0)
+	{
+		const char *extensions = glXQueryExtensionsString(display, DefaultScreen(display));
+
+		// The rate the swaps are counted at is the refresh rate
+		PFNGLXGETMSCRATEOMLPROC getMscRate = (PFNGLXGETMSCRATEOMLPROC)glXGetProcAddressARB((const GLubyte *)"glXGetMscRateOML");
+		int32_t numerator, denominator;
+
+		if (HasExtension(extensions, "GLX_OML_sync_control") && getMscRate != NULL &&
+			getMscRate(display, drawable, &numerator, &denominator) && denominator > 0 && numerator / denominator > 1)
+			refreshRate = (numerator + denominator / 2) / denominator;
+
+		// glXGetProcAddress finds functions the driver doesn't have, so the extensions are checked first
+		PFNGLXSWAPINTERVALEXTPROC swapIntervalEXT = (PFNGLXSWAPINTERVALEXTPROC)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalEXT");
+		PFNGLXSWAPINTERVALMESAPROC swapIntervalMESA = (PFNGLXSWAPINTERVALMESAPROC)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalMESA");
+
+		if (HasExtension(extensions, "GLX_EXT_swap_control") && swapIntervalEXT != NULL)
+		{
+			swapIntervalEXT(display, drawable, 1);
+			vsync = true;
+		}
+		else if (HasExtension(extensions, "GLX_MESA_swap_control") && swapIntervalMESA != NULL)
+			vsync = swapIntervalMESA(1) == 0;
+	}
+#endif
+
+	// With vsync the swap spaces the frames, the clock only keeps them from piling up
+	period = 1.0 / refreshRate;
+	frameLength = vsync ? period / 2 : period;
+
+	start = std::chrono::steady_clock::now();
+	last = 0.0;
+	lastPost = -frameLength;
+	lastFrame = -frameLength;
+	wanted = true;
+
+	glutIdleFunc(Idle);
+}
+
+void FrameLoop::Redraw()
+{
+	requests++;
+
+	// The frame on its way draws it too
+	if (wanted || posted)
+		return;
+
+	wanted = true;
+	askedAt = Now();
+}
+
+void FrameLoop::Presented()
+{
+	double now = Now();
+
+	if (posted && paced)
+	{
+		intervals[next] = (now - lastFrame) * 1000.0;
+		next = (next + 1) % WINDOW;
+
+		if (count < WINDOW)
+			count++;
+	}
+
+	// A frame GLUT drew by itself (the window was uncovered) is just as new
+	lastFrame = now;
+	wanted = false;
+	posted = false;
+	drawn++;
+}
+
+FrameLoop::Stats FrameLoop::GetStats()
+{
+	Stats stats;
+	double sum = 0.0, squares = 0.0;
+
+	stats.frames = count;
+	stats.worst = 0.0;
+	stats.late = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		sum += intervals[i];
+		squares += intervals[i] * intervals[i];
+		stats.worst = std::max(stats.worst, intervals[i]);
+
+		if (intervals[i] > period * 1500.0)
+			stats.late++;
+	}
+
+	stats.average = count > 0 ? sum / count : 0.0;
+	stats.jitter = count > 0 ? sqrt(std::max(squares / count - stats.average * stats.average, 0.0)) : 0.0;
+	stats.requests = requests;
+	stats.drawn = drawn;
+	stats.skipped = skipped;
+	stats.refreshRate = refreshRate;
+	stats.vsync = vsync;
+
+	return stats;
+}
@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Frame Loop Class
+//
+// FrameLoop.h: interface for the FrameLoop class.
+// The game used to move only when GLUT redrew it, and every
+// key press asked for a redraw three or four times over. The
+// FrameLoop runs from GLUT's idle function instead: it steps
+// the game at a fixed rate, however fast or slow the frames
+// come, and draws a frame only when something asked for one
+// with Redraw(), at most once a refresh of the screen. All of
+// the Redraw() calls made before that frame is drawn make one.
+//
+// Swaps wait for the vertical blank where the driver lets us
+// (wglSwapIntervalEXT on Windows, GLX_EXT_swap_control or
+// GLX_MESA_swap_control on X11); without it the frames are
+// spaced a refresh apart by the clock. The refresh rate comes
+// from the display settings on Windows and GLX_OML_sync_control
+// on X11, if neither tells it is taken to be 60 Hz. Between
+// ticks and frames the loop sleeps rather than spin.
+//
+// Presented() after each swap times the frames; the stats are
+// over the last 120 of them.
+//
+// Usage:
+// void tick() { ... }								// A step of the game
+// void display() { ...; glutSwapBuffers(); FrameLoop::Presented(); }
+//
+// FrameLoop::Start(60, tick);						// After the window is made
+// glutMainLoop();
+//
+// // In the input callbacks
+// FrameLoop::Redraw();
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef FRAMELOOP_H
+#define FRAMELOOP_H
+
+class FrameLoop
+{
+public:
+	struct Stats
+	{
+		int frames;									// Frames timed, up to 120
+		double average;								// Milliseconds from one frame to the next
+		double worst;
+		double jitter;								// How far they are from the average (standard deviation)
+		int late;									// Frames that took more than one and a half refreshes
+		int requests;								// Redraw() calls since the start
+		int drawn;									// Frames drawn since the start
+		int skipped;								// Ticks dropped because the game fell behind
+		int refreshRate;							// Of the screen, in Hz
+		bool vsync;									// True if swaps wait for the vertical blank
+	};
+
+	// Ticks the game ticksPerSecond times a second from GLUT's idle function
+	static void Start(int ticksPerSecond, void (*tick)());
+	static void Redraw();							// Asks for a frame, the calls before it is drawn make one
+	static void Presented();						// Call right after the swap
+	static Stats GetStats();
+};
+
+#endif FRAMELOOP_H
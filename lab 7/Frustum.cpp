@@ -0,0 +1,126 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Frustum Class
+//
+// Frustum.cpp: implementation of the Frustum class.
+// The planes come out of the projection matrix the usual way,
+// each one the last row plus or minus one of the others, and
+// are normalized so that the distance of a center from a plane
+// can be compared with the radius directly. They are kept one
+// array per coefficient so each can be spread over a register.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Frustum.h"
+#include "Simd.h"
+#include "glew.h"
+
+#include <math.h>
+#include <string.h>
+
+// Left, right, bottom, top, near and far
+#define PLANES				6
+
+static float planeX[PLANES];
+static float planeY[PLANES];
+static float planeZ[PLANES];
+static float planeW[PLANES];
+static bool ready = false;
+
+void Frustum::Look()
+{
+	float m[16];
+
+	glGetFloatv(GL_PROJECTION_MATRIX, m);
+
+	for (int i = 0; i < PLANES; i++)
+	{
+		// Row i / 2 of the matrix (it is stored by columns), added for the even planes and taken away for the odd ones
+		int row = i / 2;
+		float sign = (i & 1) ? -1.0f : 1.0f;
+
+		float x = m[3] + sign * m[row];
+		float y = m[7] + sign * m[4 + row];
+		float z = m[11] + sign * m[8 + row];
+		float w = m[15] + sign * m[12 + row];
+		float length = (float)sqrt(x*x + y*y + z*z);
+
+		planeX[i] = x / length;
+		planeY[i] = y / length;
+		planeZ[i] = z / length;
+		planeW[i] = w / length;
+	}
+
+	ready = true;
+}
+
+int Frustum::Cull(const float *x, const float *y, const float *z, const float *radius, int count, unsigned char *visible)
+{
+	if (!ready)
+	{
+		memset(visible, 1, count);
+		return count;
+	}
+
+	int inside = 0;
+	int i = 0;
+
+#ifdef SIMD_SSE2
+	// Four spheres a plane at a time, a sphere is out once it is wholly behind any one plane
+	__m128 a[PLANES], b[PLANES], c[PLANES], d[PLANES];
+
+	for (int p = 0; p < PLANES; p++)
+	{
+		a[p] = _mm_set1_ps(planeX[p]);
+		b[p] = _mm_set1_ps(planeY[p]);
+		c[p] = _mm_set1_ps(planeZ[p]);
+		d[p] = _mm_set1_ps(planeW[p]);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(x + i);
+		__m128 cy = _mm_loadu_ps(y + i);
+		__m128 cz = _mm_loadu_ps(z + i);
+		__m128 below = _mm_sub_ps(zero, _mm_loadu_ps(radius + i));
+		__m128 in = _mm_cmpeq_ps(zero, zero);
+
+		for (int p = 0; p < PLANES; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], cx), _mm_mul_ps(b[p], cy)),
+				_mm_add_ps(_mm_mul_ps(c[p], cz), d[p]));
+
+			in = _mm_and_ps(in, _mm_cmpge_ps(distance, below));
+		}
+
+		int mask = _mm_movemask_ps(in);
+
+		for (int k = 0; k < 4; k++)
+		{
+			visible[i + k] = (unsigned char)((mask >> k) & 1);
+			inside += visible[i + k];
+		}
+	}
+#endif
+
+	// The ones left over (or all of them without SSE)
+	for (; i < count; i++)
+	{
+		visible[i] = 1;
+
+		for (int p = 0; p < PLANES; p++)
+		{
+			if (planeX[p] * x[i] + planeY[p] * y[i] + planeZ[p] * z[i] + planeW[p] < -radius[i])
+			{
+				visible[i] = 0;
+				break;
+			}
+		}
+
+		inside += visible[i];
+	}
+
+	return inside;
+}
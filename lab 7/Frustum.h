@@ -0,0 +1,40 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Frustum Class
+//
+// Frustum.h: interface for the Frustum class.
+// The six planes of what the camera sees, for throwing away the
+// models that are off screen before anything is drawn. The
+// planes are kept in eye space, taken from the projection
+// matrix alone, so a bounding sphere only needs the modelview
+// matrix it is drawn with to be tested and the planes only
+// change when the projection does.
+//
+// Cull() tests a batch of spheres at once, four at a time with
+// SSE, against all six planes. A sphere is kept if any part of
+// it is inside, so a few models just past an edge or a corner
+// are drawn anyway.
+//
+// Until Look() is called everything is visible.
+//
+// Usage:
+// gluPerspective(fovy, aspectRatio, zNear, zFar);
+// Frustum::Look();
+//
+// int n = Frustum::Cull(x, y, z, radius, count, visible);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+class Frustum
+{
+public:
+	static void Look();								// Takes the planes from the current projection matrix
+	// Sets visible[i] to 1 for the spheres in eye space that are at least partly inside
+	// and 0 for the rest, returns how many are visible
+	static int Cull(const float *x, const float *y, const float *z, const float *radius, int count, unsigned char *visible);
+};
+
+#endif FRUSTUM_H
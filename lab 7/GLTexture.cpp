@@ -5,10 +5,14 @@
 //
 // GLTexture.cpp: implementation of the GLTexture class.
 // This class loads a texture file and prepares it
-// to be used in OpenGL. It can open a bitmap or a
-// targa file. The min filter is set to mipmap b/c
-// they look better and the performance cost on
-// modern video cards in negligible. I leave all of
+// to be used in OpenGL. It can open a bitmap, targa,
+// PNG or JPEG file; if the file named isn't there it
+// tries the same name with the other extensions. The
+// mipmaps it makes are saved in a KTX file next to
+// the picture for the next run. The min filter is
+// set to mipmap b/c they look better and the
+// performance cost on modern video cards in
+// negligible. I leave all of
 // the texture management to the application. I have
 // included the ability to load the texture from a
 // Visual Studio resource. The bitmap's id must be
@@ -32,13 +36,33 @@
 // tex3.BuildColorTexture(255, 0, 0);	// Builds a solid red texture
 // tex3.Use();				 // Binds the targa for use
 //
+// // If the file changed on disk you can load it again. The
+// // texture keeps its OpenGL id so nothing else has to change
+// tex.Reload();
+//
+// // Loading a file that is already loaded shares its texture
+// // (see TextureCache), so give it back when you are done
+// tex.Release();
+//
 //////////////////////////////////////////////////////////////////////
 
 #include "GLTexture.h"
+#include "TextureCache.h"
+#include "TextureCompressor.h"
+#include "MipmapGenerator.h"
+#include "TextureStreamer.h"
+#include "TextureAtlas.h"
+#include "TextureResidency.h"
+#include "Image.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
+
+#ifndef _WIN32
+#define _strdup strdup
+#endif
 
 
 //////////////////////////////////////////////////////////////////////
@@ -47,7 +71,12 @@
 
 GLTexture::GLTexture()
 {
-
+	// No name and no OpenGL texture until something is loaded
+	texturename = NULL;
+	texture[0] = 0;
+	width = 0;
+	height = 0;
+	bytes = 0;
 }
 
 GLTexture::~GLTexture()
@@ -57,30 +86,56 @@ GLTexture::~GLTexture()
 
 void GLTexture::Load(char *name)
 {
-	// make the texture name all lower case
-	texturename = _strlwr(_strdup(name));
+	free(texturename);
+	texturename = _strdup(name);
 
-	// strip "'s
+	// strip "'s, moving the name to the front so texturename can still be freed
 	if (strstr(texturename, "\""))
-		texturename = strtok(texturename, "\"");
+	{
+		char *stripped = strtok(texturename, "\"");
 
-	// check the file extension to see what type of texture
-	if(strstr(texturename, ".bmp"))	
-		LoadBMP(texturename);
-	if(strstr(texturename, ".tga"))	
-		LoadTGA(texturename);
+		if (stripped != NULL)
+			memmove(texturename, stripped, strlen(stripped) + 1);
+	}
+
+	// If another material already loaded this file share its texture
+	std::string key = TextureCache::Normalize(texturename);
+
+	if (TextureCache::Acquire(key, this))
+		return;
+
+	// Decode whatever file the material names. If it isn't there look
+	// for the same picture saved in one of the other formats we read.
+	if (!LoadFile(texturename))
+		LoadSibling();
+
+	// Let the next one that loads this file share it
+	TextureCache::Add(key, this);
 }
 
-void GLTexture::LoadFromResource(char *name)
+void GLTexture::Reload()
 {
-	// make the texture name all lower case
-	texturename = _strlwr(_strdup(name));
+	// Only textures loaded from a file can be reloaded
+	if (texturename == NULL)
+		return;
 
-	// check the file extension to see what type of texture
-	if(strstr(texturename, ".bmp"))
-		LoadBMPResource(name);
-	if(strstr(texturename, ".tga"))	
-		LoadTGAResource(name);
+	// A texture packed into an atlas is decoded again into its spot
+	if (TextureAtlas::Reload(texturename))
+		return;
+
+	// texture[0] is already set so the loaders reuse the same id
+	LoadFile(texturename);
+
+	// Everybody sharing the texture sees the new image
+	TextureCache::Update(this);
+}
+
+void GLTexture::Release()
+{
+	if (texture[0] != 0)
+		TextureCache::Release(this);
+
+	texture[0] = 0;
 }
 
 void GLTexture::Use()
@@ -91,123 +146,155 @@ void GLTexture::Use()
 
 void GLTexture::LoadBMP(char *name)
 {
-	// Create a place to store the texture
-	AUX_RGBImageRec *TextureImage[1];
+	Image image;
+
+	// If the texture file was not found (or can't be read), return from the function
+	if (!image.LoadBMP(name))
+		return;
 
-	// Set the pointer to NULL
-	memset(TextureImage,0,sizeof(void *)*1);
+	Upload(image);
+}
 
-	// Load the bitmap and assign our pointer to it
-	TextureImage[0] = auxDIBImageLoad(name);
+void GLTexture::LoadTGA(char *name)
+{
+	Image image;
 
-	// If the texture file was not found, return from the function
-	if(!TextureImage[0]) 
+	if (!image.LoadTGA(name))
 		return;
 
-	// Just in case we want to use the width and height later
-	width = TextureImage[0]->sizeX;
-	height = TextureImage[0]->sizeY;
+	Upload(image);
+}
 
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
+void GLTexture::LoadPNG(char *name)
+{
+	Image image;
 
-	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
+	if (!image.LoadPNG(name))
+		return;
 
-	// Use mipmapping filter
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+	Upload(image);
+}
 
-	// Generate the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, TextureImage[0]->sizeX, TextureImage[0]->sizeY, GL_RGB, GL_UNSIGNED_BYTE, TextureImage[0]->data);
+void GLTexture::LoadJPG(char *name)
+{
+	Image image;
 
-	// Cleanup
-	if (TextureImage[0])
-	{
-		if (TextureImage[0]->data)
-			free(TextureImage[0]->data);
+	if (!image.LoadJPG(name))
+		return;
 
-		free(TextureImage[0]);
-	}
+	Upload(image);
 }
 
-void GLTexture::LoadTGA(char *name)
+bool GLTexture::LoadFile(const char *name)
 {
-	GLubyte		TGAheader[12]	= {0,0,2,0,0,0,0,0,0,0,0,0};// Uncompressed TGA header
-	GLubyte		TGAcompare[12];								// Used to compare TGA header
-	GLubyte		header[6];									// First 6 useful bytes of the header
-	GLuint		bytesPerPixel;								// Holds the number of bytes per pixel used
-	GLuint		imageSize;									// Used to store the image size
-	GLuint		temp;										// Temporary variable
-	GLuint		type			= GL_RGBA;					// Set the default type to RBGA (32 BPP)
-	GLubyte		*imageData;									// Image data (up to 32 Bits)
-	GLuint		bpp;										// Image color depth in bits per pixel.
-
-	FILE *file = fopen(name, "rb");							// Open the TGA file
-
-	// Load the file and perform checks
-	if(file == NULL ||														// Does file exist?
-	   fread(TGAcompare,1,sizeof(TGAcompare),file) != sizeof(TGAcompare) ||	// Are there 12 bytes to read?
-	   memcmp(TGAheader,TGAcompare,sizeof(TGAheader)) != 0				 ||	// Is it the right format?
-	   fread(header,1,sizeof(header),file) != sizeof(header))				// If so then read the next 6 header bytes
-	{
-		if (file == NULL)									// If the file didn't exist then return
-			return;
-		else
-		{
-			fclose(file);									// If something broke then close the file and return
-			return;
-		}
-	}
+	std::string path = Image::FindFile(name);
+
+	if (path.empty())
+		return false;
+
+	// Decode it on another thread and upload it over the next frames,
+	// the bigger levels come later if the texture is seen up close
+	if (TextureStreamer::Queue(this, path.c_str(), TextureResidency::startSize))
+		return true;
+
+	KTXFile ktx;
+
+	if (!Decode(path.c_str(), ktx))
+		return false;
+
+	Upload(ktx);
+	int size = ktx.width > ktx.height ? ktx.width : ktx.height;
+
+	TextureResidency::Loaded(texture[0], path.c_str(), size, size, ktx.Bytes());
+	return true;
+}
 
-	// Determine the TGA width and height (highbyte*256+lowbyte)
-	width  = header[1] * 256 + header[0];
-	height = header[3] * 256 + header[2];
-    
-	// Check to make sure the targa is valid and is 24 bit or 32 bit
-	if(width	<=0	||										// Is the width less than or equal to zero
-	   height	<=0	||										// Is the height less than or equal to zero
-	   (header[4] != 24 && header[4] != 32))				// Is it 24 or 32 bit?
+bool GLTexture::Decode(const char *name, KTXFile &ktx)
+{
+	// A block compressed version is smaller and faster to upload
+	if (DecodeCompressed(name, ktx))
+		return true;
+
+	// The file and its mipmaps, made now or saved from last time
+	return MipmapGenerator::Load(name, ktx, !NonPowerOfTwoSupported());
+}
+
+bool GLTexture::DecodeCompressed(const char *name, KTXFile &ktx)
+{
+	if (!CompressionSupported())
+		return false;
+
+	// Use the baked texture, or bake it now if we are allowed to
+	if (TextureCompressor::UpToDate(name))
 	{
-		fclose(file);										// If anything didn't check out then close the file and return
-		return;
+		if (!ktx.Load(TextureCompressor::CacheName(name).c_str()))
+			return false;
 	}
+	else if (!TextureCompressor::onDemand || !TextureCompressor::Bake(name, ktx))
+		return false;
 
-	bpp				= header[4];							// Grab the bits per pixel
-	bytesPerPixel	= bpp / 8;								// Divide by 8 to get the bytes per pixel
-	imageSize		= width * height * bytesPerPixel;		// Calculate the memory required for the data
+	// Without non power of two textures MipmapGenerator has to scale it
+	bool powerOfTwo = (ktx.width & (ktx.width - 1)) == 0 && (ktx.height & (ktx.height - 1)) == 0;
 
-	// Allocate the memory for the image data
-	imageData		= new GLubyte[imageSize];
+	return powerOfTwo || NonPowerOfTwoSupported();
+}
 
-	// Make sure the data is allocated write and load it
-	if(imageData == NULL ||									// Does the memory storage exist?
-	   fread(imageData, 1, imageSize, file) != imageSize)	// Does the image size match the memory reserved?
-	{
-		if(imageData != NULL)								// Was the image data loaded
-			free(imageData);								// If so, then release the image data
+bool GLTexture::CompressionSupported()
+{
+	// Both are false until glewInit() has been called
+	return GLEW_VERSION_1_3 && GLEW_EXT_texture_compression_s3tc;
+}
 
-		fclose(file);										// Close the file
-		return;
-	}
+bool GLTexture::NonPowerOfTwoSupported()
+{
+	// Also false until glewInit() has been called, so we scale to be safe
+	return GLEW_VERSION_2_0 || GLEW_ARB_texture_non_power_of_two;
+}
+
+bool GLTexture::LoadSibling()
+{
+	static const char *extensions[] = { ".png", ".jpg", ".bmp", ".tga" };
 
-	// Loop through the image data and swap the 1st and 3rd bytes (red and blue)
-	for(GLuint i = 0; i < int(imageSize); i += bytesPerPixel)
+	const char *dot = strrchr(texturename, '.');
+	std::string stem(texturename, dot != NULL ? dot - texturename : strlen(texturename));
+
+	for (int i = 0; i < 4; i++)
 	{
-		temp = imageData[i];
-		imageData[i] = imageData[i + 2];
-		imageData[i + 2] = temp;
+		if (HasExtension(texturename, extensions[i]))
+			continue;
+
+		std::string other = stem + extensions[i];
+
+		if (LoadFile(other.c_str()))
+		{
+			// Remember the file we really used so it can be reloaded
+			free(texturename);
+			texturename = _strdup(other.c_str());
+			return true;
+		}
 	}
 
-	// We are done with the file so close it
-	fclose(file);
+	return false;
+}
 
-	// Set the type
-	if (bpp == 24)
-		type = GL_RGB;
-	
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
+void GLTexture::Upload(Image &image)
+{
+	KTXFile mipmaps;
+
+	// Cards without non power of two textures get it scaled like GLU did
+	if (MipmapGenerator::Generate(image, mipmaps, 0, !NonPowerOfTwoSupported()))
+		Upload(mipmaps);
+}
+
+void GLTexture::Upload(KTXFile &ktx)
+{
+	width = ktx.width;
+	height = ktx.height;
+	bytes = ktx.Bytes();
+
+	// Generate the OpenGL texture id (a reload keeps the one it has)
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
 
 	// Bind this texture to its id
 	glBindTexture(GL_TEXTURE_2D, texture[0]);
@@ -216,13 +303,39 @@ void GLTexture::LoadTGA(char *name)
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
 
-	// Generate the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, type, width, height, type, GL_UNSIGNED_BYTE, imageData);
+	// The mipmaps were made when the texture was baked or generated
+	ktx.Upload();
+}
+
+bool GLTexture::HasExtension(const char *name, const char *ext)
+{
+	// Compare the end of the name without caring about case
+	size_t length = strlen(name);
+	size_t extLength = strlen(ext);
+
+	if (length < extLength)
+		return false;
+
+	for (size_t i = 0; i < extLength; i++)
+	{
+		if (tolower((unsigned char)name[length - extLength + i]) != ext[i])
+			return false;
+	}
 
-	// Cleanup
-	free(imageData);
+	return true;
 }
 
+#ifdef _WIN32
+void GLTexture::LoadFromResource(char *name)
+{
+	texturename = _strdup(name);
+
+	// check the file extension to see what type of texture
+	if(HasExtension(texturename, ".bmp"))
+		LoadBMPResource(name);
+	if(HasExtension(texturename, ".tga"))
+		LoadTGAResource(name);
+}
 
 void GLTexture::LoadBMPResource(char *name)
 {
@@ -240,62 +353,17 @@ void GLTexture::LoadBMPResource(char *name)
 	if (resource==0)
 		return;
 
-	// Load it into the buffer
-	void *buffer = LockResource(resource);
+	// A bitmap resource is the file without its 14 byte file header
+	Image image;
 
-	// Cast it into a bitmap
-	BITMAP *bmp = (BITMAP*)buffer;
-
-	// Get the height and width for future use
-	width = bmp->bmWidth;
-	height = bmp->bmHeight;
-
-	// Reverse the blue colot bit and the red color bit
-	unsigned char *ptr = (unsigned char *)buffer+sizeof(BITMAPINFO)+2;
-	unsigned char temp;
-
-	for (int i = 0; i < width*height; i++)
-	{
-		temp = ptr[i*3];
-		ptr[i*3] = ptr[i*3+2];
-		ptr[i*3+2] = temp;
-	}
-
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
-
-	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
-
-	// Use mipmapping filter
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-
-	// Generate the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, (unsigned char *)buffer+sizeof(BITMAPINFO)+2);
-	//gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, bmp->bmBits);
+	if (!image.DecodeBMP((const unsigned char *)LockResource(resource), SizeofResource(0, hrsrc)))
+		return;
 
-	// Cleanup
-	free(buffer);
-	free(bmp);
+	Upload(image);
 }
 
 void GLTexture::LoadTGAResource(char *name)
 {
-	// struct to cast the resource into
-	struct TGAstruct {
-		GLubyte	TGAcompare[12];								// Used to compare TGA header
-		GLubyte	header[6];									// First 6 useful bytes of the header
-	};
-
-	GLubyte		TGAheader[12]	= {0,0,2,0,0,0,0,0,0,0,0,0};// Uncompressed TGA header
-	GLuint		bytesPerPixel;								// Holds the number of bytes per pixel used
-	GLuint		imageSize;									// Used to store the image size
-	GLuint		temp;										// Temporary variable
-	GLuint		type			= GL_RGBA;					// Set the default type to RBGA (32 BPP)
-	GLubyte		*imageData;									// Image data (up to 32 Bits)
-	GLuint		bpp;										// Image color depth in bits per pixel.
-
 	// Find the targa in the "TGA" resources
 	HRSRC hrsrc = FindResource(0, name, "TGA");
 
@@ -310,94 +378,45 @@ void GLTexture::LoadTGAResource(char *name)
 	if (resource==0)
 		return;
 
-	// Load it into the buffer
-	void *buffer = LockResource(resource);
-
-	// Cast it into the targa struct
-	TGAstruct *top = (TGAstruct*)buffer;
-
-	// Make sure it checks out against our comparison header
-	if (memcmp(TGAheader,top,sizeof(TGAheader)) != 0)
-		return;
+	// The resource is the whole targa file
+	Image image;
 
-	// Determine the TGA width and height (highbyte*256+lowbyte)
-	width  = top->header[1] * 256 + top->header[0];
-	height = top->header[3] * 256 + top->header[2];
-    
-	// Check to make sure the targa is valid and is 24 bit or 32 bit
-	if(width	<=0	||										// Is the width less than or equal to zero
-	   height	<=0	||										// Is the height less than or equal to zero
-	   (top->header[4] != 24 && top->header[4] != 32))		// Is it 24 or 32 bit?
-	{
-		// If anything didn't check out then close the file and return
+	if (!image.DecodeTGA((const unsigned char *)LockResource(resource), SizeofResource(0, hrsrc)))
 		return;
-	}
-
-	bpp				= top->header[4];							// Grab the bits per pixel
-	bytesPerPixel	= bpp / 8;								// Divide by 8 to get the bytes per pixel
-	imageSize		= width * height * bytesPerPixel;		// Calculate the memory required for the data
-
-	// Allocate the memory for the image data
-	imageData		= new GLubyte[imageSize];
-
-	// Load the data in
-	memcpy(imageData, (GLubyte*)buffer+18, imageSize);
-
-	// Loop through the image data and swap the 1st and 3rd bytes (red and blue)
-	for(GLuint i = 0; i < int(imageSize); i += bytesPerPixel)
-	{
-		temp = imageData[i];
-		imageData[i] = imageData[i + 2];
-		imageData[i + 2] = temp;
-	}
 
-	// Set the type
-	if (bpp == 24)
-		type = GL_RGB;
-	
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
-
-	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
-
-	// Use mipmapping filter
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-
-	// Generate the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, type, width, height, type, GL_UNSIGNED_BYTE, imageData);
-
-	// Cleanup
-	free(imageData);
-	free(buffer);
-	free(top);
+	Upload(image);
 }
+#endif
 
 void GLTexture::BuildColorTexture(unsigned char r, unsigned char g, unsigned char b)
 {
-	unsigned char data[12];	// a 2x2 texture at 24 bits
+	unsigned char data[3] = { r, g, b };	// a single texel is all a solid color needs
 
-	// Store the data
-	for(int i = 0; i < 12; i += 3)
-	{
-		data[i] = r;
-		data[i+1] = g;
-		data[i+2] = b;
-	}
+	// Every material of the same color can share one texture
+	char key[16];
+	sprintf(key, "#%02x%02x%02x", r, g, b);
+
+	if (TextureCache::Acquire(key, this))
+		return;
+
+	width = 1;
+	height = 1;
+	bytes = 4;
 
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
+	// Generate the OpenGL texture id (a reload keeps the one it has)
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
 
 	// Bind this texture to its id
 	glBindTexture(GL_TEXTURE_2D, texture[0]);
 
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
 	// Use mipmapping filter
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
 
-	// Generate the texture
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, 2, 2, GL_RGB, GL_UNSIGNED_BYTE, data);
+	// Generate the texture, 1x1 is its only mipmap level
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	TextureCache::Add(key, this);
 }
@@ -5,8 +5,8 @@
 //
 // GLTexture.h: interface for the GLTexture class.
 // This class loads a texture file and prepares it
-// to be used in OpenGL. It can open a bitmap or a
-// targa file. The min filter is set to mipmap b/c
+// to be used in OpenGL. It can open a bitmap, a targa,
+// a PNG or a JPEG file. The min filter is set to mipmap b/c
 // they look better and the performance cost on
 // modern video cards in negligible. I leave all of
 // the texture management to the application. I have
@@ -22,7 +22,7 @@
 // GLTexture tex1;
 // GLTexture tex3;
 //
-// tex.Load("texture.bmp"); // Loads a bitmap
+// tex.Load("texture.jpg"); // Loads a JPEG (or texture.png/.bmp/.tga if there is no .jpg)
 // tex.Use();				// Binds the bitmap for use
 // 
 // tex1.LoadFromResource("texture.tga"); // Loads a targa
@@ -32,17 +32,33 @@
 // tex3.BuildColorTexture(255, 0, 0);	// Builds a solid red texture
 // tex3.Use();				 // Binds the targa for use
 //
+// // If the file changed on disk you can load it again. The
+// // texture keeps its OpenGL id so nothing else has to change
+// tex.Reload();
+//
+// // Textures are block compressed (see TextureCompressor) when
+// // the video card can take it, call glewInit() before loading
+//
+// // After TextureStreamer::Start() files are decoded on other
+// // threads and show up a few frames later (see TextureStreamer)
+//
+// // Loading a file that is already loaded shares its texture
+// // (see TextureCache), so give it back when you are done
+// tex.Release();
+//
 //////////////////////////////////////////////////////////////////////
 
 #ifndef GLTEXTURE_H
 #define GLTEXTURE_H
 
+#ifdef _WIN32
 #include <windows.h>		// Header File For Windows
-#include <gl\gl.h>			// Header File For The OpenGL32 Library
-#include <gl\glu.h>			// Header File For The GLu32 Library
-#include "GLAUX.H"		// Header File For The Glaux Library
+#endif
+#include "glew.h"			// Header File For OpenGL and its extensions
+#include <GL/glu.h>			// Header File For The GLu32 Library
 
-#pragma comment(lib, "glaux")
+class Image;
+class KTXFile;
 
 class GLTexture  
 {
@@ -51,17 +67,34 @@ public:
 	unsigned int texture[1];						// OpenGL's number for the texture
 	int width;										// Texture's width
 	int height;										// Texture's height
+	int bytes;										// Memory used by the texture and its mipmaps
 	void Use();										// Binds the texture for use
 	void BuildColorTexture(unsigned char r, unsigned char g, unsigned char b);	// Sometimes we want a texture of uniform color
+#ifdef _WIN32
 	void LoadTGAResource(char *name);				// Load a targa from the resources
 	void LoadBMPResource(char *name);				// Load a bitmap from the resources
 	void LoadFromResource(char *name);				// Load the texture from a resource
+#endif
 	void LoadTGA(char *name);						// Loads a targa file
 	void LoadBMP(char *name);						// Loads a bitmap file
+	void LoadPNG(char *name);						// Loads a PNG file
+	void LoadJPG(char *name);						// Loads a JPEG file
 	void Load(char *name);							// Load the texture
+	void Reload();									// Reload the texture file into the same texture id
+	void Release();									// Give the texture back, deleted when nobody else shares it
+	static bool NonPowerOfTwoSupported();			// True if textures don't have to be scaled to a power of two
+	static bool Decode(const char *name, KTXFile &ktx);	// Reads a file the way it will be uploaded, safe on any thread
 	GLTexture();									// Constructor
 	virtual ~GLTexture();							// Destructor
 
+private:
+	bool LoadFile(const char *name);				// Loads any file Image can decode
+	bool LoadSibling();								// Tries the same name with the other extensions
+	static bool DecodeCompressed(const char *name, KTXFile &ktx);	// Loads (or bakes) the block compressed version of a file
+	void Upload(Image &image);						// Makes the mipmaps of a decoded image and sends them to OpenGL
+	void Upload(KTXFile &ktx);						// Sends a texture and its mipmaps to OpenGL
+	static bool CompressionSupported();				// True if the video card can take BC1/BC3 textures
+	static bool HasExtension(const char *name, const char *ext);	// Case insensitive check of the file extension
 };
 
 #endif GLTEXTURE_H
\ No newline at end of file
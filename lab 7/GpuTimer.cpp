@@ -0,0 +1,212 @@
+//////////////////////////////////////////////////////////////////////
+//
+// GPU Timer Class
+//
+// GpuTimer.cpp: implementation of the GpuTimer class.
+// Timestamps rather than GL_TIME_ELAPSED, which can't be nested
+// and is already taken by the Benchmark around the whole
+// frame. The frames are read back oldest first and stop at the
+// first one that isn't done, so the averages take them in
+// order. A frame still not done when its queries are needed
+// again is dropped.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "GpuTimer.h"
+#include "glew.h"
+
+#include <stdio.h>
+
+#define FRAMES				4						// Frames whose queries are kept
+#define WINDOW				60						// Frames the averages are over
+
+// One frame's queries, the start and the end of each pass
+struct TimedFrame
+{
+	GLuint queries[GpuTimer::MAX_PASSES + 1];
+	int marks;										// How many passes it ended
+	bool pending;									// Not read back yet
+};
+
+static TimedFrame frames[FRAMES];
+static int current = 0;								// The frame being timed
+static int inFlight = 0;							// The frames before it that haven't been read back
+static bool created = false;
+static bool timing = false;							// Between BeginFrame() and EndFrame()
+
+static const char *names[GpuTimer::MAX_PASSES];
+static int passes = 0;
+static double times[GpuTimer::MAX_PASSES][WINDOW];	// The last WINDOW times of each pass
+static double sums[GpuTimer::MAX_PASSES];
+static int counts[GpuTimer::MAX_PASSES];			// Up to WINDOW
+static int next[GpuTimer::MAX_PASSES];				// Where the next time goes
+static int collected = 0;							// Frames read back
+
+static FILE *logFile = NULL;
+
+// Takes the times out of a frame the card is done with
+static void Collect(TimedFrame &frame)
+{
+	GLuint64 stamps[GpuTimer::MAX_PASSES + 1];
+
+	for (int i = 0; i <= frame.marks; i++)
+		glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &stamps[i]);
+
+	for (int i = 0; i < frame.marks; i++)
+	{
+		double ms = (stamps[i + 1] - stamps[i]) / 1000000.0;
+
+		if (counts[i] == WINDOW)
+			sums[i] -= times[i][next[i]];
+		else
+			counts[i]++;
+
+		times[i][next[i]] = ms;
+		sums[i] += ms;
+		next[i] = (next[i] + 1) % WINDOW;
+	}
+
+	frame.pending = false;
+	collected++;
+
+	if (logFile == NULL || collected % WINDOW != 0)
+		return;
+
+	// The averages as they are every WINDOW frames, the pass names on top
+	if (collected == WINDOW)
+	{
+		fprintf(logFile, "frame");
+
+		for (int i = 0; i < passes; i++)
+			fprintf(logFile, ",%s", names[i]);
+
+		fprintf(logFile, ",Total\n");
+	}
+
+	fprintf(logFile, "%d", collected);
+
+	for (int i = 0; i < passes; i++)
+		fprintf(logFile, ",%.3f", GpuTimer::Average(i));
+
+	fprintf(logFile, ",%.3f\n", GpuTimer::Total());
+	fflush(logFile);
+}
+
+bool GpuTimer::Supported()
+{
+	return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+void GpuTimer::BeginFrame()
+{
+	if (!Supported())
+		return;
+
+	if (!created)
+	{
+		for (int i = 0; i < FRAMES; i++)
+		{
+			glGenQueries(MAX_PASSES + 1, frames[i].queries);
+			frames[i].marks = 0;
+			frames[i].pending = false;
+		}
+
+		created = true;
+	}
+
+	// Oldest first, as far as the card has got
+	while (inFlight > 0)
+	{
+		TimedFrame &frame = frames[(current - inFlight + FRAMES) % FRAMES];
+
+		if (frame.pending)
+		{
+			GLint available = 0;
+
+			glGetQueryObjectiv(frame.queries[frame.marks], GL_QUERY_RESULT_AVAILABLE, &available);
+
+			if (!available)
+				break;
+
+			Collect(frame);
+		}
+
+		inFlight--;
+	}
+
+	// The oldest one's queries are about to be used again
+	if (inFlight == FRAMES)
+	{
+		frames[current].pending = false;
+		inFlight--;
+	}
+
+	frames[current].marks = 0;
+	glQueryCounter(frames[current].queries[0], GL_TIMESTAMP);
+	timing = true;
+}
+
+void GpuTimer::Mark(const char *pass)
+{
+	TimedFrame &frame = frames[current];
+
+	if (!timing || frame.marks == MAX_PASSES)
+		return;
+
+	names[frame.marks] = pass;
+
+	if (frame.marks >= passes)
+		passes = frame.marks + 1;
+
+	frame.marks++;
+	glQueryCounter(frame.queries[frame.marks], GL_TIMESTAMP);
+}
+
+void GpuTimer::EndFrame()
+{
+	if (!timing)
+		return;
+
+	frames[current].pending = frames[current].marks > 0;
+	current = (current + 1) % FRAMES;
+	inFlight++;
+	timing = false;
+}
+
+int GpuTimer::Passes()
+{
+	return passes;
+}
+
+const char *GpuTimer::Name(int pass)
+{
+	return names[pass];
+}
+
+double GpuTimer::Average(int pass)
+{
+	return counts[pass] > 0 ? sums[pass] / counts[pass] : 0.0;
+}
+
+double GpuTimer::Total()
+{
+	double total = 0.0;
+
+	for (int i = 0; i < passes; i++)
+		total += Average(i);
+
+	return total;
+}
+
+bool GpuTimer::Log(const char *name)
+{
+	if (logFile != NULL)
+		fclose(logFile);
+
+	logFile = fopen(name, "w");
+
+	if (logFile == NULL)
+		printf("GPU timer: can't write %s\n", name);
+
+	return logFile != NULL;
+}
@@ -0,0 +1,56 @@
+//////////////////////////////////////////////////////////////////////
+//
+// GPU Timer Class
+//
+// GpuTimer.h: interface for the GpuTimer class.
+// Splits the card's time for a frame into the passes that
+// draw it. A GL_TIMESTAMP query goes in at the start of the
+// frame and after every pass, and a pass took the time between
+// its query and the one before.
+//
+// Nothing waits for the card: the queries of the last four
+// frames are kept, and BeginFrame() reads back the ones the
+// card has finished, so the times are a few frames old. The
+// averages are over the last 60 frames read back, and can be
+// written to a file every 60 frames.
+//
+// Needs timer queries (OpenGL 3.3 or ARB_timer_query), without
+// them every call does nothing and there are no passes.
+//
+// Usage:
+// GpuTimer::Log("gputimes.csv");
+//
+// GpuTimer::BeginFrame();
+// // Draw the walls
+// GpuTimer::Mark("Walls");
+// // Draw the sky
+// GpuTimer::Mark("Sky");
+// GpuTimer::EndFrame();
+//
+// for (int i = 0; i < GpuTimer::Passes(); i++)
+//		printf("%s %.3f ms\n", GpuTimer::Name(i), GpuTimer::Average(i));
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+class GpuTimer
+{
+public:
+	static const int MAX_PASSES = 16;
+
+	static bool Supported();						// True if the card has timer queries
+	static void BeginFrame();						// Reads back the frames the card is done with and starts this one
+	static void Mark(const char *pass);				// Ends the pass called pass (a string that stays around) here
+	static void EndFrame();							// Done with the frame's passes
+
+	static int Passes();							// How many passes have been timed
+	static const char *Name(int pass);
+	static double Average(int pass);				// In milliseconds
+	static double Total();							// All of the passes together
+
+	static bool Log(const char *name);				// Writes the averages to the file name from now on
+};
+
+#endif GPUTIMER_H
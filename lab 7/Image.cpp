@@ -0,0 +1,949 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Image Class
+//
+// Image.cpp: implementation of the Image class.
+// This class decodes bitmap, targa, PNG, JPEG and PPM files
+// into memory so GLTexture and TextureBuilder can upload
+// them. It replaces auxDIBImageLoad from glaux, which only
+// exists on Windows. The whole file is read with one fread
+// and bitmaps and targas are decoded in place whenever the
+// layout allows it, so a bottom-up 24 bit bitmap costs no
+// more than a memcpy: the rows are already in the order
+// OpenGL wants and the only work left is swapping blue and
+// red, which is done with SSSE3 shuffles. PNG and JPEG files
+// are handed to PNGDecoder and JPEGDecoder.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Image.h"
+#include "PNGDecoder.h"
+#include "JPEGDecoder.h"
+#include "Simd.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <strings.h>
+#endif
+
+// Bitmap compression types we understand
+#define BI_RGB_			0
+#define BI_BITFIELDS_	3
+
+// Little endian readers, the file formats are little endian on every machine
+static unsigned int Read16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int Read32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// PNG and JPEG headers are big endian
+static unsigned int Read16BE(const unsigned char *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static unsigned int Read32BE(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void Write32BE(std::vector<unsigned char> &out, unsigned int value)
+{
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+// The CRC of a PNG chunk, a byte at a time from a table
+static unsigned int Crc32(const unsigned char *p, size_t length)
+{
+	static unsigned int table[256];
+
+	if (table[1] == 0)
+	{
+		for (unsigned int n = 0; n < 256; n++)
+		{
+			unsigned int c = n;
+
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+
+			table[n] = c;
+		}
+	}
+
+	unsigned int crc = 0xFFFFFFFFu;
+
+	for (size_t i = 0; i < length; i++)
+		crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+
+	return crc ^ 0xFFFFFFFFu;
+}
+
+// Adds a chunk of type with its length in front and its CRC behind
+static void WriteChunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &body)
+{
+	Write32BE(out, (unsigned int)body.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), body.begin(), body.end());
+	Write32BE(out, Crc32(&out[start], out.size() - start));
+}
+
+#ifdef SIMD_SSE2
+// Swaps blue and red 4 pixels at a time, returns how many bytes it did
+SIMD_TARGET_SSSE3 static int SwizzleSSSE3(unsigned char *dst, const unsigned char *src, int n, int channels, bool opaque)
+{
+	int i = 0;
+
+	if (channels == 3)
+	{
+		// 4 pixels are 12 bytes, the last 4 bytes of the 16 are written back
+		// unchanged and get swapped on the next step, so we advance by 12
+		const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+
+		for (; i + 16 <= n; i += 12)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+			_mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(v, mask));
+		}
+	}
+	else
+	{
+		const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		const __m128i alpha = opaque ? _mm_set1_epi32((int)0xFF000000) : _mm_setzero_si128();
+
+		for (; i + 16 <= n; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+			_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha));
+		}
+	}
+
+	return i;
+}
+#endif
+
+// Writes the same pixel count times
+static void Fill(unsigned char *dst, const unsigned char *pixel, int count, int channels)
+{
+	int n = count * channels;
+	int i = 0;
+
+#ifdef SIMD_SSE2
+	if (channels == 4)
+	{
+		int value;
+		memcpy(&value, pixel, 4);
+
+		const __m128i v = _mm_set1_epi32(value);
+
+		for (; i + 16 <= n; i += 16)
+			_mm_storeu_si128((__m128i *)(dst + i), v);
+	}
+	else if (count >= 16)
+	{
+		// 16 RGB pixels are 48 bytes, three registers that repeat
+		unsigned char pattern[48];
+
+		for (int j = 0; j < 48; j += 3)
+		{
+			pattern[j] = pixel[0];
+			pattern[j + 1] = pixel[1];
+			pattern[j + 2] = pixel[2];
+		}
+
+		const __m128i a = _mm_loadu_si128((const __m128i *)pattern);
+		const __m128i b = _mm_loadu_si128((const __m128i *)(pattern + 16));
+		const __m128i c = _mm_loadu_si128((const __m128i *)(pattern + 32));
+
+		for (; i + 48 <= n; i += 48)
+		{
+			_mm_storeu_si128((__m128i *)(dst + i), a);
+			_mm_storeu_si128((__m128i *)(dst + i + 16), b);
+			_mm_storeu_si128((__m128i *)(dst + i + 32), c);
+		}
+	}
+#endif
+
+	// Whatever is left (or everything on a CPU without SSE2)
+	for (; i < n; i += channels)
+	{
+		dst[i] = pixel[0];
+		dst[i + 1] = pixel[1];
+		dst[i + 2] = pixel[2];
+
+		if (channels == 4)
+			dst[i + 3] = pixel[3];
+	}
+}
+
+// BGR(A) to RGB(A), optionally forcing the alpha to 255
+static void Swizzle(unsigned char *dst, const unsigned char *src, int pixels, int channels, bool opaque)
+{
+	int n = pixels * channels;
+	int i = 0;
+
+#ifdef SIMD_SSE2
+	if (SimdHasSSSE3())
+		i = SwizzleSSSE3(dst, src, n, channels, opaque);
+#endif
+
+	// Whatever is left (or everything on a CPU without SSSE3)
+	for (; i < n; i += channels)
+	{
+		unsigned char b = src[i];
+		dst[i] = src[i + 2];
+		dst[i + 1] = src[i + 1];
+		dst[i + 2] = b;
+
+		if (channels == 4)
+			dst[i + 3] = opaque ? 255 : src[i + 3];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+Image::Image()
+{
+	data = NULL;
+	buffer = NULL;
+	size = 0;
+	width = 0;
+	height = 0;
+	channels = 0;
+	alignment = 1;
+}
+
+Image::~Image()
+{
+	Free();
+}
+
+void Image::Free()
+{
+	delete [] buffer;
+
+	buffer = NULL;
+	data = NULL;
+	size = 0;
+}
+
+bool Image::Create(int w, int h, int c)
+{
+	if (w < 1 || h < 1 || (c != 3 && c != 4))
+		return false;
+
+	unsigned char *pixels = new unsigned char[(long)w * h * c];
+
+	Take(pixels, w, h, c);
+	return true;
+}
+
+void Image::SwapRedBlue(unsigned char *dst, const unsigned char *src, int pixels, int channels)
+{
+	Swizzle(dst, src, pixels, channels, false);
+}
+
+bool Image::ReadSize(const char *name, int &w, int &h)
+{
+	Image image;
+
+	if (!image.ReadFile(name))
+		return false;
+
+	const unsigned char *p = image.buffer;
+	long n = image.size;
+
+	w = 0;
+	h = 0;
+
+	if (n >= 26 && p[0] == 'B' && p[1] == 'M')
+	{
+		// Negative heights are top-down bitmaps
+		w = (int)Read32(p + 18);
+		h = (int)Read32(p + 22);
+		h = (h < 0) ? -h : h;
+	}
+	else if (n >= 24 && memcmp(p, "\x89PNG", 4) == 0)
+	{
+		// IHDR is always the first chunk
+		w = (int)Read32BE(p + 16);
+		h = (int)Read32BE(p + 20);
+	}
+	else if (n >= 3 && p[0] == 0xFF && p[1] == 0xD8)
+	{
+		// Walk the markers up to the frame header (SOF0 to SOF15 but DHT, JPG and DAC)
+		long i = 2;
+
+		while (i + 9 <= n && p[i] == 0xFF)
+		{
+			int marker = p[i + 1];
+
+			if (marker == 0xFF)
+			{
+				i++;
+				continue;
+			}
+
+			if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+			{
+				h = (int)Read16BE(p + i + 5);
+				w = (int)Read16BE(p + i + 7);
+				break;
+			}
+
+			i += 2 + Read16BE(p + i + 2);
+		}
+	}
+	else if (n >= 18)
+	{
+		// Targas have no signature, trust the extension like Load() does
+		const char *ext = strrchr(name, '.');
+		char lower[5] = { 0 };
+
+		for (int i = 0; ext != NULL && i < 4 && ext[i]; i++)
+			lower[i] = (char)tolower((unsigned char)ext[i]);
+
+		if (strcmp(lower, ".tga") == 0)
+		{
+			w = (int)Read16(p + 12);
+			h = (int)Read16(p + 14);
+		}
+	}
+
+	return w > 0 && h > 0;
+}
+
+std::string Image::FindFile(const char *name)
+{
+	FILE *file = fopen(name, "rb");
+
+	if (file != NULL)
+	{
+		fclose(file);
+		return name;
+	}
+
+#ifndef _WIN32
+	// The models were made on Windows, which doesn't care about case,
+	// so look for every part of the path in any case
+	std::string path = (name[0] == '/') ? "/" : "";
+	std::string part;
+
+	for (const char *c = name; ; c++)
+	{
+		if (*c != '/' && *c != '\\' && *c != 0)
+		{
+			part += *c;
+			continue;
+		}
+
+		if (!part.empty())
+		{
+			DIR *dir = opendir(path.empty() ? "." : path.c_str());
+			struct dirent *entry;
+			bool found = false;
+
+			while (dir != NULL && (entry = readdir(dir)) != NULL)
+			{
+				if (strcasecmp(entry->d_name, part.c_str()) == 0)
+				{
+					part = entry->d_name;
+					found = true;
+					break;
+				}
+			}
+
+			if (dir != NULL)
+				closedir(dir);
+
+			if (!found)
+				return "";
+
+			path += part;
+
+			if (*c != 0)
+				path += "/";
+		}
+
+		part.clear();
+
+		if (*c == 0)
+			break;
+	}
+
+	return path;
+#else
+	return "";
+#endif
+}
+
+bool Image::Load(const char *name)
+{
+	if (!ReadFile(name))
+		return false;
+
+	// The first bytes say what the file is, whatever its extension says
+	if (size >= 2 && buffer[0] == 'B' && buffer[1] == 'M')
+		return DecodeBMP();
+	if (size >= 8 && memcmp(buffer, "\x89PNG", 4) == 0)
+		return DecodePNG();
+	if (size >= 3 && buffer[0] == 0xFF && buffer[1] == 0xD8)
+		return DecodeJPG();
+	if (size >= 2 && buffer[0] == 'P' && buffer[1] == '6')
+		return DecodePPM();
+
+	// Targas have no signature so they go by the extension
+	const char *ext = strrchr(name, '.');
+	char lower[5] = { 0 };
+
+	for (int i = 0; ext != NULL && i < 4 && ext[i]; i++)
+		lower[i] = (char)tolower((unsigned char)ext[i]);
+
+	if (strcmp(lower, ".tga") == 0)
+		return DecodeTGA();
+
+	Free();
+	return false;
+}
+
+bool Image::LoadBMP(const char *name)
+{
+	return ReadFile(name) && DecodeBMP();
+}
+
+bool Image::LoadTGA(const char *name)
+{
+	return ReadFile(name) && DecodeTGA();
+}
+
+bool Image::LoadPNG(const char *name)
+{
+	return ReadFile(name) && DecodePNG();
+}
+
+bool Image::LoadJPG(const char *name)
+{
+	return ReadFile(name) && DecodeJPG();
+}
+
+bool Image::SavePNG(const char *name) const
+{
+	if (data == NULL)
+		return false;
+
+	int stride = (width * channels + alignment - 1) / alignment * alignment;
+	int row = width * channels + 1;					// The filter byte (0, none) and the samples
+
+	// The zlib stream: its header, stored deflate blocks of up to 65535 bytes and the Adler-32 of the rows
+	std::vector<unsigned char> rows;
+	std::vector<unsigned char> idat;
+
+	rows.reserve((size_t)row * height);
+
+	for (int y = height - 1; y >= 0; y--)
+	{
+		rows.push_back(0);
+		rows.insert(rows.end(), data + (size_t)y * stride, data + (size_t)y * stride + row - 1);
+	}
+
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+
+	size_t at = 0;
+	bool last = false;
+
+	while (!last)
+	{
+		size_t length = rows.size() - at < 65535 ? rows.size() - at : 65535;
+
+		last = at + length == rows.size();
+		idat.push_back(last ? 1 : 0);
+		idat.push_back((unsigned char)length);
+		idat.push_back((unsigned char)(length >> 8));
+		idat.push_back((unsigned char)~length);
+		idat.push_back((unsigned char)(~length >> 8));
+		idat.insert(idat.end(), rows.begin() + at, rows.begin() + at + length);
+
+		at += length;
+	}
+
+	unsigned int a = 1, b = 0;
+
+	for (size_t i = 0; i < rows.size(); i++)
+	{
+		a = (a + rows[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	Write32BE(idat, (b << 16) | a);
+
+	std::vector<unsigned char> header;
+	std::vector<unsigned char> out;
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	Write32BE(header, width);
+	Write32BE(header, height);
+	header.push_back(8);							// Bits a sample
+	header.push_back(channels == 4 ? 6 : 2);		// RGBA or RGB
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+
+	out.insert(out.end(), signature, signature + 8);
+	WriteChunk(out, "IHDR", header);
+	WriteChunk(out, "IDAT", idat);
+	WriteChunk(out, "IEND", std::vector<unsigned char>());
+
+	FILE *file = fopen(name, "wb");
+
+	if (file == NULL)
+		return false;
+
+	bool written = fwrite(&out[0], 1, out.size(), file) == out.size();
+
+	fclose(file);
+	return written;
+}
+
+bool Image::DecodeBMP(const unsigned char *file, long length)
+{
+	// Decode a copy so that we can work in place (resources are read only)
+	Free();
+
+	buffer = new unsigned char[length];
+	size = length;
+	memcpy(buffer, file, length);
+
+	return DecodeBMP();
+}
+
+bool Image::DecodeTGA(const unsigned char *file, long length)
+{
+	Free();
+
+	buffer = new unsigned char[length];
+	size = length;
+	memcpy(buffer, file, length);
+
+	return DecodeTGA();
+}
+
+bool Image::ReadFile(const char *name)
+{
+	Free();
+
+	std::string path = FindFile(name);
+
+	if (path.empty())
+		return false;
+
+	FILE *file = fopen(path.c_str(), "rb");
+
+	if (file == NULL)
+		return false;
+
+	// Find out how big the file is
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	// Read all of it in one go
+	if (size > 0)
+	{
+		buffer = new unsigned char[size];
+
+		if (fread(buffer, 1, size, file) != (size_t)size)
+			Free();
+	}
+
+	fclose(file);
+
+	return buffer != NULL;
+}
+
+bool Image::DecodeBMP()
+{
+	const unsigned char *header = buffer;
+	long offset;
+
+	if (size < 40)
+		return false;
+
+	// A file starts with a 14 byte file header, a resource starts with the info header
+	if (buffer[0] == 'B' && buffer[1] == 'M')
+	{
+		offset = Read32(buffer + 10);
+		header = buffer + 14;
+	}
+	else
+		offset = -1;
+
+	unsigned int headerSize = Read32(header);
+
+	// The old OS/2 header isn't supported
+	if (headerSize < 40 || header + headerSize > buffer + size)
+		return false;
+
+	int w = (int)Read32(header + 4);
+	int h = (int)Read32(header + 8);
+	int bpp = Read16(header + 14);
+	unsigned int compression = Read32(header + 16);
+
+	if (bpp != 24 && bpp != 32)
+		return false;
+
+	// 32 bit bitmaps only have an alpha channel if the header says so
+	bool opaque = true;
+
+	if (compression == BI_BITFIELDS_ && bpp == 32)
+	{
+		// The masks follow the header (or are part of a V4/V5 header)
+		const unsigned char *masks = header + 40;
+
+		// After a 40 byte header they may be cut off, check before reading them
+		if (masks + 12 > buffer + size)
+			return false;
+
+		if (Read32(masks) != 0x00FF0000 || Read32(masks + 4) != 0x0000FF00 || Read32(masks + 8) != 0x000000FF)
+			return false;
+
+		if (headerSize >= 56 && Read32(masks + 12) == 0xFF000000)
+			opaque = false;
+	}
+	else if (compression != BI_RGB_)
+		return false;
+
+	// A resource has no file header so the pixels follow the header and the masks
+	if (offset < 0)
+		offset = (long)(header - buffer) + headerSize + (compression == BI_BITFIELDS_ && headerSize == 40 ? 12 : 0);
+
+	// A negative height means the first row is the top one
+	bool topdown = h < 0;
+
+	if (topdown)
+		h = -h;
+
+	// Rows are padded to 4 bytes
+	int stride = ((w * bpp + 31) / 32) * 4;
+
+	if (w <= 0 || h <= 0 || offset + (long)stride * h > size)
+		return false;
+
+	width = w;
+	height = h;
+	channels = bpp / 8;
+
+	unsigned char *pixels = buffer + offset;
+
+	if (topdown)
+	{
+		// OpenGL wants the bottom row first so the rows have to move
+		CopyRows(pixels, stride, true, opaque);
+		return true;
+	}
+
+	// Bottom-up rows are already in the right order. The padding is the same
+	// as OpenGL's default unpack alignment of 4 so we can upload straight
+	// out of the file buffer after swapping red and blue.
+	if (stride == width * channels)
+		Swizzle(pixels, pixels, width * height, channels, opaque && channels == 4);
+	else
+	{
+		for (int y = 0; y < height; y++)
+			Swizzle(pixels + y * stride, pixels + y * stride, width, channels, opaque && channels == 4);
+	}
+
+	data = pixels;
+	alignment = 4;
+
+	return true;
+}
+
+bool Image::DecodeTGA()
+{
+	if (size < 18)
+		return false;
+
+	int idLength = buffer[0];
+	int colorMapType = buffer[1];
+	int imageType = buffer[2];
+	int colorMapLength = Read16(buffer + 5);
+	int colorMapBits = buffer[7];
+	int w = Read16(buffer + 12);
+	int h = Read16(buffer + 14);
+	int bpp = buffer[16];
+	int descriptor = buffer[17];
+
+	// Only true color, uncompressed (2) or run length encoded (10)
+	if ((imageType != 2 && imageType != 10) || colorMapType != 0)
+		return false;
+
+	if (bpp != 24 && bpp != 32)
+		return false;
+
+	// Skip the id and the (unused) color map
+	long offset = 18 + idLength + colorMapLength * ((colorMapBits + 7) / 8);
+	int stride = w * (bpp / 8);
+
+	if (imageType == 10)
+	{
+		if (w <= 0 || h <= 0 || offset > size)
+			return false;
+
+		width = w;
+		height = h;
+		channels = bpp / 8;
+
+		return DecodeTGARuns(buffer + offset, size - offset, (descriptor & 0x20) != 0);
+	}
+
+	if (w <= 0 || h <= 0 || offset + (long)stride * h > size)
+		return false;
+
+	width = w;
+	height = h;
+	channels = bpp / 8;
+
+	unsigned char *pixels = buffer + offset;
+
+	// Bit 5 of the descriptor is set when the first row is the top one
+	if (descriptor & 0x20)
+	{
+		CopyRows(pixels, stride, true, false);
+		return true;
+	}
+
+	// Bottom-up, swap red and blue in place and use the pixels where they are
+	Swizzle(pixels, pixels, width * height, channels, false);
+
+	data = pixels;
+	alignment = 1;
+
+	return true;
+}
+
+bool Image::DecodeTGARuns(const unsigned char *src, long length, bool topdown)
+{
+	const unsigned char *end = src + length;
+	int rowSize = width * channels;
+	unsigned char *pixels = new unsigned char[(long)rowSize * height];
+
+	// The next pixel in the file's order
+	int x = 0;
+	int y = 0;
+
+	// Every packet goes straight to its place in the pixels OpenGL gets
+	while (y < height)
+	{
+		if (src == end)
+		{
+			delete [] pixels;
+			return false;
+		}
+
+		bool run = (*src & 0x80) != 0;
+		int count = (*src & 0x7F) + 1;
+		src++;
+
+		// A run is one pixel repeated, a raw packet has all of its pixels
+		if (end - src < (run ? 1 : count) * channels)
+		{
+			delete [] pixels;
+			return false;
+		}
+
+		unsigned char color[4];
+
+		if (run)
+		{
+			color[0] = src[2];
+			color[1] = src[1];
+			color[2] = src[0];
+			color[3] = (channels == 4) ? src[3] : 255;
+			src += channels;
+		}
+
+		// Some writers let a packet go on into the next row
+		while (count > 0 && y < height)
+		{
+			int n = (count < width - x) ? count : width - x;
+			unsigned char *dst = pixels + (long)(topdown ? height - 1 - y : y) * rowSize + x * channels;
+
+			if (run)
+				Fill(dst, color, n, channels);
+			else if (n * channels >= 16)
+				Swizzle(dst, src, n, channels, false);
+			else
+			{
+				// Most raw packets in a busy texture are a few pixels long,
+				// too short for the shuffles to pay for the call
+				for (int i = 0; i < n * channels; i += channels)
+				{
+					dst[i] = src[i + 2];
+					dst[i + 1] = src[i + 1];
+					dst[i + 2] = src[i];
+
+					if (channels == 4)
+						dst[i + 3] = src[i + 3];
+				}
+			}
+
+			if (!run)
+				src += n * channels;
+
+			count -= n;
+			x += n;
+
+			if (x == width)
+			{
+				x = 0;
+				y++;
+			}
+		}
+	}
+
+	// The file isn't needed anymore
+	delete [] buffer;
+
+	buffer = pixels;
+	size = (long)rowSize * height;
+	data = pixels;
+	alignment = 1;
+
+	return true;
+}
+
+bool Image::DecodePNG()
+{
+	PNGDecoder png;
+
+	if (!png.Decode(buffer, size))
+		return false;
+
+	Take(png.pixels, png.width, png.height, png.channels);
+
+	return true;
+}
+
+bool Image::DecodeJPG()
+{
+	JPEGDecoder jpeg;
+
+	if (!jpeg.Decode(buffer, size))
+		return false;
+
+	Take(jpeg.pixels, jpeg.width, jpeg.height, jpeg.channels);
+
+	return true;
+}
+
+// Reads a number of a PPM header, skipping the blanks and comments before it
+static bool ReadNumber(const unsigned char *&p, const unsigned char *end, int &value)
+{
+	while (p < end && (isspace(*p) || *p == '#'))
+	{
+		if (*p == '#')
+		{
+			while (p < end && *p != '\n')
+				p++;
+		}
+		else
+			p++;
+	}
+
+	if (p == end || !isdigit(*p))
+		return false;
+
+	for (value = 0; p < end && isdigit(*p); p++)
+	{
+		value = value * 10 + (*p - '0');
+
+		if (value > 65535)
+			return false;
+	}
+
+	return true;
+}
+
+bool Image::DecodePPM()
+{
+	const unsigned char *p = buffer + 2;
+	const unsigned char *end = buffer + size;
+	int w, h, maxval;
+
+	if (!ReadNumber(p, end, w) || !ReadNumber(p, end, h) || !ReadNumber(p, end, maxval))
+		return false;
+
+	// A single blank ends the header, only bytes for samples are supported
+	if (p == end || !isspace(*p) || w <= 0 || h <= 0 || maxval != 255)
+		return false;
+
+	p++;
+
+	int rowSize = w * 3;
+
+	if ((long)rowSize * h > end - p)
+		return false;
+
+	// The rows are already RGB, they only have to be turned upside down
+	unsigned char *pixels = new unsigned char[(long)rowSize * h];
+
+	for (int y = 0; y < h; y++)
+		memcpy(pixels + (long)y * rowSize, p + (long)(h - 1 - y) * rowSize, rowSize);
+
+	Take(pixels, w, h, 3);
+
+	return true;
+}
+
+void Image::Take(unsigned char *&pixels, int w, int h, int c)
+{
+	// The file isn't needed anymore, the decoded pixels replace it
+	delete [] buffer;
+
+	buffer = pixels;
+	size = (long)w * h * c;
+	data = pixels;
+	width = w;
+	height = h;
+	channels = c;
+	alignment = 1;
+
+	pixels = NULL;
+}
+
+void Image::CopyRows(const unsigned char *src, int stride, bool topdown, bool opaque)
+{
+	int rowSize = width * channels;
+	unsigned char *pixels = new unsigned char[rowSize * height];
+
+	// Swap red and blue while moving every row into its place
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char *row = src + (long)(topdown ? height - 1 - y : y) * stride;
+		Swizzle(pixels + (long)y * rowSize, row, width, channels, opaque && channels == 4);
+	}
+
+	// The file isn't needed anymore
+	delete [] buffer;
+
+	buffer = pixels;
+	size = rowSize * height;
+	data = pixels;
+	alignment = 1;
+}
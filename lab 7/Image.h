@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Image Class
+//
+// Image.h: interface for the Image class.
+// This class decodes bitmap, targa, PNG, JPEG and PPM files
+// into memory so GLTexture and TextureBuilder can upload
+// them. It replaces auxDIBImageLoad from glaux, which only
+// exists on Windows. The whole file is read with one fread
+// and bitmaps and targas are decoded in place whenever the
+// layout allows it, so a bottom-up 24 bit bitmap costs no
+// more than a memcpy: the rows are already in the order
+// OpenGL wants and the only work left is swapping blue and
+// red, which is done with SSSE3 shuffles. PNG and JPEG files
+// are handed to PNGDecoder and JPEGDecoder.
+//
+// SavePNG() writes the pixels back out as a PNG, stored without
+// compression, which is all the screenshots need.
+//
+// Supported formats:
+// Bitmap: 24 and 32 bit, bottom-up and top-down
+// Targa:  24 and 32 bit, uncompressed or run length encoded, either origin
+// PNG:    see PNGDecoder.h
+// JPEG:   baseline and progressive, see JPEGDecoder.h
+// PPM:    binary (P6) with 8 bit samples
+//
+// Usage:
+// Image img;
+//
+// if (img.Load("texture.jpg"))
+// {
+//		glPixelStorei(GL_UNPACK_ALIGNMENT, img.alignment);
+//		glTexImage2D(GL_TEXTURE_2D, 0, img.channels, img.width, img.height, 0,
+//			img.channels == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, img.data);
+// }
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <string>
+
+class Image
+{
+public:
+	unsigned char *data;			// The RGB(A) pixels, bottom row first like OpenGL wants them
+	int width;						// Image's width
+	int height;						// Image's height
+	int channels;					// 3 for RGB, 4 for RGBA
+	int alignment;					// The rows start on multiples of this many bytes (1 or 4)
+	bool Load(const char *name);	// Loads a file, its first bytes say which decoder to use
+	bool LoadBMP(const char *name);	// Loads a bitmap file
+	bool LoadTGA(const char *name);	// Loads a targa file
+	bool LoadPNG(const char *name);	// Loads a PNG file
+	bool LoadJPG(const char *name);	// Loads a JPEG file
+	bool SavePNG(const char *name) const;	// Writes the pixels to a PNG file
+	bool DecodeBMP(const unsigned char *file, long size);	// Decodes a bitmap that is already in memory
+	bool DecodeTGA(const unsigned char *file, long size);	// Decodes a targa that is already in memory
+	bool Create(int w, int h, int c);	// Makes room for tightly packed pixels the caller fills in
+	void Free();					// Releases the pixels
+	Image();						// Constructor
+	virtual ~Image();				// Destructor
+
+	// Turns BGR(A) into RGB(A), src and dst may be the same
+	static void SwapRedBlue(unsigned char *dst, const unsigned char *src, int pixels, int channels);
+
+	// Reads the size of a file from its header, without decoding the pixels
+	static bool ReadSize(const char *name, int &w, int &h);
+
+	// The path of an existing file, matched without regard to case off Windows. Empty if there is none.
+	static std::string FindFile(const char *name);
+
+private:
+	unsigned char *buffer;			// The memory we own, data points somewhere inside of it
+	long size;						// Size of buffer
+
+	bool ReadFile(const char *name);	// Reads the whole file into buffer
+	bool DecodeBMP();				// Decodes buffer as a bitmap
+	bool DecodeTGA();				// Decodes buffer as a targa
+	bool DecodeTGARuns(const unsigned char *src, long length, bool topdown);	// Expands the packets of a run length encoded targa
+	bool DecodePNG();				// Decodes buffer as a PNG
+	bool DecodeJPG();				// Decodes buffer as a JPEG
+	bool DecodePPM();				// Decodes buffer as a binary PPM
+	void Take(unsigned char *&pixels, int w, int h, int c);	// Replaces buffer with a decoder's pixels
+	// Copies rows out of the file into a new tightly packed buffer, flipping and swapping as it goes
+	void CopyRows(const unsigned char *src, int stride, bool topdown, bool opaque);
+};
+
+#endif IMAGE_H
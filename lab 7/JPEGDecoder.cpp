@@ -0,0 +1,1016 @@
+//////////////////////////////////////////////////////////////////////
+//
+// JPEG Decoder Class
+//
+// JPEGDecoder.cpp: implementation of the JPEGDecoder class.
+// This class decodes a JPEG file that is already in memory
+// into RGB pixels for the Image class. Huffman codes up to
+// 9 bits are decoded with one table lookup, the IDCT is the
+// usual integer one that skips columns with no AC values,
+// and the color conversion is done in fixed point. Baseline
+// files are decoded a block at a time straight into the
+// color planes, progressive files collect their coefficients
+// over all of the scans first.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "JPEGDecoder.h"
+
+#include <string.h>
+#include <vector>
+
+// Codes up to this many bits are found with one table lookup
+#define FAST_BITS	9
+
+// Where the n-th coefficient of the zig-zag order goes in the block
+static const unsigned char dezigzag[64] = {
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+static unsigned char Clamp(int x)
+{
+	if ((unsigned int)x > 255)
+		return x < 0 ? 0 : 255;
+
+	return (unsigned char)x;
+}
+
+// The IDCT constants in 12 bit fixed point
+#define FIX(x)		((int)((x) * 4096 + 0.5))
+
+// One dimensional 8 point IDCT, leaves the even part in x0..x3 and the odd part in t0..t3
+#define IDCT_1D(s0, s1, s2, s3, s4, s5, s6, s7) \
+	int t0, t1, t2, t3, p1, p2, p3, p4, p5, x0, x1, x2, x3; \
+	p2 = s2; \
+	p3 = s6; \
+	p1 = (p2 + p3) * FIX(0.5411961f); \
+	t2 = p1 + p3 * FIX(-1.847759065f); \
+	t3 = p1 + p2 * FIX(0.765366865f); \
+	p2 = s0; \
+	p3 = s4; \
+	t0 = (p2 + p3) * 4096; \
+	t1 = (p2 - p3) * 4096; \
+	x0 = t0 + t3; \
+	x3 = t0 - t3; \
+	x1 = t1 + t2; \
+	x2 = t1 - t2; \
+	t0 = s7; \
+	t1 = s5; \
+	t2 = s3; \
+	t3 = s1; \
+	p3 = t0 + t2; \
+	p4 = t1 + t3; \
+	p1 = t0 + t3; \
+	p2 = t1 + t2; \
+	p5 = (p3 + p4) * FIX(1.175875602f); \
+	t0 = t0 * FIX(0.298631336f); \
+	t1 = t1 * FIX(2.053119869f); \
+	t2 = t2 * FIX(3.072711026f); \
+	t3 = t3 * FIX(1.501321110f); \
+	p1 = p5 + p1 * FIX(-0.899976223f); \
+	p2 = p5 + p2 * FIX(-2.562915447f); \
+	p3 = p3 * FIX(-1.961570560f); \
+	p4 = p4 * FIX(-0.390180644f); \
+	t3 += p1 + p4; \
+	t2 += p2 + p3; \
+	t1 += p2 + p4; \
+	t0 += p1 + p3;
+
+// Turns a block of dequantized coefficients into 8x8 samples
+static void IDCTBlock(const short *in, unsigned char *out, int stride)
+{
+	int temp[64];
+	int i;
+
+	// Columns
+	for (i = 0; i < 8; i++)
+	{
+		const short *d = in + i;
+		int *v = temp + i;
+
+		// Most columns have only a DC value
+		if (d[8] == 0 && d[16] == 0 && d[24] == 0 && d[32] == 0 && d[40] == 0 && d[48] == 0 && d[56] == 0)
+		{
+			int dc = d[0] * 4;
+			v[0] = v[8] = v[16] = v[24] = v[32] = v[40] = v[48] = v[56] = dc;
+			continue;
+		}
+
+		IDCT_1D(d[0], d[8], d[16], d[24], d[32], d[40], d[48], d[56])
+
+		// Round and keep 2 extra bits for the rows
+		x0 += 512;
+		x1 += 512;
+		x2 += 512;
+		x3 += 512;
+		v[0] = (x0 + t3) >> 10;
+		v[56] = (x0 - t3) >> 10;
+		v[8] = (x1 + t2) >> 10;
+		v[48] = (x1 - t2) >> 10;
+		v[16] = (x2 + t1) >> 10;
+		v[40] = (x2 - t1) >> 10;
+		v[24] = (x3 + t0) >> 10;
+		v[32] = (x3 - t0) >> 10;
+	}
+
+	// Rows
+	for (i = 0; i < 8; i++, out += stride)
+	{
+		const int *v = temp + i * 8;
+
+		IDCT_1D(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7])
+
+		// Round and add the 128 the encoder took off
+		x0 += 65536 + (128 << 17);
+		x1 += 65536 + (128 << 17);
+		x2 += 65536 + (128 << 17);
+		x3 += 65536 + (128 << 17);
+		out[0] = Clamp((x0 + t3) >> 17);
+		out[7] = Clamp((x0 - t3) >> 17);
+		out[1] = Clamp((x1 + t2) >> 17);
+		out[6] = Clamp((x1 - t2) >> 17);
+		out[2] = Clamp((x2 + t1) >> 17);
+		out[5] = Clamp((x2 - t1) >> 17);
+		out[3] = Clamp((x3 + t0) >> 17);
+		out[4] = Clamp((x3 - t0) >> 17);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+JPEGDecoder::JPEGDecoder()
+{
+	pixels = NULL;
+	width = 0;
+	height = 0;
+	channels = 3;
+	compCount = 0;
+
+	for (int i = 0; i < 3; i++)
+	{
+		comps[i].coefs = NULL;
+		comps[i].plane = NULL;
+	}
+}
+
+JPEGDecoder::~JPEGDecoder()
+{
+	Free();
+	delete [] pixels;
+}
+
+void JPEGDecoder::Free()
+{
+	for (int i = 0; i < 3; i++)
+	{
+		delete [] comps[i].coefs;
+		delete [] comps[i].plane;
+
+		comps[i].coefs = NULL;
+		comps[i].plane = NULL;
+	}
+}
+
+bool JPEGDecoder::Decode(const unsigned char *file, long size)
+{
+	if (size < 4 || file[0] != 0xFF || file[1] != 0xD8)
+		return false;
+
+	Free();
+
+	// Tables that are never defined decode as zeros instead of garbage
+	memset(huffman, 0, sizeof(huffman));
+	memset(quant, 0, sizeof(quant));
+
+	compCount = 0;
+	progressive = false;
+	rgb = false;
+	restartInterval = 0;
+
+	bool frame = false;
+
+	pos = file + 2;
+	end = file + size;
+
+	for (;;)
+	{
+		// Find the next marker
+		while (pos < end && *pos != 0xFF)
+			pos++;
+		while (pos < end && *pos == 0xFF)
+			pos++;
+
+		if (pos >= end)
+			break;
+
+		int marker = *pos++;
+
+		// End of image
+		if (marker == 0xD9)
+			break;
+
+		// Markers without a segment (and stray stuffed bytes)
+		if (marker == 0x00 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+			continue;
+
+		if (end - pos < 2)
+			break;
+
+		int length = (pos[0] << 8) | pos[1];
+
+		if (length < 2 || length > end - pos)
+			return false;
+
+		const unsigned char *data = pos + 2;
+		pos += length;
+		length -= 2;
+
+		switch (marker)
+		{
+		case 0xC0:	// Baseline
+		case 0xC1:	// Extended sequential
+		case 0xC2:	// Progressive
+			if (frame)
+				return false;
+
+			progressive = marker == 0xC2;
+
+			if (!ReadFrame(data, length))
+				return false;
+
+			frame = true;
+			break;
+
+		case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+		case 0xC9: case 0xCA: case 0xCB:
+		case 0xCD: case 0xCE: case 0xCF:
+			// Lossless, hierarchical and arithmetic coding aren't supported
+			return false;
+
+		case 0xC4:
+			if (!ReadHuffman(data, length))
+				return false;
+			break;
+
+		case 0xDB:
+			if (!ReadQuant(data, length))
+				return false;
+			break;
+
+		case 0xDD:
+			restartInterval = length >= 2 ? (data[0] << 8) | data[1] : 0;
+			break;
+
+		case 0xDA:
+			// The entropy coded data follows the scan header
+			if (!frame || !ReadScan(data, length) || !DecodeScan())
+				return false;
+			break;
+
+		case 0xEE:
+			// Adobe's marker says whether the components are YCbCr or RGB
+			if (length >= 12 && memcmp(data, "Adobe", 5) == 0)
+				rgb = data[11] == 0;
+			break;
+		}
+	}
+
+	if (!frame)
+		return false;
+
+	if (progressive)
+		Finish();
+
+	ConvertColor();
+	Free();
+
+	return true;
+}
+
+bool JPEGDecoder::ReadFrame(const unsigned char *data, int length)
+{
+	if (length < 6 || data[0] != 8)
+		return false;
+
+	height = (data[1] << 8) | data[2];
+	width = (data[3] << 8) | data[4];
+	compCount = data[5];
+
+	if (width == 0 || height == 0 || (compCount != 1 && compCount != 3) || length < 6 + compCount * 3)
+		return false;
+
+	hMax = 1;
+	vMax = 1;
+
+	for (int i = 0; i < compCount; i++)
+	{
+		Component &c = comps[i];
+		const unsigned char *p = data + 6 + i * 3;
+
+		c.id = p[0];
+		c.h = p[1] >> 4;
+		c.v = p[1] & 15;
+		c.quant = p[2];
+
+		if (c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4 || c.quant > 3)
+			return false;
+
+		if (c.h > hMax) hMax = c.h;
+		if (c.v > vMax) vMax = c.v;
+	}
+
+	// Components named R, G and B aren't YCbCr either
+	if (compCount == 3 && comps[0].id == 'R' && comps[1].id == 'G' && comps[2].id == 'B')
+		rgb = true;
+
+	mcusWide = (width + hMax * 8 - 1) / (hMax * 8);
+	mcusHigh = (height + vMax * 8 - 1) / (vMax * 8);
+
+	for (int i = 0; i < compCount; i++)
+	{
+		Component &c = comps[i];
+
+		// The chroma is upsampled by whole numbers
+		if (hMax % c.h != 0 || vMax % c.v != 0)
+			return false;
+
+		c.blocksWide = mcusWide * c.h;
+		c.blocksHigh = mcusHigh * c.v;
+		c.stride = c.blocksWide * 8;
+		c.plane = new unsigned char[(size_t)c.stride * c.blocksHigh * 8];
+
+		// Progressive scans add to the coefficients so they start at zero
+		if (progressive)
+		{
+			size_t count = (size_t)c.blocksWide * c.blocksHigh * 64;
+			c.coefs = new short[count];
+			memset(c.coefs, 0, count * sizeof(short));
+		}
+	}
+
+	return true;
+}
+
+bool JPEGDecoder::ReadHuffman(const unsigned char *data, int length)
+{
+	while (length > 17)
+	{
+		int tableClass = data[0] >> 4;
+		int id = data[0] & 15;
+
+		if (tableClass > 1 || id > 3)
+			return false;
+
+		Huffman &h = huffman[tableClass][id];
+		int count = 0;
+		int i, j, k;
+
+		for (i = 0; i < 16; i++)
+			count += data[1 + i];
+
+		if (count > 256 || 17 + count > length)
+			return false;
+
+		// The length of every code, shortest first
+		k = 0;
+
+		for (i = 0; i < 16; i++)
+		{
+			for (j = 0; j < data[1 + i]; j++)
+				h.size[k++] = (unsigned char)(i + 1);
+		}
+
+		h.size[k] = 0;
+
+		// Canonical codes: each length starts where the last one stopped
+		int code = 0;
+		k = 0;
+
+		for (j = 1; j <= 16; j++)
+		{
+			h.delta[j] = k - code;
+
+			if (h.size[k] == j)
+			{
+				while (h.size[k] == j)
+					h.code[k++] = (unsigned short)code++;
+
+				if (code - 1 >= (1 << j))
+					return false;
+			}
+
+			h.maxCode[j] = code << (16 - j);
+			code <<= 1;
+		}
+
+		h.maxCode[17] = 0xFFFFFFFF;
+
+		// Every table entry that starts with a short code decodes to it
+		memset(h.fast, 255, sizeof(h.fast));
+
+		for (i = 0; i < k; i++)
+		{
+			int s = h.size[i];
+
+			if (s <= FAST_BITS)
+			{
+				int first = h.code[i] << (FAST_BITS - s);
+
+				for (j = 0; j < (1 << (FAST_BITS - s)); j++)
+					h.fast[first + j] = (unsigned char)i;
+			}
+		}
+
+		memcpy(h.values, data + 17, count);
+
+		data += 17 + count;
+		length -= 17 + count;
+	}
+
+	return true;
+}
+
+bool JPEGDecoder::ReadQuant(const unsigned char *data, int length)
+{
+	while (length > 0)
+	{
+		int precision = data[0] >> 4;
+		int id = data[0] & 15;
+		int bytes = precision ? 129 : 65;
+
+		if (id > 3 || precision > 1 || length < bytes)
+			return false;
+
+		// The table is stored in zig-zag order
+		for (int i = 0; i < 64; i++)
+			quant[id][dezigzag[i]] = precision ? (unsigned short)((data[1 + i * 2] << 8) | data[2 + i * 2]) : data[1 + i];
+
+		data += bytes;
+		length -= bytes;
+	}
+
+	return true;
+}
+
+bool JPEGDecoder::ReadScan(const unsigned char *data, int length)
+{
+	scanCount = data[0];
+
+	if (length < 1 || scanCount < 1 || scanCount > compCount || length < 4 + scanCount * 2)
+		return false;
+
+	for (int i = 0; i < scanCount; i++)
+	{
+		int id = data[1 + i * 2];
+		int tables = data[2 + i * 2];
+		int c;
+
+		for (c = 0; c < compCount; c++)
+		{
+			if (comps[c].id == id)
+				break;
+		}
+
+		if (c == compCount || (tables >> 4) > 3 || (tables & 15) > 3)
+			return false;
+
+		comps[c].dcTable = tables >> 4;
+		comps[c].acTable = tables & 15;
+		scanComps[i] = c;
+	}
+
+	const unsigned char *p = data + 1 + scanCount * 2;
+
+	specStart = p[0];
+	specEnd = p[1];
+	succHigh = p[2] >> 4;
+	succLow = p[2] & 15;
+
+	if (progressive)
+	{
+		// DC and AC are never in the same scan, and AC scans have one component
+		if (specStart > specEnd || specEnd > 63 || succLow > 13)
+			return false;
+		if (specStart == 0 && specEnd != 0)
+			return false;
+		if (specStart != 0 && scanCount != 1)
+			return false;
+	}
+	else
+	{
+		specStart = 0;
+		specEnd = 63;
+	}
+
+	return true;
+}
+
+bool JPEGDecoder::DecodeScan()
+{
+	bitBuffer = 0;
+	bitCount = 0;
+	hitMarker = false;
+	eobRun = 0;
+
+	for (int i = 0; i < compCount; i++)
+		comps[i].dcPred = 0;
+
+	int done = 0;
+
+	if (scanCount == 1)
+	{
+		// A scan of one component only covers the blocks inside the image,
+		// every block is an MCU of its own
+		Component &c = comps[scanComps[0]];
+		int w = ((width * c.h + hMax - 1) / hMax + 7) / 8;
+		int h = ((height * c.v + vMax - 1) / vMax + 7) / 8;
+
+		for (int by = 0; by < h; by++)
+		{
+			for (int bx = 0; bx < w; bx++)
+			{
+				if (restartInterval && done > 0 && done % restartInterval == 0)
+					Restart();
+
+				if (!DecodeMCUBlock(c, bx, by))
+					return false;
+
+				done++;
+			}
+		}
+
+		return true;
+	}
+
+	for (int my = 0; my < mcusHigh; my++)
+	{
+		for (int mx = 0; mx < mcusWide; mx++)
+		{
+			if (restartInterval && done > 0 && done % restartInterval == 0)
+				Restart();
+
+			// Every component has h x v blocks in the MCU
+			for (int i = 0; i < scanCount; i++)
+			{
+				Component &c = comps[scanComps[i]];
+
+				for (int y = 0; y < c.v; y++)
+				{
+					for (int x = 0; x < c.h; x++)
+					{
+						if (!DecodeMCUBlock(c, mx * c.h + x, my * c.v + y))
+							return false;
+					}
+				}
+			}
+
+			done++;
+		}
+	}
+
+	return true;
+}
+
+bool JPEGDecoder::DecodeMCUBlock(Component &c, int bx, int by)
+{
+	if (!progressive)
+	{
+		short block[64];
+
+		if (!DecodeBlock(c, block))
+			return false;
+
+		IDCTBlock(block, c.plane + (long)by * 8 * c.stride + bx * 8, c.stride);
+		return true;
+	}
+
+	short *block = c.coefs + ((long)by * c.blocksWide + bx) * 64;
+
+	if (specStart == 0)
+		return DecodeDC(c, block);
+	if (succHigh == 0)
+		return DecodeACFirst(c, block);
+
+	return DecodeACRefine(c, block);
+}
+
+void JPEGDecoder::Restart()
+{
+	// Skip whatever is left of the bits and find the RST marker
+	while (end - pos >= 2 && !(pos[0] == 0xFF && pos[1] >= 0xD0 && pos[1] <= 0xD7))
+		pos++;
+
+	if (end - pos >= 2)
+		pos += 2;
+
+	bitBuffer = 0;
+	bitCount = 0;
+	hitMarker = false;
+	eobRun = 0;
+
+	for (int i = 0; i < compCount; i++)
+		comps[i].dcPred = 0;
+}
+
+bool JPEGDecoder::DecodeBlock(Component &c, short *block)
+{
+	const unsigned short *q = quant[c.quant];
+
+	memset(block, 0, 64 * sizeof(short));
+
+	// The DC value is coded as the difference to the last one
+	int t = DecodeHuffman(huffman[0][c.dcTable]);
+
+	if (t < 0 || t > 15)
+		return false;
+
+	c.dcPred += Receive(t);
+	block[0] = (short)(c.dcPred * q[0]);
+
+	Huffman &ac = huffman[1][c.acTable];
+
+	for (int k = 1; k < 64; )
+	{
+		int rs = DecodeHuffman(ac);
+
+		if (rs < 0)
+			return false;
+
+		int r = rs >> 4;
+		int s = rs & 15;
+
+		if (s == 0)
+		{
+			// End of block, or a run of 16 zeros
+			if (r != 15)
+				break;
+
+			k += 16;
+			continue;
+		}
+
+		k += r;
+
+		if (k > 63)
+			return false;
+
+		int z = dezigzag[k++];
+		block[z] = (short)(Receive(s) * q[z]);
+	}
+
+	return true;
+}
+
+bool JPEGDecoder::DecodeDC(Component &c, short *block)
+{
+	if (succHigh != 0)
+	{
+		// Refinement: one more bit of the DC value
+		if (GetBits(1))
+			block[0] = (short)(block[0] | (1 << succLow));
+
+		return true;
+	}
+
+	int t = DecodeHuffman(huffman[0][c.dcTable]);
+
+	if (t < 0 || t > 15)
+		return false;
+
+	c.dcPred += Receive(t);
+	block[0] = (short)(c.dcPred * (1 << succLow));
+
+	return true;
+}
+
+bool JPEGDecoder::DecodeACFirst(Component &c, short *block)
+{
+	// Still inside a run of empty blocks
+	if (eobRun > 0)
+	{
+		eobRun--;
+		return true;
+	}
+
+	Huffman &ac = huffman[1][c.acTable];
+
+	for (int k = specStart; k <= specEnd; )
+	{
+		int rs = DecodeHuffman(ac);
+
+		if (rs < 0)
+			return false;
+
+		int r = rs >> 4;
+		int s = rs & 15;
+
+		if (s == 0)
+		{
+			if (r < 15)
+			{
+				// This block and the next eobRun blocks are done
+				eobRun = (1 << r) - 1;
+
+				if (r)
+					eobRun += GetBits(r);
+
+				break;
+			}
+
+			k += 16;
+			continue;
+		}
+
+		k += r;
+
+		if (k > 63)
+			return false;
+
+		block[dezigzag[k++]] = (short)(Receive(s) * (1 << succLow));
+	}
+
+	return true;
+}
+
+bool JPEGDecoder::DecodeACRefine(Component &c, short *block)
+{
+	int bit = 1 << succLow;
+
+	if (eobRun > 0)
+	{
+		// Inside a run of blocks with no new values, only the old ones get a bit
+		eobRun--;
+
+		for (int k = specStart; k <= specEnd; k++)
+		{
+			short *p = &block[dezigzag[k]];
+
+			if (*p != 0 && GetBits(1) && (*p & bit) == 0)
+				*p = (short)(*p > 0 ? *p + bit : *p - bit);
+		}
+
+		return true;
+	}
+
+	Huffman &ac = huffman[1][c.acTable];
+	int k = specStart;
+
+	do
+	{
+		int rs = DecodeHuffman(ac);
+
+		if (rs < 0)
+			return false;
+
+		int r = rs >> 4;
+		int s = rs & 15;
+
+		if (s == 0)
+		{
+			if (r < 15)
+			{
+				eobRun = (1 << r) - 1;
+
+				if (r)
+					eobRun += GetBits(r);
+
+				// Refine the rest of the block and stop
+				r = 64;
+			}
+			// Otherwise r = 15 skips 16 zeros, the loop below does that
+		}
+		else
+		{
+			// A new value is always +-1 at this bit
+			if (s != 1)
+				return false;
+
+			s = GetBits(1) ? bit : -bit;
+		}
+
+		// Walk over r zero coefficients, refining the non zero ones on the way
+		while (k <= specEnd)
+		{
+			short *p = &block[dezigzag[k++]];
+
+			if (*p != 0)
+			{
+				if (GetBits(1) && (*p & bit) == 0)
+					*p = (short)(*p > 0 ? *p + bit : *p - bit);
+			}
+			else
+			{
+				if (r == 0)
+				{
+					*p = (short)s;
+					break;
+				}
+
+				r--;
+			}
+		}
+	} while (k <= specEnd);
+
+	return true;
+}
+
+void JPEGDecoder::Finish()
+{
+	short block[64];
+
+	// Dequantize every block and turn it into samples
+	for (int i = 0; i < compCount; i++)
+	{
+		Component &c = comps[i];
+		const unsigned short *q = quant[c.quant];
+
+		for (int by = 0; by < c.blocksHigh; by++)
+		{
+			for (int bx = 0; bx < c.blocksWide; bx++)
+			{
+				const short *coefs = c.coefs + ((long)by * c.blocksWide + bx) * 64;
+
+				for (int k = 0; k < 64; k++)
+					block[k] = (short)(coefs[k] * q[k]);
+
+				IDCTBlock(block, c.plane + (long)by * 8 * c.stride + bx * 8, c.stride);
+			}
+		}
+	}
+}
+
+void JPEGDecoder::ConvertColor()
+{
+	delete [] pixels;
+	pixels = new unsigned char[(size_t)width * height * 3];
+
+	// Rows of the chroma planes stretched to the full width
+	std::vector<unsigned char> stretched[3];
+
+	for (int i = 1; i < compCount; i++)
+	{
+		if (comps[i].h != hMax)
+			stretched[i].resize(width);
+	}
+
+	for (int y = 0; y < height; y++)
+	{
+		// OpenGL wants the bottom row first
+		unsigned char *dest = pixels + (long)(height - 1 - y) * width * 3;
+		const unsigned char *row[3];
+
+		for (int i = 0; i < compCount; i++)
+		{
+			Component &c = comps[i];
+			row[i] = c.plane + (long)(y / (vMax / c.v)) * c.stride;
+
+			if (!stretched[i].empty())
+			{
+				int scale = hMax / c.h;
+
+				for (int x = 0; x < width; x++)
+					stretched[i][x] = row[i][x / scale];
+
+				row[i] = &stretched[i][0];
+			}
+		}
+
+		if (compCount == 1)
+		{
+			for (int x = 0; x < width; x++, dest += 3)
+				dest[0] = dest[1] = dest[2] = row[0][x];
+		}
+		else if (rgb)
+		{
+			for (int x = 0; x < width; x++, dest += 3)
+			{
+				dest[0] = row[0][x];
+				dest[1] = row[1][x];
+				dest[2] = row[2][x];
+			}
+		}
+		else
+		{
+			// YCbCr to RGB in 16 bit fixed point
+			for (int x = 0; x < width; x++, dest += 3)
+			{
+				int l = (row[0][x] << 16) + 32768;
+				int cb = row[1][x] - 128;
+				int cr = row[2][x] - 128;
+
+				dest[0] = Clamp((l + 91881 * cr) >> 16);
+				dest[1] = Clamp((l - 22554 * cb - 46802 * cr) >> 16);
+				dest[2] = Clamp((l + 116130 * cb) >> 16);
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Entropy coded data
+//////////////////////////////////////////////////////////////////////
+
+void JPEGDecoder::FillBits()
+{
+	while (bitCount <= 24)
+	{
+		unsigned int byte = 0;
+
+		// After a marker the reader feeds zeros, the marker is left for Decode()
+		if (!hitMarker && pos < end)
+		{
+			byte = *pos++;
+
+			if (byte == 0xFF)
+			{
+				const unsigned char *next = pos;
+
+				while (next < end && *next == 0xFF)
+					next++;
+
+				// 0xFF 0x00 is a 0xFF in the data, anything else is a marker
+				if (next < end && *next == 0)
+					pos = next + 1;
+				else
+				{
+					hitMarker = true;
+					byte = 0;
+					pos = next - 1;
+				}
+			}
+		}
+
+		bitBuffer |= byte << (24 - bitCount);
+		bitCount += 8;
+	}
+}
+
+int JPEGDecoder::DecodeHuffman(Huffman &h)
+{
+	if (bitCount < 16)
+		FillBits();
+
+	int k = h.fast[bitBuffer >> (32 - FAST_BITS)];
+
+	if (k < 255)
+	{
+		int s = h.size[k];
+
+		bitBuffer <<= s;
+		bitCount -= s;
+
+		return h.values[k];
+	}
+
+	// A long code, compare it against the last code of every length
+	unsigned int top = bitBuffer >> 16;
+
+	for (k = FAST_BITS + 1; top >= h.maxCode[k]; k++)
+		;
+
+	if (k == 17)
+		return -1;
+
+	int index = ((bitBuffer >> (32 - k)) & ((1 << k) - 1)) + h.delta[k];
+
+	if (index < 0 || index > 255)
+		return -1;
+
+	bitBuffer <<= k;
+	bitCount -= k;
+
+	return h.values[index];
+}
+
+int JPEGDecoder::GetBits(int n)
+{
+	if (n == 0)
+		return 0;
+
+	if (bitCount < n)
+		FillBits();
+
+	int value = (int)(bitBuffer >> (32 - n));
+	bitBuffer <<= n;
+	bitCount -= n;
+
+	return value;
+}
+
+int JPEGDecoder::Receive(int n)
+{
+	if (n == 0)
+		return 0;
+
+	// The top bit is 0 for negative values
+	int value = GetBits(n);
+
+	if (value < (1 << (n - 1)))
+		value += 1 - (1 << n);
+
+	return value;
+}
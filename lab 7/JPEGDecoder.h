@@ -0,0 +1,116 @@
+//////////////////////////////////////////////////////////////////////
+//
+// JPEG Decoder Class
+//
+// JPEGDecoder.h: interface for the JPEGDecoder class.
+// This class decodes a JPEG file that is already in memory
+// into RGB pixels for the Image class. Huffman codes up to
+// 9 bits are decoded with one table lookup, the IDCT is the
+// usual integer one that skips columns with no AC values,
+// and the color conversion is done in fixed point. Baseline
+// files are decoded a block at a time straight into the
+// color planes, progressive files collect their coefficients
+// over all of the scans first.
+//
+// Supported formats:
+// Baseline and progressive Huffman coded files with 1 (gray)
+// or 3 (YCbCr or RGB) components, any chroma subsampling and
+// restart markers.
+//
+// Usage:
+// JPEGDecoder jpeg;
+//
+// if (jpeg.Decode(file, size))
+// {
+//		// jpeg.pixels is jpeg.width * jpeg.height * 3 bytes,
+//		// allocated with new[], take them or let the destructor free them
+// }
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef JPEGDECODER_H
+#define JPEGDECODER_H
+
+class JPEGDecoder
+{
+public:
+	unsigned char *pixels;			// The decoded RGB pixels, bottom row first
+	int width;						// Image's width
+	int height;						// Image's height
+	int channels;					// Always 3
+	bool Decode(const unsigned char *file, long size);	// Decodes a whole JPEG file
+	JPEGDecoder();					// Constructor
+	virtual ~JPEGDecoder();			// Destructor
+
+private:
+	// A Huffman table from a DHT segment
+	struct Huffman
+	{
+		unsigned char fast[1 << 9];		// Index of the symbol for the short codes, 255 if the code is longer
+		unsigned short code[256];		// The code of every symbol
+		unsigned char size[257];		// The length of every symbol's code
+		unsigned char values[256];		// The symbols
+		unsigned int maxCode[18];		// One past the last code of every length (left aligned to 16 bits)
+		int delta[17];					// Turns a code into an index into values
+	};
+
+	// One color component
+	struct Component
+	{
+		int id;							// The id the scans refer to it by
+		int h, v;						// Sampling factors
+		int quant;						// Quantization table
+		int dcTable, acTable;			// Huffman tables of the current scan
+		int blocksWide, blocksHigh;		// Size in blocks, padded to whole MCUs
+		int dcPred;						// The last DC value
+		short *coefs;					// All coefficients (progressive only)
+		unsigned char *plane;			// The decoded samples
+		int stride;						// Bytes per row of the plane
+	};
+
+	Huffman huffman[2][4];				// DC and AC tables
+	unsigned short quant[4][64];		// Quantization tables in natural order
+	Component comps[3];					// The components of the frame
+	int compCount;						// Number of components
+	int hMax, vMax;						// Largest sampling factors
+	int mcusWide, mcusHigh;				// Size of the image in MCUs
+	bool progressive;					// True for SOF2 files
+	bool rgb;							// True if an Adobe marker says there is no color transform
+	int restartInterval;				// MCUs between restart markers, 0 for none
+	int eobRun;							// Progressive: blocks left in an end of band run
+
+	// Scan state
+	int scanComps[3];					// The components of the scan
+	int scanCount;						// Number of components in the scan
+	int specStart, specEnd;				// Progressive: the band of coefficients
+	int succHigh, succLow;				// Progressive: successive approximation bits
+
+	// Entropy coded data reader
+	const unsigned char *pos;			// The next byte
+	const unsigned char *end;			// The end of the file
+	unsigned int bitBuffer;				// Bits read but not used yet, first bit in bit 31
+	int bitCount;						// Number of bits in bitBuffer
+	bool hitMarker;						// True once the reader ran into a marker
+
+	bool ReadFrame(const unsigned char *data, int length);	// SOF
+	bool ReadHuffman(const unsigned char *data, int length);	// DHT
+	bool ReadQuant(const unsigned char *data, int length);	// DQT
+	bool ReadScan(const unsigned char *data, int length);		// SOS header
+	bool DecodeScan();					// The entropy coded data after a SOS
+	bool DecodeBlock(Component &c, short *block);			// Baseline block
+	bool DecodeDC(Component &c, short *block);				// Progressive DC scans
+	bool DecodeACFirst(Component &c, short *block);			// Progressive first AC scans
+	bool DecodeACRefine(Component &c, short *block);		// Progressive AC refinement scans
+	bool DecodeMCUBlock(Component &c, int bx, int by);		// Decodes one block of a scan
+	void Restart();						// Skips over a restart marker and resets the predictors
+	void Finish();						// Progressive: turns the coefficients into samples
+	void ConvertColor();				// Upsamples and converts the planes into pixels
+	void Free();						// Releases the planes and coefficients
+
+	void FillBits();					// Tops up the bit buffer
+	int DecodeHuffman(Huffman &h);		// Reads one Huffman coded symbol, -1 on bad data
+	int GetBits(int n);					// Reads n bits as an unsigned value
+	int Receive(int n);					// Reads n bits as a signed value
+};
+
+#endif JPEGDECODER_H
@@ -0,0 +1,386 @@
+//////////////////////////////////////////////////////////////////////
+//
+// KTX File Class
+//
+// KTXFile.cpp: implementation of the KTXFile class.
+// This class reads and writes KTX 1.1 files, the Khronos
+// container for textures that are ready to be handed to
+// OpenGL as they are. We use it for the block compressed
+// textures TextureCompressor bakes and for the plain RGB(A)
+// mipmaps MipmapGenerator makes: one 2D texture with
+// all of its mipmap levels, stored in the byte order of
+// the machine that wrote it.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "KTXFile.h"
+#include "glew.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static const unsigned char identifier[12] = {
+	0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// The header after the identifier, all 32 bit words
+struct KTXHeader
+{
+	unsigned int endianness;
+	unsigned int glType;
+	unsigned int glTypeSize;
+	unsigned int glFormat;
+	unsigned int glInternalFormat;
+	unsigned int glBaseInternalFormat;
+	unsigned int pixelWidth;
+	unsigned int pixelHeight;
+	unsigned int pixelDepth;
+	unsigned int numberOfArrayElements;
+	unsigned int numberOfFaces;
+	unsigned int numberOfMipmapLevels;
+	unsigned int bytesOfKeyValueData;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+KTXFile::KTXFile()
+{
+	Free();
+}
+
+KTXFile::~KTXFile()
+{
+
+}
+
+void KTXFile::Free()
+{
+	format = 0;
+	baseFormat = 0;
+	type = 0;
+	width = 0;
+	height = 0;
+	levels = 0;
+
+	memset(data, 0, sizeof(data));
+	memset(size, 0, sizeof(size));
+
+	std::vector<unsigned char>().swap(storage);
+	mapped.Close();
+}
+
+int KTXFile::BlockBytes(unsigned int format)
+{
+	switch (format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		return 8;
+
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return 16;
+	}
+
+	return 0;
+}
+
+int KTXFile::PixelBytes(unsigned int format)
+{
+	switch (format)
+	{
+	case GL_RGB:
+	case GL_RGB8:
+		return 3;
+
+	case GL_RGBA:
+	case GL_RGBA8:
+		return 4;
+	}
+
+	return 0;
+}
+
+bool KTXFile::Compressed()
+{
+	return type == 0;
+}
+
+int KTXFile::LevelBytes(int level)
+{
+	// Every compressed level is a whole number of 4x4 blocks, small levels are padded
+	if (Compressed())
+		return ((LevelWidth(level) + 3) / 4) * ((LevelHeight(level) + 3) / 4) * BlockBytes(format);
+
+	return RowBytes(level) * LevelHeight(level);
+}
+
+int KTXFile::RowBytes(int level)
+{
+	// Uncompressed rows start on 4 byte boundaries like GL_UNPACK_ALIGNMENT 4
+	return (LevelWidth(level) * PixelBytes(format) + 3) & ~3;
+}
+
+int KTXFile::LevelWidth(int level)
+{
+	int w = width >> level;
+	return w > 0 ? w : 1;
+}
+
+int KTXFile::LevelHeight(int level)
+{
+	int h = height >> level;
+	return h > 0 ? h : 1;
+}
+
+int KTXFile::Bytes()
+{
+	int total = 0;
+
+	for (int i = 0; i < levels; i++)
+		total += size[i];
+
+	return total;
+}
+
+int KTXFile::LevelFor(int maxSize)
+{
+	int level = 0;
+
+	// Always keep the 1x1 level
+	while (maxSize > 0 && level < levels - 1 && (LevelWidth(level) > maxSize || LevelHeight(level) > maxSize))
+		level++;
+
+	return level;
+}
+
+int KTXFile::Shrink(int maxSize)
+{
+	int drop = LevelFor(maxSize);
+
+	if (drop == 0)
+		return 0;
+
+	// The levels stay where they are in memory, only the numbering moves
+	int w = LevelWidth(drop);
+	int h = LevelHeight(drop);
+
+	for (int i = 0; i + drop < levels; i++)
+	{
+		data[i] = data[i + drop];
+		size[i] = size[i + drop];
+	}
+
+	for (int i = levels - drop; i < levels; i++)
+	{
+		data[i] = NULL;
+		size[i] = 0;
+	}
+
+	width = w;
+	height = h;
+	levels -= drop;
+
+	return drop;
+}
+
+unsigned char *KTXFile::Create(unsigned int _format, unsigned int _baseFormat, int _width, int _height, int _levels)
+{
+	int block = BlockBytes(_format);
+	int pixel = PixelBytes(_format);
+
+	Free();
+
+	if ((block == 0 && pixel == 0) || _levels < 1 || _levels > KTX_MAX_LEVELS)
+		return NULL;
+
+	format = _format;
+	baseFormat = _baseFormat;
+	type = block == 0 ? GL_UNSIGNED_BYTE : 0;
+	width = _width;
+	height = _height;
+	levels = _levels;
+
+	int total = 0;
+
+	for (int i = 0; i < levels; i++)
+	{
+		size[i] = LevelBytes(i);
+		total += size[i];
+	}
+
+	storage.resize(total);
+
+	// The levels follow each other in the storage
+	unsigned char *p = &storage[0];
+
+	for (int i = 0; i < levels; i++)
+	{
+		data[i] = p;
+		p += size[i];
+	}
+
+	return &storage[0];
+}
+
+bool KTXFile::Load(const char *name)
+{
+	MappedFile file;
+
+	if (!file.Open(name) || !Parse(file.data, file.length))
+		return false;
+
+	// Parse() points into the file, keep it mapped
+	mapped.Swap(file);
+
+	return true;
+}
+
+bool KTXFile::Parse(const unsigned char *file, long length)
+{
+	Free();
+
+	if (length < (long)(sizeof(identifier) + sizeof(KTXHeader)) || memcmp(file, identifier, sizeof(identifier)) != 0)
+		return false;
+
+	KTXHeader header;
+	memcpy(&header, file + sizeof(identifier), sizeof(header));
+
+	// We only read files written in our own byte order
+	if (header.endianness != 0x04030201)
+		return false;
+
+	// One 2D texture, nothing else
+	if (header.pixelDepth != 0 || header.numberOfArrayElements != 0 || header.numberOfFaces != 1)
+		return false;
+
+	// No bigger than the cards take, that also keeps the level sizes in an int
+	if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelWidth > 16384 || header.pixelHeight > 16384 || header.numberOfMipmapLevels > KTX_MAX_LEVELS)
+		return false;
+
+	// Uncompressed textures have to be bytes in a format we know
+	if (header.glType != 0 && (header.glType != GL_UNSIGNED_BYTE || PixelBytes(header.glInternalFormat) == 0))
+		return false;
+
+	// Compressed ones have to be blocks we know the size of
+	if (header.glType == 0 && BlockBytes(header.glInternalFormat) == 0)
+		return false;
+
+	format = header.glInternalFormat;
+	baseFormat = header.glBaseInternalFormat;
+	type = header.glType;
+	width = header.pixelWidth;
+	height = header.pixelHeight;
+	levels = header.numberOfMipmapLevels > 0 ? header.numberOfMipmapLevels : 1;
+
+	const unsigned char *p = file + sizeof(identifier) + sizeof(header) + header.bytesOfKeyValueData;
+	const unsigned char *end = file + length;
+
+	for (int i = 0; i < levels; i++)
+	{
+		unsigned int imageSize;
+
+		if (end - p < 4)
+			return false;
+
+		memcpy(&imageSize, p, 4);
+		p += 4;
+
+		if (imageSize > (unsigned int)(end - p))
+			return false;
+
+		// A short level would have GL read past it
+		if (imageSize < (unsigned int)LevelBytes(i))
+			return false;
+
+		data[i] = p;
+		size[i] = imageSize;
+
+		// Levels start on 4 byte boundaries
+		p += (imageSize + 3) & ~3u;
+	}
+
+	return true;
+}
+
+bool KTXFile::Save(const char *name)
+{
+	if (levels == 0)
+		return false;
+
+	KTXHeader header;
+
+	header.endianness = 0x04030201;
+	header.glType = type;					// Compressed formats have no type
+	header.glTypeSize = 1;
+	header.glFormat = type != 0 ? baseFormat : 0;
+	header.glInternalFormat = format;
+	header.glBaseInternalFormat = baseFormat;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = 0;
+	header.numberOfFaces = 1;
+	header.numberOfMipmapLevels = levels;
+	header.bytesOfKeyValueData = 0;
+
+	// Somebody may have the old file mapped, so the new one is written
+	// next to it and takes its name once it is complete
+	std::string temp = std::string(name) + ".tmp";
+	FILE *file = fopen(temp.c_str(), "wb");
+
+	if (file == NULL)
+		return false;
+
+	static const unsigned char padding[3] = { 0, 0, 0 };
+	bool written = fwrite(identifier, sizeof(identifier), 1, file) == 1 && fwrite(&header, sizeof(header), 1, file) == 1;
+
+	for (int i = 0; written && i < levels; i++)
+	{
+		unsigned int imageSize = size[i];
+
+		written = fwrite(&imageSize, 4, 1, file) == 1 && fwrite(data[i], 1, size[i], file) == (size_t)size[i];
+
+		if (written && (size[i] & 3))
+			written = fwrite(padding, 1, 4 - (size[i] & 3), file) == (size_t)(4 - (size[i] & 3));
+	}
+
+	fclose(file);
+
+#ifdef _WIN32
+	// rename() doesn't replace files on Windows, and removing the old one first
+	// would leave nothing there if the move failed
+	if (written && !MoveFileExA(temp.c_str(), name, MOVEFILE_REPLACE_EXISTING))
+		written = false;
+#else
+	if (written && rename(temp.c_str(), name) != 0)
+		written = false;
+#endif
+
+	// Don't leave half a file behind
+	if (!written)
+		remove(temp.c_str());
+
+	return written;
+}
+
+void KTXFile::Upload()
+{
+	for (int i = 0; i < levels; i++)
+	{
+		if (Compressed())
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, format, LevelWidth(i), LevelHeight(i), 0, size[i], data[i]);
+		else
+			glTexImage2D(GL_TEXTURE_2D, i, format, LevelWidth(i), LevelHeight(i), 0, baseFormat, type, data[i]);
+	}
+
+	// Don't let OpenGL wait for levels we don't have, nor keep drawing with fewer than it has
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+}
@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////
+//
+// KTX File Class
+//
+// KTXFile.h: interface for the KTXFile class.
+// This class reads and writes KTX 1.1 files, the Khronos
+// container for textures that are ready to be handed to
+// OpenGL as they are. We use it for the block compressed
+// textures TextureCompressor bakes and for the plain RGB(A)
+// mipmaps MipmapGenerator makes: one 2D texture with
+// all of its mipmap levels, stored in the byte order of
+// the machine that wrote it.
+//
+// Load() maps the file instead of reading it, the levels point
+// into the mapping and Upload() hands them to OpenGL from there.
+//
+// Usage:
+// KTXFile ktx;
+//
+// if (ktx.Load("texture.jpg.ktx"))
+// {
+//		glBindTexture(GL_TEXTURE_2D, id);
+//		ktx.Upload();			// Every level into the bound texture
+// }
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef KTXFILE_H
+#define KTXFILE_H
+
+#include "MappedFile.h"
+
+#include <vector>
+
+// Enough levels for a 32768x32768 texture
+#define KTX_MAX_LEVELS	16
+
+class KTXFile
+{
+public:
+	unsigned int format;						// glInternalFormat, e.g. GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+	unsigned int baseFormat;					// glBaseInternalFormat, GL_RGB or GL_RGBA
+	unsigned int type;							// glType, GL_UNSIGNED_BYTE or 0 if the texture is compressed
+	int width;									// Width of level 0
+	int height;									// Height of level 0
+	int levels;									// Number of mipmap levels
+	const unsigned char *data[KTX_MAX_LEVELS];	// The bytes of every level
+	int size[KTX_MAX_LEVELS];					// The size of every level in bytes
+	bool Load(const char *name);				// Maps a file
+	bool Parse(const unsigned char *file, long length);	// Reads a file that is already in memory (it has to stay there)
+	bool Save(const char *name);				// Writes a file
+	unsigned char *Create(unsigned int format, unsigned int baseFormat, int width, int height, int levels);	// Makes room for a texture, returns where level 0 goes
+	void Upload();								// Sends every level to the bound GL_TEXTURE_2D
+	int LevelWidth(int level);					// Width of a mipmap level
+	int LevelHeight(int level);					// Height of a mipmap level
+	int LevelBytes(int level);					// Bytes a mipmap level takes, without the padding between levels
+	int Bytes();								// Size of all levels together
+	int LevelFor(int maxSize);					// The first level no bigger than maxSize on a side (the 1x1 one at most), 0 for no limit
+	int Shrink(int maxSize);					// Drops the levels bigger than maxSize on a side (the next is level 0 now), returns how many
+	void Free();								// Forgets the texture
+	int RowBytes(int level);					// Bytes from one row of an uncompressed level to the next
+	bool Compressed();							// True for block compressed textures
+	static int BlockBytes(unsigned int format);	// Bytes per 4x4 block of a compressed format, 0 if we don't know it
+	static int PixelBytes(unsigned int format);	// Bytes per pixel of an uncompressed format, 0 if we don't know it
+	KTXFile();									// Constructor
+	virtual ~KTXFile();							// Destructor
+
+private:
+	std::vector<unsigned char> storage;			// The memory we own
+	MappedFile mapped;							// The file Load() mapped, the levels point into it
+};
+
+#endif KTXFILE_H
@@ -0,0 +1,401 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Light Clusters Class
+//
+// LightClusters.cpp: implementation of the LightClusters class.
+// The grid lines across the screen are planes through the eye,
+// taken from the projection matrix the way Frustum takes its
+// planes, and normalized so the distance of a light from one
+// can be compared with its radius. A light reaches a column if
+// its sphere is partly right of the column's left line and
+// partly left of its right line, the same for the rows. The
+// depths are cut up evenly in log(depth), everything nearer
+// than FIRST_SLICE in the first slice.
+//
+// A light that reaches behind the near plane is put in every
+// column and row of its slices, the planes can't tell which
+// side of the screen the part in front of the camera is on.
+//
+// The clusters are sent as an offset and count into one list of
+// light numbers, the lights as three texels each in eye space:
+// the position and radius, the color and the cosine the spot
+// fades out at, the direction and the cosine it is full at.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "LightClusters.h"
+#include "Simd.h"
+#include "glew.h"
+
+#include <math.h>
+#include <vector>
+
+#define COLUMNS				16
+#define ROWS				9
+#define SLICES				24
+#define CLUSTERS			(COLUMNS * ROWS * SLICES)
+#define FIRST_SLICE			50.0f					// The depth the second slice starts at
+
+struct Light
+{
+	float position[3];
+	float radius;
+	float color[3];
+	float direction[3];								// Along the spot, 0 for a point light
+	float cosInner;									// -1 and -2 for a point light, lit all round
+	float cosOuter;
+};
+
+// The clusters block, laid out the way std140 lays it out
+struct ClusterBlock
+{
+	float scale[4];									// Columns a pixel, rows a pixel, slices a unit of log(depth), log(FIRST_SLICE)
+	int count[4];									// Columns, rows, slices and lights
+};
+
+static std::vector<Light> lights;
+static int visible = 0;
+static int assigned = 0;
+
+// The grid lines, one more than the columns and rows
+static float columnX[COLUMNS + 1], columnZ[COLUMNS + 1];
+static float rowY[ROWS + 1], rowZ[ROWS + 1];
+
+static std::vector<unsigned int> grid;				// Offset and count, a pair a cluster
+static std::vector<unsigned short> list;			// The light numbers of every cluster, one after the other
+static std::vector<float> eyeLights;				// Three texels a light
+static std::vector<int> boxes;						// The first and last column, row and slice of each light, -1 if none
+
+static GLuint buffers[3] = { 0, 0, 0 };				// The grid, the list and the lights
+static GLuint textures[3] = { 0, 0, 0 };
+static GLuint blockBuffer = 0;
+
+// The grid lines a sphere reaches past, each way: bit k of positive is set if part of it is
+// on the positive side of line k, of negative if part of it is on the other
+static void Reach(const float *a, const float *b, int lines, float u, float z, float radius,
+	unsigned int &positive, unsigned int &negative)
+{
+	positive = negative = 0;
+	int k = 0;
+
+#ifdef SIMD_SSE2
+	const __m128 pu = _mm_set1_ps(u);
+	const __m128 pz = _mm_set1_ps(z);
+	const __m128 above = _mm_set1_ps(radius);
+	const __m128 below = _mm_set1_ps(-radius);
+
+	for (; k + 4 <= lines; k += 4)
+	{
+		__m128 distance = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + k), pu), _mm_mul_ps(_mm_loadu_ps(b + k), pz));
+
+		positive |= (unsigned int)_mm_movemask_ps(_mm_cmpgt_ps(distance, below)) << k;
+		negative |= (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(distance, above)) << k;
+	}
+#endif
+
+	for (; k < lines; k++)
+	{
+		float distance = a[k] * u + b[k] * z;
+
+		if (distance > -radius)
+			positive |= 1u << k;
+		if (distance < radius)
+			negative |= 1u << k;
+	}
+}
+
+// The first and last of the cells a sphere reaches, false if it reaches none
+static bool Span(unsigned int positive, unsigned int negative, int cells, int &first, int &last)
+{
+	// In cell c if it is past line c one way and line c + 1 the other
+	unsigned int in = positive & (negative >> 1) & ((1u << cells) - 1);
+
+	if (in == 0)
+		return false;
+
+	for (first = 0; !(in & (1u << first)); first++);
+	for (last = cells - 1; !(in & (1u << last)); last--);
+
+	return true;
+}
+
+static int Slice(float depth, float scale)
+{
+	if (depth <= FIRST_SLICE)
+		return 0;
+
+	int slice = (int)(log(depth / FIRST_SLICE) * scale);
+
+	return slice < SLICES ? slice : SLICES - 1;
+}
+
+// Makes the buffers and textures the first time
+static void Create()
+{
+	if (blockBuffer != 0)
+		return;
+
+	static const GLenum formats[3] = { GL_RG32UI, GL_R16UI, GL_RGBA32F };
+
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+	glGenBuffers(1, &blockBuffer);
+
+	// A texture reads whatever its buffer holds at the time
+	for (int i = 0; i < 3; i++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// No lights until the first Build()
+	ClusterBlock block = { { 0.0f, 0.0f, 0.0f, 0.0f }, { COLUMNS, ROWS, SLICES, 0 } };
+
+	glBindBuffer(GL_UNIFORM_BUFFER, blockBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// A new store each time, the card may still be reading the last one
+static void Upload(int i, const void *data, size_t size)
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+	glBufferData(GL_TEXTURE_BUFFER, size > 0 ? size : 16, size > 0 ? data : NULL, GL_STREAM_DRAW);
+}
+
+void LightClusters::Clear()
+{
+	lights.clear();
+}
+
+bool LightClusters::AddPoint(const float *position, float radius, const float *color)
+{
+	static const float none[3] = { 0.0f, 0.0f, 0.0f };
+
+	return AddSpot(position, radius, color, none, 360.0f, 360.0f);
+}
+
+bool LightClusters::AddSpot(const float *position, float radius, const float *color, const float *direction,
+	float inner, float outer)
+{
+	if ((int)lights.size() >= MAX_LIGHTS)
+		return false;
+
+	Light light;
+	float length = (float)sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+
+	for (int i = 0; i < 3; i++)
+	{
+		light.position[i] = position[i];
+		light.color[i] = color[i];
+		light.direction[i] = length > 0.0f ? direction[i] / length : 0.0f;
+	}
+
+	light.radius = radius;
+
+	// All round, the shader's smoothstep(cosOuter, cosInner, ...) is 1 for every direction
+	if (length == 0.0f || outer >= 180.0f)
+	{
+		light.cosInner = -1.0f;
+		light.cosOuter = -2.0f;
+	}
+	else
+	{
+		light.cosInner = (float)cos(inner * 3.14159265 / 180.0);
+		light.cosOuter = (float)cos(outer * 3.14159265 / 180.0);
+	}
+
+	lights.push_back(light);
+	return true;
+}
+
+void LightClusters::Build(const float *view, const float *projection, int width, int height)
+{
+	// The near and far planes from the depth terms of the projection
+	float zNear = projection[14] / (projection[10] - 1.0f);
+	float zFar = projection[14] / (projection[10] + 1.0f);
+	float scale = SLICES / (float)log(zFar / FIRST_SLICE);
+
+	// Line k is where x on the screen is -1 + 2k / COLUMNS, y the same for the rows
+	for (int k = 0; k <= COLUMNS; k++)
+	{
+		float x = projection[0];
+		float z = projection[8] - 1.0f + 2.0f * k / COLUMNS;
+		float length = (float)sqrt(x*x + z*z);
+
+		columnX[k] = x / length;
+		columnZ[k] = z / length;
+	}
+
+	for (int k = 0; k <= ROWS; k++)
+	{
+		float y = projection[5];
+		float z = projection[9] - 1.0f + 2.0f * k / ROWS;
+		float length = (float)sqrt(y*y + z*z);
+
+		rowY[k] = y / length;
+		rowZ[k] = z / length;
+	}
+
+	int count = (int)lights.size();
+
+	grid.assign(CLUSTERS * 2, 0);
+	boxes.assign(count * 6, -1);
+	eyeLights.resize(count * 12);
+	visible = 0;
+
+	// Count the lights of each cluster
+	for (int i = 0; i < count; i++)
+	{
+		const Light &light = lights[i];
+		float *eye = &eyeLights[i * 12];
+
+		for (int r = 0; r < 3; r++)
+		{
+			eye[r] = view[r] * light.position[0] + view[4 + r] * light.position[1] + view[8 + r] * light.position[2] + view[12 + r];
+			eye[8 + r] = view[r] * light.direction[0] + view[4 + r] * light.direction[1] + view[8 + r] * light.direction[2];
+			eye[4 + r] = light.color[r];
+		}
+
+		eye[3] = light.radius;
+		eye[7] = light.cosOuter;
+		eye[11] = light.cosInner;
+
+		float x = eye[0], y = eye[1], z = eye[2];
+		float radius = light.radius;
+
+		// Wholly behind the near plane or past the far one
+		if (z - radius > -zNear || z + radius < -zFar)
+			continue;
+
+		int *box = &boxes[i * 6];
+
+		if (z + radius > -zNear)
+		{
+			box[0] = 0;
+			box[1] = COLUMNS - 1;
+			box[2] = 0;
+			box[3] = ROWS - 1;
+		}
+		else
+		{
+			unsigned int positive, negative;
+
+			Reach(columnX, columnZ, COLUMNS + 1, x, z, radius, positive, negative);
+
+			if (!Span(positive, negative, COLUMNS, box[0], box[1]))
+				continue;
+
+			Reach(rowY, rowZ, ROWS + 1, y, z, radius, positive, negative);
+
+			if (!Span(positive, negative, ROWS, box[2], box[3]))
+			{
+				box[0] = -1;
+				continue;
+			}
+		}
+
+		box[4] = Slice(-z - radius, scale);
+		box[5] = Slice(-z + radius, scale);
+		visible++;
+
+		for (int s = box[4]; s <= box[5]; s++)
+			for (int r = box[2]; r <= box[3]; r++)
+				for (int c = box[0]; c <= box[1]; c++)
+					grid[((s * ROWS + r) * COLUMNS + c) * 2 + 1]++;
+	}
+
+	// Each cluster's part of the list starts where the one before ends
+	assigned = 0;
+
+	for (int c = 0; c < CLUSTERS; c++)
+	{
+		grid[c * 2] = assigned;
+		assigned += grid[c * 2 + 1];
+		grid[c * 2 + 1] = 0;
+	}
+
+	list.resize(assigned);
+
+	for (int i = 0; i < count; i++)
+	{
+		const int *box = &boxes[i * 6];
+
+		if (box[0] < 0)
+			continue;
+
+		for (int s = box[4]; s <= box[5]; s++)
+		{
+			for (int r = box[2]; r <= box[3]; r++)
+			{
+				for (int c = box[0]; c <= box[1]; c++)
+				{
+					unsigned int *cluster = &grid[((s * ROWS + r) * COLUMNS + c) * 2];
+
+					list[cluster[0] + cluster[1]++] = (unsigned short)i;
+				}
+			}
+		}
+	}
+
+	// Only the SceneShader reads them, and it needs 3.3
+	if (!GLEW_VERSION_3_3)
+		return;
+
+	Create();
+
+	Upload(0, &grid[0], grid.size() * sizeof(unsigned int));
+	Upload(1, list.empty() ? NULL : &list[0], list.size() * sizeof(unsigned short));
+	Upload(2, eyeLights.empty() ? NULL : &eyeLights[0], eyeLights.size() * sizeof(float));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	ClusterBlock block;
+
+	block.scale[0] = (float)COLUMNS / width;
+	block.scale[1] = (float)ROWS / height;
+	block.scale[2] = scale;
+	block.scale[3] = (float)log(FIRST_SLICE);
+	block.count[0] = COLUMNS;
+	block.count[1] = ROWS;
+	block.count[2] = SLICES;
+	block.count[3] = count;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, blockBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void LightClusters::Bind()
+{
+	Create();
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, blockBuffer);
+
+	glActiveTexture(GL_TEXTURE0 + gridUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, textures[0]);
+	glActiveTexture(GL_TEXTURE0 + listUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, textures[1]);
+	glActiveTexture(GL_TEXTURE0 + lightUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, textures[2]);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+int LightClusters::Count()
+{
+	return (int)lights.size();
+}
+
+int LightClusters::Visible()
+{
+	return visible;
+}
+
+int LightClusters::Assigned()
+{
+	return assigned;
+}
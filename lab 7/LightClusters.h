@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Light Clusters Class
+//
+// LightClusters.h: interface for the LightClusters class.
+// The fixed function pipeline stops at eight lights and the
+// game only ever used the one, so the lamp gave no light at
+// all. These are the lights besides that one: point lights and
+// spot lights, as many as the level wants, each reaching only
+// as far as its radius.
+//
+// Build() cuts what the camera sees into a grid of clusters,
+// 16 across, 9 down and 24 deep (the depths growing the
+// further they are, so far away clusters aren't thin slivers),
+// and lists for each cluster the lights whose spheres reach
+// into it. The columns and rows a light touches are found four
+// grid lines at a time with SSE. The SceneShader then lights a
+// pixel with only the lights of the cluster it is in, so a
+// pixel costs about the same however many lights the level has
+// as long as they don't pile up in one place.
+//
+// The lights are given in world space every frame, which lets
+// them move or go out. They only light what the SceneShader
+// draws; with the fixed function pipeline there is just the
+// one light.
+//
+// Usage:
+// LightClusters::Clear();
+// LightClusters::AddPoint(position, 250, gold);
+// LightClusters::AddSpot(position, 800, white, down, 30, 60);
+// LightClusters::Build(view, projection, width, height);
+//
+// // In SceneShader::Begin()
+// LightClusters::Bind();
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+class LightClusters
+{
+public:
+	static const int MAX_LIGHTS = 4096;				// The light numbers are shorts on the card
+
+	static const int gridUnit = 2;					// The texture units the shader reads the clusters from
+	static const int listUnit = 3;
+	static const int lightUnit = 4;
+	static const int binding = 2;					// And the uniform block binding of the grid's size
+
+	static void Clear();							// Forgets the last frame's lights
+	// A light at position (x, y, z) that fades out to nothing at radius, false if there are too many
+	static bool AddPoint(const float *position, float radius, const float *color);
+	// A light shining along direction, full inside inner degrees of it and fading out to outer
+	static bool AddSpot(const float *position, float radius, const float *color, const float *direction,
+		float inner, float outer);
+
+	// Sorts the lights into the clusters of the camera with the view and projection matrices
+	// and a window width by height pixels, and sends them to the card
+	static void Build(const float *view, const float *projection, int width, int height);
+	static void Bind();								// Binds the clusters for the shader
+
+	static int Count();								// How many lights there are
+	static int Visible();							// How many of them reached a cluster in the last Build()
+	static int Assigned();							// How many times a light was listed in a cluster
+};
+
+#endif LIGHTCLUSTERS_H
@@ -0,0 +1,136 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mapped File Class
+//
+// MappedFile.cpp: implementation of the MappedFile class.
+// The file itself is closed as soon as it is mapped, the
+// mapping keeps it open for as long as it needs to. On
+// Windows the mapping object has to be kept until the view
+// is unmapped.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+MappedFile::MappedFile()
+{
+	data = NULL;
+	length = 0;
+	handle = NULL;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char *name)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+
+	// An empty file can't be mapped, and textures are never over 2GB
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || size.QuadPart > 0x7FFFFFFF)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+
+	if (mapping == NULL)
+		return false;
+
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (view == NULL)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	handle = mapping;
+	data = (const unsigned char *)view;
+	length = (long)size.QuadPart;
+#else
+	int file = open(name, O_RDONLY);
+
+	if (file < 0)
+		return false;
+
+	struct stat info;
+
+	if (fstat(file, &info) != 0 || info.st_size == 0 || info.st_size > 0x7FFFFFFF)
+	{
+		close(file);
+		return false;
+	}
+
+	void *view = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (view == MAP_FAILED)
+		return false;
+
+	// The levels are read front to back, once
+	madvise(view, info.st_size, MADV_SEQUENTIAL);
+
+	data = (const unsigned char *)view;
+	length = (long)info.st_size;
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data == NULL)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)handle);
+#else
+	munmap((void *)data, length);
+#endif
+
+	data = NULL;
+	length = 0;
+	handle = NULL;
+}
+
+void MappedFile::Swap(MappedFile &other)
+{
+	const unsigned char *d = data;
+	long l = length;
+	void *h = handle;
+
+	data = other.data;
+	length = other.length;
+	handle = other.handle;
+
+	other.data = d;
+	other.length = l;
+	other.handle = h;
+}
@@ -0,0 +1,48 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mapped File Class
+//
+// MappedFile.h: interface for the MappedFile class.
+// This class maps a whole file into memory, read only, with
+// mmap on Linux and a file mapping on Windows. Nothing is
+// read up front: the pages come in from the disk cache as
+// they are touched, so a KTX file can be handed from the
+// mapping straight to glTexImage2D without a copy of our own.
+// The bytes stay valid until the file is closed.
+//
+// Usage:
+// MappedFile file;
+//
+// if (file.Open("texture.jpg.mips.ktx"))
+// {
+//		ktx.Parse(file.data, file.length);
+//		ktx.Upload();			// Reads the mapped bytes
+// }
+//
+// file.Close();				// Or let the destructor do it
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+class MappedFile
+{
+public:
+	const unsigned char *data;					// The file's bytes, NULL if nothing is open
+	long length;								// Size of the file
+	bool Open(const char *name);				// Maps a file, false if it can't be (or is empty)
+	void Close();								// Unmaps it
+	void Swap(MappedFile &other);				// Trades files with another one
+	MappedFile();								// Constructor
+	virtual ~MappedFile();						// Destructor
+
+private:
+	void *handle;								// The file mapping on Windows, unused on Linux
+
+	// Two of them would unmap the same file
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+};
+
+#endif MAPPEDFILE_H
@@ -0,0 +1,157 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Matrix helpers
+//
+// Matrix.h: 4x4 matrices kept the way OpenGL keeps them, 16
+// floats a column at a time, so any of them can go straight to
+// glLoadMatrixf(). Translate, Rotate, Scale, Perspective and
+// LookAt put the new transform after the matrix like
+// glTranslatef, glRotatef, glScalef, gluPerspective and
+// gluLookAt do, so a chain of them reads like the GL calls it
+// replaces. Multiply is an SSE column at a time when there is
+// SSE.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include "Simd.h"
+
+#include <math.h>
+#include <string.h>
+
+inline void MatrixIdentity(float *m)
+{
+	memset(m, 0, 16 * sizeof(float));
+	m[0] = m[5] = m[10] = m[15] = 1.0f;
+}
+
+// out = a * b, out can be a or b
+inline void MatrixMultiply(float *out, const float *a, const float *b)
+{
+#ifdef SIMD_SSE2
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+	__m128 column[4];
+
+	// Each column of the result is the columns of a weighted by a column of b
+	for (int j = 0; j < 4; j++)
+	{
+		column[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[j * 4])), _mm_mul_ps(a1, _mm_set1_ps(b[j * 4 + 1]))),
+			_mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[j * 4 + 2])), _mm_mul_ps(a3, _mm_set1_ps(b[j * 4 + 3]))));
+	}
+
+	for (int j = 0; j < 4; j++)
+		_mm_storeu_ps(out + j * 4, column[j]);
+#else
+	float r[16];
+
+	for (int j = 0; j < 4; j++)
+		for (int i = 0; i < 4; i++)
+			r[j * 4 + i] = a[i] * b[j * 4] + a[4 + i] * b[j * 4 + 1] + a[8 + i] * b[j * 4 + 2] + a[12 + i] * b[j * 4 + 3];
+
+	memcpy(out, r, sizeof(r));
+#endif
+}
+
+inline void MatrixTranslate(float *m, float x, float y, float z)
+{
+	for (int i = 0; i < 4; i++)
+		m[12 + i] += m[i] * x + m[4 + i] * y + m[8 + i] * z;
+}
+
+// angle in degrees about the axis (x, y, z)
+inline void MatrixRotate(float *m, float angle, float x, float y, float z)
+{
+	if (angle == 0.0f)
+		return;
+
+	float length = (float)sqrt(x*x + y*y + z*z);
+
+	if (length == 0.0f)
+		return;
+
+	x /= length;
+	y /= length;
+	z /= length;
+
+	float s = (float)sin(angle * 0.0174532925);
+	float c = (float)cos(angle * 0.0174532925);
+	float t = 1.0f - c;
+	float r[16];
+
+	r[0] = x * x * t + c;		r[4] = x * y * t - z * s;	r[8] = x * z * t + y * s;	r[12] = 0.0f;
+	r[1] = y * x * t + z * s;	r[5] = y * y * t + c;		r[9] = y * z * t - x * s;	r[13] = 0.0f;
+	r[2] = x * z * t - y * s;	r[6] = y * z * t + x * s;	r[10] = z * z * t + c;		r[14] = 0.0f;
+	r[3] = 0.0f;				r[7] = 0.0f;				r[11] = 0.0f;				r[15] = 1.0f;
+
+	MatrixMultiply(m, m, r);
+}
+
+inline void MatrixScale(float *m, float x, float y, float z)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		m[i] *= x;
+		m[4 + i] *= y;
+		m[8 + i] *= z;
+	}
+}
+
+// fovy in degrees, like gluPerspective
+inline void MatrixPerspective(float *m, float fovy, float aspect, float zNear, float zFar)
+{
+	float f = 1.0f / (float)tan(fovy * 0.5 * 0.0174532925);
+	float r[16];
+
+	memset(r, 0, sizeof(r));
+	r[0] = f / aspect;
+	r[5] = f;
+	r[10] = (zFar + zNear) / (zNear - zFar);
+	r[11] = -1.0f;
+	r[14] = 2.0f * zFar * zNear / (zNear - zFar);
+
+	MatrixMultiply(m, m, r);
+}
+
+inline void MatrixLookAt(float *m, float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ, float upX, float upY, float upZ)
+{
+	// Forward, then side = forward x up and up = side x forward, the rows of the turn
+	float f[3] = { centerX - eyeX, centerY - eyeY, centerZ - eyeZ };
+	float length = (float)sqrt(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+
+	if (length == 0.0f)
+		return;
+
+	for (int i = 0; i < 3; i++)
+		f[i] /= length;
+
+	float s[3] = { f[1] * upZ - f[2] * upY, f[2] * upX - f[0] * upZ, f[0] * upY - f[1] * upX };
+	length = (float)sqrt(s[0]*s[0] + s[1]*s[1] + s[2]*s[2]);
+
+	if (length == 0.0f)
+		return;
+
+	for (int i = 0; i < 3; i++)
+		s[i] /= length;
+
+	float u[3] = { s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2], s[0] * f[1] - s[1] * f[0] };
+	float r[16];
+
+	MatrixIdentity(r);
+
+	for (int i = 0; i < 3; i++)
+	{
+		r[i * 4] = s[i];
+		r[i * 4 + 1] = u[i];
+		r[i * 4 + 2] = -f[i];
+	}
+
+	MatrixMultiply(m, m, r);
+	MatrixTranslate(m, -eyeX, -eyeY, -eyeZ);
+}
+
+#endif MATRIX_H
@@ -0,0 +1,536 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mipmap Generator Class
+//
+// MipmapGenerator.cpp: implementation of the MipmapGenerator class.
+// This class makes the mipmaps of an image, all the way
+// down to 1x1, and replaces gluBuild2DMipmaps. Every level
+// is filtered out of the one above it. The pixels are kept
+// as 16 bit linear RGBA while we work so the error doesn't
+// add up from level to level, and each level is turned back
+// into 8 bit sRGB with a table as its rows are finished.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MipmapGenerator.h"
+#include "Simd.h"
+#include "glew.h"
+
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+MipmapGenerator::Filter MipmapGenerator::filter = MipmapGenerator::BOX;
+bool MipmapGenerator::gammaCorrect = true;
+bool MipmapGenerator::cache = false;
+int MipmapGenerator::threads = 0;
+
+// Small levels aren't worth starting threads for
+#define ROWS_PER_THREAD	32
+
+// The Kaiser filter is 3 texels of the smaller level wide, the same
+// width and alpha NVIDIA's texture tools use
+#define KAISER_WIDTH	3.0
+#define KAISER_ALPHA	4.0
+
+#define PI	3.14159265358979323846
+
+static int Min(int a, int b) { return a < b ? a : b; }
+static int Max(int a, int b) { return a > b ? a : b; }
+
+// Conversions between 8 bit values and 16 bit linear light. Table 0
+// follows the sRGB curve, table 1 is a straight line for alpha and for
+// colors when gammaCorrect is off.
+struct GammaTables
+{
+	unsigned short toLinear[2][256];
+	unsigned char fromLinear[2][65536];
+
+	GammaTables()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			double c = i / 255.0;
+			double l = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+
+			toLinear[0][i] = (unsigned short)(l * 65535.0 + 0.5);
+			toLinear[1][i] = (unsigned short)(i * 257);
+		}
+
+		for (int i = 0; i < 65536; i++)
+		{
+			double l = i / 65535.0;
+			double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+
+			fromLinear[0][i] = (unsigned char)(c * 255.0 + 0.5);
+			fromLinear[1][i] = (unsigned char)((i + 128) / 257);
+		}
+	}
+};
+
+static const GammaTables &Tables()
+{
+	// Made the first time a texture needs them
+	static GammaTables tables;
+	return tables;
+}
+
+// The source pixels and weights that make every pixel along one axis
+struct Taps
+{
+	int count;									// Taps per pixel, unused ones have no weight
+	std::vector<int> index;						// count source pixels for every pixel
+	std::vector<float> weight;					// and how much each of them counts
+};
+
+// One level being filtered out of the level above it
+struct Pass
+{
+	const unsigned short *src;					// Linear RGBA of the level above
+	int srcWidth;
+	unsigned short *dest;						// Linear RGBA of this level
+	int destWidth;
+	Taps columns;
+	Taps rows;
+	unsigned char *out;							// The 8 bit level in the KTX file
+	int outStride;
+	int channels;
+	bool gamma;
+	bool halve;									// Box filter down to exactly half, every texel is 2x2 pixels
+};
+
+// Modified Bessel function of the first kind, enough terms for a float
+static double BesselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+
+	for (int k = 1; k < 25; k++)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+// The Kaiser windowed sinc, x is in pixels of the smaller level
+static double Kaiser(double x)
+{
+	double t = x / (KAISER_WIDTH / 2);
+
+	if (t <= -1.0 || t >= 1.0)
+		return 0.0;
+
+	double sinc = x == 0.0 ? 1.0 : sin(PI * x) / (PI * x);
+
+	return sinc * BesselI0(KAISER_ALPHA * sqrt(1.0 - t * t)) / BesselI0(KAISER_ALPHA);
+}
+
+static void MakeTaps(int src, int dest, MipmapGenerator::Filter filter, Taps &taps)
+{
+	double scale = (double)src / dest;
+
+	// Shrinking widens the filter to cover every source pixel, enlarging doesn't
+	double stretch = scale > 1.0 ? scale : 1.0;
+	double radius = (filter == MipmapGenerator::BOX ? 0.5 : KAISER_WIDTH / 2) * stretch;
+	int most = (int)ceil(radius * 2) + 1;
+
+	std::vector<int> index(dest * most);
+	std::vector<double> weight(dest * most);
+	std::vector<int> count(dest);
+
+	taps.count = 1;
+
+	for (int i = 0; i < dest; i++)
+	{
+		double center = (i + 0.5) * scale;
+		int first = (int)floor(center - radius);
+		double total = 0.0;
+
+		for (int j = first; j < first + most; j++)
+		{
+			double w;
+
+			if (filter == MipmapGenerator::BOX)
+			{
+				// How much of the source pixel the box covers
+				double left = center - radius > j ? center - radius : j;
+				double right = center + radius < j + 1 ? center + radius : j + 1;
+
+				w = right - left;
+			}
+			else
+				w = Kaiser((j + 0.5 - center) / stretch);
+
+			if (fabs(w) < 1e-6)
+				continue;
+
+			// Past the edges we repeat the edge
+			index[i * most + count[i]] = Min(Max(j, 0), src - 1);
+			weight[i * most + count[i]] = w;
+			count[i]++;
+			total += w;
+		}
+
+		for (int k = 0; k < count[i]; k++)
+			weight[i * most + k] /= total;
+
+		taps.count = Max(taps.count, count[i]);
+	}
+
+	// Pack them with the same number of taps for every pixel
+	taps.index.assign(dest * taps.count, 0);
+	taps.weight.assign(dest * taps.count, 0.0f);
+
+	for (int i = 0; i < dest; i++)
+	{
+		for (int k = 0; k < count[i]; k++)
+		{
+			taps.index[i * taps.count + k] = index[i * most + k];
+			taps.weight[i * taps.count + k] = (float)weight[i * most + k];
+		}
+	}
+}
+
+// Filters the rows first up to last of a level
+static void FilterRows(const Pass *pass, int first, int last)
+{
+	const GammaTables &tables = Tables();
+	const unsigned char *color = tables.fromLinear[pass->gamma ? 0 : 1];
+	const unsigned char *alpha = tables.fromLinear[1];
+
+	int srcWidth = pass->srcWidth;
+	int destWidth = pass->destWidth;
+	int columnTaps = pass->columns.count;
+	int rowTaps = pass->rows.count;
+
+	// One row of the level above, filtered down the columns
+	std::vector<float> line(srcWidth * 4);
+
+	for (int y = first; y < last; y++)
+	{
+		const int *rowIndex = &pass->rows.index[y * rowTaps];
+		const float *rowWeight = &pass->rows.weight[y * rowTaps];
+		unsigned short *dest = pass->dest + (long)y * destWidth * 4;
+
+#ifdef SIMD_SSE2
+		if (pass->halve)
+		{
+			// Most levels: add up 2x2 pixels with integers, no weights needed
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i round = _mm_set1_epi32(2 - 32768 * 4);
+			const __m128i sign = _mm_set1_epi16((short)0x8000);
+			const unsigned short *row0 = pass->src + (long)y * 2 * srcWidth * 4;
+			const unsigned short *row1 = row0 + srcWidth * 4;
+
+			for (int x = 0; x < destWidth; x++)
+			{
+				__m128i top = _mm_loadu_si128((const __m128i *)(row0 + x * 8));
+				__m128i bottom = _mm_loadu_si128((const __m128i *)(row1 + x * 8));
+
+				__m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(top, zero), _mm_unpackhi_epi16(top, zero)),
+					_mm_add_epi32(_mm_unpacklo_epi16(bottom, zero), _mm_unpackhi_epi16(bottom, zero)));
+
+				// Averaged, then packed through signed like below
+				sum = _mm_srai_epi32(_mm_add_epi32(sum, round), 2);
+				_mm_storel_epi64((__m128i *)(dest + x * 4), _mm_xor_si128(_mm_packs_epi32(sum, zero), sign));
+			}
+		}
+		else
+		{
+			// An RGBA pixel fits in one register
+			const __m128i zero = _mm_setzero_si128();
+
+			for (int x = 0; x < srcWidth; x++)
+			{
+				__m128 sum = _mm_setzero_ps();
+
+				for (int k = 0; k < rowTaps; k++)
+				{
+					const unsigned short *p = pass->src + ((long)rowIndex[k] * srcWidth + x) * 4;
+					__m128 pixel = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), zero));
+
+					sum = _mm_add_ps(sum, _mm_mul_ps(pixel, _mm_set1_ps(rowWeight[k])));
+				}
+
+				_mm_storeu_ps(&line[x * 4], sum);
+			}
+
+			const __m128 most = _mm_set1_ps(65535.0f);
+			const __m128i bias = _mm_set1_epi32(32768);
+			const __m128i sign = _mm_set1_epi16((short)0x8000);
+
+			for (int x = 0; x < destWidth; x++)
+			{
+				const int *columnIndex = &pass->columns.index[x * columnTaps];
+				const float *columnWeight = &pass->columns.weight[x * columnTaps];
+				__m128 sum = _mm_setzero_ps();
+
+				for (int k = 0; k < columnTaps; k++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&line[columnIndex[k] * 4]), _mm_set1_ps(columnWeight[k])));
+
+				// The lobes of the Kaiser filter can overshoot
+				sum = _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), most);
+
+				// SSE2 can't pack to unsigned 16 bits, go through signed and flip the sign back
+				__m128i v = _mm_packs_epi32(_mm_sub_epi32(_mm_cvtps_epi32(sum), bias), zero);
+				_mm_storel_epi64((__m128i *)(dest + x * 4), _mm_xor_si128(v, sign));
+			}
+		}
+#else
+		for (int x = 0; x < srcWidth; x++)
+		{
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+			for (int k = 0; k < rowTaps; k++)
+			{
+				const unsigned short *p = pass->src + ((long)rowIndex[k] * srcWidth + x) * 4;
+
+				for (int c = 0; c < 4; c++)
+					sum[c] += p[c] * rowWeight[k];
+			}
+
+			for (int c = 0; c < 4; c++)
+				line[x * 4 + c] = sum[c];
+		}
+
+		for (int x = 0; x < destWidth; x++)
+		{
+			const int *columnIndex = &pass->columns.index[x * columnTaps];
+			const float *columnWeight = &pass->columns.weight[x * columnTaps];
+
+			for (int c = 0; c < 4; c++)
+			{
+				float sum = 0.0f;
+
+				for (int k = 0; k < columnTaps; k++)
+					sum += line[columnIndex[k] * 4 + c] * columnWeight[k];
+
+				// The lobes of the Kaiser filter can overshoot
+				sum = sum < 0.0f ? 0.0f : (sum > 65535.0f ? 65535.0f : sum);
+				dest[x * 4 + c] = (unsigned short)(sum + 0.5f);
+			}
+		}
+#endif
+
+		// Back to 8 bits for OpenGL
+		unsigned char *out = pass->out + (long)y * pass->outStride;
+
+		for (int x = 0; x < destWidth; x++, dest += 4, out += pass->channels)
+		{
+			out[0] = color[dest[0]];
+			out[1] = color[dest[1]];
+			out[2] = color[dest[2]];
+
+			if (pass->channels == 4)
+				out[3] = alpha[dest[3]];
+		}
+	}
+}
+
+static void RunPass(const Pass &pass, int height)
+{
+	int workers = MipmapGenerator::threads > 0 ? MipmapGenerator::threads : (int)std::thread::hardware_concurrency();
+
+	workers = Max(Min(workers, height / ROWS_PER_THREAD), 1);
+
+	if (workers == 1)
+	{
+		FilterRows(&pass, 0, height);
+		return;
+	}
+
+	// Every thread gets a band of rows
+	std::vector<std::thread> pool;
+
+	for (int i = 0; i < workers; i++)
+		pool.push_back(std::thread(FilterRows, &pass, height * i / workers, height * (i + 1) / workers));
+
+	for (size_t i = 0; i < pool.size(); i++)
+		pool[i].join();
+}
+
+// Turns an image into 16 bit linear RGBA
+static void ToLinear(Image &image, unsigned short *dest, bool gamma)
+{
+	const GammaTables &tables = Tables();
+	const unsigned short *color = tables.toLinear[gamma ? 0 : 1];
+	int stride = (image.width * image.channels + image.alignment - 1) / image.alignment * image.alignment;
+
+	for (int y = 0; y < image.height; y++)
+	{
+		const unsigned char *src = image.data + (long)y * stride;
+
+		for (int x = 0; x < image.width; x++, src += image.channels, dest += 4)
+		{
+			dest[0] = color[src[0]];
+			dest[1] = color[src[1]];
+			dest[2] = color[src[2]];
+			dest[3] = image.channels == 4 ? tables.toLinear[1][src[3]] : 65535;
+		}
+	}
+}
+
+// Copies an image as it is into level 0, adding or dropping alpha
+static void CopyImage(Image &image, unsigned char *out, int outStride, int channels)
+{
+	int stride = (image.width * image.channels + image.alignment - 1) / image.alignment * image.alignment;
+
+	for (int y = 0; y < image.height; y++)
+	{
+		const unsigned char *src = image.data + (long)y * stride;
+		unsigned char *dest = out + (long)y * outStride;
+
+		if (channels == image.channels)
+		{
+			memcpy(dest, src, image.width * channels);
+			continue;
+		}
+
+		for (int x = 0; x < image.width; x++, src += image.channels, dest += channels)
+		{
+			dest[0] = src[0];
+			dest[1] = src[1];
+			dest[2] = src[2];
+
+			if (channels == 4)
+				dest[3] = 255;
+		}
+	}
+}
+
+// The power of two gluScaleImage would pick, sizes from 3/4 of the next one up round up
+static int NearestPowerOfTwo(int size)
+{
+	int power = 1;
+
+	while (power * 2 <= size)
+		power *= 2;
+
+	return power > 1 && size >= power + power / 2 ? power * 2 : power;
+}
+
+static bool IsPowerOfTwo(int size)
+{
+	return (size & (size - 1)) == 0;
+}
+
+int MipmapGenerator::Levels(int width, int height)
+{
+	int levels = 1;
+
+	while ((width >> levels) > 0 || (height >> levels) > 0)
+		levels++;
+
+	return levels;
+}
+
+bool MipmapGenerator::Generate(Image &image, KTXFile &ktx, int channels, bool powerOfTwo)
+{
+	if (image.data == NULL || image.width < 1 || image.height < 1)
+		return false;
+
+	if (channels == 0)
+		channels = image.channels;
+
+	int width = powerOfTwo ? NearestPowerOfTwo(image.width) : image.width;
+	int height = powerOfTwo ? NearestPowerOfTwo(image.height) : image.height;
+
+	unsigned char *out = ktx.Create(channels == 4 ? GL_RGBA8 : GL_RGB8, channels == 4 ? GL_RGBA : GL_RGB,
+		width, height, Levels(width, height));
+
+	if (out == NULL)
+		return false;
+
+	// The table is picked once so a change halfway can't mix two of them
+	bool gamma = gammaCorrect;
+
+	std::vector<unsigned short> level((size_t)image.width * image.height * 4);
+	std::vector<unsigned short> next;
+
+	ToLinear(image, &level[0], gamma);
+
+	int w = image.width;
+	int h = image.height;
+	int i = 0;
+
+	// Unless it has to be scaled level 0 is the image itself
+	if (w == width && h == height)
+	{
+		CopyImage(image, out, ktx.RowBytes(0), channels);
+		i = 1;
+	}
+
+	for (; i < ktx.levels; i++)
+	{
+		Pass pass;
+
+		pass.destWidth = ktx.LevelWidth(i);
+		int destHeight = ktx.LevelHeight(i);
+
+		next.resize((size_t)pass.destWidth * destHeight * 4);
+
+		MakeTaps(w, pass.destWidth, filter, pass.columns);
+		MakeTaps(h, destHeight, filter, pass.rows);
+
+		pass.src = &level[0];
+		pass.srcWidth = w;
+		pass.dest = &next[0];
+		pass.out = out + (ktx.data[i] - ktx.data[0]);
+		pass.outStride = ktx.RowBytes(i);
+		pass.channels = channels;
+		pass.gamma = gamma;
+		pass.halve = filter == BOX && w == pass.destWidth * 2 && h == destHeight * 2;
+
+		RunPass(pass, destHeight);
+
+		// The next level is made out of this one
+		level.swap(next);
+		w = pass.destWidth;
+		h = destHeight;
+	}
+
+	return true;
+}
+
+std::string MipmapGenerator::CacheName(const char *source)
+{
+	return std::string(source) + ".mips.ktx";
+}
+
+// True if file exists and isn't older than original
+static bool UpToDate(const char *file, const char *original)
+{
+	struct stat a, b;
+
+	if (stat(file, &a) != 0 || stat(original, &b) != 0)
+		return false;
+
+	return a.st_mtime >= b.st_mtime;
+}
+
+bool MipmapGenerator::Load(const char *source, KTXFile &ktx, bool powerOfTwo)
+{
+	std::string name = CacheName(source);
+
+	if (cache && UpToDate(name.c_str(), source) && ktx.Load(name.c_str()) && !ktx.Compressed())
+	{
+		// Mipmaps saved for a card that takes any size may not suit this one
+		if (!powerOfTwo || (IsPowerOfTwo(ktx.width) && IsPowerOfTwo(ktx.height)))
+			return true;
+	}
+
+	Image image;
+
+	if (!image.Load(source) || !Generate(image, ktx, 0, powerOfTwo))
+		return false;
+
+	// Even if the folder is read only the mipmaps can still be used
+	if (cache)
+		ktx.Save(name.c_str());
+
+	return true;
+}
@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mipmap Generator Class
+//
+// MipmapGenerator.h: interface for the MipmapGenerator class.
+// This class makes the mipmaps of an image, all the way
+// down to 1x1, and replaces gluBuild2DMipmaps. GLU scales
+// every texture to a power of two, even when the video card
+// doesn't need it, and builds the levels one after the other
+// on a single core. Here the colors are averaged as light
+// (in linear space, not as sRGB numbers) so the small levels
+// don't get darker, the rows of each level are spread over
+// all CPU cores and every pixel is filtered with SSE.
+// Images are only scaled to a power of two when asked to.
+//
+// The levels are kept in a KTXFile so they can be saved
+// next to the original ("bark.png" -> "bark.png.mips.ktx")
+// and loaded the next time instead of being made again.
+//
+// Usage:
+// KTXFile mipmaps;
+//
+// if (MipmapGenerator::Load("bark.png", mipmaps))
+// {
+//		glBindTexture(GL_TEXTURE_2D, id);
+//		mipmaps.Upload();
+// }
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MIPMAPGENERATOR_H
+#define MIPMAPGENERATOR_H
+
+#include "Image.h"
+#include "KTXFile.h"
+
+#include <string>
+
+class MipmapGenerator
+{
+public:
+	enum Filter
+	{
+		BOX,										// Averages the pixels a texel covers, fast and a little soft
+		KAISER										// Kaiser windowed sinc, keeps more detail in the small levels
+	};
+
+	static Filter filter;							// The filter used for every level
+	static bool gammaCorrect;						// Average the colors in linear space
+	static bool cache;								// Save the mipmaps next to the original and load them from there
+	static int threads;								// Worker threads, 0 for one per core
+
+	// Makes every level of an image. channels is 3 or 4, 0 keeps those of the image.
+	// powerOfTwo scales the image to the nearest power of two first, like GLU did.
+	static bool Generate(Image &image, KTXFile &ktx, int channels = 0, bool powerOfTwo = false);
+
+	// Loads the cached mipmaps of a file, or makes them (and caches them if cache is set)
+	static bool Load(const char *source, KTXFile &ktx, bool powerOfTwo = false);
+
+	static std::string CacheName(const char *source);	// The file the mipmaps of an original are kept in
+	static int Levels(int width, int height);		// Number of levels down to 1x1
+};
+
+#endif MIPMAPGENERATOR_H
@@ -22,7 +22,17 @@
 //    the model
 //
 // Support for non-textured faces is done by reading the color
-// from the material's diffuse color.
+// from the material's diffuse color. Those faces are drawn with
+// texturing off and the color on their vertices, so an object's
+// colored faces take a single draw and no texture at all.
+//
+// Once loaded, the vertices and faces of every object are copied
+// into buffer objects and a vertex array object remembers where
+// they are, so drawing sends nothing over the bus.
+//
+// Loading still reads (and splits and remaps) the vertices,
+// normals and texcoords as three arrays, Interleave() packs
+// them into one at the very end and frees the three.
 //
 // Some models have problems loading even if you follow all of
 // the restrictions I have stated and I don't know why. If you
@@ -66,6 +76,10 @@
 // m.Objects[0].pos.y = 0.0f;
 // m.Objects[0].pos.z = 0.0f;
 //
+// // If the .3ds file changed on disk you can load it again
+// // in place, the textures are reloaded along with it
+// m.Reload();
+//
 //////////////////////////////////////////////////////////////////////
 
 // This is used to generate a warning from the compiler
@@ -78,10 +92,61 @@
 #pragma warn( You need to uncomment this if you are using MFC )
 //#include "stdafx.h"
 #include <string>
+#include <vector>
+#include <map>
 #include "Model_3DS.h"
+#include "SceneShader.h"
+#include "RenderQueue.h"
+#include "OcclusionCuller.h"
+#include "Matrix.h"
 
 #include <math.h>			// Header file for the math library
-#include <gl\gl.h>			// Header file for the OpenGL32 library
+#include <string.h>			// Header file for the string functions
+#include <stdlib.h>			// Header file for the memory functions
+#include <stddef.h>			// Header file for offsetof
+#include <GL/gl.h>			// Header file for the OpenGL32 library
+#include <chrono>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#define _strdup strdup
+#define sprintf_s snprintf
+#endif
+
+// Packed vertices start on a 32 byte boundary so none of them straddles two cache lines
+#define VERTEX_ALIGN		32
+
+static void *AllocAligned(size_t bytes)
+{
+#ifdef _WIN32
+	return _aligned_malloc(bytes, VERTEX_ALIGN);
+#else
+	void *memory;
+	return (posix_memalign(&memory, VERTEX_ALIGN, bytes) == 0) ? memory : NULL;
+#endif
+}
+
+static void FreeAligned(void *memory)
+{
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+// Where a vertex's position and normal are, in the packed vertices
+// or in the separate arrays if there wasn't the memory to pack them
+static const float *Position(const Model_3DS::Object &obj, int v)
+{
+	return (obj.Packed != NULL) ? &obj.Packed[v].x : &obj.Vertexes[v*3];
+}
+
+static const float *Normal(const Model_3DS::Object &obj, int v)
+{
+	return (obj.Packed != NULL) ? &obj.Packed[v].nx : &obj.Normals[v*3];
+}
 
 // The chunk's id numbers
 #define MAIN3DS				0x4D4D
@@ -155,6 +220,17 @@ Model_3DS::Model_3DS()
 	rot.y = 0.0f;
 	rot.z = 0.0f;
 
+	// No model loaded yet
+	modelname = NULL;
+
+	// No copies queued
+	instances = NULL;
+	numInstances = 0;
+	maxInstances = 0;
+	drawnInstances = 0;
+	firstBounds = -1;
+	instancePixels = 0.0f;
+
 	// Set up the path
 	path = new char[80];
 	sprintf_s(path, sizeof(path), "");
@@ -163,13 +239,25 @@ Model_3DS::Model_3DS()
 	numObjects = 0;
 	numMaterials = 0;
 
+	// Nothing to be seen yet
+	center.x = 0.0f;
+	center.y = 0.0f;
+	center.z = 0.0f;
+	radius = 0.0f;
+
 	// Set the scale to one
 	scale = 1.0f;
+
+	// Which is no transform at all
+	MatrixIdentity(transform);
+	transformPos = pos;
+	transformRot = rot;
+	transformScale = scale;
 }
 
 Model_3DS::~Model_3DS()
 {
-
+	delete [] instances;
 }
 
 void Model_3DS::Load(char *name)
@@ -194,6 +282,7 @@ void Model_3DS::Load(char *name)
 			temp = strrchr(name, '\\');
 
 		// Allocate space for the path
+		delete [] path;
 		path = new char[strlen(name)-strlen(temp)+1];
 
 		// Get a pointer to the end of the path and name
@@ -208,9 +297,17 @@ void Model_3DS::Load(char *name)
 		path[src-name] = 0;
 	}
 
+	// For future reference (keep our own copy so Reload() can use it, even if this load fails)
+	free(modelname);
+	modelname = _strdup(name);
+
 	// Load the file
 	bin3ds = fopen(name,"rb");
 
+	// If the file isn't there (or is being rewritten) there is nothing to load
+	if (bin3ds == NULL)
+		return;
+
 	// Make sure we are at the beginning
 	fseek(bin3ds, 0, SEEK_SET);
 
@@ -227,9 +324,6 @@ void Model_3DS::Load(char *name)
 	// Calculate the vertex normals
 	CalculateNormals();
 
-	// For future reference
-	modelname = name;
-
 	// Find the total number of faces and vertices
 	totalFaces = 0;
 	totalVerts = 0;
@@ -260,105 +354,1075 @@ void Model_3DS::Load(char *name)
 		}
 	}
 
-	// Let's build simple colored textures for the materials w/o a texture
+	// Now that we know how the faces use them load the textures
+	LoadTextures();
+
+	// The vertices won't change anymore, pack them and hand them to the card
+	for (int i = 0; i < numObjects; i++)
+	{
+		Interleave(i);
+		UploadBuffers(i);
+	}
+
+	// Find the sphere around the vertices, so we know how big the model is on screen
+	CalculateBounds();
+}
+
+bool Model_3DS::Reload()
+{
+	// Nothing to reload if Load() was never called
+	if (modelname == NULL)
+		return false;
+
+	// Load() may cut the name up, so it gets a copy
+	char *name = _strdup(modelname);
+	Model_3DS fresh;
+
+	fresh.Load(name);
+	free(name);
+
+	// The file can't be opened while an editor is still writing it, keep the old model until it can
+	if (fresh.numObjects == 0)
+	{
+		fresh.Free();
+		delete [] fresh.path;
+		free(fresh.modelname);
+		return false;
+	}
+
+	// Throw away the old model and take the new one's geometry, materials and name
+	Free();
+	free(modelname);
+	delete [] path;
+
+	modelname = fresh.modelname;
+	path = fresh.path;
+	numObjects = fresh.numObjects;
+	numMaterials = fresh.numMaterials;
+	Objects = fresh.Objects;
+	Materials = fresh.Materials;
+	totalVerts = fresh.totalVerts;
+	totalFaces = fresh.totalFaces;
+	center = fresh.center;
+	radius = fresh.radius;
+
+	// They are ours now, fresh mustn't know about them
+	fresh.modelname = NULL;
+	fresh.path = NULL;
+	fresh.numObjects = 0;
+	fresh.numMaterials = 0;
+
+	return true;
+}
+
+void Model_3DS::Free()
+{
+	// Release the geometry of every object
+	for (int i = 0; i < numObjects; i++)
+	{
+		if (Objects[i].vao != 0)
+			glDeleteVertexArrays(1, &Objects[i].vao);
+		if (Objects[i].buffers[0] != 0)
+			glDeleteBuffers(2, Objects[i].buffers);
+
+		delete [] Objects[i].Vertexes;
+		delete [] Objects[i].Normals;
+		delete [] Objects[i].TexCoords;
+		FreeAligned(Objects[i].Packed);
+		delete [] Objects[i].Colors;
+		delete [] Objects[i].Faces;
+
+		for (int j = 0; j < Objects[i].numMatFaces; j++)
+			delete [] Objects[i].MatFaces[j].subFaces;
+
+		delete [] Objects[i].MatFaces;
+	}
+
+	if (numObjects > 0)
+		delete [] Objects;
+
+	// Release the textures of the materials (other models may still share them)
+	for (int k = 0; k < numMaterials; k++)
+		Materials[k].tex.Release();
+
+	if (numMaterials > 0)
+		delete [] Materials;
+
+	// Zero out our counters so that Load() can count again
+	numObjects = 0;
+	numMaterials = 0;
+}
+
+void Model_3DS::LoadTextures()
+{
+	bool *color = new bool[numMaterials];						// True for the materials w/o a texture
+	bool *packed = new bool[numMaterials];						// True if the texture went into an atlas
+	bool *split = new bool[numMaterials];						// True if the vertices can't be shared with other materials
+	bool *colored = new bool[numObjects];						// True if the object's colors go on its vertices
+	TextureAtlas::Rect *rects = new TextureAtlas::Rect[numMaterials];	// Where it went
+	float *cells = new float[numMaterials * 2];					// The tile of the texture the faces use
+
 	for (int j = 0; j < numMaterials; j++)
 	{
-		if (Materials[j].textured == false)
+		color[j] = (Materials[j].textured == false);
+		packed[j] = false;
+		cells[2*j] = 0.0f;
+		cells[2*j+1] = 0.0f;
+
+		// Colors need no texture, Draw() turns texturing off for them
+		if (color[j])
+			continue;
+
+		// The atlas doesn't repeat textures so only those used inside one tile can go in
+		packed[j] = InsideOneTile(j, &cells[2*j]) && TextureAtlas::Add(Materials[j].mapname, &Materials[j].tex, rects[j]);
+		if (!packed[j])
+			Materials[j].tex.Load(Materials[j].mapname);
+	}
+
+	// The faces index the vertices with 16 bits, so an object that would need
+	// too many copies of its vertices (or is short of texcoords) sets its
+	// colors with glColor, and then keeps the textures of its own
+	for (int i = 0; i < numObjects; i++)
+	{
+		colored[i] = Objects[i].numTexCoords >= Objects[i].numVerts;
+
+		for (int j = 0; j < numMaterials; j++)
+			split[j] = packed[j] || (color[j] && colored[i]);
+
+		if (colored[i] && SplitSharedVertices(i, split, false) <= 65536)
+			continue;
+
+		colored[i] = false;
+
+		if (Objects[i].numTexCoords >= Objects[i].numVerts && SplitSharedVertices(i, packed, false) <= 65536)
+			continue;
+
+		bool unpacked = false;
+
+		for (int k = 0; k < Objects[i].numMatFaces; k++)
 		{
-			unsigned char r = Materials[j].color.r;
-			unsigned char g = Materials[j].color.g;
-			unsigned char b = Materials[j].color.b;
-			Materials[j].tex.BuildColorTexture(r, g, b);
-			Materials[j].textured = true;
+			int m = Objects[i].MatFaces[k].MatIndex;
+
+			if (m >= numMaterials || !packed[m])
+				continue;
+
+			Materials[m].tex.Release();
+			Materials[m].tex.Load(Materials[m].mapname);
+			packed[m] = false;
+			unpacked = true;
 		}
+
+		// Objects before this one may have counted on those materials
+		if (unpacked)
+			i = -1;
+	}
+
+	for (int i = 0; i < numObjects; i++)
+	{
+		for (int j = 0; j < numMaterials; j++)
+			split[j] = packed[j] || (color[j] && colored[i]);
+
+		SplitSharedVertices(i, split, true);
+		RemapTexCoords(i, packed, rects, cells);
+
+		if (colored[i])
+			ColorVertices(i);
+
+		MergeMaterialFaces(i);
 	}
+
+	delete [] color;
+	delete [] packed;
+	delete [] split;
+	delete [] colored;
+	delete [] rects;
+	delete [] cells;
+}
+
+bool Model_3DS::InsideOneTile(int matindex, float *cell)
+{
+	float minU = 0.0f, maxU = 0.0f, minV = 0.0f, maxV = 0.0f;
+	bool first = true;
+
+	for (int i = 0; i < numObjects; i++)
+	{
+		for (int j = 0; j < Objects[i].numMatFaces; j++)
+		{
+			if (Objects[i].MatFaces[j].MatIndex != matindex)
+				continue;
+
+			// Without texcoords of its own the object can't be moved onto the atlas
+			if (!Objects[i].textured || Objects[i].numTexCoords < Objects[i].numVerts)
+				return false;
+
+			for (int k = 0; k < Objects[i].MatFaces[j].numSubFaces; k++)
+			{
+				int v = Objects[i].MatFaces[j].subFaces[k];
+				float s = Objects[i].TexCoords[2*v];
+				float t = Objects[i].TexCoords[2*v+1];
+
+				if (first || s < minU) minU = s;
+				if (first || s > maxU) maxU = s;
+				if (first || t < minV) minV = t;
+				if (first || t > maxV) maxV = t;
+				first = false;
+			}
+		}
+	}
+
+	// Faces in any one tile can be moved back to the first one
+	cell[0] = floorf(minU);
+	cell[1] = floorf(minV);
+
+	return maxU <= cell[0] + 1.0f && maxV <= cell[1] + 1.0f;
+}
+
+int Model_3DS::SplitSharedVertices(int objindex, const bool *split, bool apply)
+{
+	Object &obj = Objects[objindex];
+
+	// The material that has each vertex, -1 while no face uses it.
+	// numMaterials stands for all the materials that aren't split.
+	std::vector<int> owner(obj.numVerts, -1);
+	// The copies made so far, by vertex and material
+	std::map<std::pair<int, int>, int> copies;
+	std::vector<int> sources;
+	int count = obj.numVerts;
+
+	for (int j = 0; j < obj.numMatFaces; j++)
+	{
+		MaterialFaces &faces = obj.MatFaces[j];
+		int m = (faces.MatIndex < numMaterials && split[faces.MatIndex]) ? faces.MatIndex : numMaterials;
+
+		for (int k = 0; k < faces.numSubFaces; k++)
+		{
+			int v = faces.subFaces[k];
+
+			if (owner[v] == -1)
+				owner[v] = m;
+
+			if (owner[v] == m)
+				continue;
+
+			std::map<std::pair<int, int>, int>::iterator copy = copies.find(std::make_pair(v, m));
+
+			if (copy == copies.end())
+			{
+				copy = copies.insert(std::make_pair(std::make_pair(v, m), count++)).first;
+				sources.push_back(v);
+			}
+
+			if (apply)
+				faces.subFaces[k] = (unsigned short)copy->second;
+		}
+	}
+
+	if (!apply || sources.empty())
+		return count;
+
+	// Grow the arrays and fill in the copies
+	float *vertexes = new float[count * 3];
+	float *normals = new float[count * 3];
+	float *texcoords = new float[count * 2];
+
+	memcpy(vertexes, obj.Vertexes, obj.numVerts * 3 * sizeof(float));
+	memcpy(normals, obj.Normals, obj.numVerts * 3 * sizeof(float));
+	memcpy(texcoords, obj.TexCoords, obj.numVerts * 2 * sizeof(float));
+
+	for (size_t c = 0; c < sources.size(); c++)
+	{
+		int dst = obj.numVerts + (int)c;
+		int src = sources[c];
+
+		memcpy(&vertexes[dst*3], &obj.Vertexes[src*3], 3 * sizeof(float));
+		memcpy(&normals[dst*3], &obj.Normals[src*3], 3 * sizeof(float));
+		memcpy(&texcoords[dst*2], &obj.TexCoords[src*2], 2 * sizeof(float));
+	}
+
+	delete [] obj.Vertexes;
+	delete [] obj.Normals;
+	delete [] obj.TexCoords;
+
+	obj.Vertexes = vertexes;
+	obj.Normals = normals;
+	obj.TexCoords = texcoords;
+
+	totalVerts += count - obj.numVerts;
+	obj.numVerts = count;
+	obj.numTexCoords = count;
+
+	return count;
+}
+
+void Model_3DS::RemapTexCoords(int objindex, const bool *packed, const TextureAtlas::Rect *rects, const float *cells)
+{
+	Object &obj = Objects[objindex];
+
+	// Each vertex is moved once, however many faces use it
+	std::vector<bool> moved(obj.numVerts, false);
+
+	for (int j = 0; j < obj.numMatFaces; j++)
+	{
+		int m = obj.MatFaces[j].MatIndex;
+
+		if (m >= numMaterials || !packed[m])
+			continue;
+
+		for (int k = 0; k < obj.MatFaces[j].numSubFaces; k++)
+		{
+			int v = obj.MatFaces[j].subFaces[k];
+
+			if (moved[v])
+				continue;
+
+			obj.TexCoords[2*v] = rects[m].u + (obj.TexCoords[2*v] - cells[2*m]) * rects[m].width;
+			obj.TexCoords[2*v+1] = rects[m].v + (obj.TexCoords[2*v+1] - cells[2*m+1]) * rects[m].height;
+			moved[v] = true;
+		}
+
+		// Objects w/o texcoords of their own got made up ones in Load(),
+		// the atlas needs them now to find the spot
+		obj.textured = true;
+	}
+}
+
+void Model_3DS::ColorVertices(int objindex)
+{
+	Object &obj = Objects[objindex];
+
+	for (int j = 0; j < obj.numMatFaces; j++)
+	{
+		int m = obj.MatFaces[j].MatIndex;
+
+		if (m >= numMaterials || Materials[m].textured)
+			continue;
+
+		// White for the vertices of the textured faces, they never use it
+		if (obj.Colors == NULL)
+		{
+			obj.Colors = new unsigned char[obj.numVerts * 3];
+			memset(obj.Colors, 255, obj.numVerts * 3);
+		}
+
+		// SplitSharedVertices() left every vertex with one material
+		for (int k = 0; k < obj.MatFaces[j].numSubFaces; k++)
+		{
+			int v = obj.MatFaces[j].subFaces[k];
+
+			obj.Colors[3*v] = Materials[m].color.r;
+			obj.Colors[3*v+1] = Materials[m].color.g;
+			obj.Colors[3*v+2] = Materials[m].color.b;
+		}
+	}
+}
+
+void Model_3DS::MergeMaterialFaces(int objindex)
+{
+	Object &obj = Objects[objindex];
+	int merged = 0;
+
+	for (int j = 0; j < obj.numMatFaces; j++)
+	{
+		MaterialFaces &faces = obj.MatFaces[j];
+		int k;
+
+		// Find an earlier list with the same texture, or any colors
+		// if they are on the vertices
+		for (k = 0; k < merged; k++)
+		{
+			int a = obj.MatFaces[k].MatIndex;
+			int b = faces.MatIndex;
+
+			if (a >= numMaterials || b >= numMaterials || Materials[a].textured != Materials[b].textured)
+				continue;
+
+			if (Materials[a].textured && Materials[a].tex.texture[0] == Materials[b].tex.texture[0])
+				break;
+
+			if (!Materials[a].textured && (obj.Colors != NULL || memcmp(&Materials[a].color, &Materials[b].color, sizeof(Color4i)) == 0))
+				break;
+		}
+
+		if (k == merged)
+		{
+			obj.MatFaces[merged++] = faces;
+			continue;
+		}
+
+		// Append the faces to it
+		MaterialFaces &into = obj.MatFaces[k];
+		unsigned short *subFaces = new unsigned short[into.numSubFaces + faces.numSubFaces];
+
+		memcpy(subFaces, into.subFaces, into.numSubFaces * sizeof(unsigned short));
+		memcpy(subFaces + into.numSubFaces, faces.subFaces, faces.numSubFaces * sizeof(unsigned short));
+
+		delete [] into.subFaces;
+		delete [] faces.subFaces;
+
+		into.subFaces = subFaces;
+		into.numSubFaces += faces.numSubFaces;
+	}
+
+	obj.numMatFaces = merged;
+}
+
+void Model_3DS::Interleave(int objindex)
+{
+	Object &obj = Objects[objindex];
+
+	if (obj.numVerts == 0)
+		return;
+
+	// Objects can have fewer texcoords than vertices, the rest are zero
+	int count = (obj.numTexCoords < obj.numVerts) ? obj.numTexCoords : obj.numVerts;
+
+	obj.Packed = (PackedVertex *)AllocAligned(obj.numVerts * sizeof(PackedVertex));
+
+	// Out of memory, draw from the separate arrays then. They need a texcoord for every vertex too.
+	if (obj.Packed == NULL)
+	{
+		if (count < obj.numVerts)
+		{
+			float *texCoords = new float[obj.numVerts * 2];
+
+			memset(texCoords, 0, obj.numVerts * 2 * sizeof(float));
+			if (count > 0)
+				memcpy(texCoords, obj.TexCoords, count * 2 * sizeof(float));
+
+			delete [] obj.TexCoords;
+			obj.TexCoords = texCoords;
+			obj.numTexCoords = obj.numVerts;
+		}
+
+		return;
+	}
+
+	for (int v = 0; v < obj.numVerts; v++)
+	{
+		PackedVertex &p = obj.Packed[v];
+
+		p.x = obj.Vertexes[v*3];
+		p.y = obj.Vertexes[v*3+1];
+		p.z = obj.Vertexes[v*3+2];
+		p.nx = obj.Normals[v*3];
+		p.ny = obj.Normals[v*3+1];
+		p.nz = obj.Normals[v*3+2];
+		p.s = (v < count) ? obj.TexCoords[v*2] : 0.0f;
+		p.t = (v < count) ? obj.TexCoords[v*2+1] : 0.0f;
+	}
+
+	// Nothing reads the separate arrays after this
+	delete [] obj.Vertexes;
+	delete [] obj.Normals;
+	delete [] obj.TexCoords;
+
+	obj.Vertexes = NULL;
+	obj.Normals = NULL;
+	obj.TexCoords = NULL;
+}
+
+void Model_3DS::UploadBuffers(int objindex)
+{
+	Object &obj = Objects[objindex];
+
+	// Buffer objects are core since 1.5
+	if (!GLEW_VERSION_1_5 || obj.numVerts == 0)
+		return;
+
+	// The packed vertices (or the separate arrays one after the other, the same size), then the colors
+	long vertices = obj.numVerts * sizeof(PackedVertex);
+	long colors = (obj.Colors != NULL) ? obj.numVerts * 3 : 0;
+	long indices = 0;
+
+	for (int j = 0; j < obj.numMatFaces; j++)
+	{
+		obj.MatFaces[j].offset = (unsigned int)indices;
+		indices += obj.MatFaces[j].numSubFaces * sizeof(unsigned short);
+	}
+
+	glGenBuffers(2, obj.buffers);
+
+	glBindBuffer(GL_ARRAY_BUFFER, obj.buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertices + colors, NULL, GL_STATIC_DRAW);
+	if (obj.Packed != NULL)
+		glBufferSubData(GL_ARRAY_BUFFER, 0, vertices, obj.Packed);
+	else
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, obj.numVerts * 3 * sizeof(float), obj.Vertexes);
+		glBufferSubData(GL_ARRAY_BUFFER, obj.numVerts * 3 * sizeof(float), obj.numVerts * 3 * sizeof(float), obj.Normals);
+		glBufferSubData(GL_ARRAY_BUFFER, obj.numVerts * 6 * sizeof(float), obj.numVerts * 2 * sizeof(float), obj.TexCoords);
+	}
+
+	if (colors > 0)
+		glBufferSubData(GL_ARRAY_BUFFER, vertices, colors, obj.Colors);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj.buffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices, NULL, GL_STATIC_DRAW);
+
+	for (int j = 0; j < obj.numMatFaces; j++)
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, obj.MatFaces[j].offset, obj.MatFaces[j].numSubFaces * sizeof(unsigned short), obj.MatFaces[j].subFaces);
+
+	// A vertex array object keeps the pointers (and the index buffer) so
+	// drawing only has to bind it
+	if (GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object)
+	{
+		glGenVertexArrays(1, &obj.vao);
+		glBindVertexArray(obj.vao);
+		SetupArrays(objindex);
+		glBindVertexArray(0);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Model_3DS::SetupArrays(int objindex)
+{
+	Object &obj = Objects[objindex];
+
+	// With the buffers bound the pointers are offsets into them,
+	// without them (0) they are our own arrays
+	const char *vertices = (const char *)obj.Packed;
+	const unsigned char *colors = obj.Colors;
+
+	if (GLEW_VERSION_1_5)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, obj.buffers[0]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj.buffers[1]);
+	}
+
+	if (obj.buffers[0] != 0)
+	{
+		vertices = NULL;
+		colors = (const unsigned char *)NULL + obj.numVerts * sizeof(PackedVertex);
+	}
+
+	const char *positions = vertices + offsetof(PackedVertex, x);
+	const char *normals = vertices + offsetof(PackedVertex, nx);
+	const char *texCoords = vertices + offsetof(PackedVertex, s);
+	int stride = sizeof(PackedVertex);
+
+	// Interleave() ran out of memory, the arrays are still separate (one after the other in the buffer)
+	if (obj.Packed == NULL)
+	{
+		positions = (obj.buffers[0] != 0) ? vertices : (const char *)obj.Vertexes;
+		normals = (obj.buffers[0] != 0) ? vertices + obj.numVerts * 3 * sizeof(float) : (const char *)obj.Normals;
+		texCoords = (obj.buffers[0] != 0) ? vertices + obj.numVerts * 6 * sizeof(float) : (const char *)obj.TexCoords;
+		stride = 0;
+	}
+
+	// The shader reads the same arrays from its generic attributes, the colors are always on
+	// there (the materials say whether to use them)
+	if (SceneShader::Supported())
+	{
+		glEnableVertexAttribArray(SceneShader::position);
+		glEnableVertexAttribArray(SceneShader::normal);
+		glVertexAttribPointer(SceneShader::position, 3, GL_FLOAT, GL_FALSE, stride, positions);
+		glVertexAttribPointer(SceneShader::normal, 3, GL_FLOAT, GL_FALSE, stride, normals);
+
+		if (obj.textured)
+		{
+			glEnableVertexAttribArray(SceneShader::texCoord);
+			glVertexAttribPointer(SceneShader::texCoord, 2, GL_FLOAT, GL_FALSE, stride, texCoords);
+		}
+
+		if (obj.Colors != NULL)
+		{
+			glEnableVertexAttribArray(SceneShader::color);
+			glVertexAttribPointer(SceneShader::color, 3, GL_UNSIGNED_BYTE, GL_TRUE, 0, colors);
+		}
+
+		return;
+	}
+
+	// Enable texture coordiantes, normals, and vertices arrays.
+	// The normals are there even when the model isn't lit, OpenGL
+	// ignores them then.
+	if (obj.textured)
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_VERTEX_ARRAY);
+
+	// Point them into the packed vertices (the colors are turned on by the faces that use them)
+	if (obj.textured)
+		glTexCoordPointer(2, GL_FLOAT, stride, texCoords);
+	glNormalPointer(GL_FLOAT, stride, normals);
+	glVertexPointer(3, GL_FLOAT, stride, positions);
+	if (obj.Colors != NULL)
+		glColorPointer(3, GL_UNSIGNED_BYTE, 0, colors);
 }
 
 void Model_3DS::Draw()
+{
+	float modelview[16];
+
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	Draw(modelview);
+}
+
+void Model_3DS::Draw(const float *matrix)
 {
 	if (visible)
 	{
-	glPushMatrix();
+		float m[16];
+
+		MatrixMultiply(m, matrix, Transform());
+
+		int bounds = RenderQueue::AddBounds(m, center.x, center.y, center.z, radius);
+
+		// How many pixels across the model is, for the textures' levels
+		DrawObjects(TextureResidency::Footprint(m, center.x, center.y, center.z, radius), 0, bounds, m);
+	}
+}
+
+void Model_3DS::AddInstance()
+{
+	AddInstance(*this);
+}
+
+void Model_3DS::AddInstance(Model_3DS &mesh)
+{
+	float modelview[16];
+
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	AddInstance(mesh, modelview);
+}
+
+void Model_3DS::AddInstance(Model_3DS &mesh, const float *matrix)
+{
+	if (!visible)
+		return;
+
+	// Make room for twice as many
+	if (mesh.numInstances == mesh.maxInstances)
+	{
+		mesh.maxInstances = (mesh.maxInstances == 0) ? 16 : mesh.maxInstances * 2;
+
+		float *bigger = new float[mesh.maxInstances * 16];
+
+		if (mesh.numInstances > 0)
+			memcpy(bigger, mesh.instances, mesh.numInstances * 16 * sizeof(float));
+
+		delete [] mesh.instances;
+		mesh.instances = bigger;
+	}
+
+	// Where this model would be drawn, its own transform included
+	float *m = &mesh.instances[mesh.numInstances * 16];
+
+	MatrixMultiply(m, matrix, Transform());
+	mesh.numInstances++;
+
+	// The textures get the levels the closest copy needs
+	float pixels = TextureResidency::Footprint(m, mesh.center.x, mesh.center.y, mesh.center.z, mesh.radius);
+
+	if (pixels > mesh.instancePixels)
+		mesh.instancePixels = pixels;
+}
+
+void Model_3DS::DrawInstances()
+{
+	if (numInstances == 0)
+		return;
+
+	if (SceneShader::Supported())
+	{
+		// The spheres go in one after the other, the queue takes the matrices once it has culled them
+		for (int i = 0; i < numInstances; i++)
+		{
+			int bounds = RenderQueue::AddBounds(&instances[i * 16], center.x, center.y, center.z, radius);
+
+			if (i == 0)
+				firstBounds = bounds;
+		}
+
+		drawnInstances = numInstances;
+
+		// The queue puts each copy's matrix in front of the objects' own
+		float identity[16];
+
+		MatrixIdentity(identity);
+		DrawObjects(instancePixels, numInstances, -1, identity);
+	}
+	else
+	{
+		// One at a time, each under its own matrix
+		for (int i = 0; i < numInstances; i++)
+			DrawObjects(instancePixels, 0, RenderQueue::AddBounds(&instances[i * 16], center.x, center.y, center.z, radius), &instances[i * 16]);
+	}
+
+	// Start over for the next frame
+	numInstances = 0;
+	instancePixels = 0.0f;
+}
+
+int Model_3DS::CullInstances()
+{
+	int count = 0;
+
+	// The copies on screen move up over the ones that aren't
+	for (int i = 0; i < drawnInstances; i++)
+	{
+		if (!RenderQueue::Visible(firstBounds + i))
+			continue;
+
+		if (count != i)
+			memcpy(&instances[count * 16], &instances[i * 16], 16 * sizeof(float));
+
+		count++;
+	}
+
+	drawnInstances = 0;
+
+	return count;
+}
+
+const float *Model_3DS::Instances()
+{
+	return instances;
+}
+
+const float *Model_3DS::Transform()
+{
+	if (pos.x != transformPos.x || pos.y != transformPos.y || pos.z != transformPos.z ||
+		rot.x != transformRot.x || rot.y != transformRot.y || rot.z != transformRot.z || scale != transformScale)
+	{
+		MatrixIdentity(transform);
 
 		// Move the model
-		glTranslatef(pos.x, pos.y, pos.z);
+		MatrixTranslate(transform, pos.x, pos.y, pos.z);
 
 		// Rotate the model
-		glRotatef(rot.x, 1.0f, 0.0f, 0.0f);
-		glRotatef(rot.y, 0.0f, 1.0f, 0.0f);
-		glRotatef(rot.z, 0.0f, 0.0f, 1.0f);
+		MatrixRotate(transform, rot.x, 1.0f, 0.0f, 0.0f);
+		MatrixRotate(transform, rot.y, 0.0f, 1.0f, 0.0f);
+		MatrixRotate(transform, rot.z, 0.0f, 0.0f, 1.0f);
 
-		glScalef(scale, scale, scale);
+		MatrixScale(transform, scale, scale, scale);
 
-		// Loop through the objects
-		for (int i = 0; i < numObjects; i++)
+		transformPos = pos;
+		transformRot = rot;
+		transformScale = scale;
+	}
+
+	return transform;
+}
+
+const float *Model_3DS::ObjectTransform(int objindex)
+{
+	Object &obj = Objects[objindex];
+
+	if (obj.pos.x != obj.transformPos.x || obj.pos.y != obj.transformPos.y || obj.pos.z != obj.transformPos.z ||
+		obj.rot.x != obj.transformRot.x || obj.rot.y != obj.transformRot.y || obj.rot.z != obj.transformRot.z)
+	{
+		MatrixIdentity(obj.transform);
+
+		// Move the object
+		MatrixTranslate(obj.transform, obj.pos.x, obj.pos.y, obj.pos.z);
+
+		MatrixRotate(obj.transform, obj.rot.z, 0.0f, 0.0f, 1.0f);
+		MatrixRotate(obj.transform, obj.rot.y, 0.0f, 1.0f, 0.0f);
+		MatrixRotate(obj.transform, obj.rot.x, 1.0f, 0.0f, 0.0f);
+
+		obj.transformPos = obj.pos;
+		obj.transformRot = obj.rot;
+	}
+
+	return obj.transform;
+}
+
+void Model_3DS::DrawObjects(float pixels, int count, int bounds, const float *matrix)
+{
+	float m[16];
+
+	// Loop through the objects
+	for (int i = 0; i < numObjects; i++)
+	{
+		// Move the object
+		MatrixMultiply(m, matrix, ObjectTransform(i));
+
+		// Queue the faces as sorted by material
+		for (int j = 0; j < Objects[i].numMatFaces; j++)
 		{
-			// Enable texture coordiantes, normals, and vertices arrays
-			if (Objects[i].textured)
-				glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+			Material &mat = Materials[Objects[i].MatFaces[j].MatIndex];
+
+			if (mat.textured)
+				TextureResidency::Touch(mat.tex.texture[0], pixels);
+
+			RenderQueue::Add(this, i, j, count, m, bounds);
+		}
+
+		// Show the normals? (Not for the copies, the shader would put them all in one spot)
+		if (shownormals && count == 0)
+		{
+			glPushMatrix();
+			glLoadMatrixf(m);
+
+			// Disable texturing
+			glDisable(GL_TEXTURE_2D);
+			// Disbale lighting if the model is lit
 			if (lit)
-				glEnableClientState(GL_NORMAL_ARRAY);
-			glEnableClientState(GL_VERTEX_ARRAY);
+				glDisable(GL_LIGHTING);
+			// Draw the normals blue
+			glColor3f(0.0f, 0.0f, 1.0f);
+
+			// Loop through the vertices and normals and draw a line between the vertex and the end of the normal
+			glBegin(GL_LINES);
+			for (int k = 0; k < Objects[i].numVerts; k++)
+			{
+				const float *v = Position(Objects[i], k);
+				const float *n = Normal(Objects[i], k);
 
-			// Point them to the objects arrays
-			if (Objects[i].textured)
-				glTexCoordPointer(2, GL_FLOAT, 0, Objects[i].TexCoords);
+				glVertex3f(v[0], v[1], v[2]);
+				glVertex3f(v[0] + n[0], v[1] + n[1], v[2] + n[2]);
+			}
+			glEnd();
+
+			// Reset the color to white
+			glColor3f(1.0f, 1.0f, 1.0f);
+			// If the model is lit then renable lighting
 			if (lit)
-				glNormalPointer(GL_FLOAT, 0, Objects[i].Normals);
-			glVertexPointer(3, GL_FLOAT, 0, Objects[i].Vertexes);
+				glEnable(GL_LIGHTING);
+			glEnable(GL_TEXTURE_2D);
+
+			glPopMatrix();
+		}
+	}
+
+	// Outside of a queued frame the model is drawn right away
+	if (!RenderQueue::Queueing())
+		RenderQueue::Flush();
+}
+
+void Model_3DS::BindObject(int objindex)
+{
+	Object &obj = Objects[objindex];
 
-			// Loop through the faces as sorted by material and draw them
-			for (int j = 0; j < Objects[i].numMatFaces; j ++)
+	// The vertex array object has it all, otherwise point the arrays again
+	if (obj.vao != 0)
+		glBindVertexArray(obj.vao);
+	else
+		SetupArrays(objindex);
+}
+
+void Model_3DS::DrawFaces(int objindex, int group, int count)
+{
+	Object &obj = Objects[objindex];
+	MaterialFaces &faces = obj.MatFaces[group];
+
+	// Draw the faces using an index to the vertex array (an offset into the index buffer if there is one)
+	const void *indices = faces.subFaces;
+
+	if (obj.buffers[1] != 0)
+		indices = (const char *)NULL + faces.offset;
+
+	if (count > 0)
+		glDrawElementsInstanced(GL_TRIANGLES, faces.numSubFaces, GL_UNSIGNED_SHORT, indices, count);
+	else
+		glDrawElements(GL_TRIANGLES, faces.numSubFaces, GL_UNSIGNED_SHORT, indices);
+}
+
+void Model_3DS::AddOccluder(const float *matrix)
+{
+	float m[16];
+	float o[16];
+
+	MatrixMultiply(m, matrix, Transform());
+
+	for (int i = 0; i < numObjects; i++)
+	{
+		Object &obj = Objects[i];
+
+		if (obj.numVerts == 0)
+			continue;
+
+		std::vector<float> vertices(obj.numVerts * 3);
+
+		MatrixMultiply(o, m, ObjectTransform(i));
+
+		// Into world space, the culler keeps them there
+		for (int v = 0; v < obj.numVerts; v++)
+		{
+			const float *p = Position(obj, v);
+
+			for (int k = 0; k < 3; k++)
+				vertices[v * 3 + k] = o[k] * p[0] + o[4 + k] * p[1] + o[8 + k] * p[2] + o[12 + k];
+		}
+
+		for (int j = 0; j < obj.numMatFaces; j++)
+			OcclusionCuller::AddOccluder(&vertices[0], obj.numVerts, obj.MatFaces[j].subFaces, obj.MatFaces[j].numSubFaces);
+	}
+}
+
+// Milliseconds since start
+static double Elapsed(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Model_3DS::CompareLayouts(int frames)
+{
+	// Nothing to time without vertices
+	if (frames <= 0 || numObjects == 0 || totalVerts == 0)
+		return;
+
+	// Nothing to compare if an object couldn't be packed
+	for (int i = 0; i < numObjects; i++)
+	{
+		if (Objects[i].numVerts > 0 && Objects[i].Packed == NULL)
+		{
+			printf("%s: the vertices aren't interleaved, nothing to compare\n", modelname);
+			return;
+		}
+	}
+
+	// The separate arrays are gone once a model is loaded, unpack a copy
+	std::vector<std::vector<float> > separate(numObjects);
+
+	for (int i = 0; i < numObjects; i++)
+	{
+		int n = Objects[i].numVerts;
+		separate[i].resize(n * 8);
+
+		for (int v = 0; v < n; v++)
+		{
+			PackedVertex &p = Objects[i].Packed[v];
+
+			separate[i][v*3] = p.x;
+			separate[i][v*3+1] = p.y;
+			separate[i][v*3+2] = p.z;
+			separate[i][n*3 + v*3] = p.nx;
+			separate[i][n*3 + v*3+1] = p.ny;
+			separate[i][n*3 + v*3+2] = p.nz;
+			separate[i][n*6 + v*2] = p.s;
+			separate[i][n*6 + v*2+1] = p.t;
+		}
+	}
+
+	// A pass on the CPU that reads every part of every vertex, the way
+	// bounds, skinning or picking would. The sum keeps it from being optimized away.
+	volatile float sink = 0.0f;
+	double walk[2];
+
+	for (int layout = 0; layout < 2; layout++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (int f = 0; f < frames; f++)
+		{
+			for (int i = 0; i < numObjects; i++)
 			{
-				// Use the material's texture
-				Materials[Objects[i].MatFaces[j].MatIndex].tex.Use();
+				int n = Objects[i].numVerts;
+				float sum = 0.0f;
 
-				glPushMatrix();
+				// An object without vertices has no arrays to point at
+				if (n == 0)
+					continue;
 
-					// Move the model
-					glTranslatef(Objects[i].pos.x, Objects[i].pos.y, Objects[i].pos.z);
+				if (layout == 0)
+				{
+					const float *p = &separate[i][0];
+					const float *nm = p + n * 3;
+					const float *st = p + n * 6;
 
-					glRotatef(Objects[i].rot.z, 0.0f, 0.0f, 1.0f);
-					glRotatef(Objects[i].rot.y, 0.0f, 1.0f, 0.0f);
-					glRotatef(Objects[i].rot.x, 1.0f, 0.0f, 0.0f);
+					for (int v = 0; v < n; v++)
+						sum += (p[v*3] + nm[v*3]) * st[v*2] + (p[v*3+1] + nm[v*3+1]) * st[v*2+1] + p[v*3+2] + nm[v*3+2];
+				}
+				else
+				{
+					const PackedVertex *p = Objects[i].Packed;
 
-					// Draw the faces using an index to the vertex array
-					glDrawElements(GL_TRIANGLES, Objects[i].MatFaces[j].numSubFaces, GL_UNSIGNED_SHORT, Objects[i].MatFaces[j].subFaces);
+					for (int v = 0; v < n; v++)
+						sum += (p[v].x + p[v].nx) * p[v].s + (p[v].y + p[v].ny) * p[v].t + p[v].z + p[v].nz;
+				}
 
-				glPopMatrix();
+				sink = sink + sum;
 			}
+		}
+
+		walk[layout] = Elapsed(start) / frames;
+	}
+
+	// Drawing every face with each layout, from buffer objects when the card has them
+	std::vector<unsigned int> buffers(numObjects, 0);
+	double draw[2];
 
-			// Show the normals?
-			if (shownormals)
+	if (GLEW_VERSION_1_5)
+	{
+		glGenBuffers(numObjects, &buffers[0]);
+
+		for (int i = 0; i < numObjects; i++)
+		{
+			if (separate[i].empty())
+				continue;
+
+			glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+			glBufferData(GL_ARRAY_BUFFER, separate[i].size() * sizeof(float), &separate[i][0], GL_STATIC_DRAW);
+		}
+	}
+
+	if (GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object)
+		glBindVertexArray(0);
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_VERTEX_ARRAY);
+
+	for (int layout = 0; layout < 2; layout++)
+	{
+		glFinish();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (int f = 0; f < frames; f++)
+		{
+			for (int i = 0; i < numObjects; i++)
 			{
-				// Loop through the vertices and normals and draw the normal
-				for (int k = 0; k < Objects[i].numVerts * 3; k += 3)
+				Object &obj = Objects[i];
+
+				if (obj.numVerts == 0)
+					continue;
+
+				if (layout == 0)
 				{
-					// Disable texturing
-					glDisable(GL_TEXTURE_2D);
-					// Disbale lighting if the model is lit
-					if (lit)
-						glDisable(GL_LIGHTING);
-					// Draw the normals blue
-					glColor3f(0.0f, 0.0f, 1.0f);
-
-					// Draw a line between the vertex and the end of the normal
-					glBegin(GL_LINES);
-						glVertex3f(Objects[i].Vertexes[k], Objects[i].Vertexes[k+1], Objects[i].Vertexes[k+2]);
-						glVertex3f(Objects[i].Vertexes[k]+Objects[i].Normals[k], Objects[i].Vertexes[k+1]+Objects[i].Normals[k+1], Objects[i].Vertexes[k+2]+Objects[i].Normals[k+2]);
-					glEnd();
-
-					// Reset the color to white
-					glColor3f(1.0f, 1.0f, 1.0f);
-					// If the model is lit then renable lighting
-					if (lit)
-						glEnable(GL_LIGHTING);
+					const char *base = (buffers[i] != 0) ? NULL : (const char *)&separate[i][0];
+
+					if (GLEW_VERSION_1_5)
+						glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+
+					glVertexPointer(3, GL_FLOAT, 0, base);
+					glNormalPointer(GL_FLOAT, 0, base + obj.numVerts * 3 * sizeof(float));
+					glTexCoordPointer(2, GL_FLOAT, 0, base + obj.numVerts * 6 * sizeof(float));
+				}
+				else
+				{
+					const char *base = (obj.buffers[0] != 0) ? NULL : (const char *)obj.Packed;
+
+					if (GLEW_VERSION_1_5)
+						glBindBuffer(GL_ARRAY_BUFFER, obj.buffers[0]);
+
+					glVertexPointer(3, GL_FLOAT, sizeof(PackedVertex), base + offsetof(PackedVertex, x));
+					glNormalPointer(GL_FLOAT, sizeof(PackedVertex), base + offsetof(PackedVertex, nx));
+					glTexCoordPointer(2, GL_FLOAT, sizeof(PackedVertex), base + offsetof(PackedVertex, s));
 				}
+
+				// The same indices both times, from our own arrays
+				for (int j = 0; j < obj.numMatFaces; j++)
+					glDrawElements(GL_TRIANGLES, obj.MatFaces[j].numSubFaces, GL_UNSIGNED_SHORT, obj.MatFaces[j].subFaces);
 			}
 		}
 
-	glPopMatrix();
+		glFinish();
+		draw[layout] = Elapsed(start) / frames;
+	}
+
+	if (GLEW_VERSION_1_5)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDeleteBuffers(numObjects, &buffers[0]);
 	}
+
+	printf("%s: %d vertices, walk %.3f ms separate / %.3f ms interleaved, draw %.3f ms separate / %.3f ms interleaved\n",
+		modelname, totalVerts, walk[0], walk[1], draw[0], draw[1]);
 }
 
 void Model_3DS::CalculateNormals()
@@ -392,6 +1456,63 @@ void Model_3DS::CalculateNormals()
 	}
 }
 
+void Model_3DS::CalculateBounds()
+{
+	Vector low = { 0.0f, 0.0f, 0.0f };
+	Vector high = { 0.0f, 0.0f, 0.0f };
+	bool first = true;
+
+	// The box around every vertex
+	for (int i = 0; i < numObjects; i++)
+	{
+		for (int g = 0; g < Objects[i].numVerts; g++)
+		{
+			const float *v = Position(Objects[i], g);
+
+			if (first)
+			{
+				low.x = high.x = v[0];
+				low.y = high.y = v[1];
+				low.z = high.z = v[2];
+				first = false;
+				continue;
+			}
+
+			if (v[0] < low.x) low.x = v[0];
+			if (v[1] < low.y) low.y = v[1];
+			if (v[2] < low.z) low.z = v[2];
+			if (v[0] > high.x) high.x = v[0];
+			if (v[1] > high.y) high.y = v[1];
+			if (v[2] > high.z) high.z = v[2];
+		}
+	}
+
+	if (first)
+		return;
+
+	center.x = (low.x + high.x) * 0.5f;
+	center.y = (low.y + high.y) * 0.5f;
+	center.z = (low.z + high.z) * 0.5f;
+
+	// The farthest vertex from its middle
+	radius = 0.0f;
+
+	for (int i = 0; i < numObjects; i++)
+	{
+		for (int g = 0; g < Objects[i].numVerts; g++)
+		{
+			const float *v = Position(Objects[i], g);
+			float dx = v[0] - center.x;
+			float dy = v[1] - center.y;
+			float dz = v[2] - center.z;
+			float length = (float)sqrt(dx*dx + dy*dy + dz*dz);
+
+			if (length > radius)
+				radius = length;
+		}
+	}
+}
+
 void Model_3DS::MainChunkProcessor(long length, long findex)
 {
 	ChunkHeader h;
@@ -508,12 +1629,34 @@ void Model_3DS::EditChunkProcessor(long length, long findex)
 			Objects[m].rot.x = 0.0f;
 			Objects[m].rot.y = 0.0f;
 			Objects[m].rot.z = 0.0f;
+
+			MatrixIdentity(Objects[m].transform);
+			Objects[m].transformPos = Objects[m].pos;
+			Objects[m].transformRot = Objects[m].rot;
 		}
 
 		// Zero out the number of texture coords
 		for (int n = 0; n < numObjects; n++)
 			Objects[n].numTexCoords = 0;
 
+		// Nothing has been allocated for the objects yet
+		for (int o = 0; o < numObjects; o++)
+		{
+			Objects[o].Vertexes = NULL;
+			Objects[o].Normals = NULL;
+			Objects[o].TexCoords = NULL;
+			Objects[o].Packed = NULL;
+			Objects[o].Colors = NULL;
+			Objects[o].Faces = NULL;
+			Objects[o].MatFaces = NULL;
+			Objects[o].buffers[0] = 0;
+			Objects[o].buffers[1] = 0;
+			Objects[o].vao = 0;
+			Objects[o].numVerts = 0;
+			Objects[o].numFaces = 0;
+			Objects[o].numMatFaces = 0;
+		}
+
 		fseek(bin3ds, findex, SEEK_SET);
 
 		int j = 0;
@@ -599,7 +1742,7 @@ void Model_3DS::MaterialNameChunkProcessor(long length, long findex, int matinde
 		Materials[matindex].name[i] = fgetc(bin3ds);
 		if (Materials[matindex].name[i] == 0)
 		{
-			Materials[matindex].name[i] = NULL;
+			Materials[matindex].name[i] = 0;
 			break;
 		}
 	}
@@ -670,8 +1813,8 @@ void Model_3DS::FloatColorChunkProcessor(long length, long findex, int matindex)
 	fread(&b,sizeof(b),1,bin3ds);
 
 	Materials[matindex].color.r = (unsigned char)(r*255.0f);
-	Materials[matindex].color.g = (unsigned char)(r*255.0f);
-	Materials[matindex].color.b = (unsigned char)(r*255.0f);
+	Materials[matindex].color.g = (unsigned char)(g*255.0f);
+	Materials[matindex].color.b = (unsigned char)(b*255.0f);
 	Materials[matindex].color.a = 255;
 
 	// move the file pointer back to where we got it so
@@ -751,18 +1894,14 @@ void Model_3DS::MapNameChunkProcessor(long length, long findex, int matindex)
 		name[i] = fgetc(bin3ds);
 		if (name[i] == 0)
 		{
-			name[i] = NULL;
+			name[i] = 0;
 			break;
 		}
 	}
 
-	std::string n = name;
-	n.erase(n.end() - 3, n.end());
-	n += "bmp";
-	// Load the name and indicate that the material has a texture
-	char fullname[80];
-	sprintf(fullname, "%s%s", path, n.c_str());
-	Materials[matindex].tex.Load(fullname);
+	// Keep the name and indicate that the material has a texture,
+	// it is loaded by LoadTextures() once the faces have been read
+	sprintf(Materials[matindex].mapname, "%s%s", path, name);
 	Materials[matindex].textured = true;
 
 	// move the file pointer back to where we got it so
@@ -785,7 +1924,7 @@ void Model_3DS::ObjectChunkProcessor(long length, long findex, int objindex)
 		Objects[objindex].name[i] = fgetc(bin3ds);
 		if (Objects[objindex].name[i] == 0)
 		{
-			Objects[objindex].name[i] = NULL;
+			Objects[objindex].name[i] = 0;
 			break;
 		}
 	}
@@ -1105,7 +2244,7 @@ void Model_3DS::FacesMaterialsListChunkProcessor(long length, long findex, int o
 		name[i] = fgetc(bin3ds);
 		if (name[i] == 0)
 		{
-			name[i] = NULL;
+			name[i] = 0;
 			break;
 		}
 	}
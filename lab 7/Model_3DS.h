@@ -22,7 +22,43 @@
 //    the model
 //
 // Support for non-textured faces is done by reading the color
-// from the material's diffuse color.
+// from the material's diffuse color. Those faces are drawn with
+// texturing off and the color on their vertices, so an object's
+// colored faces take a single draw and no texture at all.
+//
+// Once loaded, the vertices and faces of every object are copied
+// into buffer objects and a vertex array object remembers where
+// they are, so drawing sends nothing over the bus.
+//
+// The position, normal and texcoords of a vertex are kept together,
+// 32 bytes a vertex on 32 byte boundaries, so fetching a vertex (on
+// the card or in our own passes over them) reads one cache line
+// from a single stream instead of three.
+//
+// Many copies of a model can be drawn together: AddInstance()
+// remembers the current matrix (with the model's pos, rot and
+// scale) and DrawInstances() hands all of them to the queue,
+// which draws each material once for all of the copies with
+// glDrawElementsInstanced (through the SceneShader). A model that
+// is only a placement, like one of several coins, can add itself
+// as a copy of another model without loading the file again.
+// Cards that can't instance draw them one at a time instead.
+//
+// Drawing goes through the RenderQueue: a model hands it a group
+// of faces per material and the queue sets up the arrays, binds
+// the textures and draws, right away or, between
+// RenderQueue::Begin() and End(), sorted with the rest of the frame.
+// The model hands in its bounding sphere with each copy so the
+// queue can leave the ones that are off screen out. The sphere
+// is around the whole model, moving or turning an object out of
+// it can get the object culled while it is on screen.
+//
+// The pos, rot and scale of the model, and the pos and rot of
+// each object, are turned into a matrix only when they change,
+// and the matrices the faces are queued with are multiplied out
+// here instead of on the OpenGL matrix stack. Draw() and
+// AddInstance() start from the current modelview matrix, or from
+// the one they are given (the Scene has it already).
 //
 // Some models have problems loading even if you follow all of
 // the restrictions I have stated and I don't know why. If you
@@ -66,6 +102,29 @@
 // m.Objects[0].pos.y = 0.0f;
 // m.Objects[0].pos.z = 0.0f;
 //
+// // If the .3ds file changed on disk you can load it again
+// // in place, the textures are reloaded along with it
+// m.Reload();
+//
+// // Lots of copies: queue each one where it goes, then draw them all
+// for (int i = 0; i < 100; i++)
+// {
+//		glPushMatrix();
+//		glTranslatef(i * 10.0f, 0.0f, 0.0f);
+//		m.AddInstance();
+//		glPopMatrix();
+// }
+// m.DrawInstances();
+//
+// // Copies that move on their own keep their pos and rot in
+// // models of their own, only coin1 has to be loaded
+// coin1.AddInstance();
+// coin2.AddInstance(coin1);
+// coin1.DrawInstances();
+//
+// // Times separate and interleaved vertex arrays on this model
+// m.CompareLayouts(100);
+//
 //////////////////////////////////////////////////////////////////////
 
 #ifndef MODEL_3DS_H
@@ -75,6 +134,8 @@
 // Would have greatly bloated the model class's code
 // Just replace this with your favorite texture class
 #include "GLTexture.h"
+#include "TextureAtlas.h"
+#include "TextureResidency.h"
 
 #include <stdio.h>
 
@@ -96,6 +157,13 @@ public:
 		float z;
 	};
 
+	// Everything about a vertex in one place, 32 bytes
+	struct PackedVertex {
+		float x, y, z;		// The position
+		float nx, ny, nz;	// The normal
+		float s, t;			// The texture coordinates
+	};
+
 	// Color struct holds the diffuse color of the material
 	struct Color4i {
 		unsigned char r;
@@ -105,18 +173,18 @@ public:
 	};
 
 	// Holds the material info
-	// TODO: add color support for non textured polys
 	struct Material {
 		char name[80];	// The material's name
 		GLTexture tex;	// The texture (this is the only outside reference in this class)
 		bool textured;	// whether or not it is textured
-		Color4i color;
+		Color4i color;	// The diffuse color, drawn w/o a texture if it isn't textured
+		char mapname[160];	// The texture file, loaded once the faces are read
 	};
 
 	// Every chunk in the 3ds file starts with this struct
 	struct ChunkHeader {
 		unsigned short id;	// The chunk's id
-		unsigned long  len;	// The lenght of the chunk
+		unsigned int len;	// The lenght of the chunk, 4 bytes in the file (a long is 8 on 64 bit Linux)
 	};
 
 	// I sort the mesh by material so that I won't have to switch textures a great deal
@@ -124,14 +192,17 @@ public:
 		unsigned short *subFaces;	// Index to our vertex array of all the faces that use this material
 		int numSubFaces;			// The number of faces
 		int MatIndex;				// An index to our materials
+		unsigned int offset;		// Where its indices start in the object's index buffer, in bytes
 	};
 
 	// The 3ds file can be made up of several objects
 	struct Object {
 		char name[80];				// The object name
-		float *Vertexes;			// The array of vertices
-		float *Normals;				// The array of the normals for the vertices
-		float *TexCoords;			// The array of texture coordinates for the vertices
+		float *Vertexes;			// The array of vertices (NULL once they are packed)
+		float *Normals;				// The array of the normals for the vertices (NULL once they are packed)
+		float *TexCoords;			// The array of texture coordinates for the vertices (NULL once they are packed)
+		PackedVertex *Packed;		// The vertices, normals and texcoords together, built once the model is loaded (NULL if out of memory)
+		unsigned char *Colors;		// The colors of the vertices of untextured materials, NULL to use glColor
 		unsigned short *Faces;		// The array of face indices
 		int numFaces;				// The number of faces
 		int numMatFaces;			// The number of differnet material faces
@@ -141,6 +212,11 @@ public:
 		MaterialFaces *MatFaces;	// The faces are divided by materials
 		Vector pos;					// The position to move the object to
 		Vector rot;					// The angles to rotate the object
+		unsigned int buffers[2];	// The vertex and index buffer objects, 0 to draw from our own arrays
+		unsigned int vao;			// The vertex array object that points into them, 0 if the card has none
+		float transform[16];		// pos and rot as a matrix
+		Vector transformPos;		// The pos and rot it was made from, to tell when they change
+		Vector transformRot;
 	};
 
 	char *modelname;		// The name of the model
@@ -149,6 +225,8 @@ public:
 	int numMaterials;		// Total number of materials in the model
 	int totalVerts;			// Total number of vertices in the model
 	int totalFaces;			// Total number of faces in the model
+	Vector center;			// The middle of the model's vertices
+	float radius;			// How far the vertices reach from the center
 	bool shownormals;		// True: show the normals
 	Material *Materials;	// The array of materials
 	Object *Objects;		// The array of objects in the model
@@ -158,7 +236,19 @@ public:
 	bool lit;				// True: the model is lit
 	bool visible;			// True: the model gets rendered
 	void Load(char *name);	// Loads a model
+	bool Reload();			// Loads the model again from the same file, false (the old one kept) if it can't
 	void Draw();			// Draws the model
+	void Draw(const float *matrix);	// Draws the model with matrix in place of the current modelview matrix
+	void AddInstance();		// Queues a copy of the model at the current matrix
+	void AddInstance(Model_3DS &mesh);	// Queues a copy of mesh where this model would be drawn (this one needn't be loaded)
+	void AddInstance(Model_3DS &mesh, const float *matrix);	// The same with matrix in place of the current modelview matrix
+	void BindObject(int objindex);	// Points the arrays at an object
+	void DrawFaces(int objindex, int group, int count);	// Draws a group of faces of the bound object, count copies if it isn't 0
+	void DrawInstances();	// Draws the queued copies, one draw call per material for all of them
+	int CullInstances();	// Moves the copies that are on screen to the front of Instances(), returns how many
+	const float *Instances();	// The matrices of the queued copies, 16 floats each
+	void CompareLayouts(int frames);	// Prints how long drawing and walking the vertices take with both layouts
+	void AddOccluder(const float *matrix);	// Hands the OcclusionCuller the faces, placed with matrix
 	FILE *bin3ds;			// The binary 3ds file
 	Model_3DS();			// Constructor
 	virtual ~Model_3DS();	// Destructor
@@ -198,6 +288,51 @@ private:
 	// Calculates the normals of the vertices by averaging
 	// the normals of the faces that use that vertex
 	void CalculateNormals();
+
+	// Finds the center of the vertices and the radius around it
+	void CalculateBounds();
+
+	// Releases the objects, materials and textures of the model
+	void Free();
+
+	// Loads the textures of the materials, packing the small ones into an atlas
+	void LoadTextures();
+	// True if the faces of a material only use one tile of its texture, cell gets its corner
+	bool InsideOneTile(int matindex, float *cell);
+	// Gives the vertices split materials share with other materials copies of their own,
+	// returns how many vertices that makes (only counts them if apply is false)
+	int SplitSharedVertices(int objindex, const bool *split, bool apply);
+	// Puts the colors of the untextured materials on their vertices
+	void ColorVertices(int objindex);
+	// Moves the texcoords of the packed materials onto their spot in the atlas
+	void RemapTexCoords(int objindex, const bool *packed, const TextureAtlas::Rect *rects, const float *cells);
+	// Joins the faces of materials that ended up with the same texture (or, colored on the vertices, none)
+	void MergeMaterialFaces(int objindex);
+	// Packs the vertices, normals and texcoords of an object together and frees the separate arrays,
+	// if there is the memory for it (otherwise the object is drawn from the separate arrays)
+	void Interleave(int objindex);
+	// Copies the vertices and faces of an object into buffer objects, once
+	void UploadBuffers(int objindex);
+	// Points the vertex arrays at an object's buffers (or at our arrays if it has none)
+	void SetupArrays(int objindex);
+	// The model's pos, rot and scale as a matrix, made again only if they changed
+	const float *Transform();
+	// The same for an object's pos and rot
+	const float *ObjectTransform(int objindex);
+	// Queues the objects drawn with matrix inside bounds, or count copies of them with the instance matrices if count isn't 0
+	void DrawObjects(float pixels, int count, int bounds, const float *matrix);
+
+	float transform[16];		// pos, rot and scale as a matrix
+	Vector transformPos;		// The pos, rot and scale it was made from, to tell when they change
+	Vector transformRot;
+	float transformScale;
+
+	float *instances;			// The matrices of the queued copies, 16 floats each
+	int numInstances;			// How many are queued
+	int maxInstances;			// How many fit in instances
+	float instancePixels;		// Pixels across the biggest queued copy, for the textures' levels
+	int drawnInstances;			// How many copies DrawInstances() handed the RenderQueue
+	int firstBounds;			// The RenderQueue's number for the sphere of the first one
 };
 
 #endif MODEL_3DS_H
\ No newline at end of file
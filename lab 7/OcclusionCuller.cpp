@@ -0,0 +1,518 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Occlusion Culler Class
+//
+// OcclusionCuller.cpp: implementation of the OcclusionCuller class.
+// The triangles are moved to clip space, cut at the near plane
+// and drawn with the three edge functions: a pixel is inside
+// if its center is on the inner side of all of them, and its
+// 1/w is worked out from the same functions. Four pixels of a
+// row go through together, the rows are kept a multiple of
+// four wide so they never have to be cut short.
+//
+// The worker only touches the triangles and the buffer while
+// pending is set, everything that changes them waits for it
+// to be cleared first.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "OcclusionCuller.h"
+#include "Matrix.h"
+#include "Simd.h"
+#include "glew.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define DEPTH_WIDTH			256
+#define DEPTH_HEIGHT		128
+// Halved down to 1x1
+#define LEVELS				9
+
+bool OcclusionCuller::enabled = true;
+
+static std::vector<float> triangles;				// 9 floats each, in world space
+static float camera[16];							// Projection times view, for the triangles
+static float projection[16];						// For the spheres, which are in eye space already
+static std::vector<float> levels[LEVELS];
+static int levelWidth[LEVELS];
+static int levelHeight[LEVELS];
+
+static std::mutex lock;
+static std::condition_variable wake;
+static std::thread worker;
+static bool running = false;
+static bool pending = false;						// Begin() handed over a camera the worker hasn't drawn yet
+static bool drawn = false;							// The levels are ready for Test()
+
+static int Min(int a, int b) { return a < b ? a : b; }
+static int Max(int a, int b) { return a > b ? a : b; }
+static float Min(float a, float b) { return a < b ? a : b; }
+static float Max(float a, float b) { return a > b ? a : b; }
+
+// Cuts a triangle in clip space at the near plane, returns how many corners are left (0, 3 or 4)
+static int ClipNear(const float in[3][4], float out[4][4])
+{
+	int count = 0;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const float *a = in[i];
+		const float *b = in[(i + 1) % 3];
+		float da = a[2] + a[3];
+		float db = b[2] + b[3];
+
+		if (da >= 0.0f)
+			memcpy(out[count++], a, 4 * sizeof(float));
+
+		// The edge goes through the plane, add where
+		if ((da >= 0.0f) != (db >= 0.0f))
+		{
+			float t = da / (da - db);
+
+			for (int k = 0; k < 4; k++)
+				out[count][k] = a[k] + (b[k] - a[k]) * t;
+
+			count++;
+		}
+	}
+
+	return count;
+}
+
+// Draws a triangle in pixels into the biggest level, keeping the nearest 1/w
+static void DrawTriangle(float *depth, const float *sx, const float *sy, const float *iw)
+{
+	float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+
+	if (fabs(area) < 1e-6f)
+		return;
+
+	// Edge k is the one across from corner k, on its side it is positive
+	float sign = (area > 0.0f) ? 1.0f : -1.0f;
+	float a[3], b[3], c[3];
+	float za = 0.0f, zb = 0.0f, zc = 0.0f;
+
+	for (int k = 0; k < 3; k++)
+	{
+		int i = (k + 1) % 3;
+		int j = (k + 2) % 3;
+
+		a[k] = -(sy[j] - sy[i]) * sign;
+		b[k] = (sx[j] - sx[i]) * sign;
+		c[k] = -(a[k] * sx[i] + b[k] * sy[i]);
+
+		// Each edge over the area is the weight of its corner
+		za += a[k] * iw[k];
+		zb += b[k] * iw[k];
+		zc += c[k] * iw[k];
+	}
+
+	area *= sign;
+	za /= area;
+	zb /= area;
+	zc /= area;
+
+	int minX = Max((int)floor(Min(Min(sx[0], sx[1]), sx[2])), 0);
+	int maxX = Min((int)ceil(Max(Max(sx[0], sx[1]), sx[2])), DEPTH_WIDTH - 1);
+	int minY = Max((int)floor(Min(Min(sy[0], sy[1]), sy[2])), 0);
+	int maxY = Min((int)ceil(Max(Max(sy[0], sy[1]), sy[2])), DEPTH_HEIGHT - 1);
+
+	if (minX > maxX || minY > maxY)
+		return;
+
+	// Start on a group of four
+	minX &= ~3;
+
+#ifdef SIMD_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 four = _mm_set1_ps(4.0f);
+	const __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]), az = _mm_set1_ps(za);
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		float py = y + 0.5f;
+		float *row = depth + y * DEPTH_WIDTH;
+
+		// What doesn't change along the row
+		__m128 r0 = _mm_set1_ps(b[0] * py + c[0]);
+		__m128 r1 = _mm_set1_ps(b[1] * py + c[1]);
+		__m128 r2 = _mm_set1_ps(b[2] * py + c[2]);
+		__m128 rz = _mm_set1_ps(zb * py + zc);
+		__m128 px = _mm_add_ps(_mm_set1_ps((float)minX), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+
+		for (int x = minX; x <= maxX; x += 4, px = _mm_add_ps(px, four))
+		{
+			__m128 inside = _mm_and_ps(_mm_and_ps(
+				_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+				_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero)),
+				_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 old = _mm_loadu_ps(row + x);
+			__m128 nearer = _mm_max_ps(old, _mm_add_ps(_mm_mul_ps(az, px), rz));
+
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+		}
+	}
+#else
+	for (int y = minY; y <= maxY; y++)
+	{
+		float py = y + 0.5f;
+		float *row = depth + y * DEPTH_WIDTH;
+
+		for (int x = minX; x <= maxX; x++)
+		{
+			float px = x + 0.5f;
+
+			if (a[0] * px + b[0] * py + c[0] < 0.0f || a[1] * px + b[1] * py + c[1] < 0.0f || a[2] * px + b[2] * py + c[2] < 0.0f)
+				continue;
+
+			row[x] = Max(row[x], za * px + zb * py + zc);
+		}
+	}
+#endif
+}
+
+// Draws every triangle with the camera into the biggest level
+static void Rasterize()
+{
+	float *depth = &levels[0][0];
+
+	// Nothing drawn is as far as it gets
+	memset(depth, 0, DEPTH_WIDTH * DEPTH_HEIGHT * sizeof(float));
+
+	for (size_t t = 0; t + 9 <= triangles.size(); t += 9)
+	{
+		float corners[3][4];
+		float clipped[4][4];
+
+		for (int v = 0; v < 3; v++)
+		{
+			const float *p = &triangles[t + v * 3];
+
+			for (int k = 0; k < 4; k++)
+				corners[v][k] = camera[k] * p[0] + camera[4 + k] * p[1] + camera[8 + k] * p[2] + camera[12 + k];
+		}
+
+		int count = ClipNear(corners, clipped);
+
+		if (count < 3)
+			continue;
+
+		float sx[4], sy[4], iw[4];
+
+		for (int v = 0; v < count; v++)
+		{
+			iw[v] = 1.0f / clipped[v][3];
+			sx[v] = (clipped[v][0] * iw[v] * 0.5f + 0.5f) * DEPTH_WIDTH;
+			sy[v] = (clipped[v][1] * iw[v] * 0.5f + 0.5f) * DEPTH_HEIGHT;
+		}
+
+		DrawTriangle(depth, sx, sy, iw);
+
+		// Four corners left make two triangles
+		if (count == 4)
+		{
+			float fx[3] = { sx[0], sx[2], sx[3] };
+			float fy[3] = { sy[0], sy[2], sy[3] };
+			float fw[3] = { iw[0], iw[2], iw[3] };
+
+			DrawTriangle(depth, fx, fy, fw);
+		}
+	}
+}
+
+// Each level keeps the farthest depth of the 2x2 texels above it
+static void BuildLevels()
+{
+	for (int l = 1; l < LEVELS; l++)
+	{
+		const float *src = &levels[l - 1][0];
+		float *dest = &levels[l][0];
+		int srcWidth = levelWidth[l - 1];
+		int srcHeight = levelHeight[l - 1];
+		int width = levelWidth[l];
+		int height = levelHeight[l];
+
+		for (int y = 0; y < height; y++)
+		{
+			const float *row0 = src + Min(y * 2, srcHeight - 1) * srcWidth;
+			const float *row1 = src + Min(y * 2 + 1, srcHeight - 1) * srcWidth;
+			int x = 0;
+
+#ifdef SIMD_SSE2
+			// Eight texels of both rows down to four
+			for (; x + 4 <= width && x * 2 + 8 <= srcWidth; x += 4)
+			{
+				__m128 left = _mm_min_ps(_mm_loadu_ps(row0 + x * 2), _mm_loadu_ps(row1 + x * 2));
+				__m128 right = _mm_min_ps(_mm_loadu_ps(row0 + x * 2 + 4), _mm_loadu_ps(row1 + x * 2 + 4));
+
+				_mm_storeu_ps(dest + y * width + x, _mm_min_ps(_mm_shuffle_ps(left, right, _MM_SHUFFLE(2, 0, 2, 0)),
+					_mm_shuffle_ps(left, right, _MM_SHUFFLE(3, 1, 3, 1))));
+			}
+#endif
+
+			for (; x < width; x++)
+			{
+				int x0 = Min(x * 2, srcWidth - 1);
+				int x1 = Min(x * 2 + 1, srcWidth - 1);
+
+				dest[y * width + x] = Min(Min(row0[x0], row0[x1]), Min(row1[x0], row1[x1]));
+			}
+		}
+	}
+}
+
+static void Work()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (running)
+	{
+		if (!pending)
+		{
+			wake.wait(guard);
+			continue;
+		}
+
+		// Nobody else touches the triangles or the levels while pending is set
+		guard.unlock();
+		Rasterize();
+		BuildLevels();
+		guard.lock();
+
+		pending = false;
+		drawn = true;
+		wake.notify_all();
+	}
+}
+
+static void StopWorker()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running = false;
+	}
+
+	wake.notify_all();
+
+	if (worker.joinable())
+		worker.join();
+}
+
+static void StartWorker()
+{
+	if (running)
+		return;
+
+	int width = DEPTH_WIDTH;
+	int height = DEPTH_HEIGHT;
+
+	for (int l = 0; l < LEVELS; l++)
+	{
+		levelWidth[l] = width;
+		levelHeight[l] = height;
+		levels[l].resize(width * height);
+
+		width = Max(width / 2, 1);
+		height = Max(height / 2, 1);
+	}
+
+	running = true;
+	worker = std::thread(Work);
+
+	static bool registered = false;
+
+	if (!registered)
+		atexit(StopWorker);
+
+	registered = true;
+}
+
+// Waits for the frame the worker is drawing, true if there is one to test against
+static bool WaitForWorker()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (pending)
+		wake.wait(guard);
+
+	return drawn;
+}
+
+void OcclusionCuller::AddOccluder(const float *vertices, int numVertices, const unsigned short *indices, int numIndices)
+{
+	WaitForWorker();
+
+	for (int i = 0; i + 3 <= numIndices; i += 3)
+	{
+		if (indices[i] >= numVertices || indices[i + 1] >= numVertices || indices[i + 2] >= numVertices)
+			continue;
+
+		for (int k = 0; k < 3; k++)
+		{
+			const float *v = &vertices[indices[i + k] * 3];
+
+			triangles.push_back(v[0]);
+			triangles.push_back(v[1]);
+			triangles.push_back(v[2]);
+		}
+	}
+}
+
+void OcclusionCuller::AddBox(const float *matrix)
+{
+	static const unsigned short faces[36] = {
+		0, 2, 1,  1, 2, 3,							// -z
+		4, 5, 6,  5, 7, 6,							// +z
+		0, 1, 4,  1, 5, 4,							// -y
+		2, 6, 3,  3, 6, 7,							// +y
+		0, 4, 2,  2, 4, 6,							// -x
+		1, 3, 5,  3, 7, 5							// +x
+	};
+	float corners[8 * 3];
+
+	for (int i = 0; i < 8; i++)
+	{
+		float x = (i & 1) ? 0.5f : -0.5f;
+		float y = (i & 2) ? 0.5f : -0.5f;
+		float z = (i & 4) ? 0.5f : -0.5f;
+
+		for (int k = 0; k < 3; k++)
+			corners[i * 3 + k] = matrix[k] * x + matrix[4 + k] * y + matrix[8 + k] * z + matrix[12 + k];
+	}
+
+	AddOccluder(corners, 8, faces, 36);
+}
+
+void OcclusionCuller::ClearOccluders()
+{
+	WaitForWorker();
+	triangles.clear();
+
+	// What was drawn with them doesn't hide anything anymore
+	drawn = false;
+}
+
+void OcclusionCuller::Begin()
+{
+	if (!enabled || triangles.empty())
+		return;
+
+	StartWorker();
+
+	// The frame before has to be done with the levels first
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (pending)
+		wake.wait(guard);
+
+	float view[16];
+
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, view);
+	MatrixMultiply(camera, projection, view);
+
+	pending = true;
+	drawn = false;
+	wake.notify_all();
+}
+
+// True if the sphere is behind what is drawn everywhere its box covers
+static bool Hidden(float x, float y, float z, float radius)
+{
+	// w of the point nearest to us, if it is in front of us at all
+	float nearest = projection[3] * x + projection[7] * y + projection[11] * (z + radius) + projection[15];
+
+	if (nearest <= 0.0f)
+		return false;
+
+	float minX = 1.0f, maxX = -1.0f, minY = 1.0f, maxY = -1.0f;
+
+	for (int i = 0; i < 8; i++)
+	{
+		float cx = x + ((i & 1) ? radius : -radius);
+		float cy = y + ((i & 2) ? radius : -radius);
+		float cz = z + ((i & 4) ? radius : -radius);
+		float w = projection[3] * cx + projection[7] * cy + projection[11] * cz + projection[15];
+
+		if (w <= 0.0f)
+			return false;
+
+		float sx = (projection[0] * cx + projection[4] * cy + projection[8] * cz + projection[12]) / w;
+		float sy = (projection[1] * cx + projection[5] * cy + projection[9] * cz + projection[13]) / w;
+
+		if (i == 0 || sx < minX) minX = sx;
+		if (i == 0 || sx > maxX) maxX = sx;
+		if (i == 0 || sy < minY) minY = sy;
+		if (i == 0 || sy > maxY) maxY = sy;
+	}
+
+	// The texels of the biggest level it covers
+	int x0 = Max((int)floor((minX * 0.5f + 0.5f) * DEPTH_WIDTH), 0);
+	int x1 = Min((int)floor((maxX * 0.5f + 0.5f) * DEPTH_WIDTH), DEPTH_WIDTH - 1);
+	int y0 = Max((int)floor((minY * 0.5f + 0.5f) * DEPTH_HEIGHT), 0);
+	int y1 = Min((int)floor((maxY * 0.5f + 0.5f) * DEPTH_HEIGHT), DEPTH_HEIGHT - 1);
+
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	// Up the levels until it covers 2x2 texels at most
+	int l = 0;
+
+	while (l < LEVELS - 1 && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1))
+		l++;
+
+	const float *level = &levels[l][0];
+	float farthest = nearest;
+
+	for (int ty = y0 >> l; ty <= (y1 >> l); ty++)
+	{
+		for (int tx = x0 >> l; tx <= (x1 >> l); tx++)
+		{
+			float d = level[ty * levelWidth[l] + tx];
+
+			if (tx == (x0 >> l) && ty == (y0 >> l))
+				farthest = d;
+			else
+				farthest = Min(farthest, d);
+		}
+	}
+
+	return 1.0f / nearest < farthest;
+}
+
+int OcclusionCuller::Test(const float *x, const float *y, const float *z, const float *radius, int count, unsigned char *visible)
+{
+	if (!enabled || !WaitForWorker())
+		return 0;
+
+	int hidden = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (visible[i] && Hidden(x[i], y[i], z[i], radius[i]))
+		{
+			visible[i] = 0;
+			hidden++;
+		}
+	}
+
+	return hidden;
+}
+
+void OcclusionCuller::Stop()
+{
+	StopWorker();
+
+	std::lock_guard<std::mutex> guard(lock);
+	drawn = false;
+}
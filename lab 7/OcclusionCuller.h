@@ -0,0 +1,63 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Occlusion Culler Class
+//
+// OcclusionCuller.h: interface for the OcclusionCuller class.
+// The frustum only throws away what is off screen. Behind a
+// wall or the wardrobe the models are on screen but hidden,
+// and the card used to draw them anyway. This class draws a
+// few big occluders (their triangles, no textures) into a
+// small depth buffer of its own on the CPU, and tests the
+// bounding spheres of the models against it before anything is
+// sent to the card.
+//
+// The buffer is 256x128 and keeps 1/w, so it can be
+// interpolated straight across a triangle; bigger is nearer.
+// The rasterizer does four pixels at a time with SSE. The
+// buffer is then halved down to 1x1, every texel of a level
+// keeping the farthest depth under it. A sphere's box covers
+// at most 2x2 texels of the right level, and the sphere is
+// hidden if its nearest point is behind the farthest depth of
+// all of them.
+//
+// Begin() hands the camera to a worker thread, which draws the
+// occluders while the frame is being set up. Test() waits for
+// it. Everything counts as visible until the first Begin(),
+// and triangles crossing the near plane are left out, so
+// mistakes can only keep models that are hidden.
+//
+// Occluders are copied in world space when added, so ones
+// that move have to be cleared and added again.
+//
+// Usage:
+// OcclusionCuller::AddOccluder(vertices, numVertices, indices, numIndices);
+//
+// // Once the camera is set up
+// OcclusionCuller::Begin();
+// ...
+// int hidden = OcclusionCuller::Test(x, y, z, radius, count, visible);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+class OcclusionCuller
+{
+public:
+	static bool enabled;							// False tests nothing, every model is drawn
+
+	// Adds triangles in world space, 3 floats a vertex, 3 indices a triangle
+	static void AddOccluder(const float *vertices, int numVertices, const unsigned short *indices, int numIndices);
+	// Adds the 12 triangles of the cube from -0.5 to 0.5 moved by matrix
+	static void AddBox(const float *matrix);
+	static void ClearOccluders();
+
+	static void Begin();							// Starts drawing the occluders with the current matrices as the camera
+	// Clears visible[i] for the spheres in eye space that are hidden (only looking at those
+	// still visible), returns how many that was
+	static int Test(const float *x, const float *y, const float *z, const float *radius, int count, unsigned char *visible);
+	static void Stop();								// Waits for the thread to finish
+};
+
+#endif OCCLUSIONCULLER_H
@@ -1,18 +1,40 @@
 #include "TextureBuilder.h"
 #include "Model_3DS.h"
 #include "GLTexture.h"
+#include "AssetWatcher.h"
+#include "TextureCache.h"
+#include "TextureAtlas.h"
+#include "TextureCompressor.h"
+#include "TextureStreamer.h"
+#include "TextureResidency.h"
+#include "RenderQueue.h"
+#include "Frustum.h"
+#include "Scene.h"
+#include "OcclusionCuller.h"
+#include "Matrix.h"
+#include "SkyDome.h"
+#include "SceneShader.h"
+#include "LightClusters.h"
+#include "Benchmark.h"
+#include "GpuTimer.h"
+#include "FrameLoop.h"
 #include <glut.h>
 #include <math.h>
+#include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
-#include<Windows.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
 #include <sstream>
 #include <vector>
 #include <thread>
+#include <chrono>
 
 #define GLUT_KEY_ESCAPE 27
 #define DEG2RAD(a) (a * 0.0174532925)
+#define TICKS_PER_SECOND 60
 int WIDTH = 1280;
 int HEIGHT = 720;
 
@@ -24,6 +46,25 @@ GLdouble fovy = 45.0;
 GLdouble aspectRatio = (GLdouble)WIDTH / (GLdouble)HEIGHT;
 GLdouble zNear = 0.1;
 GLdouble zFar = 4800;
+
+// The camera's matrices, made on the CPU every frame
+float cameraProjection[16];
+float cameraView[16];
+
+// The one light, shining straight down, and what all the materials share
+GLfloat lightDirection[] = { 0.0f, 1.0f, 0.0f, 0.0f };
+GLfloat lightAmbient[] = { 0.7f, 0.7f, 0.7f, 1.0f };
+GLfloat lightDiffuse[] = { 0.7f, 0.7f, 1.0f, 1.0f };
+GLfloat lightSpecular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+GLfloat sceneAmbient[] = { 0.2f, 0.2f, 0.2f, 1.0f };
+GLfloat materialSpecular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+GLfloat materialShininess = 50.0f;
+
+// The other lights, the LightClusters' (the shader draws them only)
+GLfloat lampLight[] = { 0.0f, 90.0f, -800.0f };
+int coinEntities[4];
+int props;											// The Scene groups everything is placed in
+int characters;
 bool coin1 = true;
 bool coin2 = true;
 bool coin3 = true;
@@ -40,6 +81,7 @@ int remainingTime = 1800;
 
 void setupCamera();
 void setupLights();
+void setupClusterLights();
 void checkForEnvironment2();
 void checkforApples();
 void renderString(float x, float y, float z, void* font, const char* string);
@@ -55,11 +97,11 @@ public:
 		z = _z;
 	}
 
-	Vector3f operator+(Vector3f& v) {
+	Vector3f operator+(const Vector3f& v) {
 		return Vector3f(x + v.x, y + v.y, z + v.z);
 	}
 
-	Vector3f operator-(Vector3f& v) {
+	Vector3f operator-(const Vector3f& v) {
 		return Vector3f(x - v.x, y - v.y, z - v.z);
 	}
 
@@ -123,12 +165,19 @@ public:
 		center = eye + view;
 	}
 
-	void look() {
-		gluLookAt(
+	void look(float* view) {
+		MatrixIdentity(view);
+		MatrixLookAt(view,
 			eye.x, eye.y, eye.z,
 			center.x, center.y, center.z,
 			up.x, up.y, up.z
 		);
+
+		// The walls, the ground and the sky still go through the matrix stack
+		glLoadMatrixf(view);
+
+		// The planes of what can be seen, for leaving out the models that are off screen
+		Frustum::Look();
 	}
 };
 
@@ -186,6 +235,12 @@ Model_3DS model_lamp;
 // Textures
 GLTexture tex_ground;
 
+// Reloads the models and textures that are edited while the game runs
+AssetWatcher watcher;
+
+// Shows what the last frame cost to draw
+bool showStats = true;
+
 //=======================================================================
 // Lighting Configuration Function
 //=======================================================================
@@ -198,21 +253,13 @@ void InitLightSource()
 	// OpengL has 8 light sources
 	glEnable(GL_LIGHT0);
 
-	// Define Light source 0 ambient light
-	GLfloat ambient[] = { 0.1f, 0.1f, 0.1, 1.0f };
-	glLightfv(GL_LIGHT0, GL_AMBIENT, ambient);
+	// Define Light source 0 ambient, diffuse and specular light, once; the SceneShader gets the same
+	glLightfv(GL_LIGHT0, GL_AMBIENT, lightAmbient);
+	glLightfv(GL_LIGHT0, GL_DIFFUSE, lightDiffuse);
+	glLightfv(GL_LIGHT0, GL_SPECULAR, lightSpecular);
+	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, sceneAmbient);
 
-	// Define Light source 0 diffuse light
-	GLfloat diffuse[] = { 0.5f, 0.5f, 0.5f, 1.0f };
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuse);
-
-	// Define Light source 0 Specular light
-	GLfloat specular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glLightfv(GL_LIGHT0, GL_SPECULAR, specular);
-
-	// Finally, define light source 0 position in World Space
-	GLfloat light_position[] = { 0.0f, 10.0f, 0.0f, 1.0f };
-	glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+	// The position moves with the camera, setupLights() sets it every frame
 }
 
 //=======================================================================
@@ -228,12 +275,10 @@ void InitMaterial()
 
 	// Set Material's Specular Color
 	// Will be applied to all objects
-	GLfloat specular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
+	glMaterialfv(GL_FRONT, GL_SPECULAR, materialSpecular);
 
 	// Set Material's Shine value (0->128)
-	GLfloat shininess[] = { 96.0f };
-	glMaterialfv(GL_FRONT, GL_SHININESS, shininess);
+	glMaterialf(GL_FRONT, GL_SHININESS, materialShininess);
 }
 
 //=======================================================================
@@ -286,6 +331,7 @@ void RenderGround()
 	glEnable(GL_TEXTURE_2D);	// Enable 2D texturing
 
 	glBindTexture(GL_TEXTURE_2D, tex_ground.texture[0]);	// Bind the ground texture
+	TextureResidency::Touch(tex_ground.texture[0]);	// It reaches up to the camera, keep it sharp
 
 	glPushMatrix();
 	glBegin(GL_QUADS);
@@ -310,29 +356,60 @@ void RenderGround()
 // Display Function
 //=======================================================================
 
-void Timer(int value) {
-	if (remainingTime > 0) {
-		remainingTime--;  // Decrement the remaining time
-		glutPostRedisplay();  // Redraw the scene
-		glutTimerFunc(1000, Timer, 0);  // Call the Timer function again after 1000 milliseconds (1 second)
+void HotReload(int value) {
+	// Runs between frames so the reloaded assets are never half drawn
+	if (watcher.Update() > 0)
+		FrameLoop::Redraw();
+	glutTimerFunc(250, HotReload, 0);
+}
+
+// The unit cube glutSolidCube(1) draws, the same faces in the same order; the benchmark
+// draws without GLUT, where glutSolidCube can't be called
+void solidCube() {
+	static const GLfloat normals[6][3] = {
+		{ -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f },
+		{ 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+	};
+	static const int faces[6][4] = {
+		{ 0, 1, 2, 3 }, { 3, 2, 6, 7 }, { 7, 6, 5, 4 },
+		{ 4, 5, 1, 0 }, { 5, 6, 2, 1 }, { 7, 4, 0, 3 }
+	};
+	static const GLfloat corners[8][3] = {
+		{ -0.5f, -0.5f, -0.5f }, { -0.5f, -0.5f, 0.5f }, { -0.5f, 0.5f, 0.5f }, { -0.5f, 0.5f, -0.5f },
+		{ 0.5f, -0.5f, -0.5f }, { 0.5f, -0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f }, { 0.5f, 0.5f, -0.5f }
+	};
+
+	glBegin(GL_QUADS);
+	for (int i = 5; i >= 0; i--) {
+		glNormal3fv(normals[i]);
+		for (int k = 0; k < 4; k++)
+			glVertex3fv(corners[faces[i][k]]);
 	}
+	glEnd();
 }
 
 void drawWall(double thickness) {
 	glPushMatrix();
 	glTranslated(0.5, 0.5 * thickness, 0.5);
 	glScaled(80.0, thickness, 80.0);
-	glutSolidCube(1);
+	solidCube();
 	glPopMatrix();
 }
 
+// The sounds are only played on Windows
+void playSound(const wchar_t* path) {
+#ifdef _WIN32
+	PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+#endif
+}
+
 void checkforCoins() {
 	if (model_character.pos.x == -700 && model_character.pos.z == -200) {
 		model_coin3.pos.x = 120000000;
 		//sound for coin
 		if (coin3) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Coin\\coin.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			coin3 = false;
 		}
 	}
@@ -341,7 +418,7 @@ void checkforCoins() {
 		//sound for coin
 		if (coin1) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Coin\\coin.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			coin1 = false;
 		}
 	}
@@ -350,7 +427,7 @@ void checkforCoins() {
 		//sound for coin
 		if (coin4) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Coin\\coin.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			coin4 = false;
 		}
 	}
@@ -359,11 +436,10 @@ void checkforCoins() {
 		//sound for coin
 		if (coin2) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Coin\\coin.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			coin2 = false;
 		}
 	}
-	glutPostRedisplay();
 }
 
 void checkForEnvironment2() {
@@ -372,7 +448,6 @@ void checkForEnvironment2() {
 		&& model_character.pos.z == 600 && model_character.pos.x == -700) {
 		model_character.pos.x -= 200;
 	}
-	glutPostRedisplay();
 }
 
 void checkforApples() {
@@ -382,7 +457,7 @@ void checkforApples() {
 		//sound for apple
 		if (apple6) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Apple\\apple.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			apple6 = false;
 		}
 	}
@@ -392,7 +467,7 @@ void checkforApples() {
 		//sound for apple
 		if (apple3) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Apple\\apple.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			apple3 = false;
 		}
 	}
@@ -401,7 +476,7 @@ void checkforApples() {
 		//sound for apple
 		if (apple4) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Apple\\apple.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			apple4 = false;
 		}
 	}
@@ -410,7 +485,7 @@ void checkforApples() {
 		//sound for apple
 		if (apple2) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Apple\\apple.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			apple2 = false;
 		}
 	}
@@ -419,7 +494,7 @@ void checkforApples() {
 		//sound for apple
 		if (apple1) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Apple\\apple.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			apple1 = false;
 		}
 	}
@@ -428,7 +503,7 @@ void checkforApples() {
 		//sound for apple
 		if (apple7) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Apple\\apple.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			apple7 = false;
 		}
 	}
@@ -437,11 +512,10 @@ void checkforApples() {
 		//sound for apple
 		if (apple5) {
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Apple\\apple.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 			apple5 = false;
 		}
 	}
-	glutPostRedisplay();
 }
 
 void renderString(float x, float y, float z, void* font, const char* string) {
@@ -458,6 +532,85 @@ void renderInteger(float x, float y, float z, void* font, int value) {
 	renderString(x, y, z, font, buffer);
 }
 
+void renderStats() {
+	RenderQueue::Stats stats = RenderQueue::GetStats();
+	GLint viewport[4];
+	char line[128];
+
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// Straight onto the screen, in pixels from the top left
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	gluOrtho2D(0, viewport[2], viewport[3], 0);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+	glDisable(GL_DEPTH_TEST);
+	glColor3f(1.0f, 1.0f, 1.0f);
+
+	void* font = GLUT_BITMAP_HELVETICA_12;
+
+	snprintf(line, sizeof(line), "Draw calls: %d", stats.drawCalls);
+	renderString(10, 20, 0, font, line);
+	snprintf(line, sizeof(line), "Texture binds: %d (%d unsorted)", stats.binds, stats.unsortedBinds);
+	renderString(10, 36, 0, font, line);
+	snprintf(line, sizeof(line), "State changes: %d (%d unsorted)%s", stats.stateChanges, stats.unsortedStateChanges,
+		RenderQueue::sorting ? "" : " - sorting off");
+	renderString(10, 52, 0, font, line);
+	snprintf(line, sizeof(line), "Models on screen: %d of %d%s", stats.models - stats.culled, stats.models,
+		RenderQueue::culling ? "" : " - culling off");
+	renderString(10, 68, 0, font, line);
+	snprintf(line, sizeof(line), "Behind walls: %d%s", stats.occluded,
+		OcclusionCuller::enabled ? "" : " - occlusion off");
+	renderString(10, 84, 0, font, line);
+	snprintf(line, sizeof(line), "World matrices updated: %d of %d", Scene::Updated(), Scene::Count());
+	renderString(10, 100, 0, font, line);
+	snprintf(line, sizeof(line), "Lights: %d of %d in view, %d in clusters", LightClusters::Visible(),
+		LightClusters::Count(), LightClusters::Assigned());
+	renderString(10, 116, 0, font, line);
+
+	// How evenly the frames come, over the last couple of seconds of drawing
+	FrameLoop::Stats pacing = FrameLoop::GetStats();
+
+	snprintf(line, sizeof(line), "Frames: %.2f ms apart, worst %.2f ms, jitter %.2f ms, %d late (%d Hz%s)",
+		pacing.average, pacing.worst, pacing.jitter, pacing.late, pacing.refreshRate, pacing.vsync ? ", vsync" : "");
+	renderString(10, 132, 0, font, line);
+	snprintf(line, sizeof(line), "Redraws: %d asked for, %d drawn, %d ticks dropped", pacing.requests, pacing.drawn,
+		pacing.skipped);
+	renderString(10, 148, 0, font, line);
+
+	// What the card spends on each pass, averaged over the last second or so
+	if (!GpuTimer::Supported())
+	{
+		renderString(10, 164, 0, font, "GPU: no timer queries");
+	}
+	else
+	{
+		snprintf(line, sizeof(line), "GPU: %.2f ms", GpuTimer::Total());
+		renderString(10, 164, 0, font, line);
+
+		for (int i = 0; i < GpuTimer::Passes(); i++)
+		{
+			snprintf(line, sizeof(line), "  %s: %.2f ms", GpuTimer::Name(i), GpuTimer::Average(i));
+			renderString(10, 180 + 16 * i, 0, font, line);
+		}
+	}
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_TEXTURE_2D);
+	glEnable(GL_LIGHTING);
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
+
 void checkforWin() {
 	if (((model_character.pos.x == 1700 && model_character.pos.z == 1000) ||
 		(model_character.pos.x == 1800 && model_character.pos.z == 900) || 
@@ -489,187 +642,74 @@ void checkForLose() {
 	}
 }
 
+// The zombie's walk, a step (100 units, the monsters are scaled up) at a time: each one
+// starts when the clock reads when and takes until the next one starts, and the last
+// one sets the clock back so the walk goes round again
+struct Step {
+	int when;
+	int dx, dy;			// In the monsters' space, where y is the level's x and -x its z
+};
+
+static const Step walk[] = {
+	{ 1798, 0, -1 }, { 1794, 0, -1 }, { 1790, 0, -1 }, { 1786, 0, -1 },
+	{ 1782, 0, -1 }, { 1778, 0, -1 }, { 1774, -1, 0 }, { 1770, -1, 0 },
+	{ 1766, -1, 0 }, { 1762, -1, 0 }, { 1758, -1, 0 }, { 1754, -1, 0 },
+	{ 1750, -1, 0 }, { 1746, -1, 0 }, { 1742, 0, 1 }, { 1738, 0, 1 },
+	{ 1734, -1, 0 }, { 1730, -1, 0 }, { 1726, -1, 0 }, { 1722, 0, 1 },
+	{ 1718, 0, 1 }, { 1714, 0, 1 }, { 1710, 0, 1 }, { 1707, 0, 1 },
+	{ 1704, 0, 1 }, { 1700, 0, 1 }, { 1696, 0, 1 }, { 1692, 1, 0 },
+	{ 1688, 1, 0 }, { 1684, 1, 0 }, { 1680, 1, 0 }, { 1676, 0, 1 },
+	{ 1672, 0, 1 }, { 1668, 0, 1 }, { 1664, 1, 0 }, { 1660, 1, 0 },
+	{ 1656, 1, 0 }, { 1652, 1, 0 }, { 1648, 1, 0 }, { 1644, 1, 0 },
+	{ 1640, 1, 0 }, { 1636, 1, 0 }, { 1632, 1, 0 }, { 1628, 1, 0 },
+	{ 1624, 1, 0 }, { 1620, 0, -1 }, { 1616, 0, -1 }, { 1612, 0, -1 },
+	{ 1608, 0, -1 }, { 1604, 0, -1 }, { 1600, 0, -1 }, { 1596, 0, -1 },
+	{ 1592, -1, 0 }, { 1588, -1, 0 }, { 1584, -1, 0 }, { 1580, -1, 0 },
+};
+
+#define STEPS ((int)(sizeof(walk) / sizeof(walk[0])))
+
+// Moves the zombie along the step it is on by a tick's worth of it
 void enemy1Move() {
-	if (remainingTime == 1798) {
-		model_zombie1.pos.y -= 1.0f;
-		model_zombie1.rot.z = 90.0f;
-	}
-	if (remainingTime == 1794) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1790) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1786) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1782) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1778) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1774) {
-		model_zombie1.pos.x -= 1.0f;
-		model_zombie1.rot.z = 0.0f;
-	}
-	if (remainingTime == 1770) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1766) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1762) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1758) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1754) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1750) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1746) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1742) {
-		model_zombie1.pos.y += 1.0f;
-		model_zombie1.rot.z = -90.0f;
-	}
-	if (remainingTime == 1738) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1734) {
-		model_zombie1.pos.x -= 1.0f;
-		model_zombie1.rot.z = 0.0f;
-	}
-	if (remainingTime == 1730) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1726) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1722) {
-		model_zombie1.rot.z = -90.0f;
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1718) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1714) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1710) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1707) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1704) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1700) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1696) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1692) {
-		model_zombie1.rot.z = 180.0f;
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1688) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1684) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1680) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1676) {
-		model_zombie1.rot.z = -90.0f;
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1672) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1668) {
-		model_zombie1.pos.y += 1.0f;
-	}
-	if (remainingTime == 1664) {
-		model_zombie1.rot.z = 180.0f;
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1660) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1656) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1652) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1648) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1644) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1640) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1636) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1632) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1628) {
-		model_zombie1.pos.x += 1.0f;
-	}
-	if (remainingTime == 1624) {
-		model_zombie1.pos.x += 1.0f;
-	}
+	static int step = -1;				// The step being taken, -1 before the first
+	static int length = 0;				// In ticks
+	static int done = 0;				// Ticks of it taken
+	static float fromX, fromY;			// Where it started
+	int next = (step + 1) % STEPS;
 
-	if (remainingTime == 1620) {
-		model_zombie1.rot.z = 90.0f;
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1616) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1612) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1608) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1604) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1600) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1596) {
-		model_zombie1.pos.y -= 1.0f;
-	}
-	if (remainingTime == 1592) {
-		model_zombie1.rot.z = 0.0f;
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1588) {
-		model_zombie1.pos.x -= 1.0f;
-	}
-	if (remainingTime == 1584) {
-		model_zombie1.pos.x -= 1.0f;
+	if (remainingTime == walk[next].when) {
+		step = next;
+		next = (step + 1) % STEPS;
+
+		if (next == 0)
+			remainingTime = 1799;
+
+		length = (remainingTime - walk[next].when) * TICKS_PER_SECOND;
+		done = 0;
+		fromX = model_zombie1.pos.x;
+		fromY = model_zombie1.pos.y;
+
+		// Face the way it walks
+		model_zombie1.rot.z = walk[step].dx < 0 ? 0.0f : walk[step].dx > 0 ? 180.0f : walk[step].dy < 0 ? 90.0f : -90.0f;
 	}
-	if (remainingTime == 1580) {
-		model_zombie1.pos.x -= 1.0f;
-		remainingTime = 1799;
+
+	if (step < 0 || done >= length)
+		return;
+
+	// It takes length ticks over a step, so it moves speed / TICKS_PER_SECOND of one a tick;
+	// the last tick lands it exactly on the next spot
+	float speed = (float)TICKS_PER_SECOND / length;		// Steps a second
+
+	done++;
+	model_zombie1.pos.x += walk[step].dx * speed / TICKS_PER_SECOND;
+	model_zombie1.pos.y += walk[step].dy * speed / TICKS_PER_SECOND;
+
+	if (done == length) {
+		model_zombie1.pos.x = fromX + walk[step].dx;
+		model_zombie1.pos.y = fromY + walk[step].dy;
 	}
+
+	FrameLoop::Redraw();
 }
 
 void beginning() {
@@ -678,19 +718,40 @@ void beginning() {
 	model_zombie2.pos.y += 11.0f;
 }
 
-void myDisplay(void)
+// A step of the game, TICKS_PER_SECOND of them a second however often the frames come
+void tick() {
+	static int ticks = 0;
+
+	if (begin) {
+		beginning();
+		begin = false;
+		FrameLoop::Redraw();
+	}
+
+	// The clock moves on once a second
+	if (++ticks == TICKS_PER_SECOND) {
+		ticks = 0;
+
+		if (remainingTime > 0)
+			remainingTime--;
+	}
+
+	// The zombie a little every tick
+	if (remainingTime > 0)
+		enemy1Move();
+}
+
+// Everything the camera sees, from the walls to the sky
+void drawScene()
 {
 	setupCamera();
+	// The worker draws the occluders while the walls and the ground go out
+	OcclusionCuller::Begin();
 	setupLights();
+	setupClusterLights();
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	GLfloat lightIntensity[] = { 0.7, 0.7, 0.7, 1.0f };
-	GLfloat lightPosition[] = { 0.0f, 100.0f, 0.0f, 0.0f };
-	glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
-	glLightfv(GL_LIGHT0, GL_AMBIENT, lightIntensity);
-
-	enemy1Move();
+	GpuTimer::Mark("Clear");
 
 	//walls
 	//ground
@@ -737,247 +798,60 @@ void myDisplay(void)
 	glScaled(20, 2, 20);
 	drawWall(0.02);
 	glPopMatrix();
+	GpuTimer::Mark("Walls");
 
 	// Draw Ground
 	RenderGround();
+	GpuTimer::Mark("Ground");
+
+	// The models only queue their faces until End(), which draws them sorted by texture and mesh
+	RenderQueue::Begin();
+
+	// Only what moved since the last frame gets a new world matrix
+	Scene::Update();
+	// Every model at its world matrix, the props placed more than once as copies in one draw call per material.
+	// The props are drawn before the characters are queued so the GPU timer can tell the two apart.
+	Scene::Draw(cameraView, props);
+	RenderQueue::Flush();
+	GpuTimer::Mark("Props");
+
+	Scene::Draw(cameraView, characters);
+	RenderQueue::End();
+	GpuTimer::Mark("Characters");
+
+	// Sky, last so only the pixels nothing covers are drawn
+	SkyDome::Draw();
+	GpuTimer::Mark("Sky");
+}
 
-	// Draw apple Model
-	glPushMatrix();
-	glTranslatef(0, 0, 1700);
-	glScalef(1.0, 1.0, 1.0);
-	model_apple1.Draw();
-	glPopMatrix();
-	// Draw Tree Model
-	glPushMatrix();
-	glTranslatef(100, 0, 1700);
-	glScalef(100.0, 100.0, 100.0);
-	model_tree.Draw();
-	glPopMatrix();
-	// Draw apple Model
-	glPushMatrix();
-	glTranslatef(900, 0, 1700);
-	glScalef(1.0, 1.0, 1.0);
-	model_apple2.Draw();
-	glPopMatrix();
-
-	// Draw apple Model
-	glPushMatrix();
-	glTranslatef(1800, 0, 600);
-	glScalef(1.0, 1.0, 1.0);
-	model_apple3.Draw();
-	glPopMatrix();
-	// Draw Tree Model
-	glPushMatrix();
-	glTranslatef(1800, 0, 100);
-	glScalef(100.0, 100.0, 100.0);
-	model_tree.Draw();
-	glPopMatrix();
-	// Draw apple Model
-	glPushMatrix();
-	glTranslatef(1800, 0, 0);
-	glScalef(1.0, 1.0, 1.0);
-	model_apple4.Draw();
-	glPopMatrix();
-
-	// Draw apple Model
-	glPushMatrix();
-	glTranslatef(-1670, 0, -1900);
-	glScalef(1.0, 1.0, 1.0);
-	model_apple5.Draw();
-	glPopMatrix();
-	// Draw Tree Model
-	glPushMatrix();
-	glTranslatef(-1270, 0, -1700);
-	glScalef(100.0, 100.0, 100.0);
-	model_tree.Draw();
-	glPopMatrix();
-
-	// Draw apple Model
-	glPushMatrix();
-	glTranslatef(1500, 0, -1900);
-	glScalef(1.0, 1.0, 1.0);
-	model_apple6.Draw();
-	glPopMatrix();
-	// Draw Tree Model
-	glPushMatrix();
-	glTranslatef(1000, 0, -1600);
-	glScalef(100.0, 100.0, 100.0);
-	model_tree.Draw();
-	glPopMatrix();
-
-	// Draw palm Tree Model
-	glPushMatrix();
-	glTranslatef(-1600, 0, 1000);
-	glScalef(100.0, 100.0, 100.0);
-	model_palmtree.Draw();
-	glPopMatrix();
-	// Draw apple Model
-	glPushMatrix();
-	glTranslatef(-2100, 0, -500);
-	glScalef(1.0, 1.0, 1.0);
-	model_apple7.Draw();
-	glPopMatrix();
-
-	// Draw Table Model
-	glPushMatrix();
-	glTranslated(800, 0, 50);
-	glRotated(45, 0.0, 1.0, 0.0);
-	glScalef(3.0, 3.0, 3.0);
-	model_table.Draw();
-	glPopMatrix();
-
-	// Draw Table Model
-	glPushMatrix();
-	glTranslated(50, 0, 700);
-	glScalef(3.0, 3.0, 3.0);
-	model_table.Draw();
-	glPopMatrix();
-
-	// Draw wardrobe Model
-	glPushMatrix();
-	glTranslated(-800, 0, 0);
-	glRotated(-135, 0.0, 1.0, 0.0);
-	glScalef(200.0, 200.0, 200.0);
-	model_wardrobe.Draw();
-	glPopMatrix();
-
-	// Draw Table Model
-	glPushMatrix();
-	glTranslated(-400, 0, -280);
-	glRotated(135, 0.0, 1.0, 0.0);
-	glScalef(3.0, 3.0, 3.0);
-	model_table.Draw();
-	glPopMatrix();
-
-	// Draw Chair Model
-	glPushMatrix();
-	glTranslated(50, 0, 650);
-	glScalef(1.8, 1.8, 1.8);
-	model_chair.Draw();
-	glPopMatrix();
-
-	// Draw Chair Model
-	glPushMatrix();
-	glTranslated(-400, 0, -180);
-	glRotated(135, 0.0, 1.0, 0.0);
-	glScalef(1.8, 1.8, 1.8);
-	model_chair.Draw();
-	glPopMatrix();
-	// Draw Chair Model
-	glPushMatrix();
-	glTranslated(-500, 0, -280);
-	glRotated(135, 0.0, 1.0, 0.0);
-	glScalef(1.8, 1.8, 1.8);
-	model_chair.Draw();
-	glPopMatrix();
-	// Draw Chair Model
-	glPushMatrix();
-	glTranslated(-300, 0, -280);
-	glRotated(315, 0.0, 1.0, 0.0);
-	glScalef(1.8, 1.8, 1.8);
-	model_chair.Draw();
-	glPopMatrix();
-	// Draw Chair Model
-	glPushMatrix();
-	glTranslated(-300, 0, -480);
-	glRotated(315, 0.0, 1.0, 0.0);
-	glScalef(1.8, 1.8, 1.8);
-	model_chair.Draw();
-	glPopMatrix();
-
-	// Draw Coin Model
-	glPushMatrix();
-	glTranslated(0, 100, 0);
-	glScalef(1.0, 1.0, 1.0);
-	model_coin1.Draw();
-	glPopMatrix();
-	// Draw Coin Model
-	glPushMatrix();
-	glTranslated(-800, 100, -180);
-	glScalef(1.0, 1.0, 1.0);
-	model_coin2.Draw();
-	glPopMatrix();
-	// Draw Coin Model
-	glPushMatrix();
-	glTranslated(1000, 100, 30);
-	glScalef(1.0, 1.0, 1.0);
-	model_coin3.Draw();
-	glPopMatrix();
-	// Draw Coin Model
-	glPushMatrix();
-	glTranslated(0, 100, 900);
-	glScalef(1.0, 1.0, 1.0);
-	model_coin4.Draw();
-	glPopMatrix();
-
-	// Draw Door Model
-	glPushMatrix();
-	glTranslated(550, 0, -550);
-	glRotated(-45, 0.0, 1.0, 0.0);
-	glScalef(1.0, 1.0, 1.0);
-	model_door.Draw();
-	glPopMatrix();
-
-	// Draw monster Model
-	glPushMatrix();
-	glTranslated(400, 1, 400); //new
-	glRotated(-45, 0.0, 1.0, 0.0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glScalef(100.0, 100.0, 100.0);
-	model_zombie2.Draw();
-	glPopMatrix();
-
-	// Draw monster Model
-
-	glPushMatrix();
-	glTranslated(400, 1, 400); //new
-	glRotated(-45, 0.0, 1.0, 0.0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glScalef(100.0, 100.0, 100.0);
-	model_zombie1.Draw();
-	glPopMatrix();
-
-	// Draw character Model
-	glPushMatrix();
-	glTranslated(400, 1, 400);
-	glRotated(225, 0.0, 1.0, 0.0);
-	glScalef(1.0, 1.0, 1.0);
-	model_character.Draw();
-	glPopMatrix();
-
-	// Draw lamp Model
-	glPushMatrix();
-	glTranslated(0, 0, -800);
-	//glRotated(225, 0.0, 1.0, 0.0);
-	glScalef(0.25, 0.25, 0.25);
-	model_lamp.Draw();
-	glPopMatrix();
-
-	//sky box
-	glPushMatrix();
-
-	GLUquadricObj* qobj;
-	qobj = gluNewQuadric();
-	glTranslated(50, 0, 0);
-	glRotated(90, 1, 0, 1);
-	glBindTexture(GL_TEXTURE_2D, tex);
-	gluQuadricTexture(qobj, true);
-	gluQuadricNormals(qobj, GL_SMOOTH);
-	glScalef(30, 30, 30);
-	gluSphere(qobj, 100, 100, 100);
-	gluDeleteQuadric(qobj);
+void myDisplay(void)
+{
+	// Reads back the pass times of a few frames ago, the card is done with those
+	GpuTimer::BeginFrame();
 
+	// Textures that are still loading get this frame's share of the upload budget
+	TextureStreamer::Update();
+	// Sharpen the textures that got close and drop levels to stay in the memory budget
+	TextureResidency::Update();
+	GpuTimer::Mark("Uploads");
 
-	glPopMatrix();
+	drawScene();
 
-	if (begin) {
-	    beginning();
-		begin = false;
-    }
 	checkforWin();
 	checkForLose();
 
+	if (showStats)
+		renderStats();
+
+	GpuTimer::Mark("HUD");
+	GpuTimer::EndFrame();
+
 	glutSwapBuffers();
+	FrameLoop::Presented();
+
+	// Keep drawing until every texture has arrived
+	if (TextureStreamer::Busy())
+		FrameLoop::Redraw();
 }
 
 //=======================================================================
@@ -994,6 +868,23 @@ void myKeyboard(unsigned char key, int x, int y)
 	case 't':
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		break;
+	case 'p':
+		TextureCache::PrintStats();
+		TextureAtlas::PrintStats();
+		TextureResidency::PrintStats();
+		break;
+	case 'h':
+		showStats = !showStats;
+		break;
+	case 'o':
+		RenderQueue::sorting = !RenderQueue::sorting;
+		break;
+	case 'c':
+		RenderQueue::culling = !RenderQueue::culling;
+		break;
+	case 'x':
+		OcclusionCuller::enabled = !OcclusionCuller::enabled;
+		break;
 	case 27:
 		exit(0);
 		break;
@@ -1027,7 +918,7 @@ void myKeyboard(unsigned char key, int x, int y)
 				model_character.pos.x == -600 || model_character.pos.x == -700)) {
 			//sound for walls
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if (model_character.pos.z == -300 &&
 			(model_character.pos.x == 800 ||
@@ -1040,7 +931,7 @@ void myKeyboard(unsigned char key, int x, int y)
 				|| model_character.pos.x == -800)) {
 			//sound for walls
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -400 && model_character.pos.z == -100) ||
 			(model_character.pos.x == -500 && model_character.pos.z == -100) ||
@@ -1055,19 +946,19 @@ void myKeyboard(unsigned char key, int x, int y)
 			) {
 			//sound for tables
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 500 && model_character.pos.z == 1000) ||
 			(model_character.pos.x == 600 && model_character.pos.z == 1000)) {
 			//sound for wardrobe
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -500 && model_character.pos.z == 1100) ||
 			(model_character.pos.x == -600 && model_character.pos.z == 1100)) {
 			//sound for bulb
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 1800 && model_character.pos.z == 900) ||
 			(model_character.pos.x == 1900 && model_character.pos.z == 900) ||
@@ -1079,7 +970,7 @@ void myKeyboard(unsigned char key, int x, int y)
 			(model_character.pos.x == -300 && model_character.pos.z == 2600) ) {
 			//sound for trees
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 0 && model_character.pos.z == 900) ||
 			(model_character.pos.x == 200 && model_character.pos.z == 900) ||
@@ -1088,7 +979,7 @@ void myKeyboard(unsigned char key, int x, int y)
 			(model_character.pos.x == -200 && model_character.pos.z == 1000)) {
 			// sound for chair
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else {
 			model_character.pos.z += 100.0f;
@@ -1106,7 +997,7 @@ void myKeyboard(unsigned char key, int x, int y)
 				model_character.pos.z == 1300)) {
 			//sound for walls
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if (model_character.pos.x == -900 &&
 			(model_character.pos.z == -200 || model_character.pos.z == -100 || model_character.pos.z == 0 || model_character.pos.z == 100 ||
@@ -1118,7 +1009,7 @@ void myKeyboard(unsigned char key, int x, int y)
 				model_character.pos.z == 1300)) {
 			//sound for walls
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 0 && model_character.pos.z == 900) ||
 			(model_character.pos.x == 0 && model_character.pos.z == 1000) ||
@@ -1130,26 +1021,26 @@ void myKeyboard(unsigned char key, int x, int y)
 			(model_character.pos.x == 500 && model_character.pos.z == 200)) {
 			// sound for tables
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 400 && model_character.pos.z == 1000) ||
 			(model_character.pos.x == 400 && model_character.pos.z == 1100) ||
 			(model_character.pos.x == 400 && model_character.pos.z == 1200)) {
 			// sound for wardrobe
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -700 && model_character.pos.z == 1100)) {
 			// sound for bulb
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -100 && model_character.pos.z == 1000) ||
 			(model_character.pos.x == -200 && model_character.pos.z == 1100) ||
 			(model_character.pos.x == 300 && model_character.pos.z == 100)) {
 			// sound for chair
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -1900 && model_character.pos.z == 1000) ||
 			(model_character.pos.x == -1300 && model_character.pos.z == -800) ||
@@ -1158,7 +1049,7 @@ void myKeyboard(unsigned char key, int x, int y)
 			(model_character.pos.x == -400 && model_character.pos.z == 2700)) {
 			// sound for trees
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else {
 			model_character.pos.x += 100.0f;
@@ -1176,7 +1067,7 @@ void myKeyboard(unsigned char key, int x, int y)
 				model_character.pos.x == -600 || model_character.pos.x == -700)) {
 			// sound for walls
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if (model_character.pos.z == 1400 &&
 			(model_character.pos.x == 800 ||
@@ -1188,7 +1079,7 @@ void myKeyboard(unsigned char key, int x, int y)
 				model_character.pos.x == -600 || model_character.pos.x == -700)) {
 			//sound for walls
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 100 && model_character.pos.z == 1300) ||
 			(model_character.pos.x == -700 && model_character.pos.z == 100) || 
@@ -1201,19 +1092,19 @@ void myKeyboard(unsigned char key, int x, int y)
 			(model_character.pos.x == 300 && model_character.pos.z == 0)) {
 			// sound for tables
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 600 && model_character.pos.z == 1300) ||
 			(model_character.pos.x == 500 && model_character.pos.z == 1300)) {
 			// sound for wardrobe
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -600 && model_character.pos.z == 1200) ||
 			(model_character.pos.x == -500 && model_character.pos.z == 1200)) {
 			// sound for bulb
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -100 && model_character.pos.z == 1200) ||
 			(model_character.pos.x == -200 && model_character.pos.z == 1200) ||
@@ -1223,7 +1114,7 @@ void myKeyboard(unsigned char key, int x, int y)
 			|| (model_character.pos.x == 400 && model_character.pos.z == 200)) {
 			// sound for chair
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -1900 && model_character.pos.z == 1100) ||
 			(model_character.pos.x == -1800 && model_character.pos.z == 1100) ||
@@ -1235,7 +1126,7 @@ void myKeyboard(unsigned char key, int x, int y)
 			(model_character.pos.x == -300 && model_character.pos.z == 2800)) {
 			// sound for trees
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else {
 			model_character.pos.z -= 100.0f;
@@ -1253,7 +1144,7 @@ void myKeyboard(unsigned char key, int x, int y)
 				model_character.pos.z == 1300)) {
 			//sound for walls
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if (model_character.pos.x == 900 &&
 			(model_character.pos.z == -200 || model_character.pos.z == -100 || model_character.pos.z == 0 || model_character.pos.z == 100 ||
@@ -1265,7 +1156,7 @@ void myKeyboard(unsigned char key, int x, int y)
 				model_character.pos.z == 1300)) {
 			//sound for walls
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 200 && model_character.pos.z == 1200) ||
 			(model_character.pos.x == 200 && model_character.pos.z == 1100) ||
@@ -1279,26 +1170,26 @@ void myKeyboard(unsigned char key, int x, int y)
 			(model_character.pos.x == 500 && model_character.pos.z == -100)) {
 			// sound for tables
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 700 && model_character.pos.z == 1000) ||
 			(model_character.pos.x == 700 && model_character.pos.z == 1100) ||
 			(model_character.pos.x == 700 && model_character.pos.z == 1200)) {
 			// sound for wardrobe
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -500 && model_character.pos.z == 1100)) {
 			// sound for bulb
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == 300 && model_character.pos.z == 1000) ||
 			(model_character.pos.x == 300 && model_character.pos.z == 1100)
 			|| (model_character.pos.x == 0 && model_character.pos.z == 1100)) {
 			// sound for chair
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else if ((model_character.pos.x == -1700 && model_character.pos.z == 1000) ||
 			(model_character.pos.x == -1100 && model_character.pos.z == -800) ||
@@ -1308,7 +1199,7 @@ void myKeyboard(unsigned char key, int x, int y)
 			(model_character.pos.x == -200 && model_character.pos.z == 2600)) {
 			// sound for trees
 			const wchar_t* path = L"C:\\Users\\ziad sherif\\Documents\\Sounds\\Hit\\hit.wav";
-			PlaySoundW(path, NULL, SND_FILENAME | SND_ASYNC);
+			playSound(path);
 		}
 		else {
 			model_character.pos.x -= 100.0f;
@@ -1321,7 +1212,7 @@ void myKeyboard(unsigned char key, int x, int y)
 	checkforCoins();
 	checkForEnvironment2();
 	checkforApples();
-	glutPostRedisplay();
+	FrameLoop::Redraw();
 }
 void Special(int key, int x, int y) {
 	float a = 1.0;
@@ -1341,7 +1232,7 @@ void Special(int key, int x, int y) {
 		break;
 	}
 
-	glutPostRedisplay();
+	FrameLoop::Redraw();
 }
 
 //=======================================================================
@@ -1368,10 +1259,7 @@ void myMotion(int x, int y)
 
 	gluLookAt(Eye.x, Eye.y, Eye.z, At.x, At.y, At.z, Up.x, Up.y, Up.z);	//Setup Camera with modified paramters
 
-	GLfloat light_position[] = { 0.0f, 10.0f, 0.0f, 1.0f };
-	glLightfv(GL_LIGHT0, GL_POSITION, light_position);
-
-	glutPostRedisplay();	//Re-draw scene 
+	FrameLoop::Redraw();	//Re-draw scene 
 }
 
 //=======================================================================
@@ -1418,96 +1306,308 @@ void myReshape(int w, int h)
 //=======================================================================
 void LoadAssets()
 {
+	// The mipmaps of a texture are saved next to it the first time and mapped from there after that
+	MipmapGenerator::cache = true;
+
 	// Loading Model files
 	//model_wall.Load("Models/wall/wall.3ds");
 	model_tree.Load("Models/tree/Tree1.3ds");
 	model_palmtree.Load("models/Tree3/Tree3.3ds");
 	model_table.Load("Models/odesd2_B2_3ds/odesd2_B2_3ds.3ds");
+	// The other apples, coins and the second zombie are only placements, drawn as copies of these
 	model_apple1.Load("models/apple/apple.3ds");
-	model_apple2.Load("models/apple/apple.3ds");
-	model_apple3.Load("models/apple/apple.3ds");
-	model_apple4.Load("models/apple/apple.3ds");
-	model_apple5.Load("models/apple/apple.3ds");
-	model_apple6.Load("models/apple/apple.3ds");
-	model_apple7.Load("models/apple/apple.3ds");
 	model_chair.Load("Models/odesd2_C4_3ds/odesd2_C4_3ds.3ds");
 	model_wardrobe.Load("Models/Wardobe_3ds/MRWardobe.3ds");
 	model_coin1.Load("models/3ds-coin/rc-coin.3ds");
-	model_coin2.Load("models/3ds-coin/rc-coin.3ds");
-	model_coin3.Load("models/3ds-coin/rc-coin.3ds");
-	model_coin4.Load("models/3ds-coin/rc-coin.3ds");
 	model_door.Load("models/Door_3DS/Door_Standart.3ds");
 	model_character.Load("models/Terrorist/FatTerrorist.3ds");
 	model_zombie1.Load("models/Zombie/ZOMBIE.3ds");
-	model_zombie2.Load("models/Zombie/ZOMBIE.3ds");
 	model_lamp.Load("models/lamp3ds/lamp.3ds");
 
 	// Loading texture files
 	tex_ground.Load("Textures/ground.bmp");
 	loadBMP(&tex, "Textures/blu-sky-3.bmp", true);
+	SkyDome::Create(tex, 3000, 64, 32);
+
+	// Watch the asset folders so edited files are picked up without a restart
+	Model_3DS* models[] = {
+		&model_tree, &model_palmtree, &model_table, &model_chair, &model_wardrobe,
+		&model_apple1, &model_coin1,
+		&model_door, &model_character, &model_zombie1, &model_lamp
+	};
+	for (size_t i = 0; i < sizeof(models) / sizeof(models[0]); i++)
+		watcher.Track(models[i]);
+	watcher.Track(&tex_ground);
+	watcher.Watch("models");
+	watcher.Watch("textures");
+
+	// Shows how many textures the models shared instead of loading again
+	TextureCache::PrintStats();
+	TextureAtlas::PrintStats();
+	TextureResidency::PrintStats();
+}
+
+//=======================================================================
+// Scene Building Function
+//=======================================================================
+int place(int parent, Model_3DS* model, Model_3DS* mesh, float x, float y, float z, float angle, float scale)
+{
+	int entity = Scene::Add(parent, model, mesh);
+
+	Scene::SetPosition(entity, x, y, z);
+	Scene::SetRotation(entity, 0, angle, 0);
+	Scene::SetScale(entity, scale, scale, scale);
+
+	return entity;
+}
+
+// The same box drawWall(0.02) draws for a wall, as an occluder
+void addWallOccluder(float x, float z, float angle)
+{
+	float m[16];
+
+	MatrixIdentity(m);
+	MatrixTranslate(m, x, 0, z);
+	MatrixRotate(m, angle, 0, 1, 0);
+	MatrixRotate(m, 90, 0, 0, 1);
+	MatrixScale(m, 20, 2, 20);
+	MatrixTranslate(m, 0.5, 0.01, 0.5);
+	MatrixScale(m, 80, 0.02, 80);
+
+	OcclusionCuller::AddBox(m);
+}
+
+void buildScene()
+{
+	// Two groups, so they can be drawn (and timed) apart
+	props = Scene::Add(Scene::ROOT);
+	characters = Scene::Add(Scene::ROOT);
+
+	// Apples and trees
+	place(props, &model_apple1, &model_apple1, 0, 0, 1700, 0, 1);
+	place(props, &model_tree, &model_tree, 100, 0, 1700, 0, 100);
+	place(props, &model_apple2, &model_apple1, 900, 0, 1700, 0, 1);
+	place(props, &model_apple3, &model_apple1, 1800, 0, 600, 0, 1);
+	place(props, &model_tree, &model_tree, 1800, 0, 100, 0, 100);
+	place(props, &model_apple4, &model_apple1, 1800, 0, 0, 0, 1);
+	place(props, &model_apple5, &model_apple1, -1670, 0, -1900, 0, 1);
+	place(props, &model_tree, &model_tree, -1270, 0, -1700, 0, 100);
+	place(props, &model_apple6, &model_apple1, 1500, 0, -1900, 0, 1);
+	place(props, &model_tree, &model_tree, 1000, 0, -1600, 0, 100);
+	place(props, &model_palmtree, NULL, -1600, 0, 1000, 0, 100);
+	place(props, &model_apple7, &model_apple1, -2100, 0, -500, 0, 1);
+
+	// Tables, the wardrobe and chairs
+	place(props, &model_table, &model_table, 800, 0, 50, 45, 3);
+	place(props, &model_table, &model_table, 50, 0, 700, 0, 3);
+	int wardrobe = place(props, &model_wardrobe, NULL, -800, 0, 0, -135, 200);
+	place(props, &model_table, &model_table, -400, 0, -280, 135, 3);
+	place(props, &model_chair, &model_chair, 50, 0, 650, 0, 1.8);
+	place(props, &model_chair, &model_chair, -400, 0, -180, 135, 1.8);
+	place(props, &model_chair, &model_chair, -500, 0, -280, 135, 1.8);
+	place(props, &model_chair, &model_chair, -300, 0, -280, 315, 1.8);
+	place(props, &model_chair, &model_chair, -300, 0, -480, 315, 1.8);
+
+	// Coins
+	coinEntities[0] = place(props, &model_coin1, &model_coin1, 0, 100, 0, 0, 1);
+	coinEntities[1] = place(props, &model_coin2, &model_coin1, -800, 100, -180, 0, 1);
+	coinEntities[2] = place(props, &model_coin3, &model_coin1, 1000, 100, 30, 0, 1);
+	coinEntities[3] = place(props, &model_coin4, &model_coin1, 0, 100, 900, 0, 1);
+
+	int door = place(props, &model_door, NULL, 550, 0, -550, -45, 1);
+
+	// Both monsters stand up from the same spot and walk off from there with their pos
+	int monsters = place(characters, NULL, NULL, 400, 1, 400, -45, 100);
+	Scene::SetRotation(monsters, 90, -45, 0);
+	Scene::Add(monsters, &model_zombie2, &model_zombie1);
+	Scene::Add(monsters, &model_zombie1, &model_zombie1);
+
+	place(characters, &model_character, NULL, 400, 1, 400, 225, 1);
+	place(props, &model_lamp, NULL, 0, 0, -800, 0, 0.25);
+
+	// The walls, the wardrobe and the door hide what is behind them; none of them move
+	addWallOccluder(575, 575, -45);
+	addWallOccluder(-555, -555, -45);
+	addWallOccluder(555, -555, 45);
+	addWallOccluder(-575, 575, 45);
+
+	Scene::Update();
+	model_wardrobe.AddOccluder(Scene::World(wardrobe));
+	model_door.AddOccluder(Scene::World(door));
 }
 
 //................................................................................................
 
 void setupLights() {
-	GLfloat ambient[] = { 0.7f, 0.7f, 0.7, 1.0f };
-	GLfloat diffuse[] = { 0.6f, 0.6f, 0.6, 1.0f };
-	GLfloat specular[] = { 1.0f, 1.0f, 1.0, 1.0f };
-	GLfloat shininess[] = { 50 };
-	glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
-	glMaterialfv(GL_FRONT, GL_SHININESS, shininess);
-
-	GLfloat lightIntensity[] = { 0.7f, 0.7f, 1, 1.0f };
-	GLfloat lightPosition[] = { -7.0f, 6.0f, 3.0f, 0.0f };
-	glLightfv(GL_LIGHT0, GL_POSITION, lightIntensity);
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, lightIntensity);
+	// The light turns with the camera, the rest was set once in InitLightSource() and InitMaterial()
+	glLightfv(GL_LIGHT0, GL_POSITION, lightDirection);
+
+	// The same for the shader, in one block for the whole frame
+	SceneShader::Frame frame;
+
+	memset(&frame, 0, sizeof(frame));
+	memcpy(frame.projection, cameraProjection, sizeof(frame.projection));
+
+	for (int i = 0; i < 4; i++)
+	{
+		frame.lightPosition[i] = cameraView[i] * lightDirection[0] + cameraView[4 + i] * lightDirection[1] +
+			cameraView[8 + i] * lightDirection[2] + cameraView[12 + i] * lightDirection[3];
+		frame.lightAmbient[i] = lightAmbient[i] + sceneAmbient[i];
+		frame.lightDiffuse[i] = lightDiffuse[i];
+		frame.lightSpecular[i] = lightSpecular[i];
+		frame.specular[i] = materialSpecular[i];
+	}
+
+	frame.specular[3] = materialShininess;
+
+	SceneShader::SetFrame(frame);
+}
+
+void setupClusterLights() {
+	static const float lampColor[] = { 1.0f, 0.85f, 0.6f };
+	static const float coinColor[] = { 1.0f, 0.75f, 0.2f };
+	bool coinsLeft[4] = { coin1, coin2, coin3, coin4 };
+
+	LightClusters::Clear();
+
+	// The lamp's bulb, and a glow around every coin that hasn't been picked up
+	LightClusters::AddPoint(lampLight, 800, lampColor);
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (coinsLeft[i])
+			LightClusters::AddPoint(&Scene::World(coinEntities[i])[12], 250, coinColor);
+	}
+
+	LightClusters::Build(cameraView, cameraProjection, WIDTH, HEIGHT);
+}
+
+// Flies the camera along the path for frames frames, every texture loaded first so each run
+// draws the same thing, and writes the times to benchmark.csv
+void runBenchmark(const char* pathName, int frames, const char* folder) {
+	if (!Benchmark::LoadPath(pathName) || frames < 1)
+		return;
+
+	while (TextureStreamer::Busy()) {
+		TextureStreamer::Update();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	for (int i = 0; i < frames; i++) {
+		float eye[3], center[3];
+
+		Benchmark::Camera(i, frames, eye, center);
+		camera.eye = Vector3f(eye[0], eye[1], eye[2]);
+		camera.center = Vector3f(center[0], center[1], center[2]);
+		camera.up = Vector3f(0.0f, 1.0f, 0.0f);
+
+		GpuTimer::BeginFrame();
+		Benchmark::BeginFrame();
+		TextureResidency::Update();
+		GpuTimer::Mark("Uploads");
+		drawScene();
+		GpuTimer::EndFrame();
+		Benchmark::EndFrame();
+
+		if (folder != NULL) {
+			char name[512];
+
+			snprintf(name, sizeof(name), "%s/frame%04d.png", folder, i);
+			Benchmark::SaveFrame(name, WIDTH, HEIGHT);
+		}
+	}
+
+	Benchmark::Write("benchmark.csv");
+
+	// Where the card's time went, over the last frames
+	GpuTimer::BeginFrame();
+
+	for (int i = 0; i < GpuTimer::Passes(); i++)
+		printf("  %s %.3f ms on the GPU\n", GpuTimer::Name(i), GpuTimer::Average(i));
 }
 
 void setupCamera() {
+	MatrixIdentity(cameraProjection);
+	MatrixPerspective(cameraProjection, fovy, aspectRatio, zNear, zFar);
+
 	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(fovy,aspectRatio,zNear,zFar);
+	glLoadMatrixf(cameraProjection);
 
 	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
 
-	camera.look();
+	camera.look(cameraView);
 }
 
 //=======================================================================
 // Main Function
 //=======================================================================
-void main(int argc, char** argv)
+int main(int argc, char** argv)
 {
-	glutInit(&argc, argv);
+	// "-bake" compresses all of the textures ahead of time and quits
+	if (argc > 1 && strcmp(argv[1], "-bake") == 0)
+	{
+		TextureCompressor::BakeFolder("models");
+		TextureCompressor::BakeFolder("textures");
+		return 0;
+	}
 
-	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+	// "-layouts" times the separate and interleaved vertex layouts on the trees and quits
+	bool layouts = (argc > 1 && strcmp(argv[1], "-layouts") == 0);
 
-	glutInitWindowSize(WIDTH, HEIGHT);
+	// "-benchmark path frames [folder]" flies the camera along the path, writes the times
+	// (and the frames into folder) and quits; off Windows it draws without a window
+	bool benchmark = (argc > 3 && strcmp(argv[1], "-benchmark") == 0);
+	bool headless = benchmark && Benchmark::CreateContext(WIDTH, HEIGHT);
 
-	glutInitWindowPosition(100, 150);
+	if (!headless)
+	{
+		glutInit(&argc, argv);
 
-	glutCreateWindow(title);
+		glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 
-	glutDisplayFunc(myDisplay);
+		glutInitWindowSize(WIDTH, HEIGHT);
 
-	glutKeyboardFunc(myKeyboard);
+		glutInitWindowPosition(100, 150);
 
-	glutSpecialFunc(Special);
+		glutCreateWindow(title);
+	}
+
+	// The extensions (compressed textures) can only be looked up once there is a context
+	glewInit();
+
+	// Decode the textures on other threads and upload them a little every frame
+	TextureStreamer::Start();
+
+	if (!headless)
+	{
+		glutDisplayFunc(myDisplay);
 
-	glutTimerFunc(1000, Timer, 0);
+		glutKeyboardFunc(myKeyboard);
 
-	glutMotionFunc(myMotion);
+		glutSpecialFunc(Special);
 
-	glutMouseFunc(myMouse);
+		glutTimerFunc(250, HotReload, 0);
 
-	glutReshapeFunc(myReshape);
+		glutMotionFunc(myMotion);
+
+		glutMouseFunc(myMouse);
+
+		glutReshapeFunc(myReshape);
+	}
 
 	myInit();
 
 	LoadAssets();
+
+	buildScene();
+
+	if (layouts)
+	{
+		model_tree.CompareLayouts(100);
+		model_palmtree.CompareLayouts(100);
+		return 0;
+	}
+
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_LIGHTING);
 	glEnable(GL_LIGHT0);
@@ -1516,5 +1616,18 @@ void main(int argc, char** argv)
 
 	glShadeModel(GL_SMOOTH);
 
+	if (benchmark)
+	{
+		// The pass times too, every second or so
+		GpuTimer::Log("gputimes.csv");
+		runBenchmark(argv[2], atoi(argv[3]), argc > 4 ? argv[4] : NULL);
+		Benchmark::DestroyContext();
+		return 0;
+	}
+
+	// The game steps at a fixed rate from here on, and draws only when something changed
+	FrameLoop::Start(TICKS_PER_SECOND, tick);
+
 	glutMainLoop();
+	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,749 @@
+//////////////////////////////////////////////////////////////////////
+//
+// PNG Decoder Class
+//
+// PNGDecoder.cpp: implementation of the PNGDecoder class.
+// This class decodes a PNG file that is already in memory
+// into RGB(A) pixels for the Image class. It has its own
+// inflate so nothing has to be linked in. The Huffman codes
+// are decoded with a lookup table that handles every code
+// up to 10 bits in one step, and the rows are unfiltered
+// and converted straight into their place in the picture,
+// bottom row first like OpenGL wants them.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "PNGDecoder.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+// Codes up to this many bits are found with one table lookup
+#define FAST_BITS	10
+#define FAST_MASK	((1 << FAST_BITS) - 1)
+
+// Base values and extra bits of the length and distance codes (RFC 1951)
+static const unsigned short lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// The order the code length code lengths are stored in
+static const unsigned char codeOrder[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Samples per pixel of every color type
+static const int samplesPerPixel[7] = { 1, 0, 3, 1, 2, 0, 4 };
+
+static unsigned int Read32BE(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Reverses the lowest n bits, deflate stores the codes backwards
+static int ReverseBits(int code, int n)
+{
+	int result = 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		result = (result << 1) | (code & 1);
+		code >>= 1;
+	}
+
+	return result;
+}
+
+// Reads sample i of a row at any bit depth
+static int GetSample(const unsigned char *raw, int i, int depth)
+{
+	if (depth == 8)
+		return raw[i];
+	if (depth == 16)
+		return (raw[i * 2] << 8) | raw[i * 2 + 1];
+
+	int bit = i * depth;
+	int shift = 8 - depth - (bit & 7);
+
+	return (raw[bit >> 3] >> shift) & ((1 << depth) - 1);
+}
+
+// Scales a sample to 8 bits
+static unsigned char ToByte(int value, int depth)
+{
+	if (depth == 8)
+		return (unsigned char)value;
+	if (depth == 16)
+		return (unsigned char)(value >> 8);
+
+	return (unsigned char)(value * 255 / ((1 << depth) - 1));
+}
+
+static unsigned char Paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+
+	if (pa <= pb && pa <= pc)
+		return (unsigned char)a;
+	if (pb <= pc)
+		return (unsigned char)b;
+
+	return (unsigned char)c;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+PNGDecoder::PNGDecoder()
+{
+	pixels = NULL;
+	width = 0;
+	height = 0;
+	channels = 0;
+}
+
+PNGDecoder::~PNGDecoder()
+{
+	delete [] pixels;
+}
+
+bool PNGDecoder::Decode(const unsigned char *file, long size)
+{
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+	if (size < 8 || memcmp(file, signature, 8) != 0)
+		return false;
+
+	bitDepth = 0;
+	colorType = 0;
+	interlace = 0;
+	paletteSize = 0;
+	hasKey = false;
+
+	bool hasAlpha = false;
+	std::vector<unsigned char> idat;
+
+	// Walk through the chunks
+	const unsigned char *chunk = file + 8;
+	const unsigned char *end = file + size;
+
+	while (chunk + 12 <= end)
+	{
+		unsigned int length = Read32BE(chunk);
+		const unsigned char *type = chunk + 4;
+		const unsigned char *data = chunk + 8;
+
+		if (length > (unsigned int)(end - data) - 4)
+			return false;
+
+		if (memcmp(type, "IHDR", 4) == 0 && length >= 13)
+		{
+			width = (int)Read32BE(data);
+			height = (int)Read32BE(data + 4);
+			bitDepth = data[8];
+			colorType = data[9];
+			interlace = data[12];
+
+			if (width <= 0 || height <= 0 || width > (1 << 16) || height > (1 << 16))
+				return false;
+			if (colorType > 6 || samplesPerPixel[colorType] == 0 || interlace > 1)
+				return false;
+			// Palettes and gray can be smaller than a byte, the rest is 8 or 16 bits
+			if (bitDepth != 8 && bitDepth != 16 && !((colorType == 0 || colorType == 3) && bitDepth < 8 && (bitDepth & (bitDepth - 1)) == 0))
+				return false;
+			if (colorType == 3 && bitDepth == 16)
+				return false;
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			paletteSize = length / 3;
+
+			if (paletteSize > 256)
+				return false;
+
+			for (int i = 0; i < paletteSize; i++)
+			{
+				palette[i * 4] = data[i * 3];
+				palette[i * 4 + 1] = data[i * 3 + 1];
+				palette[i * 4 + 2] = data[i * 3 + 2];
+				palette[i * 4 + 3] = 255;
+			}
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (colorType == 3)
+			{
+				// Alpha for the first palette entries
+				for (unsigned int i = 0; i < length && i < 256; i++)
+					palette[i * 4 + 3] = data[i];
+
+				hasAlpha = true;
+			}
+			else if (colorType == 0 && length >= 2)
+			{
+				key[0] = (unsigned short)((data[0] << 8) | data[1]);
+				hasKey = true;
+			}
+			else if (colorType == 2 && length >= 6)
+			{
+				for (int i = 0; i < 3; i++)
+					key[i] = (unsigned short)((data[i * 2] << 8) | data[i * 2 + 1]);
+				hasKey = true;
+			}
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+			idat.insert(idat.end(), data, data + length);
+		else if (memcmp(type, "IEND", 4) == 0)
+			break;
+
+		chunk = data + length + 4;
+	}
+
+	if (bitDepth == 0 || idat.size() < 2 || (colorType == 3 && paletteSize == 0))
+		return false;
+
+	// The zlib header: deflate, no preset dictionary
+	if ((idat[0] & 15) != 8 || (idat[1] & 32) != 0 || ((idat[0] << 8) | idat[1]) % 31 != 0)
+		return false;
+
+	int samples = samplesPerPixel[colorType];
+	int pixelBytes = (samples * bitDepth + 7) / 8;
+
+	// The Adam7 passes, a plain image is one pass over everything
+	static const int passes[7][4] = {
+		{ 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 },
+		{ 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+	static const int whole[1][4] = { { 0, 0, 1, 1 } };
+
+	const int (*pass)[4] = interlace ? passes : whole;
+	int passCount = interlace ? 7 : 1;
+
+	// Work out how much inflated data there is
+	long rawSize = 0;
+
+	for (int p = 0; p < passCount; p++)
+	{
+		long w = (width - pass[p][0] + pass[p][2] - 1) / pass[p][2];
+		long h = (height - pass[p][1] + pass[p][3] - 1) / pass[p][3];
+
+		if (w > 0 && h > 0)
+			rawSize += ((w * samples * bitDepth + 7) / 8 + 1) * h;
+	}
+
+	unsigned char *raw = new unsigned char[rawSize];
+
+	if (!Inflate(&idat[2], (long)idat.size() - 2, raw, rawSize))
+	{
+		delete [] raw;
+		return false;
+	}
+
+	channels = (colorType == 4 || colorType == 6 || hasAlpha || hasKey) ? 4 : 3;
+
+	delete [] pixels;
+	pixels = new unsigned char[(size_t)width * height * channels];
+
+	int rowSize = width * channels;
+	unsigned char *passData = raw;
+	std::vector<unsigned char> row(rowSize);
+
+	for (int p = 0; p < passCount; p++)
+	{
+		int x0 = pass[p][0], y0 = pass[p][1], dx = pass[p][2], dy = pass[p][3];
+		int w = (width - x0 + dx - 1) / dx;
+		int h = (height - y0 + dy - 1) / dy;
+
+		if (w <= 0 || h <= 0)
+			continue;
+
+		int rowBytes = (w * samples * bitDepth + 7) / 8;
+
+		if (!Unfilter(passData, rowBytes, h, pixelBytes))
+		{
+			delete [] raw;
+			return false;
+		}
+
+		for (int y = 0; y < h; y++)
+		{
+			const unsigned char *src = passData + (long)y * (rowBytes + 1) + 1;
+
+			// OpenGL wants the bottom row first
+			unsigned char *dest = pixels + (long)(height - 1 - (y0 + y * dy)) * rowSize;
+
+			if (!interlace)
+			{
+				ExpandRow(src, width, dest);
+				continue;
+			}
+
+			// Spread the pixels of the pass over the row
+			ExpandRow(src, w, &row[0]);
+
+			for (int x = 0; x < w; x++)
+				memcpy(dest + (x0 + x * dx) * channels, &row[x * channels], channels);
+		}
+
+		passData += (long)(rowBytes + 1) * h;
+	}
+
+	delete [] raw;
+
+	return true;
+}
+
+bool PNGDecoder::Unfilter(unsigned char *raw, int rowBytes, int rows, int pixelBytes)
+{
+	// The row above the first one counts as zeros
+	std::vector<unsigned char> zeros(rowBytes, 0);
+	const unsigned char *prior = &zeros[0];
+
+	for (int y = 0; y < rows; y++)
+	{
+		int filter = raw[0];
+		unsigned char *cur = raw + 1;
+		int i;
+
+		switch (filter)
+		{
+		case 0:		// None
+			break;
+
+		case 1:		// Sub
+			for (i = pixelBytes; i < rowBytes; i++)
+				cur[i] = (unsigned char)(cur[i] + cur[i - pixelBytes]);
+			break;
+
+		case 2:		// Up
+			for (i = 0; i < rowBytes; i++)
+				cur[i] = (unsigned char)(cur[i] + prior[i]);
+			break;
+
+		case 3:		// Average
+			for (i = 0; i < pixelBytes; i++)
+				cur[i] = (unsigned char)(cur[i] + (prior[i] >> 1));
+			for (; i < rowBytes; i++)
+				cur[i] = (unsigned char)(cur[i] + ((cur[i - pixelBytes] + prior[i]) >> 1));
+			break;
+
+		case 4:		// Paeth
+			for (i = 0; i < pixelBytes; i++)
+				cur[i] = (unsigned char)(cur[i] + prior[i]);
+			for (; i < rowBytes; i++)
+				cur[i] = (unsigned char)(cur[i] + Paeth(cur[i - pixelBytes], prior[i], prior[i - pixelBytes]));
+			break;
+
+		default:
+			return false;
+		}
+
+		prior = cur;
+		raw += rowBytes + 1;
+	}
+
+	return true;
+}
+
+void PNGDecoder::ExpandRow(const unsigned char *raw, int count, unsigned char *dest)
+{
+	// The common cases are a straight copy
+	if (bitDepth == 8 && !hasKey && ((colorType == 2 && channels == 3) || colorType == 6))
+	{
+		memcpy(dest, raw, count * channels);
+		return;
+	}
+
+	int samples = samplesPerPixel[colorType];
+
+	for (int x = 0; x < count; x++, dest += channels)
+	{
+		int s = x * samples;
+
+		switch (colorType)
+		{
+		case 0:		// Gray
+		{
+			int v = GetSample(raw, s, bitDepth);
+			dest[0] = dest[1] = dest[2] = ToByte(v, bitDepth);
+
+			if (channels == 4)
+				dest[3] = (hasKey && v == key[0]) ? 0 : 255;
+			break;
+		}
+
+		case 2:		// RGB
+		{
+			int r = GetSample(raw, s, bitDepth);
+			int g = GetSample(raw, s + 1, bitDepth);
+			int b = GetSample(raw, s + 2, bitDepth);
+
+			dest[0] = ToByte(r, bitDepth);
+			dest[1] = ToByte(g, bitDepth);
+			dest[2] = ToByte(b, bitDepth);
+
+			if (channels == 4)
+				dest[3] = (hasKey && r == key[0] && g == key[1] && b == key[2]) ? 0 : 255;
+			break;
+		}
+
+		case 3:		// Palette
+		{
+			int index = GetSample(raw, s, bitDepth);
+			const unsigned char *entry = palette + (index < paletteSize ? index : 0) * 4;
+
+			memcpy(dest, entry, channels);
+			break;
+		}
+
+		case 4:		// Gray and alpha
+			dest[0] = dest[1] = dest[2] = ToByte(GetSample(raw, s, bitDepth), bitDepth);
+			dest[3] = ToByte(GetSample(raw, s + 1, bitDepth), bitDepth);
+			break;
+
+		case 6:		// RGBA at 16 bits
+			for (int c = 0; c < 4; c++)
+				dest[c] = ToByte(GetSample(raw, s + c, bitDepth), bitDepth);
+			break;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Inflate
+//////////////////////////////////////////////////////////////////////
+
+bool PNGDecoder::Inflate(const unsigned char *data, long size, unsigned char *dest, long destSize)
+{
+	in = data;
+	inEnd = data + size;
+	bitBuffer = 0;
+	bitCount = 0;
+	out = dest;
+	outPos = dest;
+	outEnd = dest + destSize;
+
+	Huffman lengths, distances;
+	bool last;
+
+	do
+	{
+		last = GetBits(1) != 0;
+
+		switch (GetBits(2))
+		{
+		case 0:		// Stored
+			if (!InflateStored())
+				return false;
+			break;
+
+		case 1:		// Fixed Huffman codes
+		{
+			unsigned char sizes[288 + 32];
+			int i;
+
+			for (i = 0; i < 144; i++) sizes[i] = 8;
+			for (; i < 256; i++) sizes[i] = 9;
+			for (; i < 280; i++) sizes[i] = 7;
+			for (; i < 288; i++) sizes[i] = 8;
+			for (i = 0; i < 32; i++) sizes[288 + i] = 5;
+
+			if (!BuildHuffman(lengths, sizes, 288) || !BuildHuffman(distances, sizes + 288, 32))
+				return false;
+			if (!InflateBlock(lengths, distances))
+				return false;
+			break;
+		}
+
+		case 2:		// Dynamic Huffman codes
+			if (!ReadCodes(lengths, distances) || !InflateBlock(lengths, distances))
+				return false;
+			break;
+
+		default:
+			return false;
+		}
+	} while (!last);
+
+	// Every row has to be there
+	return outPos == outEnd;
+}
+
+void PNGDecoder::FillBits()
+{
+	while (bitCount <= 24)
+	{
+		// Past the end we feed zeros, the block decoder notices the bad data
+		unsigned int byte = in < inEnd ? *in : 0;
+		in++;
+
+		bitBuffer |= byte << bitCount;
+		bitCount += 8;
+	}
+}
+
+unsigned int PNGDecoder::GetBits(int n)
+{
+	if (bitCount < n)
+		FillBits();
+
+	unsigned int value = bitBuffer & ((1u << n) - 1);
+	bitBuffer >>= n;
+	bitCount -= n;
+
+	return value;
+}
+
+bool PNGDecoder::BuildHuffman(Huffman &h, const unsigned char *sizes, int count)
+{
+	int sizeCount[17] = { 0 };
+	int nextCode[16];
+	int i;
+
+	memset(h.fast, 0, sizeof(h.fast));
+
+	for (i = 0; i < count; i++)
+		sizeCount[sizes[i]]++;
+	sizeCount[0] = 0;
+
+	for (i = 1; i < 16; i++)
+	{
+		if (sizeCount[i] > (1 << i))
+			return false;
+	}
+
+	// Canonical codes: each length starts where the last one stopped
+	int code = 0;
+	int k = 0;
+
+	for (i = 1; i < 16; i++)
+	{
+		nextCode[i] = code;
+		h.firstCode[i] = (unsigned short)code;
+		h.firstSymbol[i] = (unsigned short)k;
+		code += sizeCount[i];
+
+		if (sizeCount[i] && code - 1 >= (1 << i))
+			return false;
+
+		h.maxCode[i] = code << (16 - i);
+		code <<= 1;
+		k += sizeCount[i];
+	}
+
+	h.maxCode[16] = 0x10000;
+
+	for (i = 0; i < count; i++)
+	{
+		int s = sizes[i];
+
+		if (s == 0)
+			continue;
+
+		int index = nextCode[s] - h.firstCode[s] + h.firstSymbol[s];
+		h.length[index] = (unsigned char)s;
+		h.symbol[index] = (unsigned short)i;
+
+		// Every table entry whose low bits are this code decodes to it
+		if (s <= FAST_BITS)
+		{
+			for (int j = ReverseBits(nextCode[s], s); j < (1 << FAST_BITS); j += 1 << s)
+				h.fast[j] = (unsigned short)((s << 9) | i);
+		}
+
+		nextCode[s]++;
+	}
+
+	return true;
+}
+
+int PNGDecoder::DecodeSymbol(Huffman &h)
+{
+	if (bitCount < 16)
+		FillBits();
+
+	int fast = h.fast[bitBuffer & FAST_MASK];
+
+	if (fast)
+	{
+		int s = fast >> 9;
+		bitBuffer >>= s;
+		bitCount -= s;
+		return fast & 511;
+	}
+
+	// A long code, compare it against the last code of every length
+	int code = ReverseBits(bitBuffer & 0xFFFF, 16);
+	int s;
+
+	for (s = FAST_BITS + 1; code >= h.maxCode[s]; s++)
+		;
+
+	if (s >= 16)
+		return -1;
+
+	int index = (code >> (16 - s)) - h.firstCode[s] + h.firstSymbol[s];
+
+	if (index >= 288 || h.length[index] != s)
+		return -1;
+
+	bitBuffer >>= s;
+	bitCount -= s;
+
+	return h.symbol[index];
+}
+
+bool PNGDecoder::ReadCodes(Huffman &lengths, Huffman &distances)
+{
+	int literalCount = GetBits(5) + 257;
+	int distanceCount = GetBits(5) + 1;
+	int codeCount = GetBits(4) + 4;
+
+	// The code lengths are Huffman coded themselves
+	unsigned char codeSizes[19] = { 0 };
+
+	for (int i = 0; i < codeCount; i++)
+		codeSizes[codeOrder[i]] = (unsigned char)GetBits(3);
+
+	Huffman codes;
+
+	if (!BuildHuffman(codes, codeSizes, 19))
+		return false;
+
+	unsigned char sizes[286 + 32];
+	int total = literalCount + distanceCount;
+	int n = 0;
+
+	while (n < total)
+	{
+		int c = DecodeSymbol(codes);
+		int fill = 0;
+		int repeat;
+
+		if (c < 0 || c > 18)
+			return false;
+
+		if (c < 16)
+		{
+			sizes[n++] = (unsigned char)c;
+			continue;
+		}
+
+		if (c == 16)
+		{
+			// Repeat the last length
+			if (n == 0)
+				return false;
+
+			fill = sizes[n - 1];
+			repeat = GetBits(2) + 3;
+		}
+		else if (c == 17)
+			repeat = GetBits(3) + 3;
+		else
+			repeat = GetBits(7) + 11;
+
+		if (n + repeat > total)
+			return false;
+
+		memset(sizes + n, fill, repeat);
+		n += repeat;
+	}
+
+	return BuildHuffman(lengths, sizes, literalCount) && BuildHuffman(distances, sizes + literalCount, distanceCount);
+}
+
+bool PNGDecoder::InflateStored()
+{
+	// Skip to the next byte
+	GetBits(bitCount & 7);
+
+	unsigned int length = GetBits(16);
+	unsigned int inverse = GetBits(16);
+
+	if ((length ^ 0xFFFF) != inverse)
+		return false;
+
+	if ((long)length > outEnd - outPos)
+		return false;
+
+	// Bytes that are already in the bit buffer come first
+	while (length > 0 && bitCount > 0)
+	{
+		*outPos++ = (unsigned char)GetBits(8);
+		length--;
+	}
+
+	if ((long)length > inEnd - in)
+		return false;
+
+	memcpy(outPos, in, length);
+	outPos += length;
+	in += length;
+
+	return true;
+}
+
+bool PNGDecoder::InflateBlock(Huffman &lengths, Huffman &distances)
+{
+	for (;;)
+	{
+		int symbol = DecodeSymbol(lengths);
+
+		if (symbol < 256)
+		{
+			if (symbol < 0 || outPos >= outEnd)
+				return false;
+
+			*outPos++ = (unsigned char)symbol;
+			continue;
+		}
+
+		if (symbol == 256)
+			return in <= inEnd + 4;
+
+		// A match: copy length bytes from distance bytes back
+		symbol -= 257;
+
+		if (symbol >= 29)
+			return false;
+
+		int length = lengthBase[symbol] + (lengthExtra[symbol] ? GetBits(lengthExtra[symbol]) : 0);
+		int code = DecodeSymbol(distances);
+
+		if (code < 0 || code >= 30)
+			return false;
+
+		int distance = distBase[code] + (distExtra[code] ? GetBits(distExtra[code]) : 0);
+
+		if (distance > outPos - out || length > outEnd - outPos)
+			return false;
+
+		const unsigned char *from = outPos - distance;
+
+		if (distance == 1)
+			memset(outPos, *from, length);
+		else if (distance >= length)
+			memcpy(outPos, from, length);
+		else
+		{
+			// The copy overlaps itself so it has to go a byte at a time
+			for (int i = 0; i < length; i++)
+				outPos[i] = from[i];
+		}
+
+		outPos += length;
+	}
+}
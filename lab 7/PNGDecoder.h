@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////////////////////
+//
+// PNG Decoder Class
+//
+// PNGDecoder.h: interface for the PNGDecoder class.
+// This class decodes a PNG file that is already in memory
+// into RGB(A) pixels for the Image class. It has its own
+// inflate so nothing has to be linked in. The Huffman codes
+// are decoded with a lookup table that handles every code
+// up to 10 bits in one step, and the rows are unfiltered
+// and converted straight into their place in the picture,
+// bottom row first like OpenGL wants them.
+//
+// Supported formats:
+// Every color type at 8 bits, palettes at 1, 2, 4 and 8 bits,
+// 16 bit channels (cut down to 8 bits), interlaced or not,
+// and transparency from a tRNS chunk.
+//
+// Usage:
+// PNGDecoder png;
+//
+// if (png.Decode(file, size))
+// {
+//		// png.pixels is png.width * png.height * png.channels bytes,
+//		// allocated with new[], take them or let the destructor free them
+// }
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef PNGDECODER_H
+#define PNGDECODER_H
+
+class PNGDecoder
+{
+public:
+	unsigned char *pixels;			// The decoded RGB(A) pixels, bottom row first
+	int width;						// Image's width
+	int height;						// Image's height
+	int channels;					// 3 for RGB, 4 for RGBA
+	bool Decode(const unsigned char *file, long size);	// Decodes a whole PNG file
+	PNGDecoder();					// Constructor
+	virtual ~PNGDecoder();			// Destructor
+
+private:
+	// A Huffman code of the deflate stream
+	struct Huffman
+	{
+		unsigned short fast[1 << 10];	// (length << 9) | symbol for the short codes, 0 if the code is longer
+		unsigned short firstCode[16];	// The first code of every length
+		int maxCode[17];				// One past the last code of every length (left aligned to 16 bits)
+		unsigned short firstSymbol[16];	// Index of the first symbol of every length
+		unsigned char length[288];		// Code length of every sorted symbol
+		unsigned short symbol[288];		// The symbols sorted by code
+	};
+
+	int bitDepth;					// Bits per sample
+	int colorType;					// PNG color type
+	int interlace;					// 1 for Adam7
+	unsigned char palette[256 * 4];	// RGBA palette entries
+	int paletteSize;				// Number of palette entries
+	bool hasKey;					// True if a tRNS chunk gave a transparent color
+	unsigned short key[3];			// The transparent gray or RGB value
+
+	// Inflate state
+	const unsigned char *in;		// Next compressed byte
+	const unsigned char *inEnd;		// End of the compressed bytes
+	unsigned int bitBuffer;			// Bits read but not used yet, first bit in bit 0
+	int bitCount;					// Number of bits in bitBuffer
+	unsigned char *out;				// Start of the inflated data
+	unsigned char *outPos;			// Where the next inflated byte goes
+	unsigned char *outEnd;			// End of the room for inflated data
+
+	bool Inflate(const unsigned char *data, long size, unsigned char *dest, long destSize);
+	bool InflateBlock(Huffman &lengths, Huffman &distances);	// Decodes one compressed block
+	bool InflateStored();			// Copies one uncompressed block
+	bool ReadCodes(Huffman &lengths, Huffman &distances);		// Reads the Huffman codes of a dynamic block
+	bool BuildHuffman(Huffman &h, const unsigned char *sizes, int count);
+	int DecodeSymbol(Huffman &h);	// Reads one Huffman coded symbol, -1 on bad data
+	void FillBits();				// Tops up the bit buffer
+	unsigned int GetBits(int n);	// Reads n bits
+
+	bool Unfilter(unsigned char *raw, int rowBytes, int rows, int pixelBytes);	// Undoes the row filters in place
+	void ExpandRow(const unsigned char *raw, int count, unsigned char *dest);	// Turns a row of samples into RGB(A)
+};
+
+#endif PNGDECODER_H
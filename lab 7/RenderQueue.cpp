@@ -0,0 +1,537 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Render Queue Class
+//
+// RenderQueue.cpp: implementation of the RenderQueue class.
+// Every entry is drawn with the same shader (the SceneShader or
+// none), so the sort key only has the texture (0 for the faces
+// colored on their vertices) in the top 32 bits and the mesh in
+// the rest. Meshes are numbered in the order they are first
+// seen in a frame, so the sort is the same every frame as long
+// as the scene is. The same walk over the entries draws them
+// and, without touching OpenGL, counts what the unsorted order
+// would have cost.
+//
+// With the shader the matrices of all the entries, each copy's
+// times its object's, and their materials are gathered before
+// the walk and sent in one go; a draw then only points at its
+// first matrix.
+//
+// The spheres are moved into eye space as they come in, where
+// the Frustum keeps its planes, and stored one array per
+// coordinate so the whole frame can be culled in one call.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "RenderQueue.h"
+#include "Model_3DS.h"
+#include "SceneShader.h"
+#include "Frustum.h"
+#include "OcclusionCuller.h"
+#include "Matrix.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <utility>
+
+// Nothing is known about the state yet
+#define UNKNOWN				-1
+
+bool RenderQueue::sorting = true;
+bool RenderQueue::culling = true;
+
+// One group of faces to draw
+struct Entry
+{
+	unsigned long long key;							// Texture, mesh
+	Model_3DS *model;								// The model the faces belong to
+	int objindex;									// The object in it
+	int group;										// The MaterialFaces of the object
+	int count;										// Copies drawn with the instance matrices, 0 for one with matrix
+	float matrix[16];								// The modelview matrix to draw with
+	int bounds;										// The sphere it is culled with, -1 for the copies
+	int material;									// Its SceneShader material
+	int firstMatrix;								// Where its matrices start in the shader's
+};
+
+// What Walk() has set up so far
+struct State
+{
+	int shader;										// 1 for the SceneShader, 0 for fixed function
+	const Model_3DS::Object *mesh;					// Whose arrays are bound
+	int material;									// The SceneShader material in use
+	int texturing;									// GL_TEXTURE_2D on or off
+	unsigned int texture;							// The texture bound (textures that failed to load are 0)
+	int colorArray;									// GL_COLOR_ARRAY on or off
+	int color;										// The current color, packed rgb (UNKNOWN after the color array)
+};
+
+static std::vector<Entry> entries;
+static std::map<const Model_3DS::Object *, int> meshes;
+static std::vector<float> boundsX;
+static std::vector<float> boundsY;
+static std::vector<float> boundsZ;
+static std::vector<float> boundsRadius;
+static std::vector<unsigned char> visible;
+static std::vector<float> matrices;					// What the shader draws with, 16 floats each
+static std::vector<SceneShader::Material> materials;
+static bool queueing = false;
+static RenderQueue::Stats current;
+static RenderQueue::Stats last;
+
+static bool ByKey(const Entry &a, const Entry &b)
+{
+	return a.key < b.key;
+}
+
+static void ResetState(State &state)
+{
+	state.shader = 0;
+	state.mesh = NULL;
+	state.material = UNKNOWN;
+	state.texturing = UNKNOWN;
+	state.texture = (unsigned int)UNKNOWN;
+	state.colorArray = 0;
+	state.color = 0xFFFFFF;
+}
+
+// Goes through the entries in order, drawing them if draw is set, and counts the binds and state changes
+static void Walk(bool draw, int &binds, int &changes)
+{
+	State state;
+	ResetState(state);
+
+	int shader = SceneShader::Supported() ? 1 : 0;
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		Entry &e = entries[i];
+		const Model_3DS::Object &obj = e.model->Objects[e.objindex];
+		Model_3DS::Material &mat = e.model->Materials[obj.MatFaces[e.group].MatIndex];
+
+		if (shader != state.shader)
+		{
+			if (draw)
+				SceneShader::Begin();
+
+			state.shader = shader;
+			changes++;
+		}
+
+		if (&obj != state.mesh)
+		{
+			// The color array is kept in the vertex array object, leave it off there
+			if (state.colorArray)
+			{
+				if (draw)
+					glDisableClientState(GL_COLOR_ARRAY);
+
+				state.colorArray = 0;
+				changes++;
+			}
+
+			if (draw)
+				e.model->BindObject(e.objindex);
+
+			state.mesh = &obj;
+			changes++;
+		}
+
+		if (shader)
+		{
+			// The material block has the color and says where it comes from
+			if (e.material != state.material)
+			{
+				if (draw)
+					SceneShader::UseMaterial(e.material);
+
+				state.material = e.material;
+				changes++;
+			}
+
+			if (mat.textured && mat.tex.texture[0] != state.texture)
+			{
+				if (draw)
+					glBindTexture(GL_TEXTURE_2D, mat.tex.texture[0]);
+
+				state.texture = mat.tex.texture[0];
+				binds++;
+			}
+		}
+		else if (!mat.textured)
+		{
+			// Colors are drawn w/o a texture
+			if (state.texturing != 0)
+			{
+				if (draw)
+					glDisable(GL_TEXTURE_2D);
+
+				state.texturing = 0;
+				changes++;
+			}
+
+			if (obj.Colors != NULL)
+			{
+				if (!state.colorArray)
+				{
+					if (draw)
+						glEnableClientState(GL_COLOR_ARRAY);
+
+					state.colorArray = 1;
+					changes++;
+				}
+
+				// Drawing from the array leaves the current color undefined
+				state.color = UNKNOWN;
+			}
+			else
+			{
+				int color = (mat.color.r << 16) | (mat.color.g << 8) | mat.color.b;
+
+				if (state.colorArray)
+				{
+					if (draw)
+						glDisableClientState(GL_COLOR_ARRAY);
+
+					state.colorArray = 0;
+					changes++;
+				}
+
+				if (color != state.color)
+				{
+					if (draw)
+						glColor3ub(mat.color.r, mat.color.g, mat.color.b);
+
+					state.color = color;
+					changes++;
+				}
+			}
+		}
+		else
+		{
+			if (state.colorArray)
+			{
+				if (draw)
+					glDisableClientState(GL_COLOR_ARRAY);
+
+				state.colorArray = 0;
+				changes++;
+			}
+
+			// The textures are tinted by the current color, so white
+			if (state.color != 0xFFFFFF)
+			{
+				if (draw)
+					glColor3f(1.0f, 1.0f, 1.0f);
+
+				state.color = 0xFFFFFF;
+				changes++;
+			}
+
+			if (state.texturing != 1)
+			{
+				if (draw)
+					glEnable(GL_TEXTURE_2D);
+
+				state.texturing = 1;
+				changes++;
+			}
+
+			if (mat.tex.texture[0] != state.texture)
+			{
+				if (draw)
+					glBindTexture(GL_TEXTURE_2D, mat.tex.texture[0]);
+
+				state.texture = mat.tex.texture[0];
+				binds++;
+			}
+		}
+
+		if (draw && shader)
+		{
+			// A single model is one copy as far as the shader is concerned
+			SceneShader::UseMatrices(e.firstMatrix);
+			e.model->DrawFaces(e.objindex, e.group, (e.count > 0) ? e.count : 1);
+		}
+		else if (draw)
+		{
+			glLoadMatrixf(e.matrix);
+			e.model->DrawFaces(e.objindex, e.group, e.count);
+		}
+	}
+
+	if (!draw)
+		return;
+
+	// Leave things the way models used to
+	if (state.colorArray)
+		glDisableClientState(GL_COLOR_ARRAY);
+	if (state.color != 0xFFFFFF)
+		glColor3f(1.0f, 1.0f, 1.0f);
+	if (state.texturing == 0)
+		glEnable(GL_TEXTURE_2D);
+	if (state.shader)
+		SceneShader::End();
+
+	if (GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object)
+		glBindVertexArray(0);
+	if (GLEW_VERSION_1_5)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+}
+
+void RenderQueue::Begin()
+{
+	// The frame before is complete now
+	last = current;
+	memset(&current, 0, sizeof(current));
+
+	queueing = true;
+}
+
+void RenderQueue::End()
+{
+	Flush();
+	queueing = false;
+}
+
+bool RenderQueue::Queueing()
+{
+	return queueing;
+}
+
+int RenderQueue::AddBounds(const float *matrix, float x, float y, float z, float radius)
+{
+	// The scale of the matrix grows the radius as well, by the most it stretches any axis
+	float scale = 0.0f;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const float *axis = &matrix[i * 4];
+		float length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+		if (length > scale)
+			scale = length;
+	}
+
+	boundsX.push_back(matrix[0] * x + matrix[4] * y + matrix[8] * z + matrix[12]);
+	boundsY.push_back(matrix[1] * x + matrix[5] * y + matrix[9] * z + matrix[13]);
+	boundsZ.push_back(matrix[2] * x + matrix[6] * y + matrix[10] * z + matrix[14]);
+	boundsRadius.push_back(radius * (float)sqrt(scale));
+
+	return (int)boundsX.size() - 1;
+}
+
+void RenderQueue::Add(Model_3DS *model, int objindex, int group, int count, const float *matrix, int bounds)
+{
+	Model_3DS::Object &obj = model->Objects[objindex];
+	Model_3DS::Material &mat = model->Materials[obj.MatFaces[group].MatIndex];
+
+	// Meshes are numbered as they come
+	std::map<const Model_3DS::Object *, int>::iterator it = meshes.find(&obj);
+	int mesh;
+
+	if (it == meshes.end())
+	{
+		mesh = (int)meshes.size();
+		meshes[&obj] = mesh;
+	}
+	else
+		mesh = it->second;
+
+	unsigned long long texture = mat.textured ? (unsigned long long)mat.tex.texture[0] + 1 : 0;
+
+	Entry e;
+	e.key = (texture << 32) | (unsigned int)mesh;
+	e.model = model;
+	e.objindex = objindex;
+	e.group = group;
+	e.count = count;
+	memcpy(e.matrix, matrix, sizeof(e.matrix));
+	e.bounds = bounds;
+	e.material = 0;
+	e.firstMatrix = 0;
+
+	entries.push_back(e);
+}
+
+bool RenderQueue::Visible(int bounds)
+{
+	if (bounds < 0 || bounds >= (int)visible.size())
+		return true;
+
+	return visible[bounds] != 0;
+}
+
+// Tests every sphere added since the last Flush() and drops the entries that are off screen
+static void Cull()
+{
+	int count = (int)boundsX.size();
+	int inside = count;
+	int hidden = 0;
+
+	visible.resize(count);
+
+	if (count > 0)
+	{
+		if (RenderQueue::culling)
+		{
+			inside = Frustum::Cull(&boundsX[0], &boundsY[0], &boundsZ[0], &boundsRadius[0], count, &visible[0]);
+			// Only the ones on screen can be hidden
+			hidden = OcclusionCuller::Test(&boundsX[0], &boundsY[0], &boundsZ[0], &boundsRadius[0], count, &visible[0]);
+		}
+		else
+			memset(&visible[0], 1, count);
+	}
+
+	current.models += count;
+	current.culled += count - inside;
+	current.occluded += hidden;
+
+	// The copies' matrices go to the card now, only the ones on screen
+	std::map<Model_3DS *, int> copies;
+	size_t kept = 0;
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		Entry &e = entries[i];
+
+		if (e.count > 0)
+		{
+			std::map<Model_3DS *, int>::iterator it = copies.find(e.model);
+
+			if (it == copies.end())
+				it = copies.insert(std::make_pair(e.model, e.model->CullInstances())).first;
+
+			e.count = it->second;
+
+			if (e.count == 0)
+				continue;
+		}
+		else if (!RenderQueue::Visible(e.bounds))
+			continue;
+
+		if (kept != i)
+			entries[kept] = e;
+
+		kept++;
+	}
+
+	entries.resize(kept);
+}
+
+// Gives every entry its material and its matrices, and sends them all to the shader
+static void Prepare()
+{
+	std::map<std::pair<const Model_3DS::Material *, int>, int> numbers;
+
+	matrices.clear();
+	materials.clear();
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		Entry &e = entries[i];
+		const Model_3DS::Object &obj = e.model->Objects[e.objindex];
+		const Model_3DS::Material &mat = e.model->Materials[obj.MatFaces[e.group].MatIndex];
+
+		// The same material is colored on the vertices in one object and not in another
+		int vertexColors = (!mat.textured && obj.Colors != NULL) ? 1 : 0;
+		std::pair<const Model_3DS::Material *, int> key(&mat, vertexColors);
+		std::map<std::pair<const Model_3DS::Material *, int>, int>::iterator it = numbers.find(key);
+
+		if (it == numbers.end())
+		{
+			SceneShader::Material m;
+
+			memset(&m, 0, sizeof(m));
+
+			// A texture that didn't load leaves the faces white, the way it does without the shader
+			m.textured = (mat.textured && mat.tex.texture[0] != 0) ? 1 : 0;
+			m.vertexColors = vertexColors;
+			m.lit = e.model->lit ? 1 : 0;		// A material only belongs to one model
+			m.color[0] = mat.textured ? 1.0f : mat.color.r / 255.0f;
+			m.color[1] = mat.textured ? 1.0f : mat.color.g / 255.0f;
+			m.color[2] = mat.textured ? 1.0f : mat.color.b / 255.0f;
+			m.color[3] = 1.0f;
+
+			it = numbers.insert(std::make_pair(key, (int)materials.size())).first;
+			materials.push_back(m);
+		}
+
+		e.material = it->second;
+		e.firstMatrix = (int)matrices.size() / 16;
+
+		if (e.count == 0)
+		{
+			matrices.insert(matrices.end(), e.matrix, e.matrix + 16);
+			continue;
+		}
+
+		// Each copy's matrix in front of the object's own
+		const float *copies = e.model->Instances();
+		size_t first = matrices.size();
+
+		matrices.resize(first + e.count * 16);
+
+		for (int c = 0; c < e.count; c++)
+			MatrixMultiply(&matrices[first + c * 16], &copies[c * 16], e.matrix);
+	}
+
+	SceneShader::SetMatrices(&matrices[0], (int)matrices.size() / 16);
+	SceneShader::SetMaterials(&materials[0], (int)materials.size());
+}
+
+void RenderQueue::Flush()
+{
+	Cull();
+
+	boundsX.clear();
+	boundsY.clear();
+	boundsZ.clear();
+	boundsRadius.clear();
+
+	if (entries.empty())
+	{
+		meshes.clear();
+		return;
+	}
+
+	bool shader = SceneShader::Supported();
+
+	if (shader)
+		Prepare();
+
+	// What it would have cost as it came
+	Walk(false, current.unsortedBinds, current.unsortedStateChanges);
+
+	// Equal keys stay in the order they came in
+	if (sorting)
+		std::stable_sort(entries.begin(), entries.end(), ByKey);
+
+	// Without the shader each entry loads its matrix
+	if (!shader)
+	{
+		glMatrixMode(GL_MODELVIEW);
+		glPushMatrix();
+	}
+
+	Walk(true, current.binds, current.stateChanges);
+
+	if (!shader)
+		glPopMatrix();
+
+	current.drawCalls += (int)entries.size();
+
+	entries.clear();
+	meshes.clear();
+}
+
+RenderQueue::Stats RenderQueue::GetStats()
+{
+	return last;
+}
@@ -0,0 +1,83 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Render Queue Class
+//
+// RenderQueue.h: interface for the RenderQueue class.
+// Every model used to draw itself as soon as it was asked to,
+// in the order the scene happened to be written in, setting up
+// its arrays and binding its textures each time. Between
+// Begin() and End() Model_3DS::Draw() and DrawInstances() only
+// add an entry per material of each object instead: the model,
+// the object, the group of faces and the matrix they are drawn
+// with. End() sorts the entries by texture, then mesh and draws
+// them, changing only the state that differs from the entry
+// before. On cards that can run the SceneShader everything is
+// drawn with it, from matrices and materials sent once for the
+// whole frame; the others get the fixed function pipeline. The
+// shader takes the projection and the light from
+// SceneShader::SetFrame(), not from OpenGL, so that has to be
+// called once the camera is set up.
+//
+// Outside of Begin() and End() models are drawn right away,
+// the same way, one model at a time.
+//
+// Each model (or copy of one) also hands in its bounding sphere
+// with AddBounds(). Before anything is sent to the card the
+// spheres of the whole frame are tested against the Frustum in
+// one batch, then the ones left against the OcclusionCuller's
+// depth buffer. The entries of the models that are off screen or
+// hidden are dropped, those copies left out of the instance
+// matrices.
+//
+// The stats count what the last frame cost, and what it would
+// have cost drawn in the order the entries came in.
+//
+// Usage:
+// RenderQueue::Begin();
+// model.Draw();						// Only queues it (if it is on screen)
+// tree.DrawInstances();
+// RenderQueue::End();					// Draws it all
+//
+// RenderQueue::Stats stats = RenderQueue::GetStats();
+// printf("%d draws, %d binds\n", stats.drawCalls, stats.binds);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+class Model_3DS;
+
+class RenderQueue
+{
+public:
+	struct Stats
+	{
+		int drawCalls;								// glDrawElements calls
+		int binds;									// Textures bound
+		int stateChanges;							// Everything else switched: shaders, meshes, materials, texturing, colors
+		int unsortedBinds;							// Textures that would have been bound in the order they came in
+		int unsortedStateChanges;					// And the rest of the state
+		int models;									// Models and copies tested against the frustum
+		int culled;									// How many of them were off screen
+		int occluded;								// And how many were hidden behind the occluders
+	};
+
+	static bool sorting;							// False draws the entries in the order they came in
+	static bool culling;							// False draws the models that are off screen too
+
+	static void Begin();							// Starts queueing a frame
+	static void End();								// Sorts and draws the frame
+	static bool Queueing();							// True between Begin() and End()
+	// Adds the sphere around a model drawn with matrix, returns the number to queue its faces with
+	static int AddBounds(const float *matrix, float x, float y, float z, float radius);
+	// Queues a group of faces of an object drawn with matrix inside bounds, or count copies
+	// with the instance matrices if it isn't 0 (those are culled by the model)
+	static void Add(Model_3DS *model, int objindex, int group, int count, const float *matrix, int bounds);
+	static bool Visible(int bounds);				// Whether the sphere is on screen, while the queue is drawn
+	// Draws what has been queued so far
+	static void Flush();
+	static Stats GetStats();						// What the last whole frame cost
+};
+
+#endif RENDERQUEUE_H
@@ -0,0 +1,194 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Scene Class
+//
+// Scene.cpp: implementation of the Scene class.
+// The entities are kept one array per part, not one struct
+// each, so Update() runs down the flags and matrices it needs
+// in order. An entity is dirty when its own transform was set,
+// and moved when Update() made its world matrix again; a child
+// looks at its parent's moved flag, which is already known
+// since the parent comes first.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Scene.h"
+#include "Model_3DS.h"
+#include "Matrix.h"
+#include "glew.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// Where an entity is placed under its parent
+struct Placement
+{
+	float x, y, z;									// Position
+	float rx, ry, rz;								// Angles in degrees
+	float sx, sy, sz;								// Scale
+};
+
+static std::vector<int> parents;
+static std::vector<Placement> placements;
+static std::vector<float> locals;					// 16 floats an entity, the placement as a matrix
+static std::vector<float> worlds;					// 16 floats an entity, the locals of its parents and its own
+static std::vector<unsigned char> dirty;
+static std::vector<unsigned char> moved;
+static std::vector<Model_3DS *> models;
+static std::vector<Model_3DS *> meshes;
+static std::vector<Model_3DS *> instanced;			// The meshes drawn as copies, each once, in the order they came
+static int updated = 0;
+
+// True if entity is group or one of the entities under it
+static bool Under(int entity, int group)
+{
+	while (entity != Scene::ROOT && entity != group)
+		entity = parents[entity];
+
+	return entity == group;
+}
+
+int Scene::Add(int parent, Model_3DS *model, Model_3DS *mesh)
+{
+	int entity = (int)parents.size();
+
+	// Only entities that are already there keep the array in order
+	if (parent >= entity)
+		parent = ROOT;
+
+	Placement p = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+
+	parents.push_back(parent);
+	placements.push_back(p);
+	locals.resize(locals.size() + 16);
+	worlds.resize(worlds.size() + 16);
+	dirty.push_back(1);
+	moved.push_back(0);
+	models.push_back(model);
+	meshes.push_back(mesh);
+
+	if (mesh != 0 && std::find(instanced.begin(), instanced.end(), mesh) == instanced.end())
+		instanced.push_back(mesh);
+
+	return entity;
+}
+
+void Scene::SetPosition(int entity, float x, float y, float z)
+{
+	Placement &p = placements[entity];
+
+	p.x = x;
+	p.y = y;
+	p.z = z;
+	dirty[entity] = 1;
+}
+
+void Scene::SetRotation(int entity, float x, float y, float z)
+{
+	Placement &p = placements[entity];
+
+	p.rx = x;
+	p.ry = y;
+	p.rz = z;
+	dirty[entity] = 1;
+}
+
+void Scene::SetScale(int entity, float x, float y, float z)
+{
+	Placement &p = placements[entity];
+
+	p.sx = x;
+	p.sy = y;
+	p.sz = z;
+	dirty[entity] = 1;
+}
+
+void Scene::Update()
+{
+	int count = (int)parents.size();
+
+	updated = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		int parent = parents[i];
+		float *local = &locals[i * 16];
+		float *world = &worlds[i * 16];
+
+		moved[i] = 0;
+
+		if (dirty[i])
+		{
+			Placement &p = placements[i];
+
+			MatrixIdentity(local);
+			MatrixTranslate(local, p.x, p.y, p.z);
+			MatrixRotate(local, p.ry, 0.0f, 1.0f, 0.0f);
+			MatrixRotate(local, p.rx, 1.0f, 0.0f, 0.0f);
+			MatrixRotate(local, p.rz, 0.0f, 0.0f, 1.0f);
+			MatrixScale(local, p.sx, p.sy, p.sz);
+		}
+		else if (parent == ROOT || !moved[parent])
+			continue;
+
+		if (parent == ROOT)
+			memcpy(world, local, 16 * sizeof(float));
+		else
+			MatrixMultiply(world, &worlds[parent * 16], local);
+
+		dirty[i] = 0;
+		moved[i] = 1;
+		updated++;
+	}
+}
+
+const float *Scene::World(int entity)
+{
+	return &worlds[entity * 16];
+}
+
+int Scene::Count()
+{
+	return (int)parents.size();
+}
+
+int Scene::Updated()
+{
+	return updated;
+}
+
+void Scene::Draw()
+{
+	float view[16];
+
+	glGetFloatv(GL_MODELVIEW_MATRIX, view);
+	Draw(view);
+}
+
+void Scene::Draw(const float *view)
+{
+	Draw(view, ROOT);
+}
+
+void Scene::Draw(const float *view, int group)
+{
+	float m[16];
+
+	for (size_t i = 0; i < parents.size(); i++)
+	{
+		if (models[i] == 0 || !Under((int)i, group))
+			continue;
+
+		MatrixMultiply(m, view, &worlds[i * 16]);
+
+		if (meshes[i] != 0)
+			models[i]->AddInstance(*meshes[i], m);
+		else
+			models[i]->Draw(m);
+	}
+
+	// All the copies of a mesh in one go (the meshes the group has none of have nothing to draw)
+	for (size_t i = 0; i < instanced.size(); i++)
+		instanced[i]->DrawInstances();
+}
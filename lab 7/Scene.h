@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Scene Class
+//
+// Scene.h: interface for the Scene class.
+// Where everything in the level is placed. Each entity has a
+// position, angles and a scale of its own, relative to its
+// parent, and the entities are kept in one flat array with
+// every parent before its children. Update() goes through the
+// array once, front to back, and makes the world matrix of an
+// entity again only if its own transform changed or its
+// parent's world matrix did, so the props that never move cost
+// nothing after the first frame.
+//
+// An entity can draw a model, queue a copy of a model for its
+// DrawInstances(), or just be the parent of others. Draw() puts
+// the camera in front of each world matrix and hands it to the
+// model, which adds its own pos, rot and scale, so the game can
+// still move a model through those.
+//
+// The angles are turned about y, then x, then z, the scale is
+// applied last.
+//
+// Usage:
+// int table = Scene::Add(Scene::ROOT, &model_table, &model_table);
+// Scene::SetPosition(table, 800, 0, 50);
+// Scene::SetRotation(table, 0, 45, 0);
+// Scene::SetScale(table, 3, 3, 3);
+//
+// Scene::Update();
+// camera.look();
+// Scene::Draw();						// Or Scene::Draw(view) with the camera's matrix
+// Scene::Draw(view, props);			// Only the entities under props
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef SCENE_H
+#define SCENE_H
+
+class Model_3DS;
+
+class Scene
+{
+public:
+	static const int ROOT = -1;						// The parent of the entities that have none
+
+	// Adds an entity under parent (which has to be added already) that draws model, or a copy
+	// of mesh where model would be drawn if there is one, or nothing; returns its number
+	static int Add(int parent, Model_3DS *model = 0, Model_3DS *mesh = 0);
+	static void SetPosition(int entity, float x, float y, float z);
+	static void SetRotation(int entity, float x, float y, float z);	// In degrees
+	static void SetScale(int entity, float x, float y, float z);
+
+	static void Update();							// Makes the world matrices that are out of date again
+	static const float *World(int entity);			// The entity's world matrix as of the last Update()
+	static int Count();								// How many entities there are
+	static int Updated();							// How many world matrices the last Update() made again
+
+	static void Draw();								// Draws the models with the current modelview matrix as the camera
+	static void Draw(const float *view);			// The same with view as the camera
+	static void Draw(const float *view, int group);	// Only group and the entities under it, ROOT for all of them
+};
+
+#endif SCENE_H
@@ -0,0 +1,335 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Scene Shader Class
+//
+// SceneShader.cpp: implementation of the SceneShader class.
+// The lighting follows the fixed function formula for one light
+// with a local viewer off and a single color: the ambient of the
+// scene and the light, diffuse, and specular only on the side
+// facing the light, clamped per vertex. A normal of length 0 is
+// left at 0 (normalize() of it is undefined), which gets the
+// ambient only, as it does with GL_NORMALIZE. Textures multiply
+// the lit color like GL_MODULATE.
+//
+// The LightClusters' lights are added on top per pixel, diffuse
+// only, each fading out to nothing at its radius so a light
+// never ends at the edge of a cluster.
+//
+// The frame block is bound at 0 and the materials at 1; the
+// material ranges start on the card's uniform buffer alignment.
+// The matrices are a buffer texture of four floats a texel, a
+// matrix every four, on unit 1. The clusters are at the units
+// and binding LightClusters gives.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "SceneShader.h"
+#include "LightClusters.h"
+#include "glew.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define FRAME_BINDING		0
+#define MATERIAL_BINDING	1
+#define MATRIX_UNIT			1
+
+static const char *vertexSource =
+	"#version 330\n"
+	"layout(location = 0) in vec3 position;\n"
+	"layout(location = 1) in vec3 normal;\n"
+	"layout(location = 2) in vec2 texCoord;\n"
+	"layout(location = 3) in vec4 color;\n"
+	"layout(std140) uniform Frame\n"
+	"{\n"
+	"	mat4 projection;\n"
+	"	vec4 lightPosition;\n"
+	"	vec4 lightAmbient;\n"
+	"	vec4 lightDiffuse;\n"
+	"	vec4 lightSpecular;\n"
+	"	vec4 specular;\n"
+	"};\n"
+	"layout(std140) uniform Material\n"
+	"{\n"
+	"	vec4 materialColor;\n"
+	"	int textured;\n"
+	"	int vertexColors;\n"
+	"	int lit;\n"
+	"};\n"
+	"uniform samplerBuffer matrices;\n"
+	"uniform int firstMatrix;\n"
+	"out vec4 litColor;\n"
+	"out vec4 surfaceColor;\n"
+	"out vec3 eyePosition;\n"
+	"out vec3 eyeNormal;\n"
+	"out vec2 uv;\n"
+	"void main()\n"
+	"{\n"
+	"	int i = (firstMatrix + gl_InstanceID) * 4;\n"
+	"	mat4 modelview = mat4(texelFetch(matrices, i), texelFetch(matrices, i + 1), texelFetch(matrices, i + 2), texelFetch(matrices, i + 3));\n"
+	"	vec4 eye = modelview * vec4(position, 1.0);\n"
+	"	gl_Position = projection * eye;\n"
+	"	uv = texCoord;\n"
+	"	vec4 c = (textured != 0) ? vec4(1.0) : (vertexColors != 0) ? color : materialColor;\n"
+	"	vec3 n = mat3(modelview) * normal;\n"
+	"	surfaceColor = c;\n"
+	"	eyePosition = eye.xyz;\n"
+	"	eyeNormal = n;\n"
+	"	if (lit == 0)\n"
+	"	{\n"
+	"		litColor = c;\n"
+	"		return;\n"
+	"	}\n"
+	"	if (dot(n, n) > 0.0)\n"
+	"		n = normalize(n);\n"
+	"	vec3 l = normalize(lightPosition.xyz - eye.xyz * lightPosition.w);\n"
+	"	float diffuse = max(dot(n, l), 0.0);\n"
+	"	vec3 result = c.rgb * lightAmbient.rgb + c.rgb * lightDiffuse.rgb * diffuse;\n"
+	"	if (diffuse > 0.0)\n"
+	"	{\n"
+	"		vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+	"		result += specular.rgb * lightSpecular.rgb * pow(max(dot(n, h), 0.0), specular.w);\n"
+	"	}\n"
+	"	litColor = vec4(clamp(result, 0.0, 1.0), c.a);\n"
+	"}\n";
+
+static const char *fragmentSource =
+	"#version 330\n"
+	"layout(std140) uniform Frame\n"
+	"{\n"
+	"	mat4 projection;\n"
+	"	vec4 lightPosition;\n"
+	"	vec4 lightAmbient;\n"
+	"	vec4 lightDiffuse;\n"
+	"	vec4 lightSpecular;\n"
+	"	vec4 specular;\n"
+	"};\n"
+	"layout(std140) uniform Material\n"
+	"{\n"
+	"	vec4 materialColor;\n"
+	"	int textured;\n"
+	"	int vertexColors;\n"
+	"	int lit;\n"
+	"};\n"
+	"layout(std140) uniform Clusters\n"
+	"{\n"
+	"	vec4 clusterScale;\n"
+	"	ivec4 clusterCount;\n"
+	"};\n"
+	"uniform sampler2D texture0;\n"
+	"uniform usamplerBuffer clusterGrid;\n"
+	"uniform usamplerBuffer clusterList;\n"
+	"uniform samplerBuffer clusterLights;\n"
+	"in vec4 litColor;\n"
+	"in vec4 surfaceColor;\n"
+	"in vec3 eyePosition;\n"
+	"in vec3 eyeNormal;\n"
+	"in vec2 uv;\n"
+	"out vec4 fragColor;\n"
+	"vec3 clusterLight()\n"
+	"{\n"
+	"	ivec3 cell = ivec3(vec3(gl_FragCoord.xy * clusterScale.xy, (log(max(-eyePosition.z, 1.0)) - clusterScale.w) * clusterScale.z));\n"
+	"	cell = clamp(cell, ivec3(0), clusterCount.xyz - 1);\n"
+	"	uvec2 range = texelFetch(clusterGrid, (cell.z * clusterCount.y + cell.y) * clusterCount.x + cell.x).xy;\n"
+	"	vec3 n = eyeNormal;\n"
+	"	if (dot(n, n) > 0.0)\n"
+	"		n = normalize(n);\n"
+	"	vec3 sum = vec3(0.0);\n"
+	"	for (uint k = 0u; k < range.y; k++)\n"
+	"	{\n"
+	"		int i = int(texelFetch(clusterList, int(range.x + k)).r) * 3;\n"
+	"		vec4 position = texelFetch(clusterLights, i);\n"
+	"		vec4 color = texelFetch(clusterLights, i + 1);\n"
+	"		vec4 spot = texelFetch(clusterLights, i + 2);\n"
+	"		vec3 d = position.xyz - eyePosition;\n"
+	"		float distance2 = dot(d, d);\n"
+	"		float falloff = clamp(1.0 - distance2 / (position.w * position.w), 0.0, 1.0);\n"
+	"		vec3 l = d * inversesqrt(max(distance2, 1e-6));\n"
+	"		float cone = smoothstep(color.w, spot.w, dot(-l, spot.xyz));\n"
+	"		sum += color.rgb * (max(dot(n, l), 0.0) * falloff * falloff * cone);\n"
+	"	}\n"
+	"	return sum;\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 c = litColor;\n"
+	"	if (lit != 0 && clusterCount.w > 0)\n"
+	"		c.rgb = min(c.rgb + surfaceColor.rgb * clusterLight(), 1.0);\n"
+	"	fragColor = (textured != 0) ? c * texture(texture0, uv) : c;\n"
+	"}\n";
+
+// 0 until the first Supported(), then the program or 0 if it failed
+static GLuint program = 0;
+static GLint firstMatrixLocation = -1;
+static bool tried = false;
+
+static GLuint frameBuffer = 0;
+static GLuint materialBuffer = 0;
+static GLuint matrixBuffer = 0;
+static GLuint matrixTexture = 0;
+static int materialStride = 0;						// Bytes from one material to the next
+static std::vector<unsigned char> materialData;		// The materials spread out to the stride
+
+// Compiles one stage, 0 if it didn't
+static GLuint Compile(GLenum type, const char *source, const char *name)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint ok = GL_FALSE;
+	char log[1024];
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+
+	if (!ok)
+	{
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("Scene %s shader didn't compile:\n%s\n", name, log);
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+bool SceneShader::Supported()
+{
+	if (tried)
+		return program != 0;
+
+	tried = true;
+
+	// GLSL 3.30 with its uniform blocks and buffer textures
+	if (!GLEW_VERSION_3_3)
+		return false;
+
+	GLuint vertex = Compile(GL_VERTEX_SHADER, vertexSource, "vertex");
+	GLuint fragment = Compile(GL_FRAGMENT_SHADER, fragmentSource, "fragment");
+
+	if (vertex == 0 || fragment == 0)
+	{
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		return false;
+	}
+
+	program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glLinkProgram(program);
+
+	// The program keeps them for as long as it needs them
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+
+	GLint ok = GL_FALSE;
+	char log[1024];
+
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+
+	if (!ok)
+	{
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("Scene shader didn't link:\n%s\n", log);
+		glDeleteProgram(program);
+		program = 0;
+		return false;
+	}
+
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Frame"), FRAME_BINDING);
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Material"), MATERIAL_BINDING);
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Clusters"), LightClusters::binding);
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "texture0"), 0);
+	glUniform1i(glGetUniformLocation(program, "matrices"), MATRIX_UNIT);
+	glUniform1i(glGetUniformLocation(program, "clusterGrid"), LightClusters::gridUnit);
+	glUniform1i(glGetUniformLocation(program, "clusterList"), LightClusters::listUnit);
+	glUniform1i(glGetUniformLocation(program, "clusterLights"), LightClusters::lightUnit);
+	firstMatrixLocation = glGetUniformLocation(program, "firstMatrix");
+	glUseProgram(0);
+
+	// A material range has to start on the alignment
+	GLint alignment = 256;
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	materialStride = ((int)sizeof(Material) + alignment - 1) / alignment * alignment;
+
+	glGenBuffers(1, &frameBuffer);
+	glGenBuffers(1, &materialBuffer);
+	glGenBuffers(1, &matrixBuffer);
+	glGenTextures(1, &matrixTexture);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Frame), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// The texture reads whatever the buffer holds at the time
+	glBindBuffer(GL_TEXTURE_BUFFER, matrixBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, 16 * sizeof(float), NULL, GL_STREAM_DRAW);
+	glBindTexture(GL_TEXTURE_BUFFER, matrixTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, matrixBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	return true;
+}
+
+void SceneShader::SetFrame(const Frame &frame)
+{
+	if (!Supported())
+		return;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Frame), &frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void SceneShader::SetMatrices(const float *matrices, int count)
+{
+	// A new store each time, the card may still be reading the last one
+	glBindBuffer(GL_TEXTURE_BUFFER, matrixBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, count * 16 * sizeof(float), matrices, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void SceneShader::SetMaterials(const Material *materials, int count)
+{
+	materialData.assign(count * materialStride, 0);
+
+	for (int i = 0; i < count; i++)
+		memcpy(&materialData[i * materialStride], &materials[i], sizeof(Material));
+
+	glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, materialData.size(), &materialData[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void SceneShader::Begin()
+{
+	glUseProgram(program);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, frameBuffer);
+
+	glActiveTexture(GL_TEXTURE0 + MATRIX_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, matrixTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	LightClusters::Bind();
+}
+
+void SceneShader::UseMaterial(int material)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BINDING, materialBuffer, material * materialStride, sizeof(Material));
+}
+
+void SceneShader::UseMatrices(int first)
+{
+	glUniform1i(firstMatrixLocation, first);
+}
+
+void SceneShader::End()
+{
+	glUseProgram(0);
+}
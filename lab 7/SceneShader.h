@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Scene Shader Class
+//
+// SceneShader.h: interface for the SceneShader class.
+// The models used to be lit and moved by the fixed function
+// pipeline: glLight and glMaterial calls spread over the game,
+// some of them made again every frame with other values, and
+// one glLoadMatrixf per draw. With this shader (GLSL 3.30, no
+// built in state) everything a draw needs comes from buffers
+// filled on the CPU:
+//
+// - The frame block: the projection, the light in eye space
+//   and the specular every material shares, sent once a frame
+//   with SetFrame().
+// - The material blocks: the color of a material, whether it
+//   is textured or colored on its vertices and whether its
+//   model is lit, all of a frame's in one uniform buffer, one
+//   range bound per material.
+// - The matrices: every modelview matrix the frame draws with,
+//   the copies' included, in one buffer read as a texture. A
+//   draw only says where its first one is, each instance takes
+//   the next.
+//
+// The lighting is the fixed function formula for one light,
+// worked out per vertex, so the models look the way they did.
+// The LightClusters' point and spot lights are added per pixel.
+// Normals are only right for uniform scales.
+//
+// The vertices come in the generic attributes below, the
+// texture is on unit 0 like before.
+//
+// Needs OpenGL 3.3, Supported() is false without it and the
+// RenderQueue draws with the fixed function pipeline then.
+//
+// Usage:
+// SceneShader::Frame frame;
+// // The projection, the light ...
+// SceneShader::SetFrame(frame);
+//
+// if (SceneShader::Supported())
+// {
+//		SceneShader::SetMatrices(matrices, count);
+//		SceneShader::SetMaterials(materials, count);
+//		SceneShader::Begin();
+//		SceneShader::UseMaterial(material);
+//		SceneShader::UseMatrices(first);
+//		glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, 0, instances);
+//		SceneShader::End();
+// }
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef SCENESHADER_H
+#define SCENESHADER_H
+
+class SceneShader
+{
+public:
+	// The frame block, laid out the way std140 lays it out
+	struct Frame
+	{
+		float projection[16];
+		float lightPosition[4];						// In eye space, w 0 for a direction
+		float lightAmbient[4];						// The light's ambient and the scene's together
+		float lightDiffuse[4];
+		float lightSpecular[4];
+		float specular[4];							// The materials' specular color, the shininess in the last
+	};
+
+	// A material block
+	struct Material
+	{
+		float color[4];								// Ambient and diffuse, when neither of the next two are set
+		int textured;								// White, times the texture on unit 0
+		int vertexColors;							// The colors of the vertices
+		int lit;									// 0 draws the plain colors, for the models that aren't lit
+		int unused;
+	};
+
+	static const int position = 0;					// The generic attributes the vertices come in
+	static const int normal = 1;
+	static const int texCoord = 2;
+	static const int color = 3;
+
+	static bool Supported();						// Compiles the shader the first time, false if the card can't run it
+	static void SetFrame(const Frame &frame);		// Sends the frame block
+	static void SetMatrices(const float *matrices, int count);		// Sends the frame's matrices, 16 floats each
+	static void SetMaterials(const Material *materials, int count);	// Sends the frame's materials
+
+	static void Begin();							// Draws with the shader
+	static void UseMaterial(int material);			// Which of the materials the next draws use
+	static void UseMatrices(int first);				// Which matrix the first instance of the next draws uses
+	static void End();								// Back to the fixed function pipeline
+};
+
+#endif SCENESHADER_H
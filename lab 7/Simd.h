@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////
+//
+// SIMD helpers
+//
+// Simd.h: the SSE intrinsics and CPU checks shared by the
+// image and geometry code. SSE2 is always there on the x86
+// and x64 compilers we build with, SSSE3 (pshufb) has to be
+// checked for at run time. Everything has a plain C++ path
+// so the code still builds for other CPUs.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#include <tmmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC lets us use any intrinsic in any function
+#define SIMD_TARGET_SSSE3
+#else
+#include <cpuid.h>
+// GCC and clang need to be told a function may use SSSE3
+#define SIMD_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+// True if the CPU can run SSSE3 instructions
+inline bool SimdHasSSSE3()
+{
+	static int has = -1;
+
+	if (has < 0)
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		has = (info[2] >> 9) & 1;
+#else
+		unsigned int a, b, c, d;
+		has = __get_cpuid(1, &a, &b, &c, &d) ? (c >> 9) & 1 : 0;
+#endif
+	}
+
+	return has != 0;
+}
+#else
+inline bool SimdHasSSSE3() { return false; }
+#endif
+
+#endif SIMD_H
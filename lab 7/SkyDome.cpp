@@ -0,0 +1,169 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Sky Dome Class
+//
+// SkyDome.cpp: implementation of the SkyDome class.
+// The vertices go round the z axis and down from +z the way
+// gluSphere's do, with the same texture coordinates, so the
+// sky texture lands where it always did. The sphere has radius
+// 1 until it is drawn, which makes every position its own
+// normal: the normals are read from the positions.
+//
+// The far plane is reached with glDepthRange(1, 1), every
+// pixel of the dome gets the depth the buffer is cleared to,
+// and GL_LEQUAL lets it in only where nothing was drawn.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "SkyDome.h"
+#include "glew.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+
+struct SkyVertex
+{
+	float x, y, z;									// The position, and the normal
+	float s, t;										// The texture coordinates
+};
+
+static std::vector<SkyVertex> vertices;				// Kept for drawing without buffer objects
+static std::vector<unsigned short> indices;
+static GLuint buffers[2] = { 0, 0 };				// The vertices, then the indices
+static GLuint skyTexture = 0;
+static float skyRadius = 1.0f;
+
+void SkyDome::Create(unsigned int texture, float radius, int slices, int stacks)
+{
+	Destroy();
+
+	// The indices are shorts
+	if ((slices + 1) * (stacks + 1) > 65536)
+		slices = 65536 / (stacks + 1) - 1;
+
+	skyTexture = texture;
+	skyRadius = radius;
+
+	for (int j = 0; j <= stacks; j++)
+	{
+		float b = 3.14159265f * j / stacks;
+
+		for (int i = 0; i <= slices; i++)
+		{
+			float a = 2.0f * 3.14159265f * i / slices;
+			SkyVertex v;
+
+			v.x = (float)(sin(b) * sin(a));
+			v.y = (float)(sin(b) * cos(a));
+			v.z = (float)cos(b);
+			v.s = 1.0f - (float)i / slices;
+			v.t = 1.0f - (float)j / stacks;
+			vertices.push_back(v);
+		}
+	}
+
+	// Two triangles a quad, facing out like gluSphere's
+	for (int j = 0; j < stacks; j++)
+	{
+		for (int i = 0; i < slices; i++)
+		{
+			unsigned short top = (unsigned short)(j * (slices + 1) + i);
+			unsigned short bottom = (unsigned short)(top + slices + 1);
+
+			indices.push_back(bottom);
+			indices.push_back(top);
+			indices.push_back(top + 1);
+			indices.push_back(bottom);
+			indices.push_back(top + 1);
+			indices.push_back(bottom + 1);
+		}
+	}
+
+	// Buffer objects are core since 1.5
+	if (!GLEW_VERSION_1_5)
+		return;
+
+	glGenBuffers(2, buffers);
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SkyVertex), &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void SkyDome::Draw()
+{
+	if (indices.empty())
+		return;
+
+	float m[16];
+
+	// The camera's turn without its position
+	glGetFloatv(GL_MODELVIEW_MATRIX, m);
+	m[12] = m[13] = m[14] = 0.0f;
+
+	glPushMatrix();
+	glLoadMatrixf(m);
+	glRotated(90, 1, 0, 1);
+	glScalef(skyRadius, skyRadius, skyRadius);
+
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, skyTexture);
+
+	// At the far plane, behind everything, without writing a depth of its own
+	glDepthRange(1.0, 1.0);
+	glDepthFunc(GL_LEQUAL);
+	glDepthMask(GL_FALSE);
+
+	// With the buffers bound the pointers are offsets into them
+	const char *base = (const char *)&vertices[0];
+	const unsigned short *elements = &indices[0];
+
+	if (buffers[0] != 0)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+		base = NULL;
+		elements = NULL;
+	}
+
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_VERTEX_ARRAY);
+
+	glTexCoordPointer(2, GL_FLOAT, sizeof(SkyVertex), base + offsetof(SkyVertex, s));
+	glNormalPointer(GL_FLOAT, sizeof(SkyVertex), base + offsetof(SkyVertex, x));
+	glVertexPointer(3, GL_FLOAT, sizeof(SkyVertex), base + offsetof(SkyVertex, x));
+
+	glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_SHORT, elements);
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	if (buffers[0] != 0)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	glDepthRange(0.0, 1.0);
+
+	glPopMatrix();
+}
+
+void SkyDome::Destroy()
+{
+	if (buffers[0] != 0)
+		glDeleteBuffers(2, buffers);
+
+	buffers[0] = buffers[1] = 0;
+	vertices.clear();
+	indices.clear();
+}
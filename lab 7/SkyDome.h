@@ -0,0 +1,41 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Sky Dome Class
+//
+// SkyDome.h: interface for the SkyDome class.
+// The sky used to be a gluSphere of 100x100 quads made again in
+// immediate mode every frame, and drawn last without anything
+// in front of it being able to stop it. The dome is now made
+// once, as the same sphere gluSphere would make (texture
+// coordinates and all) in a buffer object, and drawn with one
+// call.
+//
+// Draw() keeps the camera at the middle of the dome, so it is
+// always around it however far it walks, and pushes every
+// pixel of it to the far plane. It goes after the opaque
+// models: the depth test then throws away every pixel
+// something was already drawn on before it is textured, and
+// nothing can poke through the sky.
+//
+// Usage:
+// SkyDome::Create(tex, 3000, 64, 32);
+//
+// // After the opaque models
+// SkyDome::Draw();
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef SKYDOME_H
+#define SKYDOME_H
+
+class SkyDome
+{
+public:
+	// Makes the sphere of radius (which has to be between the near and far planes), slices
+	// around and stacks from top to bottom, drawn with texture
+	static void Create(unsigned int texture, float radius, int slices, int stacks);
+	static void Draw();								// Draws the sky around the current camera
+	static void Destroy();							// Deletes the buffers
+};
+
+#endif SKYDOME_H
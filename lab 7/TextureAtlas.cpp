@@ -0,0 +1,309 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Atlas
+//
+// TextureAtlas.cpp: implementation of the TextureAtlas class.
+// The pages are filled shelf by shelf: a texture goes on the
+// lowest shelf it fits on (wasting the least height), or on a
+// new shelf above the others, or on a new page. The pages are
+// kept in TextureCache like any other texture, with one
+// reference held by the atlas itself so a page never goes away
+// while there are textures in it.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "TextureAtlas.h"
+#include "TextureCache.h"
+#include "MipmapGenerator.h"
+#include "GLTexture.h"
+#include "Image.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+
+#ifndef _WIN32
+#define _strdup strdup
+#endif
+
+#define ATLAS_SIZE		1024	// Width and height of a page
+#define ATLAS_LEVELS	5		// Mipmap levels of a page
+#define ATLAS_ALIGN		16		// 1 << (ATLAS_LEVELS - 1), so no level has a texel shared by two textures
+#define ATLAS_GUTTER	16		// Edge copies around a texture, one texel of the last level
+
+// A row of textures of about the same height
+struct AtlasShelf
+{
+	int y;					// Bottom row
+	int height;				// Height of the tallest texture it can take
+	int x;					// First free column
+};
+
+// A texture that textures are packed into
+struct AtlasPage
+{
+	GLTexture tex;						// The OpenGL texture
+	std::string key;					// Its key in TextureCache
+	std::vector<AtlasShelf> shelves;	// Bottom to top
+	int top;							// First row above the shelves
+	int used;							// Texels given to textures
+};
+
+// A file that was packed
+struct AtlasEntry
+{
+	int page;				// Index of its page
+	int x;					// Corner of its block, gutter included
+	int y;
+	int width;				// Size of the texture itself
+	int height;
+	TextureAtlas::Rect rect;	// What the materials get
+};
+
+bool TextureAtlas::enabled = true;
+int TextureAtlas::maxSize = 512;
+
+static std::vector<AtlasPage *> pages;
+static std::map<std::string, AtlasEntry> entries;
+
+// Makes an empty page, its levels are filled in as textures arrive
+static AtlasPage *NewPage()
+{
+	AtlasPage *page = new AtlasPage;
+
+	char key[16];
+	sprintf(key, "#atlas%d", (int)pages.size());
+
+	page->key = key;
+	page->top = 0;
+	page->used = 0;
+
+	glGenTextures(1, &page->tex.texture[0]);
+	glBindTexture(GL_TEXTURE_2D, page->tex.texture[0]);
+
+	// The same filters GLTexture uses
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	page->tex.bytes = 0;
+
+	for (int level = 0; level < ATLAS_LEVELS; level++)
+	{
+		int size = ATLAS_SIZE >> level;
+
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		page->tex.bytes += size * size * 4;
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ATLAS_LEVELS - 1);
+
+	page->tex.width = ATLAS_SIZE;
+	page->tex.height = ATLAS_SIZE;
+
+	// This is the atlas's own reference, the materials add theirs
+	TextureCache::Add(page->key, &page->tex);
+
+	pages.push_back(page);
+	return page;
+}
+
+// Finds room for a block of width x height texels (both multiples of ATLAS_ALIGN)
+static bool Place(int width, int height, AtlasEntry &entry)
+{
+	if (width > ATLAS_SIZE || height > ATLAS_SIZE)
+		return false;
+
+	for (size_t i = 0; i <= pages.size(); i++)
+	{
+		AtlasPage *page = (i < pages.size()) ? pages[i] : NewPage();
+		AtlasShelf *best = NULL;
+
+		// The shelf that wastes the least height
+		for (size_t j = 0; j < page->shelves.size(); j++)
+		{
+			AtlasShelf &shelf = page->shelves[j];
+
+			if (height <= shelf.height && shelf.x + width <= ATLAS_SIZE)
+			{
+				if (best == NULL || shelf.height < best->height)
+					best = &shelf;
+			}
+		}
+
+		// Or a new one on top
+		if (best == NULL && page->top + height <= ATLAS_SIZE)
+		{
+			AtlasShelf shelf;
+
+			shelf.y = page->top;
+			shelf.height = height;
+			shelf.x = 0;
+
+			page->shelves.push_back(shelf);
+			page->top += height;
+
+			best = &page->shelves.back();
+		}
+
+		if (best == NULL)
+			continue;
+
+		entry.page = (int)i;
+		entry.x = best->x;
+		entry.y = best->y;
+
+		best->x += width;
+		page->used += width * height;
+
+		return true;
+	}
+
+	return false;
+}
+
+// Surrounds a texture with copies of its edges, out to a multiple of ATLAS_ALIGN
+static void Pad(const Image &image, Image &block)
+{
+	int width = (image.width + 2 * ATLAS_GUTTER + ATLAS_ALIGN - 1) & ~(ATLAS_ALIGN - 1);
+	int height = (image.height + 2 * ATLAS_GUTTER + ATLAS_ALIGN - 1) & ~(ATLAS_ALIGN - 1);
+	int stride = (image.width * image.channels + image.alignment - 1) & ~(image.alignment - 1);
+
+	block.Create(width, height, 4);
+
+	for (int y = 0; y < height; y++)
+	{
+		int sy = y - ATLAS_GUTTER;
+		sy = (sy < 0) ? 0 : (sy >= image.height ? image.height - 1 : sy);
+
+		const unsigned char *src = image.data + (long)sy * stride;
+		unsigned char *dst = block.data + (long)y * width * 4;
+
+		for (int x = 0; x < width; x++)
+		{
+			int sx = x - ATLAS_GUTTER;
+			sx = (sx < 0) ? 0 : (sx >= image.width ? image.width - 1 : sx);
+
+			const unsigned char *p = src + sx * image.channels;
+
+			dst[4 * x] = p[0];
+			dst[4 * x + 1] = p[1];
+			dst[4 * x + 2] = p[2];
+			dst[4 * x + 3] = (image.channels == 4) ? p[3] : 255;
+		}
+	}
+}
+
+// Makes the mipmaps of a block and copies them into its spot
+static void Upload(const AtlasEntry &entry, Image &block)
+{
+	KTXFile mipmaps;
+
+	if (!MipmapGenerator::Generate(block, mipmaps, 4))
+		return;
+
+	glBindTexture(GL_TEXTURE_2D, pages[entry.page]->tex.texture[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	for (int level = 0; level < ATLAS_LEVELS && level < mipmaps.levels; level++)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, level, entry.x >> level, entry.y >> level,
+			mipmaps.LevelWidth(level), mipmaps.LevelHeight(level), GL_RGBA, GL_UNSIGNED_BYTE, mipmaps.data[level]);
+	}
+}
+
+// Gives tex a reference to the page of an entry
+static void Share(const AtlasEntry &entry, GLTexture *tex, TextureAtlas::Rect &rect)
+{
+	TextureCache::Acquire(pages[entry.page]->key, tex);
+	rect = entry.rect;
+}
+
+bool TextureAtlas::Add(const char *name, GLTexture *tex, Rect &rect)
+{
+	if (!enabled)
+		return false;
+
+	std::string key = TextureCache::Normalize(name);
+	std::map<std::string, AtlasEntry>::iterator it = entries.find(key);
+
+	if (it == entries.end())
+	{
+		std::string path = Image::FindFile(name);
+		int width, height;
+
+		// Only look at the pixels of files small enough to be packed
+		if (path.empty() || !Image::ReadSize(path.c_str(), width, height) || width > maxSize || height > maxSize)
+			return false;
+
+		Image image;
+
+		if (!image.Load(path.c_str()))
+			return false;
+
+		Image block;
+		AtlasEntry entry;
+
+		Pad(image, block);
+
+		if (!Place(block.width, block.height, entry))
+			return false;
+
+		entry.width = image.width;
+		entry.height = image.height;
+		entry.rect.u = (float)(entry.x + ATLAS_GUTTER) / ATLAS_SIZE;
+		entry.rect.v = (float)(entry.y + ATLAS_GUTTER) / ATLAS_SIZE;
+		entry.rect.width = (float)image.width / ATLAS_SIZE;
+		entry.rect.height = (float)image.height / ATLAS_SIZE;
+
+		Upload(entry, block);
+
+		it = entries.insert(std::make_pair(key, entry)).first;
+	}
+
+	Share(it->second, tex, rect);
+
+	// Keep the name so the file can be reloaded when it changes
+	free(tex->texturename);
+	tex->texturename = _strdup(name);
+
+	return true;
+}
+
+bool TextureAtlas::Reload(const char *name)
+{
+	std::map<std::string, AtlasEntry>::iterator it = entries.find(TextureCache::Normalize(name));
+
+	if (it == entries.end())
+		return false;
+
+	AtlasEntry &entry = it->second;
+	Image image;
+
+	// Keep what we have if the file is still being written
+	if (!image.Load(name))
+		return true;
+
+	// The texcoords were moved for the old size, so only the same size fits
+	if (image.width != entry.width || image.height != entry.height)
+	{
+		printf("%s changed size (%dx%d to %dx%d), restart to see it\n", name, entry.width, entry.height, image.width, image.height);
+		return true;
+	}
+
+	Image block;
+
+	Pad(image, block);
+	Upload(entry, block);
+
+	return true;
+}
+
+void TextureAtlas::PrintStats()
+{
+	printf("Texture atlas: %d textures in %d page(s) of %dx%d\n", (int)entries.size(), (int)pages.size(), ATLAS_SIZE, ATLAS_SIZE);
+
+	for (size_t i = 0; i < pages.size(); i++)
+		printf("  %-40s %5.1f%% used\n", pages[i]->key.c_str(), 100.0 * pages[i]->used / (ATLAS_SIZE * ATLAS_SIZE));
+}
@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Atlas
+//
+// TextureAtlas.h: interface for the TextureAtlas class.
+// Many materials use a tiny texture: the coin, the door.
+// Drawing a model bound each of them in turn, one
+// glBindTexture per material. The
+// atlas packs those textures side by side into big shared
+// pages so the materials end up on the same texture, and
+// Model_3DS moves their texcoords onto their spot in the page.
+// The faces of materials that share a page can then be drawn
+// with a single call.
+//
+// Every texture is surrounded by copies of its edge texels
+// and starts on a multiple of 16 texels, so the first five
+// mipmap levels never mix two textures. Each texture gets its
+// own mipmaps before it is copied in. Textures that repeat
+// across the faces (texcoords outside one 0..1 tile) can't be
+// packed, the page doesn't repeat them.
+//
+// Usage:
+// GLTexture tex;
+// TextureAtlas::Rect rect;
+//
+// if (TextureAtlas::Add("models/coin/coin.jpg", &tex, rect))
+// {
+//		// Texcoord (s, t) becomes
+//		// (rect.u + s * rect.width, rect.v + t * rect.height)
+// }
+//
+// tex.Release();							// Same as for any other texture
+//
+// TextureAtlas::PrintStats();				// How full the pages are
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+class GLTexture;
+
+class TextureAtlas
+{
+public:
+	// Where a texture went in its page, in texcoords of the page
+	struct Rect
+	{
+		float u;									// Left edge
+		float v;									// Bottom edge
+		float width;								// Size
+		float height;
+	};
+
+	static bool enabled;							// Pack textures, false gives every material its own
+	static int maxSize;								// Files up to this size on both sides are packed
+
+	// Packs a file (or finds it packed already) and shares its page with tex, false if it is too big
+	static bool Add(const char *name, GLTexture *tex, Rect &rect);
+	// Decodes a packed file again into its spot, false if the file isn't in an atlas
+	static bool Reload(const char *name);
+	// Prints the pages and how full they are
+	static void PrintStats();
+};
+
+#endif TEXTUREATLAS_H
@@ -1,61 +1,86 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string>
 #include "glew.h"
-#include "glaux.h"
+#include "Image.h"
+#include "GLTexture.h"
+#include "MipmapGenerator.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #pragma comment(lib, "glew32.lib")
-#pragma comment(lib, "glaux.lib")
 
-void loadPPM(GLuint *textureID, char *strFileName, int width, int height, int wrap) {
-	BYTE *data;
-	FILE *pFile;
-
-	fopen_s(&pFile, strFileName, "r");
-	if (pFile) {
-		data = (BYTE*)malloc(width * height * 3);
-		fread(data, 1, width * height * 3, pFile);
-		fclose(pFile);
-	} else {
-		MessageBoxA(NULL, "Texture file not found!", "Error!", MB_OK);
-		exit(EXIT_FAILURE);
-	}
+static void textureNotFound(const char *strFileName) {
+#ifdef _WIN32
+	MessageBoxA(NULL, "Texture file not found!", "Error!", MB_OK);
+#else
+	fprintf(stderr, "Texture file not found: %s\n", strFileName);
+#endif
+	exit(EXIT_FAILURE);
+}
+
+// Loads a KTX file as it is, or any other image through the mipmaps saved
+// for it (made the first time). Either way the levels go to OpenGL straight
+// out of the mapped file. False if the file can't be found or read.
+static bool loadMapped(GLuint *textureID, const char *strFileName) {
+	std::string path = Image::FindFile(strFileName);
+	KTXFile mipmaps;
+
+	if (path.empty())
+		return false;
+
+	if (!mipmaps.Load(path.c_str()) && !GLTexture::Decode(path.c_str(), mipmaps))
+		return false;
 
 	glGenTextures(1, textureID);
 	glBindTexture(GL_TEXTURE_2D, *textureID);
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	mipmaps.Upload();
+
+	return true;
+}
+
+void loadPPM(GLuint *textureID, char *strFileName, int width, int height, int wrap) {
+	// A PPM with its header (or a KTX file) knows its size, anything else is raw RGB of the size given
+	if (!loadMapped(textureID, strFileName)) {
+		Image pixels;
+		KTXFile mipmaps;
+		FILE *pFile = fopen(strFileName, "rb");
+		size_t bytes = (size_t)width * height * 3;
+
+		// A short file would leave part of the texture uninitialized
+		bool read = pFile && pixels.Create(width, height, 3) && fread(pixels.data, 1, bytes, pFile) == bytes;
+
+		if (pFile)
+			fclose(pFile);
+
+		if (!read)
+			textureNotFound(strFileName);
+
+		MipmapGenerator::Generate(pixels, mipmaps, 3, !GLTexture::NonPowerOfTwoSupported());
+
+		glGenTextures(1, textureID);
+		glBindTexture(GL_TEXTURE_2D, *textureID);
+		mipmaps.Upload();
+	}
+
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap ? GL_REPEAT : GL_CLAMP);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap ? GL_REPEAT : GL_CLAMP);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-
-	free(data);
 }
 
 void loadBMP(GLuint *textureID, char *strFileName, int wrap) {
-	AUX_RGBImageRec *pBitmap = NULL;
-	FILE *pFile = NULL;
-
-	fopen_s(&pFile, strFileName, "r");
-	if (pFile) {
-		pBitmap = auxDIBImageLoadA(strFileName);
-	}
-	else {
-		MessageBoxA(NULL, "Texture file not found!", "Error!", MB_OK);
-		exit(EXIT_FAILURE);
+	// The mipmaps are made and saved the first time, later runs just map them
+	if (!loadMapped(textureID, strFileName)) {
+		textureNotFound(strFileName);
 	}
 
-	glGenTextures(1, textureID);
-	glBindTexture(GL_TEXTURE_2D, *textureID);
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, pBitmap->sizeX, pBitmap->sizeY, GL_RGB, GL_UNSIGNED_BYTE, pBitmap->data);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap ? GL_REPEAT : GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap ? GL_REPEAT : GL_CLAMP);
-
-	if (pBitmap) {
-		if (pBitmap->data) {
-			free(pBitmap->data);
-		}
-		free(pBitmap);
-	}
 }
\ No newline at end of file
@@ -0,0 +1,208 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Cache
+//
+// TextureCache.cpp: implementation of the TextureCache class.
+// Every material of every model loads its own texture, so
+// seven apples would decode and upload the same image seven
+// times. The cache keeps one OpenGL texture per image file,
+// keyed by the normalized path of the file, and counts how
+// many GLTextures share it. The texture is only deleted when
+// the last one releases it.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "TextureCache.h"
+#include "GLTexture.h"
+#include "TextureStreamer.h"
+#include "TextureResidency.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// One image file in the cache
+struct CacheEntry
+{
+	unsigned int texture;	// The shared OpenGL texture
+	int width;				// Size of the image
+	int height;
+	int bytes;				// Memory used by the texture and its mipmaps
+	int refs;				// Number of GLTextures sharing it
+	std::vector<GLTexture *> users;	// And which they are, to tell them when the size changes
+	int hits;				// Number of loads that found it in the cache
+};
+
+// The cache itself, by key and by OpenGL texture
+static std::map<std::string, CacheEntry> entries;
+static std::map<unsigned int, std::string> keys;
+
+// Statistics
+static int requests = 0;
+static int hits = 0;
+static double uploaded = 0.0;
+static double saved = 0.0;
+
+bool TextureCache::Acquire(const std::string &key, GLTexture *tex)
+{
+	requests++;
+
+	std::map<std::string, CacheEntry>::iterator it = entries.find(key);
+
+	if (it == entries.end())
+		return false;
+
+	// Share the texture instead of loading it again
+	CacheEntry &entry = it->second;
+
+	tex->texture[0] = entry.texture;
+	tex->width = entry.width;
+	tex->height = entry.height;
+	tex->bytes = entry.bytes;
+
+	entry.refs++;
+	entry.users.push_back(tex);
+	entry.hits++;
+
+	hits++;
+	saved += entry.bytes;
+
+	return true;
+}
+
+void TextureCache::Add(const std::string &key, GLTexture *tex)
+{
+	// Only textures that actually loaded go in the cache
+	if (tex->texture[0] == 0)
+		return;
+
+	CacheEntry entry;
+
+	entry.texture = tex->texture[0];
+	entry.width = tex->width;
+	entry.height = tex->height;
+	entry.bytes = tex->bytes;
+	entry.refs = 1;
+	entry.users.push_back(tex);
+	entry.hits = 0;
+
+	entries[key] = entry;
+	keys[entry.texture] = key;
+
+	uploaded += entry.bytes;
+}
+
+void TextureCache::Release(GLTexture *tex)
+{
+	unsigned int texture = tex->texture[0];
+	std::map<unsigned int, std::string>::iterator key = keys.find(texture);
+
+	// Not ours, so nobody else shares it
+	if (key == keys.end())
+	{
+		TextureStreamer::Cancel(texture);
+		TextureResidency::Forget(texture);
+		glDeleteTextures(1, &texture);
+		return;
+	}
+
+	CacheEntry &entry = entries[key->second];
+
+	entry.users.erase(std::remove(entry.users.begin(), entry.users.end(), tex), entry.users.end());
+
+	// Delete the texture with its last user
+	if (--entry.refs <= 0)
+	{
+		TextureStreamer::Cancel(texture);
+		TextureResidency::Forget(texture);
+		glDeleteTextures(1, &texture);
+		entries.erase(key->second);
+		keys.erase(key);
+	}
+}
+
+void TextureCache::Update(GLTexture *tex)
+{
+	std::map<unsigned int, std::string>::iterator key = keys.find(tex->texture[0]);
+
+	if (key == keys.end())
+		return;
+
+	CacheEntry &entry = entries[key->second];
+
+	// Streamed textures only know their size once they are in
+	uploaded += tex->bytes - entry.bytes;
+
+	entry.width = tex->width;
+	entry.height = tex->height;
+	entry.bytes = tex->bytes;
+
+	for (size_t i = 0; i < entry.users.size(); i++)
+	{
+		entry.users[i]->width = tex->width;
+		entry.users[i]->height = tex->height;
+		entry.users[i]->bytes = tex->bytes;
+	}
+}
+
+void TextureCache::PrintStats()
+{
+	double rate = requests > 0 ? 100.0 * hits / requests : 0.0;
+
+	printf("Texture cache: %d textures, %d loads, %d hits (%.1f%%)\n", (int)entries.size(), requests, hits, rate);
+	printf("  %.1f MB uploaded, %.1f MB of VRAM saved\n", uploaded / (1024.0 * 1024.0), saved / (1024.0 * 1024.0));
+
+	for (std::map<std::string, CacheEntry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		const CacheEntry &entry = it->second;
+		printf("  %-40s %4dx%-4d %7.1f KB %3d refs %3d hits\n", it->first.c_str(),
+			entry.width, entry.height, entry.bytes / 1024.0, entry.refs, entry.hits);
+	}
+}
+
+std::string TextureCache::Normalize(const char *name)
+{
+	std::vector<std::string> parts;
+	std::string part;
+
+	// Split the path into its folders, dropping "." and resolving ".."
+	for (const char *c = name; ; c++)
+	{
+		if (*c == '/' || *c == '\\' || *c == 0)
+		{
+			if (part == "..")
+			{
+				if (!parts.empty() && parts.back() != "..")
+					parts.pop_back();
+				else
+					parts.push_back(part);
+			}
+			else if (!part.empty() && part != ".")
+				parts.push_back(part);
+
+			part.clear();
+
+			if (*c == 0)
+				break;
+		}
+		else
+			// Windows doesn't care about case so neither do we
+			part += (char)tolower((unsigned char)*c);
+	}
+
+	std::string result;
+
+	if (name[0] == '/' || name[0] == '\\')
+		result = "/";
+
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		if (i > 0)
+			result += "/";
+		result += parts[i];
+	}
+
+	return result;
+}
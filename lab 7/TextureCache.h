@@ -0,0 +1,51 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Cache
+//
+// TextureCache.h: interface for the TextureCache class.
+// Every material of every model loads its own texture, so
+// seven apples would decode and upload the same image seven
+// times. The cache keeps one OpenGL texture per image file,
+// keyed by the normalized path of the file, and counts how
+// many GLTextures share it. The texture is only deleted when
+// the last one releases it. GLTexture uses the cache on its
+// own, you only need it for the statistics.
+//
+// Usage:
+// GLTexture a, b;
+//
+// a.Load("models/apple/apple.bmp");	// Decodes and uploads the image
+// b.Load("Models\\Apple\\apple.bmp");	// Same file, shares a's texture
+//
+// a.Release();							// b still has the texture
+// b.Release();							// Now it is deleted
+//
+// TextureCache::PrintStats();			// Hit rate and memory saved
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <string>
+
+class GLTexture;
+
+class TextureCache
+{
+public:
+	// Shares the cached texture with tex if the file was loaded before
+	static bool Acquire(const std::string &key, GLTexture *tex);
+	// Adds a freshly uploaded texture to the cache
+	static void Add(const std::string &key, GLTexture *tex);
+	// Drops tex's reference, deletes the texture when nobody uses it anymore
+	static void Release(GLTexture *tex);
+	// Gives every GLTexture sharing tex's texture its new size, after a reload, streaming or eviction
+	static void Update(GLTexture *tex);
+	// Prints the hit rate and the memory the cache saved
+	static void PrintStats();
+	// Lower case, forward slashes, no "." or ".." so equal files get equal keys
+	static std::string Normalize(const char *name);
+};
+
+#endif TEXTURECACHE_H
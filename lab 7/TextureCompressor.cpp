@@ -0,0 +1,544 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Compressor Class
+//
+// TextureCompressor.cpp: implementation of the TextureCompressor class.
+// This class turns images into BC1 (DXT1) or BC3 (DXT5)
+// textures with all of their mipmaps and keeps them in KTX
+// files next to the originals ("bark.png" -> "bark.png.ktx").
+// A compressed texture takes 1/6 (BC1) or 1/4 (BC3) of the
+// video memory and upload bandwidth of a plain RGB(A) one.
+// Opaque images become BC1, images with alpha become BC3.
+// The blocks are spread over all CPU cores and the search
+// for the best palette entry of each pixel uses SSE2.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "TextureCompressor.h"
+#include "MipmapGenerator.h"
+#include "Simd.h"
+#include "glew.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+bool TextureCompressor::onDemand = true;
+int TextureCompressor::threads = 0;
+
+// Level 0 of a 4096x4096 texture has 1024 rows of blocks, smaller levels
+// aren't worth starting threads for
+#define ROWS_PER_THREAD	16
+
+static int Min(int a, int b) { return a < b ? a : b; }
+static int Max(int a, int b) { return a > b ? a : b; }
+
+// True if any pixel of an RGBA image isn't opaque
+static bool HasAlpha(const unsigned char *rgba, int pixels)
+{
+	for (int i = 0; i < pixels; i++)
+	{
+		if (rgba[i * 4 + 3] != 255)
+			return true;
+	}
+
+	return false;
+}
+
+static unsigned short Pack565(const int *color)
+{
+	int r = (color[0] * 31 + 127) / 255;
+	int g = (color[1] * 63 + 127) / 255;
+	int b = (color[2] * 31 + 127) / 255;
+
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+// Expands a 565 color the way the hardware does
+static void Unpack565(unsigned short c, int *color)
+{
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// Picks the nearest of the 4 palette colors for all 16 pixels
+static unsigned int FindIndices(const unsigned char *pixels, int palette[4][3])
+{
+	unsigned int indices = 0;
+
+#ifdef SIMD_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+	__m128i colors[4];
+
+	for (int j = 0; j < 4; j++)
+		colors[j] = _mm_set1_epi32(palette[j][0] | (palette[j][1] << 8) | (palette[j][2] << 16));
+
+	// 4 pixels at a time
+	for (int i = 0; i < 4; i++)
+	{
+		__m128i px = _mm_and_si128(_mm_loadu_si128((const __m128i *)(pixels + i * 16)), rgbMask);
+		__m128i best = _mm_set1_epi32(0x7FFFFFFF);
+		__m128i index = zero;
+
+		for (int j = 0; j < 4; j++)
+		{
+			// |pixel - color| per channel, then the squares summed per pixel
+			__m128i diff = _mm_or_si128(_mm_subs_epu8(px, colors[j]), _mm_subs_epu8(colors[j], px));
+			__m128i lo = _mm_unpacklo_epi8(diff, zero);
+			__m128i hi = _mm_unpackhi_epi8(diff, zero);
+
+			lo = _mm_madd_epi16(lo, lo);
+			hi = _mm_madd_epi16(hi, hi);
+			lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+			hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+
+			__m128i dist = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+
+			// Keep the closer one
+			__m128i closer = _mm_cmplt_epi32(dist, best);
+			best = _mm_or_si128(_mm_and_si128(closer, dist), _mm_andnot_si128(closer, best));
+			index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(j)), _mm_andnot_si128(closer, index));
+		}
+
+		int found[4];
+		_mm_storeu_si128((__m128i *)found, index);
+
+		for (int k = 0; k < 4; k++)
+			indices |= (unsigned int)found[k] << ((i * 4 + k) * 2);
+	}
+#else
+	for (int i = 0; i < 16; i++)
+	{
+		const unsigned char *px = pixels + i * 4;
+		int best = 0x7FFFFFFF;
+
+		for (int j = 0; j < 4; j++)
+		{
+			int dr = px[0] - palette[j][0];
+			int dg = px[1] - palette[j][1];
+			int db = px[2] - palette[j][2];
+			int dist = dr * dr + dg * dg + db * db;
+
+			if (dist < best)
+			{
+				best = dist;
+				indices = (indices & ~(3u << (i * 2))) | ((unsigned int)j << (i * 2));
+			}
+		}
+	}
+#endif
+
+	return indices;
+}
+
+// Writes the 8 byte color part of a block
+static void EncodeColor(const unsigned char *pixels, unsigned char *out)
+{
+	int lo[3] = { 255, 255, 255 };
+	int hi[3] = { 0, 0, 0 };
+	int i, c;
+
+	// The bounding box of the colors
+#ifdef SIMD_SSE2
+	__m128i mn = _mm_loadu_si128((const __m128i *)pixels);
+	__m128i mx = mn;
+
+	for (i = 1; i < 4; i++)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i *)(pixels + i * 16));
+		mn = _mm_min_epu8(mn, px);
+		mx = _mm_max_epu8(mx, px);
+	}
+
+	// Fold the 4 pixels of each register into one
+	mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+	mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+	mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+	mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+
+	unsigned int packedMin = (unsigned int)_mm_cvtsi128_si32(mn);
+	unsigned int packedMax = (unsigned int)_mm_cvtsi128_si32(mx);
+
+	for (c = 0; c < 3; c++)
+	{
+		lo[c] = (packedMin >> (c * 8)) & 255;
+		hi[c] = (packedMax >> (c * 8)) & 255;
+	}
+#else
+	for (i = 0; i < 16; i++)
+	{
+		for (c = 0; c < 3; c++)
+		{
+			lo[c] = Min(lo[c], pixels[i * 4 + c]);
+			hi[c] = Max(hi[c], pixels[i * 4 + c]);
+		}
+	}
+#endif
+
+	// Pull the ends in a little, they are rarely the best end points
+	for (c = 0; c < 3; c++)
+	{
+		int inset = (hi[c] - lo[c]) >> 4;
+		lo[c] += inset;
+		hi[c] -= inset;
+	}
+
+	// The box has 4 diagonals, use the one the colors lie along
+	int center[3] = { (lo[0] + hi[0]) / 2, (lo[1] + hi[1]) / 2, (lo[2] + hi[2]) / 2 };
+	int covRG = 0;
+	int covBG = 0;
+
+	for (i = 0; i < 16; i++)
+	{
+		int g = pixels[i * 4 + 1] - center[1];
+		covRG += (pixels[i * 4] - center[0]) * g;
+		covBG += (pixels[i * 4 + 2] - center[2]) * g;
+	}
+
+	if (covRG < 0)
+	{
+		int t = lo[0];
+		lo[0] = hi[0];
+		hi[0] = t;
+	}
+
+	if (covBG < 0)
+	{
+		int t = lo[2];
+		lo[2] = hi[2];
+		hi[2] = t;
+	}
+
+	unsigned short c0 = Pack565(hi);
+	unsigned short c1 = Pack565(lo);
+
+	// c0 > c1 selects the 4 color mode
+	if (c0 < c1)
+	{
+		unsigned short t = c0;
+		c0 = c1;
+		c1 = t;
+	}
+
+	out[0] = (unsigned char)c0;
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)c1;
+	out[3] = (unsigned char)(c1 >> 8);
+
+	// One color, every pixel uses it
+	if (c0 == c1)
+	{
+		memset(out + 4, 0, 4);
+		return;
+	}
+
+	int palette[4][3];
+
+	Unpack565(c0, palette[0]);
+	Unpack565(c1, palette[1]);
+
+	for (c = 0; c < 3; c++)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	unsigned int indices = FindIndices(pixels, palette);
+
+	out[4] = (unsigned char)indices;
+	out[5] = (unsigned char)(indices >> 8);
+	out[6] = (unsigned char)(indices >> 16);
+	out[7] = (unsigned char)(indices >> 24);
+}
+
+// Writes the 8 byte alpha part of a BC3 block
+static void EncodeAlpha(const unsigned char *pixels, unsigned char *out)
+{
+	int lo = 255;
+	int hi = 0;
+	int i;
+
+	for (i = 0; i < 16; i++)
+	{
+		lo = Min(lo, pixels[i * 4 + 3]);
+		hi = Max(hi, pixels[i * 4 + 3]);
+	}
+
+	// a0 > a1 selects the 8 value mode, which has no fixed 0 and 255
+	out[0] = (unsigned char)hi;
+	out[1] = (unsigned char)lo;
+	memset(out + 2, 0, 6);
+
+	if (hi == lo)
+		return;
+
+	int range = hi - lo;
+	unsigned long long bits = 0;
+
+	for (i = 0; i < 16; i++)
+	{
+		// Where the pixel lies between lo (0) and hi (7)
+		int t = ((pixels[i * 4 + 3] - lo) * 7 + range / 2) / range;
+
+		// Index 0 is hi, 1 is lo and 2..7 go from hi towards lo
+		int index = t == 7 ? 0 : (t == 0 ? 1 : 8 - t);
+
+		bits |= (unsigned long long)index << (i * 3);
+	}
+
+	for (i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(bits >> (i * 8));
+}
+
+// Compresses the rows of blocks from first up to last
+static void CompressRows(const unsigned char *rgba, int width, int height, bool alpha, unsigned char *out, int first, int last)
+{
+	int blocksWide = (width + 3) / 4;
+	int blockBytes = alpha ? 16 : 8;
+	unsigned char block[64];
+
+	for (int by = first; by < last; by++)
+	{
+		for (int bx = 0; bx < blocksWide; bx++)
+		{
+			// Gather the 4x4 pixels, blocks hanging over the edge repeat it
+			for (int y = 0; y < 4; y++)
+			{
+				const unsigned char *row = rgba + (long)Min(by * 4 + y, height - 1) * width * 4;
+
+				for (int x = 0; x < 4; x++)
+					memcpy(block + (y * 4 + x) * 4, row + Min(bx * 4 + x, width - 1) * 4, 4);
+			}
+
+			unsigned char *dest = out + ((long)by * blocksWide + bx) * blockBytes;
+
+			if (alpha)
+			{
+				EncodeAlpha(block, dest);
+				dest += 8;
+			}
+
+			EncodeColor(block, dest);
+		}
+	}
+}
+
+void TextureCompressor::CompressLevel(const unsigned char *rgba, int width, int height, bool alpha, unsigned char *out)
+{
+	int rows = (height + 3) / 4;
+	int workers = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+
+	workers = Max(Min(workers, rows / ROWS_PER_THREAD), 1);
+
+	if (workers == 1)
+	{
+		CompressRows(rgba, width, height, alpha, out, 0, rows);
+		return;
+	}
+
+	// Every thread gets a band of rows
+	std::vector<std::thread> pool;
+
+	for (int i = 0; i < workers; i++)
+		pool.push_back(std::thread(CompressRows, rgba, width, height, alpha, out, rows * i / workers, rows * (i + 1) / workers));
+
+	for (size_t i = 0; i < pool.size(); i++)
+		pool[i].join();
+}
+
+bool TextureCompressor::Compress(Image &image, KTXFile &ktx)
+{
+	KTXFile mipmaps;
+
+	// Every level as RGBA, the blocks are read straight out of them
+	if (!MipmapGenerator::Generate(image, mipmaps, 4))
+		return false;
+
+	bool alpha = HasAlpha(mipmaps.data[0], image.width * image.height);
+
+	unsigned char *out = ktx.Create(alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+		alpha ? GL_RGBA : GL_RGB, image.width, image.height, mipmaps.levels);
+
+	if (out == NULL)
+		return false;
+
+	for (int i = 0; i < ktx.levels; i++)
+	{
+		CompressLevel(mipmaps.data[i], ktx.LevelWidth(i), ktx.LevelHeight(i), alpha, out);
+		out += ktx.size[i];
+	}
+
+	return true;
+}
+
+std::string TextureCompressor::CacheName(const char *source)
+{
+	return std::string(source) + ".ktx";
+}
+
+bool TextureCompressor::UpToDate(const char *source)
+{
+	struct stat original, cached;
+
+	if (stat(source, &original) != 0 || stat(CacheName(source).c_str(), &cached) != 0)
+		return false;
+
+	return cached.st_mtime >= original.st_mtime;
+}
+
+bool TextureCompressor::Bake(const char *source, KTXFile &ktx)
+{
+	Image image;
+
+	if (!image.Load(source) || !Compress(image, ktx))
+		return false;
+
+	// Even if the folder is read only the texture can still be used
+	ktx.Save(CacheName(source).c_str());
+
+	return true;
+}
+
+// True for the files Image can read
+static bool IsImage(const char *name)
+{
+	static const char *extensions[] = { ".bmp", ".tga", ".png", ".jpg", ".jpeg" };
+
+	const char *dot = strrchr(name, '.');
+
+	if (dot == NULL)
+		return false;
+
+	for (int i = 0; i < 5; i++)
+	{
+		const char *a = dot;
+		const char *b = extensions[i];
+
+		while (*a && tolower((unsigned char)*a) == *b)
+		{
+			a++;
+			b++;
+		}
+
+		if (*a == 0 && *b == 0)
+			return true;
+	}
+
+	return false;
+}
+
+// Lists the files in a folder and its subfolders
+static void ListFiles(const std::string &dir, std::vector<std::string> &files)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA((dir + "/*").c_str(), &found);
+
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		std::string name = found.cFileName;
+
+		if (name == "." || name == "..")
+			continue;
+
+		if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			ListFiles(dir + "/" + name, files);
+		else
+			files.push_back(dir + "/" + name);
+	} while (FindNextFileA(find, &found));
+
+	FindClose(find);
+#else
+	DIR *d = opendir(dir.c_str());
+
+	if (d == NULL)
+		return;
+
+	struct dirent *entry;
+
+	while ((entry = readdir(d)) != NULL)
+	{
+		std::string name = entry->d_name;
+
+		if (name == "." || name == "..")
+			continue;
+
+		std::string path = dir + "/" + name;
+		struct stat st;
+
+		if (stat(path.c_str(), &st) != 0)
+			continue;
+
+		if (S_ISDIR(st.st_mode))
+			ListFiles(path, files);
+		else
+			files.push_back(path);
+	}
+
+	closedir(d);
+#endif
+}
+
+int TextureCompressor::BakeFolder(const char *dir)
+{
+	std::vector<std::string> files;
+	ListFiles(dir, files);
+
+	int baked = 0;
+	double before = 0.0;
+	double after = 0.0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		const char *name = files[i].c_str();
+
+		if (!IsImage(name) || UpToDate(name))
+			continue;
+
+		KTXFile ktx;
+
+		if (!Bake(name, ktx))
+		{
+			printf("  %-50s could not be read\n", name);
+			continue;
+		}
+
+		// What the texture would take uncompressed with its mipmaps
+		double plain = ktx.width * ktx.height * (ktx.baseFormat == GL_RGBA ? 4.0 : 3.0) * 4.0 / 3.0;
+
+		printf("  %-50s %4dx%-4d %s %8.1f KB -> %7.1f KB\n", name, ktx.width, ktx.height,
+			ktx.baseFormat == GL_RGBA ? "BC3" : "BC1", plain / 1024.0, ktx.Bytes() / 1024.0);
+
+		before += plain;
+		after += ktx.Bytes();
+		baked++;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("Baked %d texture(s) in %s in %.2f s, %.1f MB -> %.1f MB\n", baked, dir, seconds,
+		before / (1024.0 * 1024.0), after / (1024.0 * 1024.0));
+
+	return baked;
+}
@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Compressor Class
+//
+// TextureCompressor.h: interface for the TextureCompressor class.
+// This class turns images into BC1 (DXT1) or BC3 (DXT5)
+// textures with all of their mipmaps and keeps them in KTX
+// files next to the originals ("bark.png" -> "bark.png.ktx").
+// A compressed texture takes 1/6 (BC1) or 1/4 (BC3) of the
+// video memory and upload bandwidth of a plain RGB(A) one.
+// Opaque images become BC1, images with alpha become BC3.
+// The blocks are spread over all CPU cores and the search
+// for the best palette entry of each pixel uses SSE2.
+//
+// Textures can be baked ahead of time with
+//		OpenGLMeshLoader.exe -bake
+// or on demand the first time GLTexture loads them. A KTX
+// file is remade whenever its original is newer.
+//
+// Usage:
+// KTXFile ktx;
+//
+// if (TextureCompressor::UpToDate("bark.png"))
+//		ktx.Load(TextureCompressor::CacheName("bark.png").c_str());
+// else
+//		TextureCompressor::Bake("bark.png", ktx);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTURECOMPRESSOR_H
+#define TEXTURECOMPRESSOR_H
+
+#include "Image.h"
+#include "KTXFile.h"
+
+#include <string>
+
+class TextureCompressor
+{
+public:
+	static bool onDemand;							// Compress textures that have no KTX file when they are loaded
+	static int threads;								// Worker threads, 0 for one per core
+
+	static bool Compress(Image &image, KTXFile &ktx);		// Builds the mipmaps and compresses all of them
+	static bool Bake(const char *source, KTXFile &ktx);	// Compresses a file and saves the KTX next to it
+	static int BakeFolder(const char *dir);		// Bakes every image in a folder and its subfolders
+	static bool UpToDate(const char *source);		// True if the KTX file is newer than the original
+	static std::string CacheName(const char *source);	// The KTX file of an original
+
+	// Compresses one mipmap level, rgba is width * height * 4 bytes
+	static void CompressLevel(const unsigned char *rgba, int width, int height, bool alpha, unsigned char *out);
+};
+
+#endif TEXTURECOMPRESSOR_H
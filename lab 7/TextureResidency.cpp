@@ -0,0 +1,350 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Residency
+//
+// TextureResidency.cpp: implementation of the TextureResidency class.
+// Each texture keeps a record of the file it came from, the
+// size of its biggest level in memory and the frame it was
+// last drawn in. The texture keeps the file's level numbers:
+// an eviction moves GL_TEXTURE_BASE_LEVEL up one and gives the
+// memory of the level below it back, the file isn't read. An
+// upgrade decodes the file again but only sends the levels the
+// texture is missing, and the base level comes down once they
+// are in. Until then the record already counts the memory they
+// will use, so one slow upgrade doesn't make Update() evict
+// twice for it.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "TextureResidency.h"
+#include "TextureStreamer.h"
+#include "TextureCache.h"
+#include "GLTexture.h"
+#include "KTXFile.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <map>
+#include <string>
+
+int TextureResidency::budget = 32 * 1024 * 1024;
+int TextureResidency::startSize = 256;
+int TextureResidency::minSize = 64;
+float TextureResidency::detail = 1.0f;
+
+// What we know about one texture
+struct Resident
+{
+	std::string name;								// The file, to load other levels from
+	GLTexture proxy;								// Hands the texture to the streamer and its new size to the TextureCache
+	int fullSize;									// Biggest side of the file
+	int size;										// Biggest side of the levels in memory (or on their way)
+	int bytes;										// Memory those levels use
+	int want;										// Biggest side the last frame's models asked for
+	int lastUsed;									// Frame it was last drawn in
+	bool pending;									// Levels are on their way
+};
+
+static std::map<unsigned int, Resident *> residents;
+static int frame = 0;
+static int evictions = 0;
+static int upgrades = 0;
+
+static int Max(int a, int b) { return a > b ? a : b; }
+
+// The biggest side of the smallest level that still has want texels
+static int SizeFor(Resident *r, int want)
+{
+	int size = r->fullSize;
+
+	while (size / 2 >= want && size / 2 >= TextureResidency::minSize)
+		size /= 2;
+
+	return size;
+}
+
+// About the memory the levels up to size would use, from what the levels up to r->size use
+static int BytesFor(Resident *r, int size)
+{
+	double scale = (double)size / r->size;
+	return (int)(r->bytes * scale * scale);
+}
+
+// Loads the levels between the texture's biggest one and size, returns
+// false if that was done right away instead of streamed
+static bool Upgrade(Resident *r, int size)
+{
+	int have = r->size;
+
+	r->pending = true;
+	r->bytes = BytesFor(r, size);
+	r->size = size;
+
+	if (TextureStreamer::Queue(&r->proxy, r->name.c_str(), size, have))
+		return true;
+
+	KTXFile ktx;
+
+	if (GLTexture::Decode(r->name.c_str(), ktx))
+	{
+		int first = ktx.LevelFor(size);
+		int last = ktx.LevelFor(have) - 1;
+		int bytes = 0;
+
+		glBindTexture(GL_TEXTURE_2D, r->proxy.texture[0]);
+
+		// Below the base level until they are all in, then draw with them
+		for (int i = last; i >= first; i--)
+		{
+			if (ktx.Compressed())
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, ktx.format, ktx.LevelWidth(i), ktx.LevelHeight(i), 0, ktx.size[i], ktx.data[i]);
+			else
+				glTexImage2D(GL_TEXTURE_2D, i, ktx.format, ktx.LevelWidth(i), ktx.LevelHeight(i), 0, ktx.baseFormat, ktx.type, ktx.data[i]);
+		}
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, first);
+
+		for (int i = first; i < ktx.levels; i++)
+			bytes += ktx.size[i];
+
+		r->proxy.width = ktx.LevelWidth(first);
+		r->proxy.height = ktx.LevelHeight(first);
+		r->proxy.bytes = bytes;
+
+		TextureCache::Update(&r->proxy);
+		TextureResidency::Loaded(r->proxy.texture[0], r->name.c_str(), Max(ktx.width, ktx.height),
+			Max(r->proxy.width, r->proxy.height), bytes);
+	}
+	else
+		r->pending = false;
+
+	return false;
+}
+
+// Drops the texture's biggest level, the others stay as they are
+static void Evict(Resident *r)
+{
+	GLint base = 0, width = 0, height = 0;
+
+	glBindTexture(GL_TEXTURE_2D, r->proxy.texture[0]);
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &base);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base + 1);
+
+	// Nothing samples it anymore, give its memory back
+	glTexImage2D(GL_TEXTURE_2D, base, GL_RGB8, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, base + 1, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, base + 1, GL_TEXTURE_HEIGHT, &height);
+
+	r->bytes = BytesFor(r, r->size / 2);
+	r->size /= 2;
+
+	r->proxy.width = width;
+	r->proxy.height = height;
+	r->proxy.bytes = r->bytes;
+
+	TextureCache::Update(&r->proxy);
+}
+
+// The texture drawn longest ago that has a level to spare, NULL if there is none
+static Resident *Victim()
+{
+	Resident *victim = NULL;
+
+	for (std::map<unsigned int, Resident *>::iterator it = residents.begin(); it != residents.end(); ++it)
+	{
+		Resident *r = it->second;
+
+		if (r->pending || r->size / 2 < TextureResidency::minSize)
+			continue;
+
+		// What is on screen keeps the levels it needs
+		if (r->lastUsed == frame && r->size / 2 < SizeFor(r, r->want))
+			continue;
+
+		if (victim == NULL || r->lastUsed < victim->lastUsed || (r->lastUsed == victim->lastUsed && r->bytes > victim->bytes))
+			victim = r;
+	}
+
+	return victim;
+}
+
+void TextureResidency::Loaded(unsigned int texture, const char *name, int fullSize, int size, int bytes)
+{
+	Resident *&r = residents[texture];
+
+	if (r == NULL)
+	{
+		r = new Resident;
+		r->proxy.texture[0] = texture;
+		r->want = 0;
+		r->lastUsed = frame;
+	}
+
+	r->name = name;
+	r->fullSize = fullSize;
+	r->size = size;
+	r->bytes = bytes;
+	r->pending = false;
+}
+
+void TextureResidency::Forget(unsigned int texture)
+{
+	std::map<unsigned int, Resident *>::iterator it = residents.find(texture);
+
+	if (it == residents.end())
+		return;
+
+	delete it->second;
+	residents.erase(it);
+}
+
+float TextureResidency::Footprint(float x, float y, float z, float radius)
+{
+	float modelview[16];
+
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+
+	return Footprint(modelview, x, y, z, radius);
+}
+
+float TextureResidency::Footprint(const float *modelview, float x, float y, float z, float radius)
+{
+	float projection[16];
+	int viewport[4];
+
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// The center in eye space, and how much the model was scaled
+	float ex = modelview[0] * x + modelview[4] * y + modelview[8] * z + modelview[12];
+	float ey = modelview[1] * x + modelview[5] * y + modelview[9] * z + modelview[13];
+	float ez = modelview[2] * x + modelview[6] * y + modelview[10] * z + modelview[14];
+	float scale = sqrtf(modelview[0] * modelview[0] + modelview[1] * modelview[1] + modelview[2] * modelview[2]);
+
+	radius *= scale;
+
+	// Standing inside it, it covers the whole screen
+	if (ex * ex + ey * ey + ez * ez <= radius * radius)
+		return (float)viewport[3];
+
+	float w = projection[3] * ex + projection[7] * ey + projection[11] * ez + projection[15];
+
+	// Behind us, the smallest levels will do until we turn around
+	if (w <= 0.0f)
+		return 1.0f;
+
+	return radius * projection[5] * viewport[3] / w;
+}
+
+void TextureResidency::Touch(unsigned int texture, float pixels)
+{
+	std::map<unsigned int, Resident *>::iterator it = residents.find(texture);
+
+	if (it == residents.end())
+		return;
+
+	Resident *r = it->second;
+	int want = (pixels < 0.0f) ? r->fullSize : (int)(pixels * detail);
+
+	r->want = Max(r->want, want);
+	r->lastUsed = frame;
+}
+
+void TextureResidency::Update()
+{
+	int total = 0;
+	int needed = 0;
+
+	for (std::map<unsigned int, Resident *>::iterator it = residents.begin(); it != residents.end(); ++it)
+	{
+		Resident *r = it->second;
+		total += r->bytes;
+
+		// What the textures drawn last frame are missing
+		if (!r->pending && r->lastUsed == frame && SizeFor(r, r->want) > r->size)
+			needed += BytesFor(r, SizeFor(r, r->want)) - r->bytes;
+	}
+
+	// Without the streamer every upgrade stalls the frame, so only one per frame
+	bool stalled = false;
+
+	// Make room by dropping a level at a time, from what was drawn longest ago
+	while (budget > 0 && total + needed > budget)
+	{
+		Resident *r = Victim();
+
+		if (r == NULL)
+			break;
+
+		total -= r->bytes;
+		Evict(r);
+		total += r->bytes;
+
+		evictions++;
+	}
+
+	// Then load the levels that fit
+	for (std::map<unsigned int, Resident *>::iterator it = residents.begin(); it != residents.end() && !stalled; ++it)
+	{
+		Resident *r = it->second;
+
+		if (r->pending || r->lastUsed != frame)
+			continue;
+
+		int size = SizeFor(r, r->want);
+
+		if (size <= r->size)
+			continue;
+
+		int extra = BytesFor(r, size) - r->bytes;
+
+		if (budget > 0 && total + extra > budget)
+			continue;
+
+		total += extra;
+		stalled = !Upgrade(r, size);
+
+		upgrades++;
+	}
+
+	// The frame about to be drawn asks again
+	for (std::map<unsigned int, Resident *>::iterator it = residents.begin(); it != residents.end(); ++it)
+		it->second->want = 0;
+
+	frame++;
+}
+
+TextureResidency::Stats TextureResidency::GetStats()
+{
+	Stats stats;
+
+	stats.textures = (int)residents.size();
+	stats.bytes = 0;
+	stats.fullBytes = 0;
+	stats.evictions = evictions;
+	stats.upgrades = upgrades;
+	stats.pending = 0;
+
+	for (std::map<unsigned int, Resident *>::iterator it = residents.begin(); it != residents.end(); ++it)
+	{
+		Resident *r = it->second;
+
+		stats.bytes += r->bytes;
+		stats.fullBytes += BytesFor(r, r->fullSize);
+
+		if (r->pending)
+			stats.pending++;
+	}
+
+	return stats;
+}
+
+void TextureResidency::PrintStats()
+{
+	Stats stats = GetStats();
+
+	printf("Texture residency: %d textures in %.1f MB of %.1f MB (%.1f MB at full size), %d levels evicted, %d loaded, %d pending\n",
+		stats.textures, stats.bytes / 1048576.0, budget / 1048576.0, stats.fullBytes / 1048576.0,
+		stats.evictions, stats.upgrades, stats.pending);
+}
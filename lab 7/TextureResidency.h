@@ -0,0 +1,78 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Residency
+//
+// TextureResidency.h: interface for the TextureResidency class.
+// Every texture used to stay in video memory at full size for
+// as long as the game ran, even the ones on models far away
+// or behind us. This class keeps the textures loaded from files
+// under a memory budget. Models report how big they are on
+// screen when they are drawn, and each frame Update() compares
+// that with what their textures hold:
+// - A texture that is drawn bigger than its biggest level gets
+//   its next levels loaded, if they fit in the budget.
+// - Over the budget, the textures drawn longest ago lose their
+//   biggest level, one level at a time. Textures that are on
+//   screen only lose levels they don't need.
+// A lost level only frees its memory, the texture keeps the
+// smaller ones and the file isn't read. The levels a texture
+// gets back are loaded from the file again, only those it is
+// missing, through the TextureStreamer when it runs. Without it
+// they load right away, one texture per frame.
+//
+// With the streamer a texture is first loaded only up to
+// startSize, the rest comes in once a model shows it bigger.
+//
+// Usage:
+// TextureResidency::budget = 64 * 1024 * 1024;	// 64 MB
+//
+// // Once per frame, before drawing
+// TextureResidency::Update();
+//
+// // When drawing, say how many pixels across the texture will be
+// TextureResidency::Touch(tex.texture[0], TextureResidency::Footprint(x, y, z, radius));
+// TextureResidency::Touch(tex_ground.texture[0]);	// Don't know, keep it sharp
+//
+// TextureResidency::PrintStats();		// Memory used and levels evicted
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTURERESIDENCY_H
+#define TEXTURERESIDENCY_H
+
+class TextureResidency
+{
+public:
+	struct Stats
+	{
+		int textures;								// Textures loaded from files
+		int bytes;									// Memory their levels use now
+		int fullBytes;								// Memory they would use with every level
+		int evictions;								// Levels dropped to stay in the budget
+		int upgrades;								// Levels loaded because a texture got bigger on screen
+		int pending;								// Textures waiting for their levels
+	};
+
+	static int budget;								// Bytes the textures may use, 0 for no limit
+	static int startSize;							// Streamed textures load up to this size first, 0 for all of it
+	static int minSize;								// Textures never drop below this size
+	static float detail;							// Texels wanted per pixel a model covers on screen
+
+	// GLTexture and TextureStreamer tell what the texture holds now: its biggest level is size on
+	// its biggest side, bytes all of its levels, and fullSize is the biggest side of the file
+	static void Loaded(unsigned int texture, const char *name, int fullSize, int size, int bytes);
+	// The texture is being deleted
+	static void Forget(unsigned int texture);
+	// Pixels across a sphere around (x, y, z) covers with the current matrices and viewport
+	static float Footprint(float x, float y, float z, float radius);
+	// The same with modelview in place of the current modelview matrix
+	static float Footprint(const float *modelview, float x, float y, float z, float radius);
+	// The texture is drawn this frame about this many pixels across, negative if nobody knows
+	static void Touch(unsigned int texture, float pixels = -1.0f);
+	// Loads and evicts levels for the frame that was just drawn
+	static void Update();
+	static Stats GetStats();
+	static void PrintStats();
+};
+
+#endif TEXTURERESIDENCY_H
@@ -0,0 +1,551 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Streamer Class
+//
+// TextureStreamer.cpp: implementation of the TextureStreamer class.
+// A texture goes through three hands. A worker decodes the
+// file into a KTXFile (compressed or with its mipmaps, the
+// way GLTexture would upload it). Workers then copy it, a
+// slot at a time, into the mapped pixel buffers of the ring,
+// smallest level first. Update() unmaps the filled slots in
+// the order they were handed out, points glTexSubImage2D at
+// them and gives them fresh memory to be filled again. The
+// buffers are orphaned with glBufferData before they are
+// mapped so the driver never makes us wait for a transfer.
+//
+// The texture keeps the numbering of the file's levels. Each
+// level is made in OpenGL when its first rows arrive, while it
+// is still below GL_TEXTURE_BASE_LEVEL where nothing samples
+// it, so a texture that gets its bigger levels later keeps
+// drawing with the ones it has until they are in.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "TextureStreamer.h"
+#include "TextureCache.h"
+#include "TextureResidency.h"
+#include "GLTexture.h"
+#include "KTXFile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+int TextureStreamer::budget = 2 * 1024 * 1024;
+int TextureStreamer::threads = 0;
+
+// Twice the slots one frame's budget uses, so the workers can fill the
+// next frame's while this frame's are being sent
+#define RING_SLOTS	8
+#define SLOT_BYTES	(512 * 1024)
+
+static int Min(int a, int b) { return a < b ? a : b; }
+static int Max(int a, int b) { return a > b ? a : b; }
+
+enum JobState
+{
+	QUEUED,											// Waiting for a worker
+	DECODING,										// A worker is reading the file
+	READY,											// Decoded, being copied and sent
+	FAILED											// The file couldn't be decoded
+};
+
+// One texture on its way
+struct StreamJob
+{
+	GLTexture *tex;									// Who asked for it
+	unsigned int texture;							// The OpenGL texture it goes into
+	std::string name;								// The file
+	int maxSize;									// Levels bigger than this on a side are left out, 0 for none
+	int haveSize;									// The texture already has the levels up to this size, 0 for none
+	int fullSize;									// Biggest side of the file
+	int first;										// The biggest level it brings, the last one sent
+	KTXFile ktx;									// The decoded levels
+	JobState state;
+	bool cancelled;									// The texture was deleted or reloaded meanwhile
+	bool started;									// Something of it has been sent
+	bool finished;									// Its biggest level is in
+	int level;										// The next rows to copy, -1 when all are copied
+	int row;
+	int slots;										// Slots holding rows of this job
+};
+
+// One pixel buffer of the ring
+struct Slot
+{
+	unsigned int buffer;							// The pixel buffer object
+	unsigned char *mapped;							// Where the workers write, NULL while OpenGL has it
+	StreamJob *job;									// Whose rows it holds, NULL if it is free
+	int level;										// Which rows those are
+	int row;
+	int rows;
+	int bytes;
+	bool filled;									// The rows have been copied in
+};
+
+static std::mutex lock;
+static std::condition_variable wake;
+static std::vector<std::thread> workers;
+static bool running = false;
+
+static Slot ring[RING_SLOTS];
+static std::list<StreamJob *> jobs;					// Every job in the order it was queued
+static std::deque<Slot *> assigned;					// Slots given to a worker, in the order they have to be sent
+
+// Bytes from one row of blocks (or pixels) of a level to the next, and the rows in it
+static int RowStep(KTXFile &ktx, int level)
+{
+	if (ktx.Compressed())
+		return (ktx.LevelWidth(level) + 3) / 4 * KTXFile::BlockBytes(ktx.format);
+
+	return ktx.RowBytes(level);
+}
+
+static int RowsPerStep(KTXFile &ktx)
+{
+	return ktx.Compressed() ? 4 : 1;
+}
+
+// Where a row starts within its level
+static int RowOffset(KTXFile &ktx, int level, int row)
+{
+	int rows = RowsPerStep(ktx);
+	return (row + rows - 1) / rows * RowStep(ktx, level);
+}
+
+// The first decoded texture that still has rows to copy
+static StreamJob *NextToCopy()
+{
+	for (std::list<StreamJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+	{
+		StreamJob *job = *it;
+
+		if (job->state == READY && !job->cancelled && job->level >= 0)
+			return job;
+	}
+
+	return NULL;
+}
+
+static StreamJob *NextToDecode()
+{
+	for (std::list<StreamJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+	{
+		StreamJob *job = *it;
+
+		if (job->state == QUEUED && !job->cancelled)
+			return job;
+	}
+
+	return NULL;
+}
+
+static Slot *FreeSlot()
+{
+	for (int i = 0; i < RING_SLOTS; i++)
+	{
+		if (ring[i].job == NULL && ring[i].mapped != NULL)
+			return &ring[i];
+	}
+
+	return NULL;
+}
+
+static void Work()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (running)
+	{
+		// Copying comes first, the frame is waiting for it
+		StreamJob *job = NextToCopy();
+		Slot *slot = job != NULL ? FreeSlot() : NULL;
+
+		if (slot != NULL)
+		{
+			KTXFile &ktx = job->ktx;
+			int height = ktx.LevelHeight(job->level);
+			int rows = Max(SLOT_BYTES / RowStep(ktx, job->level), 1) * RowsPerStep(ktx);
+
+			slot->job = job;
+			slot->level = job->level;
+			slot->row = job->row;
+			slot->rows = Min(rows, height - job->row);
+			slot->bytes = RowOffset(ktx, slot->level, slot->row + slot->rows) - RowOffset(ktx, slot->level, slot->row);
+			slot->filled = false;
+
+			job->slots++;
+			assigned.push_back(slot);
+
+			// Move on to the next rows, or the next bigger level
+			job->row += slot->rows;
+
+			if (job->row >= height)
+			{
+				job->level = job->level > job->first ? job->level - 1 : -1;
+				job->row = 0;
+			}
+
+			const unsigned char *src = ktx.data[slot->level] + RowOffset(ktx, slot->level, slot->row);
+			unsigned char *dest = slot->mapped;
+			int bytes = slot->bytes;
+
+			// The slot is ours, nobody touches it until it is marked filled
+			guard.unlock();
+			memcpy(dest, src, bytes);
+			guard.lock();
+
+			slot->filled = true;
+			continue;
+		}
+
+		job = NextToDecode();
+
+		if (job != NULL)
+		{
+			job->state = DECODING;
+			std::string name = job->name;
+
+			// Nobody else looks at the KTXFile while it is being decoded
+			guard.unlock();
+			bool decoded = GLTexture::Decode(name.c_str(), job->ktx);
+
+			// The levels it brings, from the smallest the texture doesn't have yet
+			int last = -1;
+
+			if (decoded)
+			{
+				KTXFile &ktx = job->ktx;
+
+				job->fullSize = Max(ktx.width, ktx.height);
+				job->first = ktx.LevelFor(job->maxSize);
+				last = job->haveSize > 0 ? ktx.LevelFor(job->haveSize) - 1 : ktx.levels - 1;
+			}
+
+			guard.lock();
+
+			job->state = decoded ? READY : FAILED;
+			job->level = decoded && last >= job->first ? last : -1;
+			job->row = 0;
+
+			// The other workers can help copy it
+			wake.notify_all();
+			continue;
+		}
+
+		wake.wait(guard);
+	}
+}
+
+// Tells the texture's users and the residency what the texture holds now
+static void Finish(StreamJob *job)
+{
+	KTXFile &ktx = job->ktx;
+	int bytes = 0;
+
+	for (int i = job->first; i < ktx.levels; i++)
+		bytes += ktx.size[i];
+
+	job->tex->width = ktx.LevelWidth(job->first);
+	job->tex->height = ktx.LevelHeight(job->first);
+	job->tex->bytes = bytes;
+
+	TextureCache::Update(job->tex);
+	TextureResidency::Loaded(job->texture, job->name.c_str(), job->fullSize,
+		Max(job->tex->width, job->tex->height), bytes);
+
+	job->finished = true;
+}
+
+// Sends the rows in a slot to their texture, returns true if that finished it
+static bool Send(Slot *slot)
+{
+	StreamJob *job = slot->job;
+	KTXFile &ktx = job->ktx;
+
+	glBindTexture(GL_TEXTURE_2D, job->texture);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// A texture loaded from scratch (or reloaded) starts from its smallest level
+	if (!job->started && job->haveSize == 0)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ktx.levels - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, ktx.levels - 1);
+
+		// Levels of the white placeholder or of the old file it won't fill give their memory back
+		for (int i = 0; i < job->first; i++)
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGB8, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	}
+
+	job->started = true;
+
+	// Make the level as its first rows come, it is below the base level until it is full
+	if (slot->row == 0)
+	{
+		int i = slot->level;
+
+		if (ktx.Compressed())
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, ktx.format, ktx.LevelWidth(i), ktx.LevelHeight(i), 0, ktx.size[i], NULL);
+		else
+			glTexImage2D(GL_TEXTURE_2D, i, ktx.format, ktx.LevelWidth(i), ktx.LevelHeight(i), 0, ktx.baseFormat, ktx.type, NULL);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+
+	// With a pixel buffer bound the pointer is an offset into it
+	if (ktx.Compressed())
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, slot->level, 0, slot->row, ktx.LevelWidth(slot->level), slot->rows, ktx.format, slot->bytes, NULL);
+	else
+		glTexSubImage2D(GL_TEXTURE_2D, slot->level, 0, slot->row, ktx.LevelWidth(slot->level), slot->rows, ktx.baseFormat, ktx.type, NULL);
+
+	if (slot->row + slot->rows < ktx.LevelHeight(slot->level))
+		return false;
+
+	// The levels from this one down to 1x1 are all there, draw with them.
+	// The 1x1 level is a single slot so a new texture never samples an
+	// empty level.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, slot->level);
+
+	if (slot->level > job->first)
+		return false;
+
+	Finish(job);
+	return true;
+}
+
+// Orphans a free slot's buffer and maps it for the workers
+static void Map(Slot *slot)
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, SLOT_BYTES, NULL, GL_STREAM_DRAW);
+	slot->mapped = (unsigned char *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+}
+
+// Joins the workers, at exit the OpenGL context may be gone already so
+// the buffers are left to it
+static void StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running = false;
+	}
+
+	wake.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	workers.clear();
+
+	for (std::list<StreamJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+		delete *it;
+
+	jobs.clear();
+	assigned.clear();
+}
+
+bool TextureStreamer::Start()
+{
+	if (running)
+		return true;
+
+	// Pixel buffers are core in 2.1, the buffer functions in 1.5
+	if (!GLEW_VERSION_1_5 || !(GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object))
+		return false;
+
+	for (int i = 0; i < RING_SLOTS; i++)
+	{
+		memset(&ring[i], 0, sizeof(ring[i]));
+		glGenBuffers(1, &ring[i].buffer);
+		Map(&ring[i]);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	running = true;
+
+	int count = threads > 0 ? threads : Max((int)std::thread::hardware_concurrency() - 1, 1);
+
+	for (int i = 0; i < count; i++)
+		workers.push_back(std::thread(Work));
+
+	static bool registered = false;
+
+	if (!registered)
+		atexit(StopWorkers);
+
+	registered = true;
+
+	return true;
+}
+
+void TextureStreamer::Stop()
+{
+	if (!running)
+		return;
+
+	StopWorkers();
+
+	for (int i = 0; i < RING_SLOTS; i++)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring[i].buffer);
+
+		if (ring[i].mapped != NULL)
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &ring[i].buffer);
+
+		memset(&ring[i], 0, sizeof(ring[i]));
+	}
+}
+
+bool TextureStreamer::Queue(GLTexture *tex, const char *name, int maxSize, int haveSize)
+{
+	if (!running)
+		return false;
+
+	if (tex->texture[0] == 0)
+	{
+		static const unsigned char white[3] = { 255, 255, 255 };
+
+		glGenTextures(1, &tex->texture[0]);
+		glBindTexture(GL_TEXTURE_2D, tex->texture[0]);
+
+		// The same filters GLTexture uses
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		// White until the first level arrives
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, white);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+
+	// A reload replaces whatever was still on its way
+	Cancel(tex->texture[0]);
+
+	StreamJob *job = new StreamJob;
+
+	job->tex = tex;
+	job->texture = tex->texture[0];
+	job->name = name;
+	job->maxSize = maxSize;
+	job->haveSize = haveSize;
+	job->fullSize = 0;
+	job->first = 0;
+	job->state = QUEUED;
+	job->cancelled = false;
+	job->started = false;
+	job->finished = false;
+	job->level = -1;
+	job->row = 0;
+	job->slots = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(job);
+	}
+
+	wake.notify_all();
+
+	return true;
+}
+
+void TextureStreamer::Cancel(unsigned int texture)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	for (std::list<StreamJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+	{
+		if ((*it)->texture == texture)
+			(*it)->cancelled = true;
+	}
+}
+
+int TextureStreamer::Update()
+{
+	if (!running)
+		return 0;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	int sent = 0;
+	int finished = 0;
+
+	// Send the filled slots in order until this frame's budget is used
+	while (!assigned.empty() && assigned.front()->filled && sent < budget)
+	{
+		Slot *slot = assigned.front();
+		assigned.pop_front();
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		slot->mapped = NULL;
+
+		if (!slot->job->cancelled)
+		{
+			if (Send(slot))
+				finished++;
+
+			sent += slot->bytes;
+		}
+
+		slot->job->slots--;
+		slot->job = NULL;
+		slot->filled = false;
+	}
+
+	// The slots that were sent get fresh memory for the workers
+	bool mapped = false;
+
+	for (int i = 0; i < RING_SLOTS; i++)
+	{
+		if (ring[i].job == NULL && ring[i].mapped == NULL)
+		{
+			Map(&ring[i]);
+			mapped = true;
+		}
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// Forget the jobs that are over
+	for (std::list<StreamJob *>::iterator it = jobs.begin(); it != jobs.end(); )
+	{
+		StreamJob *job = *it;
+		bool over = job->state == FAILED || (job->state == READY && (job->level < 0 || job->cancelled));
+
+		if ((over || (job->cancelled && job->state == QUEUED)) && job->slots == 0)
+		{
+			if (job->state == FAILED && !job->cancelled)
+				printf("Could not stream %s\n", job->name.c_str());
+
+			// The texture already had every level it asked for
+			if (job->state == READY && !job->cancelled && !job->finished)
+				Finish(job);
+
+			delete job;
+			it = jobs.erase(it);
+		}
+		else
+			++it;
+	}
+
+	if (mapped)
+		wake.notify_all();
+
+	return finished;
+}
+
+bool TextureStreamer::Busy()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return !jobs.empty();
+}
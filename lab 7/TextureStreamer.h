@@ -0,0 +1,58 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Streamer Class
+//
+// TextureStreamer.h: interface for the TextureStreamer class.
+// Loading a texture used to decode the file and hand it to
+// glTexImage2D right away, and the frame waited for both.
+// The streamer moves that work out of the frame. Files are
+// decoded on worker threads, which then copy the pixels into
+// a ring of pixel buffer objects through mapped pointers.
+// Once per frame Update() sends the filled buffers to their
+// textures, never more than budget bytes, so a big texture
+// arrives over several frames instead of in one long one.
+// The smallest mipmaps go first and GL_TEXTURE_BASE_LEVEL
+// follows them, so a texture starts out blurry and sharpens
+// without ever showing memory that isn't filled in yet. Bigger
+// levels for a texture that has the small ones are sent the
+// same way, on top of the levels it already has.
+// Until its first level arrives a texture is plain white.
+//
+// Without pixel buffer objects Start() returns false and
+// GLTexture keeps loading everything right away.
+//
+// Usage:
+// glewInit();
+// TextureStreamer::Start();			// After there is a window
+//
+// tex.Load("texture.jpg");				// Returns before the file is decoded
+//
+// // Once per frame, before drawing
+// TextureStreamer::Update();
+// if (TextureStreamer::Busy())
+//		glutPostRedisplay();			// Keep the frames coming until all are in
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+class GLTexture;
+
+class TextureStreamer
+{
+public:
+	static int budget;								// Bytes sent to OpenGL per frame
+	static int threads;								// Decoder threads, 0 for one per core but the one drawing
+
+	static bool Start();							// Makes the buffers and starts the threads, false if the card can't stream
+	static void Stop();								// Waits for the threads and frees the buffers
+	// Streams a file into tex (only the levels up to maxSize if set, and above haveSize if the texture
+	// has those already), false if the streamer isn't running
+	static bool Queue(GLTexture *tex, const char *name, int maxSize = 0, int haveSize = 0);
+	static void Cancel(unsigned int texture);		// Drops the work for a texture that is being deleted or reloaded
+	static int Update();							// Sends up to budget bytes, returns how many textures were finished
+	static bool Busy();								// True while textures are still on their way
+};
+
+#endif TEXTURESTREAMER_H